@@ -25,8 +25,9 @@ typedef struct arp_pkt
 
 void arp_init();
 void arp_print();
-void arp_in(buf_t *buf, uint8_t *src_mac);
-void arp_out(buf_t *buf, uint8_t *ip);
-void arp_req(uint8_t *target_ip);
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac);
+void arp_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_mac);
+void arp_out(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *ip);
+int arp_lookup(uint8_t *ip, uint8_t *mac);
+void arp_req(net_ctx_t *ctx, netif_t *netif, uint8_t *target_ip);
+void arp_resp(net_ctx_t *ctx, netif_t *netif, uint8_t *target_ip, uint8_t *target_mac);
 #endif
\ No newline at end of file
@@ -8,6 +8,8 @@
 #define UDP
 #define TCP
 #define HTTP
+// #define IP_FORWARD //开启后转发目的地址不是本机的IP数据包
+// #define NET_MULTICORE //开启后按流哈希将收到的数据包分发给多个工作线程并行处理
 
 
 #ifdef TEST
@@ -29,8 +31,13 @@
         0x00, 0x11, 0x22, 0x33, 0x44, 0x55 \
     } //自定义网卡mac地址
 #endif 
+#define NET_IF_PREFIX_LEN 24 //默认网卡子网前缀长度
 
+#define NET_IF_MAX 4          //最大网卡数
+#define NET_IF_NAME_LEN 128   //网卡名最大长度
 
+#define NET_WORKER_NUM 4  //开启NET_MULTICORE时的工作线程数
+#define NET_RING_SIZE 256 //每个工作线程接收队列的槽数，须为2的幂
 
 #define ETHERNET_MAX_TRANSPORT_UNIT 1500 //以太网最大传输单元
 
@@ -39,6 +46,35 @@
 
 #define IP_DEFALUT_TTL 64 //IP默认TTL
 
+#define ROUTE_MAX_NUM 16 //路由表最大表项数
+
+#define IP_DST_CACHE_SIZE 64          //目的地缓存槽数，须为2的幂
+#define IP_DST_CACHE_TIMEOUT_SEC 30   //目的地缓存过期时间
+
+#define TCP_CONN_HASH_INIT_SIZE 1024 //每个上下文连接表的初始槽数，须为2的幂
+#define TCP_CONN_MAX 65536           //每个上下文的最大连接数
+#define TCP_TIMEWAIT_MAX 65536       //每个上下文的TIME_WAIT记录数上限，超过后关闭的连接不再进入TIME_WAIT
+#define TCP_TIMEWAIT_MS (60 * 1000)  //TIME_WAIT的持续时间，即2MSL
+#define TCP_BUF_INIT_SIZE 4096         //每个连接收发缓存的初始容量，须为2的幂
+#define TCP_BUF_MAX_SIZE (128 * 1024)  //每个连接收发缓存自动增长的上限，须为2的幂
+#define TCP_RTO_INIT_MS 1000   //还没有RTT样本时的重传超时，毫秒
+#define TCP_RTO_MIN_MS 200     //重传超时下限，毫秒
+#define TCP_RTO_MAX_MS 60000   //重传超时上限，毫秒
+#define TCP_RETRIES_MAX 8      //连续超时重传次数上限，超过后放弃连接
+#define TCP_SYNACK_RETRIES 5   //SYN+ACK的重传次数上限，超过后丢弃半连接
+#define TCP_SYN_BACKLOG 256    //每个上下文的半连接数上限，超过后改用SYN cookie
+#define TCP_SYN_RETRIES 6      //主动打开时SYN的重传次数上限，超过后放弃连接
+#define TCP_PORT_MIN 32768     //临时端口范围的下限，主动打开的连接从中分配本地端口
+#define TCP_PORT_MAX 60999     //临时端口范围的上限
+#define TCP_DELACK_MS 40       //延迟确认的最长等待时间，毫秒
+#define TCP_CC_DEFAULT "cubic" //新连接的拥塞控制算法，可选newreno、cubic
+
+#define UDP_RX_QUEUE_LEN 256 //每个udp套接字在每个上下文中接收队列的长度，须为2的幂，队列满时丢弃新到的数据报
+#define UDP_TX_BATCH 32      //每个上下文发送帧池中的帧数，udp_sendmany每攒满这么多帧交给驱动一次
+
+#define CORO_STACK_SIZE (64 * 1024) //每个协程的栈大小
+#define CORO_POOL_MAX 1024          //协程结束后留作复用的栈数，超过的部分归还系统
+
 #define BUF_MAX_LEN (2 * UINT16_MAX + UINT8_MAX) //buf最大长度
 
 #define MAP_MAX_LEN (16 * BUF_MAX_LEN) //map最大长度
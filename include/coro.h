@@ -0,0 +1,55 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include "net.h"
+#include "sock.h"
+#ifndef _WIN32
+#include <ucontext.h>
+#endif
+
+#define CORO_EVENT_BATCH 64 //调度器每次从等待集取出的就绪句柄数
+
+typedef struct coro coro_t;
+typedef struct coro_sched coro_sched_t;
+typedef void (*coro_fn_t)(coro_t *co, void *arg);
+
+struct coro //协程，有独立的栈，在读写句柄暂时无法进行时让出处理器，由调度器在句柄就绪后恢复
+{
+#ifdef _WIN32
+    void *fiber;        //纤程，栈由系统分配
+#else
+    ucontext_t uctx;    //保存的寄存器与栈指针
+    void *stack;        //栈
+#endif
+    coro_sched_t *sched; //所属的调度器
+    coro_fn_t fn;        //入口函数，运行结束后为NULL
+    void *arg;           //入口函数的参数
+    struct coro *next;   //运行队列或空闲链表中的下一个协程
+};
+
+struct coro_sched //调度器，在一个上下文的线程中轮流运行协程，多核模式下每个工作线程一个
+{
+#ifdef _WIN32
+    void *fiber;        //调度器所在线程转换成的纤程
+#else
+    ucontext_t uctx;    //调度器的寄存器与栈指针
+#endif
+    coro_t *current;             //正在运行的协程
+    coro_t *run_head, *run_tail; //可以运行的协程
+    coro_t *free;                //结束运行、栈留作复用的协程
+    size_t free_num;             //空闲链表中的协程数
+    size_t live;                 //还没结束的协程数
+    sock_poll_t poll;            //等待中的协程关注的句柄
+};
+
+void coro_sched_init(coro_sched_t *sched);
+coro_t *coro_spawn(coro_sched_t *sched, coro_fn_t fn, void *arg);
+size_t coro_sched_run(coro_sched_t *sched);
+void coro_sched_destroy(coro_sched_t *sched);
+void coro_yield(coro_t *co);
+uint32_t coro_wait(coro_t *co, sock_t *sock, uint32_t events);
+sock_t *coro_accept(coro_t *co, sock_t *sock);
+int coro_read(coro_t *co, sock_t *sock, uint8_t *data, size_t len);
+int coro_write(coro_t *co, sock_t *sock, const uint8_t *data, size_t len);
+
+#endif
@@ -2,12 +2,14 @@
 #define DRIVER_H
 
 #include "net.h"
+#include "ethernet.h"
 
 #ifndef PCAP_BUF_SIZE
 #define PCAP_BUF_SIZE 1024
 #endif
-int driver_open();
-int driver_recv(buf_t *buf);
-int driver_send(buf_t *buf);
-void driver_close();
+int driver_open(netif_t *netif);
+int driver_recv(netif_t *netif, buf_t *buf);
+int driver_send(netif_t *netif, buf_t *buf);
+int driver_send_many(netif_t *netif, const ether_frame_t *frames, int num);
+void driver_close(netif_t *netif);
 #endif
\ No newline at end of file
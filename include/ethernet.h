@@ -14,9 +14,17 @@ typedef struct ether_hdr
     uint16_t protocol16;      // 协议/长度
 } ether_hdr_t;
 #pragma pack()
-void ethernet_init();
-void ethernet_in(buf_t *buf);
-void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
-void ethernet_poll();
+
+typedef struct ether_frame //批量发送的一个已封装好的以太网帧
+{
+    uint8_t *data;
+    size_t len;
+} ether_frame_t;
+
+void ethernet_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf);
+void ethernet_out(netif_t *netif, buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
+void ethernet_out_hdr(netif_t *netif, buf_t *buf, const ether_hdr_t *hdr);
+void ethernet_out_many(netif_t *netif, const ether_frame_t *frames, int num);
+void ethernet_poll(net_ctx_t *ctx);
 static const uint8_t ether_broadcast_mac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}; //以太网广播mac地址
 #endif
\ No newline at end of file
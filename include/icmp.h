@@ -19,16 +19,25 @@ typedef enum icmp_type
     ICMP_TYPE_ECHO_REQUEST = 8, // 回显请求
     ICMP_TYPE_ECHO_REPLY = 0,   // 回显响应
     ICMP_TYPE_UNREACH = 3,      // 目的不可达
+    ICMP_TYPE_SOURCE_QUENCH = 4, // 源抑制
+    ICMP_TYPE_REDIRECT = 5,     // 重定向
+    ICMP_TYPE_TIME_EXCEEDED = 11, // 超时
+    ICMP_TYPE_PARAM_PROBLEM = 12, // 参数问题
 } icmp_type_t;
 
 typedef enum icmp_code
 {
     ICMP_CODE_PROTOCOL_UNREACH = 2, // 协议不可达
-    ICMP_CODE_PORT_UNREACH = 3      // 端口不可达
+    ICMP_CODE_PORT_UNREACH = 3,     // 端口不可达
+    ICMP_CODE_FRAG_NEEDED = 4,      // 需要分片但设置了DF
+    ICMP_CODE_TTL_EXCEEDED = 0,     // 传输中TTL超时
 } icmp_code_t;
 
-void icmp_req(uint8_t *dst_ip);
-void icmp_in(buf_t *buf, uint8_t *src_ip);
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code);
+void icmp_req(net_ctx_t *ctx, uint8_t *dst_ip);
+void icmp_ping_test(net_ctx_t *ctx, uint8_t *target_ip, int times);
+void icmp_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_ip);
+void icmp_unreachable(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code);
+void icmp_frag_needed(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu);
+void icmp_time_exceeded(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip);
 void icmp_init();
 #endif
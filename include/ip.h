@@ -2,6 +2,7 @@
 #define IP_H
 
 #include "net.h"
+#include "ethernet.h"
 
 #pragma pack(1)
 typedef struct ip_hdr
@@ -30,11 +31,52 @@ typedef struct ipq
 } ipq_t;
 #pragma pack()
 
+typedef struct ip_dst //目的地缓存项，保存到某一目的地址的已解析下一跳与预构造的报头
+{
+    uint8_t ip[NET_IP_LEN];  // 目的IP
+    uint8_t next_hop[NET_IP_LEN]; // 下一跳IP
+    netif_t *netif;          // 出口网卡
+    uint64_t gen;            // 建立时的缓存代数，与当前代数不同即失效
+    time_t expire;           // 过期时间
+    uint16_t mtu;            // 路径MTU
+    uint32_t hdr_sum;        // IP头模板中固定字段的16位累加和，用于快速计算校验和
+    ether_hdr_t ether_hdr;   // 以太网头模板
+    ip_hdr_t ip_hdr;         // IP头模板，总长度、标识、分片、协议与校验和字段为0
+} ip_dst_t;
+
 #define IP_HDR_LEN_PER_BYTE 4      //ip包头长度单位
 #define IP_HDR_OFFSET_PER_BYTE 8   //ip分片偏移长度单位
 #define IP_VERSION_4 4             //ipv4
 #define IP_MORE_FRAGMENT (1 << 13) //ip分片mf位
-void ip_in(buf_t *buf, uint8_t *src_mac);
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+#define IP_DONT_FRAGMENT (1 << 14) //ip分片df位
+/**
+ * @brief 按目的地缓存项的模板填写ip报头，只填写随报文变化的字段，校验和在模板累加和上补充这些字段
+ * 
+ * @param dst 目的地缓存项
+ * @param hdr 要填写的报头
+ * @param total_len 总长度
+ * @param id 数据包id
+ * @param flags_fragment 标志与分片偏移，主机字节序
+ * @param protocol 上层协议
+ */
+static inline void ip_dst_hdr(const ip_dst_t *dst, ip_hdr_t *hdr, uint16_t total_len, uint16_t id, uint16_t flags_fragment, uint8_t protocol) {
+    memcpy(hdr, &dst->ip_hdr, sizeof(ip_hdr_t));
+    hdr->total_len16 = swap16(total_len);
+    hdr->id16 = swap16(id);
+    hdr->flags_fragment16 = swap16(flags_fragment);
+    hdr->protocol = protocol;
+    uint16_t *p = (uint16_t *)hdr;
+    uint32_t checksum = dst->hdr_sum + p[1] + p[2] + p[3] + p[4];
+    while (checksum > 0xffff)
+        checksum = (checksum >> 16) + (checksum & 0xffff);
+    hdr->hdr_checksum16 = ~(uint16_t)checksum;
+}
+
+void ip_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_mac);
+void ip_out(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+void ip_out_src(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol, const uint8_t *src_ip);
+ip_dst_t *ip_dst_lookup(net_ctx_t *ctx, uint8_t *ip);
+void ip_dst_cache_flush();
+void ip_forward_set(int enable);
 void ip_init();
 #endif
\ No newline at end of file
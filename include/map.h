@@ -7,7 +7,7 @@
 #include "config.h"
 
 typedef void (*map_constuctor_t)(void *dst, const void *src, size_t len);
-typedef void (*map_entry_handler_t)(void *key, void *value, time_t *timestamp);
+typedef void (*map_entry_handler_t)(void *key, void *value, time_t *timestamp, void *arg);
 
 typedef struct map //协议栈的通用泛型map，即键值对的容器，支持超时时间与非平凡值类型
 {
@@ -25,6 +25,6 @@ size_t map_size(map_t *map);
 void *map_get(map_t *map, const void *key);
 int map_set(map_t *map, const void *key, const void *value);
 void map_delete(map_t *map, const void *key);
-void map_foreach(map_t *map, map_entry_handler_t handler);
+void map_foreach(map_t *map, map_entry_handler_t handler, void *arg);
 
 #endif
\ No newline at end of file
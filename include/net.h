@@ -6,6 +6,10 @@
 #include "utils.h"
 #include "map.h"
 #include "buf.h"
+#include "timer.h"
+#ifdef NET_MULTICORE
+#include <pthread.h>
+#endif
 
 typedef enum net_protocol
 {
@@ -16,17 +20,77 @@ typedef enum net_protocol
     NET_PROTOCOL_TCP = 6,
 } net_protocol_t;
 
-typedef void (*net_handler_t)(buf_t *buf, uint8_t *src);
-
 #define NET_MAC_LEN 6 //mac地址长度
 #define NET_IP_LEN 4  //ip地址长度
 
-extern uint8_t net_if_mac[NET_MAC_LEN];
-extern uint8_t net_if_ip[NET_IP_LEN];
-extern buf_t rxbuf, txbuf; //一个buf足够单线程使用
+#ifdef NET_MULTICORE
+#define NET_CTX_NUM (NET_WORKER_NUM + 1) //上下文数，0号为主循环，其余为工作线程
+typedef _Atomic uint64_t net_counter_t;  //多个工作线程共同更新的计数器
+typedef pthread_mutex_t net_lock_t;      //保护少量共享慢路径状态的锁
+#define net_lock_init(lock) pthread_mutex_init(lock, NULL)
+#define net_lock(lock) pthread_mutex_lock(lock)
+#define net_unlock(lock) pthread_mutex_unlock(lock)
+#else
+#define NET_CTX_NUM 1
+typedef uint64_t net_counter_t;
+typedef int net_lock_t;
+#define net_lock_init(lock) ((void)(lock))
+#define net_lock(lock) ((void)(lock))
+#define net_unlock(lock) ((void)(lock))
+#endif
+
+typedef struct netif_stats //网卡收发统计
+{
+    net_counter_t rx_packets; // 收到的包数
+    net_counter_t rx_bytes;   // 收到的字节数
+    net_counter_t rx_dropped; // 丢弃的包数
+    net_counter_t tx_packets; // 发送的包数
+    net_counter_t tx_bytes;   // 发送的字节数
+    net_counter_t tx_errors;  // 发送失败的包数
+} netif_stats_t;
+
+typedef struct netif //网卡，每个网卡有独立的地址、驱动句柄与收发缓冲区
+{
+    int index;                  // 网卡编号
+    char name[NET_IF_NAME_LEN]; // 网卡名，由驱动填写
+    uint8_t mac[NET_MAC_LEN];   // mac地址
+    uint8_t ip[NET_IP_LEN];     // ip地址
+    uint8_t prefix_len;         // 子网前缀长度
+    uint16_t mtu;               // 最大传输单元
+    void *driver;               // 接收用的驱动句柄，只由接收线程使用
+    void *tx_driver;            // 发送用的驱动句柄，与接收句柄分开，接收线程与发送线程不会同时使用同一句柄
+    net_lock_t tx_lock;         // 发送锁，发送句柄不能被多个线程同时使用
+    netif_stats_t stats;        // 收发统计
+} netif_t;
+
+typedef struct net_ctx //协议栈上下文，保存一个线程的可变状态，沿调用链显式传递；只有多核模式下由worker_dispatch按流分发帧时不同上下文才并行运行
+{
+    int id;          // 上下文编号，小于NET_CTX_NUM且不与其他运行中的上下文重复，用于索引连接表、目的地缓存、分片重组表等按上下文划分的状态
+    uint16_t ip_id;  // 下一个发出的ip数据包id
+    buf_t rxbuf;     // 接收缓冲区
+    buf_t txbuf;     // 发送缓冲区
+    uint64_t now;    // 本轮轮询开始时的单调时间，毫秒
+    timer_wheel_t timers; // 本上下文的定时器，只在本上下文的线程中启动与到期
+} net_ctx_t;
+
+typedef void (*net_handler_t)(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src);
+
+extern netif_t net_ifs[NET_IF_MAX];
+extern int net_if_num;
+
+#define net_if_default (&net_ifs[0])     //默认网卡，未匹配路由的数据包从此发出
+#define net_if_mac (net_if_default->mac) //默认网卡mac地址
+#define net_if_ip (net_if_default->ip)   //默认网卡ip地址
+
+extern net_ctx_t net_main_ctx;
 
+netif_t *net_if_add(const uint8_t *ip, const uint8_t *mac, uint8_t prefix_len);
+netif_t *net_if_find(const uint8_t *ip);
+void net_if_print();
+void net_ctx_init(net_ctx_t *ctx, int id);
 int net_init();
 void net_poll();
-int net_in(buf_t *buf, uint16_t protocol, uint8_t *src);
+void net_ctx_tick(net_ctx_t *ctx);
+int net_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint16_t protocol, uint8_t *src);
 void net_add_protocol(uint16_t protocol, net_handler_t handler);
 #endif
\ No newline at end of file
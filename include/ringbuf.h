@@ -0,0 +1,43 @@
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct ringbuf //容量为2的幂的环形字节缓冲区，读写指针自由增长，用掩码取下标，读写都不移动数据
+{
+    uint8_t *data; //缓冲区，未分配时为NULL
+    uint32_t size; //容量，为2的幂
+    uint32_t head; //读指针，下一个要读出的字节
+    uint32_t tail; //写指针，下一个要写入的字节
+} ringbuf_t;
+
+//已缓存的字节数
+static inline uint32_t ringbuf_len(const ringbuf_t *ring) {
+    return ring->tail - ring->head;
+}
+
+//剩余空间
+static inline uint32_t ringbuf_space(const ringbuf_t *ring) {
+    return ring->size - ringbuf_len(ring);
+}
+
+//向上取整到2的幂
+static inline uint32_t ringbuf_roundup(uint32_t x) {
+    uint32_t size = 1;
+    while (size < x)
+        size <<= 1;
+    return size;
+}
+
+int ringbuf_init(ringbuf_t *ring, uint32_t size);
+int ringbuf_resize(ringbuf_t *ring, uint32_t size);
+void ringbuf_free(ringbuf_t *ring);
+uint32_t ringbuf_write(ringbuf_t *ring, const uint8_t *data, uint32_t len);
+uint32_t ringbuf_write_at(ringbuf_t *ring, uint32_t offset, const uint8_t *data, uint32_t len);
+uint32_t ringbuf_commit(ringbuf_t *ring, uint32_t len);
+uint32_t ringbuf_peek(const ringbuf_t *ring, uint32_t offset, uint8_t *data, uint32_t len);
+uint32_t ringbuf_read(ringbuf_t *ring, uint8_t *data, uint32_t len);
+uint32_t ringbuf_drop(ringbuf_t *ring, uint32_t len);
+
+#endif
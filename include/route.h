@@ -0,0 +1,20 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include "net.h"
+
+typedef struct route_entry //路由表项
+{
+    uint8_t dst[NET_IP_LEN];     // 目的网络
+    uint8_t prefix_len;          // 前缀长度
+    uint8_t gateway[NET_IP_LEN]; // 网关，全0表示直连
+    netif_t *netif;              // 出口网卡
+    uint8_t valid;               // 是否有效
+} route_entry_t;
+
+void route_init();
+int route_add(uint8_t *dst, uint8_t prefix_len, uint8_t *gateway, netif_t *netif);
+void route_delete(uint8_t *dst, uint8_t prefix_len);
+netif_t *route_lookup(uint8_t *ip, uint8_t *next_hop);
+void route_print();
+#endif
@@ -0,0 +1,11 @@
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SIPHASH_KEY_LEN 16 //密钥长度，字节
+
+uint64_t siphash(const uint8_t key[SIPHASH_KEY_LEN], const void *data, size_t len);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct slab //定长对象分配器，按块向系统申请内存，对象地址在释放前保持不变
+{
+    size_t obj_size;   //对象大小，已按指针大小对齐
+    size_t chunk_objs; //每块容纳的对象数
+    void *free_list;   //空闲对象链表，链表指针存放在空闲对象自身中
+    void *chunks;      //已申请的块链表
+    size_t used;       //已分配出去的对象数
+    size_t total;      //全部块中的对象总数
+} slab_t;
+
+void slab_init(slab_t *slab, size_t obj_size, size_t chunk_objs);
+void *slab_alloc(slab_t *slab);
+void slab_free(slab_t *slab, void *obj);
+void slab_destroy(slab_t *slab);
+
+#endif
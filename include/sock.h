@@ -0,0 +1,69 @@
+#ifndef SOCK_H
+#define SOCK_H
+
+#include "net.h"
+#include "tcp.h"
+#include "udp.h"
+#include "ringbuf.h"
+
+#define SOCK_EV_IN 1  //可读：有数据、对端已关闭、监听句柄有等待accept的连接，或udp句柄有数据报
+#define SOCK_EV_OUT 2 //可写：发送缓存有空间
+#define SOCK_EV_HUP 4 //连接已释放，不论是否关注都会报告
+
+#define SOCK_AGAIN -1 //非阻塞读写暂时无法进行，等待就绪后重试
+#define SOCK_ERROR -2 //句柄不支持该操作或连接已不可写
+
+typedef enum sock_type
+{
+    SOCK_TCP_LISTEN, //TCP监听端口
+    SOCK_TCP,        //TCP连接
+    SOCK_UDP,        //UDP端口
+} sock_type_t;
+
+typedef struct sock_poll sock_poll_t;
+
+typedef struct sock //应用持有的句柄，收发都不阻塞，就绪状态由sock_wait报告
+{
+    sock_type_t type;
+    net_ctx_t *ctx;                  //句柄所属的上下文，只能在这个上下文的线程中使用
+    tcp_listen_t *listen;            //SOCK_TCP_LISTEN的监听端口
+    tcp_connect_t *connect;          //SOCK_TCP的连接，连接释放后为NULL
+    udp_socket_t *udp;               //SOCK_UDP的udp套接字
+    ringbuf_t rest;                  //连接释放时还没读走的数据，之后的sock_read从这里读取
+    uint8_t hup;                     //连接已释放
+    sock_poll_t *poll;               //关注该句柄的等待集，没有为NULL
+    uint32_t events;                 //关注的事件
+    void *data;                      //应用的私有数据，随事件返回
+    uint8_t ready;                   //是否在等待集的就绪链表中
+    struct sock *ready_prev, *ready_next; //就绪链表中的前后句柄
+} sock_t;
+
+typedef struct sock_event //sock_wait返回的一个就绪句柄
+{
+    sock_t *sock;
+    uint32_t events; //已就绪的事件
+    void *data;      //sock_watch时登记的私有数据
+} sock_event_t;
+
+struct sock_poll //等待集，只记录可能就绪的句柄，等待的开销与句柄总数无关
+{
+    sock_t *head, *tail; //就绪链表
+    uint32_t num;        //就绪链表中的句柄数
+};
+
+void sock_poll_init(sock_poll_t *poll);
+sock_t *sock_listen(net_ctx_t *ctx, uint16_t port, uint32_t backlog);
+sock_t *sock_accept(sock_t *sock);
+sock_t *sock_connect(net_ctx_t *ctx, uint8_t *ip, uint16_t port);
+sock_t *sock_udp(net_ctx_t *ctx, uint16_t port);
+int sock_read(sock_t *sock, uint8_t *data, size_t len);
+int sock_write(sock_t *sock, const uint8_t *data, size_t len);
+void sock_set_cork(sock_t *sock, int on);
+int sock_recvmmsg(sock_t *sock, udp_msg_t *msgs, int num);
+int sock_sendmmsg(sock_t *sock, udp_msg_t *msgs, int num);
+uint32_t sock_events(sock_t *sock);
+int sock_watch(sock_poll_t *poll, sock_t *sock, uint32_t events, void *data);
+int sock_wait(sock_poll_t *poll, sock_event_t *events, int max, int timeout_ms);
+void sock_close(sock_t *sock);
+
+#endif
@@ -2,6 +2,7 @@
 #define TCP_H
 
 #include "net.h"
+#include "ringbuf.h"
 
 #pragma pack(1)
 
@@ -17,10 +18,12 @@ typedef struct tcp_flags {
 } tcp_flags_t;
 
 static const tcp_flags_t tcp_flags_null = {};
+static const tcp_flags_t tcp_flags_syn = { .syn = 1 };
 static const tcp_flags_t tcp_flags_ack = { .ack = 1 };
 static const tcp_flags_t tcp_flags_ack_syn = { .ack = 1 ,.syn = 1 };
 static const tcp_flags_t tcp_flags_ack_fin = { .ack = 1, .fin = 1 };
 static const tcp_flags_t tcp_flags_ack_rst = { .ack = 1 ,.rst = 1 };
+static const tcp_flags_t tcp_flags_rst = { .rst = 1 };
 
 typedef struct tcp_hdr {
     uint16_t src_port16;
@@ -45,11 +48,50 @@ typedef struct tcp_peso_hdr {
 
 #pragma pack()
 
+// TCP选项，见RFC 793、RFC 2018、RFC 7323
+#define TCP_OPT_EOL 0          //选项表结束
+#define TCP_OPT_NOP 1          //填充
+#define TCP_OPT_MSS 2          //最大报文段长度，只出现在SYN中
+#define TCP_OPT_WSCALE 3       //窗口扩大因子，只出现在SYN中
+#define TCP_OPT_SACK_PERM 4    //允许SACK，只出现在SYN中
+#define TCP_OPT_SACK 5         //SACK块
+#define TCP_OPT_TIMESTAMP 8    //时间戳
+#define TCP_OPT_MAX_LEN 40     //选项的最大总长度
+#define TCP_OPT_TS_LEN 12      //时间戳选项加上两个NOP对齐后的长度
+#define TCP_WSCALE_MAX 14      //窗口扩大因子的上限
+#define TCP_SACK_BLOCKS 4      //一个报文段最多携带的SACK块数
+
+typedef struct tcp_range { // 一段序号区间[start, end)
+    uint32_t start, end;
+} tcp_range_t;
+
+typedef struct tcp_opts { //从报文段中解析出的选项
+    uint16_t mss;      // 对端的MSS，0表示没有携带
+    int8_t wscale;     // 对端的窗口扩大因子，-1表示没有携带
+    uint8_t sack_ok;   // 是否携带允许SACK
+    uint8_t ts_ok;     // 是否携带时间戳
+    uint32_t tsval;    // 对端的时间戳
+    uint32_t tsecr;    // 对端回显的本端时间戳
+    uint8_t sack_num;  // SACK块数
+    tcp_range_t sack[TCP_SACK_BLOCKS]; // SACK块
+} tcp_opts_t;
+
+#define TCP_DEFAULT_MSS 536 //对端没有通告MSS时使用的SMSS，见RFC 879
+#define TCP_MAX_MSS (ETHERNET_MAX_TRANSPORT_UNIT - 20 - sizeof(tcp_hdr_t)) //本端通告的MSS，以太网MTU减去ip头与tcp头
+#define TCP_MIN_MSS 88 //对端通告的MSS的下限，保证带满选项的报文段仍有负载
+#define TCP_CC_PRIV_LEN 8   //拥塞控制算法私有状态的大小，以8字节计
+#define TCP_OOO_MAX 8       //乱序队列最多记录的不连续序号区间数
+#define TCP_SACK_MAX 16     //发送方记分板最多记录的已被SACK的区间数
+#define TCP_SECRET_ISN 1    //tcp_secret_hash的用途：初始序号
+#define TCP_SECRET_COOKIE 2 //tcp_secret_hash的用途：SYN cookie
+#define TCP_SECRET_PORT 3   //tcp_secret_hash的用途：临时端口的起始偏移
+#define TCP_SECRET_TABLE 4  //tcp_secret_hash的用途：连接表与TIME_WAIT表的散列
+
 
 typedef enum tcp_state {
     // 不使用状态 TCP_CLOSED,
     TCP_LISTEN = 0, /* 初始化的状态，没有分配缓存。处于这个状态时 tcp_connect_t 其他字段全是无效的
-                        其他状态rx_buf、tx_buf都在堆上动态分配了缓存，因此释放时要调用释放函数。
+                        其他状态rx_buf、tx_buf都在堆上动态分配了环形缓存，因此释放时要调用释放函数。
                     */
     TCP_SYN_SEND,
     TCP_SYN_RCVD,
@@ -72,13 +114,58 @@ typedef struct tcp_connect {
     tcp_state_t state;
     uint16_t local_port, remote_port;
     uint8_t ip[NET_IP_LEN];
+    netif_t* netif; // 本端地址所属的网卡
+    net_ctx_t* ctx; // 处理该连接的协议栈上下文
     uint32_t unack_seq, next_seq; // tx_buf中前[next_seq - unack_seq]字节已经发送，unack_seq未确认的起始序号，next_seq下一发送序号
     uint32_t ack;
-    uint16_t remote_mss;
-    uint16_t remote_win;
+    uint16_t remote_mss; // 对端在SYN中通告的MSS
+    uint32_t remote_win; // 对端通告的窗口，已按窗口扩大因子左移
+    uint8_t snd_wscale; // 对端的窗口扩大因子，对端通告的窗口要左移这么多位
+    uint8_t rcv_wscale; // 本端的窗口扩大因子，本端通告的窗口要右移这么多位
+    uint8_t sack_ok; // 双方都允许SACK
+    uint8_t ts_ok; // 双方都使用时间戳选项
+    uint32_t ts_recent; // 下一次要回显给对端的时间戳
+    uint32_t ts_ecr; // 当前报文段回显的本端时间戳，用于测量往返时间
+    uint8_t ts_ecr_valid; // 当前报文段是否带有有效的回显时间戳
+    uint32_t max_seq; // 发送过的最大序号，序号小于它的报文段是重传
+    uint32_t srtt, rttvar, rto; // 平滑往返时间、往返时间偏差与重传超时，毫秒，srtt为0表示还没有样本
+    uint32_t rtt_seq; // 正在测量往返时间的报文段的起始序号
+    uint64_t rtt_time; // 该报文段的发送时间，毫秒
+    uint8_t rtt_timing; // 是否正在测量往返时间，按Karn算法重传后不测量
+    uint8_t retries; // 连续超时重传次数
+    timer_node_t rto_timer; // 重传定时器，有未确认的数据时启动
+    timer_node_t ack_timer; // 延迟确认定时器，有收到但还没确认的数据时启动
+    uint8_t ack_pending; // 收到但还没确认的报文段数
+    uint32_t mss; // 发送方最大报文段长度SMSS
+    uint32_t cwnd; // 拥塞窗口，字节
+    uint32_t ssthresh; // 慢启动阈值，字节
+    uint32_t cwnd_cnt; // 拥塞避免阶段已确认、还不够让cwnd增长一个SMSS的字节数
+    uint32_t recover; // NewReno快速恢复的恢复点，确认号超过它才算完全恢复
+    uint8_t dupacks; // 连续收到的重复ACK数
+    uint8_t in_recovery; // 是否处于快速恢复
+    uint8_t fin_queued; // 本端已关闭，发完发送缓存中的数据后发送FIN
+    uint8_t fin_sent; // FIN是否已发送过
+    uint32_t fin_seq; // FIN的序号
+    uint8_t nodelay; // 关闭Nagle算法，不足一个报文段的数据也立即发送
+    uint8_t cork; // 塞住发送，只发满长度的报文段，解除后再发剩余的数据
+    uint8_t active; // 主动打开的连接，本地端口由临时端口分配器分配，释放时归还
+    struct tcp_listen* listener; // 被动打开的连接所属的监听端口
+    uint8_t queued; // 是否在监听端口的accept队列中等待应用取走
+    struct tcp_connect *accept_prev, *accept_next; // accept队列中的前后连接
+    void* user; // 应用的私有数据，协议栈不使用
+    const struct tcp_cc_ops* cc; // 拥塞控制算法
+    uint64_t cc_priv[TCP_CC_PRIV_LEN]; // 拥塞控制算法的私有状态
+    tcp_range_t ooo[TCP_OOO_MAX]; // 乱序队列，乱序到达、已存入接收缓存写指针之后的序号区间，按序号升序排列，互不重叠也不相邻
+    uint8_t ooo_num; // 乱序队列中的区间数
+    uint32_t ooo_recent; // 最近一个乱序报文段的序号，包含它的区间作为第一个SACK块
+    tcp_range_t sacked[TCP_SACK_MAX]; // 记分板，对端SACK过的序号区间，排列方式同乱序队列
+    uint8_t sacked_num; // 记分板中的区间数
+    uint32_t high_rxt; // 本次恢复中重传到的最大序号
+    uint8_t ooo_fin; // 是否已收到乱序的FIN，空洞补齐后再处理
+    uint32_t ooo_fin_seq; // 乱序FIN的序号
     void* handler;
-    buf_t* rx_buf; // 接收缓存
-    buf_t* tx_buf; // 发送缓存
+    ringbuf_t rx_buf; // 接收缓存，容量在TCP_BUF_INIT_SIZE与TCP_BUF_MAX_SIZE之间按需增长
+    ringbuf_t tx_buf; // 发送缓存，容量随对端窗口增长
 } tcp_connect_t;
 
 static const tcp_connect_t CONNECT_LISTEN = {
@@ -92,16 +179,51 @@ typedef enum connect_state {
     TCP_CONN_DATA_RECV,
     // 关闭连接
     TCP_CONN_CLOSED,
+    // 发送的数据被确认，发送缓存腾出了空间
+    TCP_CONN_DATA_SENT,
 } connect_state_t;
 
 typedef void (*tcp_handler_t)(tcp_connect_t* conect, connect_state_t state);
 
-void tcp_init();
+typedef struct tcp_listen tcp_listen_t;
+typedef void (*tcp_listen_handler_t)(tcp_listen_t* listen, net_ctx_t* ctx);
+
+typedef struct tcp_accept_queue { //一个上下文中握手已完成、等待应用取走的连接，按完成的先后排列
+    tcp_connect_t *head, *tail;
+    uint32_t len;
+} tcp_accept_queue_t;
+
+struct tcp_listen { //监听端口
+    uint16_t port;
+    tcp_handler_t handler; // 连接的回调函数，有accept队列时从tcp_accept取走连接后才开始调用
+    uint32_t backlog; // 每个上下文accept队列的长度上限，0表示不排队，握手完成即以TCP_CONN_CONNECTED调用handler
+    tcp_listen_handler_t ready; // accept队列由空变为非空时调用，可以为NULL
+    void* user; // 应用的私有数据，协议栈不使用
+    tcp_accept_queue_t queue[NET_CTX_NUM]; // 各上下文的accept队列，多核模式下各工作线程只访问自己的队列
+};
+
+// 考虑回绕的序号比较
+static inline int tcp_seq_lt(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+static inline int tcp_seq_leq(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) <= 0;
+}
+
+int tcp_init();
 int tcp_open(uint16_t port, tcp_handler_t handler);
+tcp_listen_t* tcp_listen(uint16_t port, uint32_t backlog, tcp_handler_t handler, tcp_listen_handler_t ready);
+tcp_connect_t* tcp_accept(net_ctx_t* ctx, tcp_listen_t* listen);
+void tcp_listen_close(tcp_listen_t* listen);
 void tcp_close(uint16_t port);
+tcp_connect_t* tcp_connect(net_ctx_t* ctx, uint8_t* ip, uint16_t port, tcp_handler_t handler);
 void tcp_connect_close(tcp_connect_t* connect);
 size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len);
+size_t tcp_connect_write_space(tcp_connect_t* connect);
 size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len);
-void tcp_in(buf_t* buf, uint8_t* src_ip);
+void tcp_connect_set_nodelay(tcp_connect_t* connect, int on);
+void tcp_connect_set_cork(tcp_connect_t* connect, int on);
+void tcp_in(net_ctx_t* ctx, netif_t* netif, buf_t* buf, uint8_t* src_ip);
+uint64_t tcp_secret_hash(uint32_t use, const tcp_key_t* key, uint64_t extra);
 
 #endif
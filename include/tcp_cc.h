@@ -0,0 +1,29 @@
+#ifndef TCP_CC_H
+#define TCP_CC_H
+
+#include "tcp.h"
+
+#define TCP_CC_MAX 8             //最多可注册的拥塞控制算法数
+#define TCP_CC_NAME_LEN 16       //算法名最大长度
+
+typedef struct tcp_cc_ops //拥塞控制算法，慢启动、快速重传与快速恢复由tcp.c统一处理，算法只决定丢包后的ssthresh与拥塞避免阶段cwnd如何增长
+{
+    char name[TCP_CC_NAME_LEN];
+    void (*init)(tcp_connect_t *connect);                      //可选，连接建立时初始化cc_priv
+    uint32_t (*ssthresh)(tcp_connect_t *connect);              //检测到丢包时调用，返回新的ssthresh，字节
+    void (*cong_avoid)(tcp_connect_t *connect, uint32_t acked); //不在快速恢复中且确认了acked字节新数据时调用，增长cwnd
+    void (*pkts_acked)(tcp_connect_t *connect, uint32_t acked); //可选，每次确认新数据后调用，供基于时延或带宽的算法取样
+} tcp_cc_ops_t;
+
+extern const tcp_cc_ops_t tcp_newreno;
+extern const tcp_cc_ops_t tcp_cubic;
+
+int tcp_cc_register(const tcp_cc_ops_t *ops);
+const tcp_cc_ops_t *tcp_cc_find(const char *name);
+const tcp_cc_ops_t *tcp_cc_default();
+int tcp_connect_set_cc(tcp_connect_t *connect, const char *name);
+uint32_t tcp_cc_slow_start(tcp_connect_t *connect, uint32_t acked);
+void tcp_cc_cong_avoid_ai(tcp_connect_t *connect, uint32_t w, uint32_t acked);
+uint32_t tcp_cc_flight(tcp_connect_t *connect);
+
+#endif
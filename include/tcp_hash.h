@@ -0,0 +1,34 @@
+#ifndef TCP_HASH_H
+#define TCP_HASH_H
+
+#include "tcp.h"
+#include "slab.h"
+
+typedef struct tcp_hash_entry //连接表的一个槽，键内联存放，查找时不必访问连接对象
+{
+    uint32_t hash;          //键的哈希值
+    uint32_t dist;          //到理想槽的探测距离+1，0表示空槽
+    tcp_key_t key;          //[IP, src port, dst port]
+    tcp_connect_t *connect; //连接对象，由slab分配，地址在删除前保持不变
+} tcp_hash_entry_t;
+
+typedef struct tcp_hash //以tcp_key_t为键的Robin Hood开放寻址哈希表
+{
+    tcp_hash_entry_t *entries; //槽数组
+    size_t mask;               //槽数-1，槽数为2的幂
+    size_t size;               //连接数
+    slab_t slab;               //连接对象分配器
+} tcp_hash_t;
+
+// 返回非0时删除该连接
+typedef int (*tcp_hash_handler_t)(tcp_connect_t *connect, void *arg);
+
+int tcp_hash_init(tcp_hash_t *table);
+size_t tcp_hash_size(tcp_hash_t *table);
+tcp_connect_t *tcp_hash_get(tcp_hash_t *table, const tcp_key_t *key);
+tcp_connect_t *tcp_hash_add(tcp_hash_t *table, const tcp_key_t *key);
+void tcp_hash_delete(tcp_hash_t *table, const tcp_key_t *key);
+void tcp_hash_foreach(tcp_hash_t *table, tcp_hash_handler_t handler, void *arg);
+void tcp_hash_destroy(tcp_hash_t *table);
+
+#endif
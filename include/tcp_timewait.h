@@ -0,0 +1,34 @@
+#ifndef TCP_TIMEWAIT_H
+#define TCP_TIMEWAIT_H
+
+#include "tcp.h"
+#include "slab.h"
+#include "timer.h"
+
+typedef struct tcp_timewait //TIME_WAIT记录，连接关闭后只保留应答迟到报文段所需的字段，不占用连接对象与收发缓存
+{
+    struct tcp_timewait *next; //同一个桶中的下一条记录
+    tcp_key_t key;             //[IP, src port, dst port]
+    uint32_t snd_nxt;          //本端FIN之后的序号，重发ACK时用作序号
+    uint32_t rcv_nxt;          //对端FIN之后的序号，即要确认的序号
+    netif_t *netif;            //发送ACK的网卡
+    uint8_t active;            //主动打开的连接，本地端口保留到记录回收时才归还
+    timer_node_t timer;        //2MSL定时器，到期时回收记录
+} tcp_timewait_t;
+
+typedef struct tcp_timewait_table //以tcp_key_t为键的拉链哈希表，桶数固定
+{
+    tcp_timewait_t **buckets; //桶数组，每个桶是一条单向链表
+    size_t mask;              //桶数-1，桶数为2的幂
+    size_t size;              //记录数
+    slab_t slab;              //记录分配器
+} tcp_timewait_table_t;
+
+int tcp_timewait_init(tcp_timewait_table_t *table);
+size_t tcp_timewait_size(tcp_timewait_table_t *table);
+tcp_timewait_t *tcp_timewait_get(tcp_timewait_table_t *table, const tcp_key_t *key);
+tcp_timewait_t *tcp_timewait_add(tcp_timewait_table_t *table, const tcp_key_t *key);
+void tcp_timewait_delete(tcp_timewait_table_t *table, tcp_timewait_t *tw);
+void tcp_timewait_destroy(tcp_timewait_table_t *table);
+
+#endif
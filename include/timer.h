@@ -0,0 +1,39 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TIMER_WHEEL_SIZE 1024 //时间轮槽数，须为2的幂，每槽1毫秒
+
+typedef struct timer_node timer_node_t;
+typedef void (*timer_handler_t)(timer_node_t *node, void *arg);
+
+typedef struct timer_node //定时器，嵌入到使用者的结构体中，不需要额外分配
+{
+    timer_node_t *prev, *next; //所在槽的双向链表，未启动时next为NULL
+    uint64_t expire;           //到期时间，毫秒
+    timer_handler_t handler;   //到期回调
+} timer_node_t;
+
+typedef struct timer_wheel //单层哈希时间轮，到期时间对槽数取模决定所在的槽，超过一圈的定时器每圈检查一次
+{
+    timer_node_t slots[TIMER_WHEEL_SIZE]; //各槽链表的哨兵
+    uint64_t now;                          //已处理到的时间，毫秒
+} timer_wheel_t;
+
+//由结构体中的定时器成员得到结构体指针
+#define timer_entry(node, type, member) ((type *)((uint8_t *)(node) - offsetof(type, member)))
+
+//定时器是否已启动
+static inline int timer_pending(const timer_node_t *node) {
+    return node->next != NULL;
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now);
+void timer_init(timer_node_t *node, timer_handler_t handler);
+void timer_add(timer_wheel_t *wheel, timer_node_t *node, uint64_t expire);
+void timer_cancel(timer_node_t *node);
+void timer_wheel_run(timer_wheel_t *wheel, uint64_t now, void *arg);
+
+#endif
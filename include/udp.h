@@ -22,12 +22,59 @@ typedef struct udp_peso_hdr
 } udp_peso_hdr_t;
 #pragma pack()
 
-typedef void (*udp_handler_t)(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
+typedef void (*udp_handler_t)(net_ctx_t *ctx, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
+
+#define UDP_MAX_PAYLOAD (UINT16_MAX - 20 - sizeof(udp_hdr_t))                    //一个数据报的最大数据长度
+#define UDP_DGRAM_INLINE (ETHERNET_MAX_TRANSPORT_UNIT - 20 - sizeof(udp_hdr_t)) //不分片的数据报的最大数据长度
+
+typedef struct udp_dgram //接收队列中的一个数据报，从池中分配，放不下的分片重组数据报另行分配
+{
+    uint8_t src_ip[NET_IP_LEN];
+    uint16_t src_port;
+    uint16_t len;
+    uint8_t *data;                          // 指向inline_data或另行分配的缓冲区
+    uint8_t inline_data[UDP_DGRAM_INLINE];
+} udp_dgram_t;
+
+typedef struct udp_ring //一个上下文的接收队列，只存数据报的指针
+{
+    udp_dgram_t **slots; // 槽，个数为UDP_RX_QUEUE_LEN
+    uint32_t head;       // 下一个取出的位置
+    uint32_t tail;       // 下一个放入的位置
+} udp_ring_t;
+
+typedef struct udp_msg //批量收发的一个数据报
+{
+    uint8_t *data;          // 数据
+    size_t len;             // 接收时调用前为data的容量，返回后为数据长度；发送时为数据长度
+    uint8_t ip[NET_IP_LEN]; // 接收时为源ip，发送时为目的ip
+    uint16_t port;          // 接收时为源端口，发送时为目的端口
+    uint8_t trunc;          // 接收时数据报比data长，多出的部分已丢弃
+} udp_msg_t;
+
+typedef struct udp_socket udp_socket_t;
+typedef void (*udp_socket_handler_t)(udp_socket_t *socket, net_ctx_t *ctx);
+
+struct udp_socket //udp套接字，收到的数据报在接收队列中等待应用批量取走
+{
+    uint16_t port;
+    udp_socket_handler_t ready;      // 接收队列由空变为非空时调用，可以为NULL
+    void *user;                      // 应用的私有数据，协议栈不使用
+    net_counter_t drops;             // 队列满而丢弃的数据报数
+    udp_ring_t ring[NET_CTX_NUM];    // 各上下文的接收队列，多核模式下各工作线程只访问自己的队列
+};
 
 void udp_init();
-void udp_in(buf_t *buf, uint8_t *src_ip);
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void udp_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_ip);
+void udp_out(net_ctx_t *ctx, buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void udp_send(net_ctx_t *ctx, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+int udp_sendmany(net_ctx_t *ctx, uint16_t src_port, udp_msg_t *msgs, int num);
+int udp_send_gso(net_ctx_t *ctx, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port, uint8_t *data, size_t len, uint16_t seg_size);
 int udp_open(uint16_t port, udp_handler_t handler);
 void udp_close(uint16_t port);
+udp_socket_t *udp_socket_open(uint16_t port, udp_socket_handler_t ready);
+int udp_socket_recv(net_ctx_t *ctx, udp_socket_t *socket, udp_msg_t *msgs, int num);
+int udp_socket_send(net_ctx_t *ctx, udp_socket_t *socket, udp_msg_t *msgs, int num);
+uint32_t udp_socket_pending(net_ctx_t *ctx, udp_socket_t *socket);
+void udp_socket_close(udp_socket_t *socket);
 #endif
\ No newline at end of file
@@ -27,6 +27,9 @@ static inline uint32_t min32(uint32_t a, uint32_t b) {
 char *iptos(uint8_t *ip);
 char *mactos(uint8_t *mac);
 char *timetos(time_t timestamp);
+uint64_t time_ms();
+uint64_t time_us();
+int random_bytes(void *buf, size_t len);
 uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb);
 
 
@@ -0,0 +1,49 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "net.h"
+#include "ethernet.h"
+
+#ifdef NET_MULTICORE
+#include <stdatomic.h>
+
+#define WORKER_FRAME_MAX (ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t)) //队列中一帧的最大长度
+#define WORKER_CACHE_LINE 64                                              //缓存行大小
+
+typedef struct worker_frame //接收队列中的一帧
+{
+    netif_t *netif;                  // 收到该帧的网卡
+    size_t len;                      // 帧长度
+    uint8_t data[WORKER_FRAME_MAX];  // 帧数据
+} worker_frame_t;
+
+typedef struct worker_ring //单生产者单消费者无锁环形队列，由接收线程写入、一个工作线程读出
+{
+    _Atomic size_t head;                                   // 消费者下一个读取的位置
+    uint8_t pad0[WORKER_CACHE_LINE - sizeof(size_t)];      // 避免head与tail伪共享
+    _Atomic size_t tail;                                   // 生产者下一个写入的位置
+    uint8_t pad1[WORKER_CACHE_LINE - sizeof(size_t)];
+    worker_frame_t slots[NET_RING_SIZE];                   // 帧槽
+} worker_ring_t;
+
+typedef struct worker //工作线程
+{
+    int index;                // 工作线程编号，0号同时处理ARP、ICMP等非TCP/UDP数据包
+    pthread_t thread;         // 线程句柄
+    _Atomic int running;      // 是否继续运行
+    net_counter_t dropped;    // 队列满而丢弃的帧数
+    worker_ring_t ring;       // 接收队列
+} worker_t;
+
+void worker_ring_init(worker_ring_t *ring);
+int worker_ring_push(worker_ring_t *ring, netif_t *netif, const uint8_t *data, size_t len);
+worker_frame_t *worker_ring_peek(worker_ring_t *ring);
+void worker_ring_pop(worker_ring_t *ring);
+int worker_steer(const uint8_t *frame, size_t len);
+int worker_steer_flow(const uint8_t *src_ip, const uint8_t *dst_ip, const uint8_t *ports);
+int worker_start();
+void worker_stop();
+void worker_dispatch(net_ctx_t *ctx);
+void worker_print();
+#endif
+#endif
@@ -3,8 +3,9 @@
 #include "net.h"
 #include "arp.h"
 #include "ethernet.h"
+#include "ip.h"
 /**
- * @brief 初始的arp包
+ * @brief 初始的arp包，发送方地址由出口网卡填写
  * 
  */
 static const arp_pkt_t arp_init_pkt = {
@@ -12,8 +13,6 @@ static const arp_pkt_t arp_init_pkt = {
     .pro_type16 = constswap16(NET_PROTOCOL_IP),
     .hw_len = NET_MAC_LEN,
     .pro_len = NET_IP_LEN,
-    .sender_ip = NET_IF_IP,
-    .sender_mac = NET_IF_MAC,
     .target_mac = {0}};
 
 /**
@@ -28,14 +27,21 @@ map_t arp_table;
  */
 map_t arp_buf;
 
+/**
+ * @brief 保护arp_table与arp_buf，多核模式下各工作线程在目的地缓存未命中时会访问它们
+ * 
+ */
+static net_lock_t arp_lock;
+
 /**
  * @brief 打印一条arp表项
  * 
  * @param ip 表项的ip地址
  * @param mac 表项的mac地址
  * @param timestamp 表项的更新时间
+ * @param arg 未使用
  */
-void arp_entry_print(void *ip, void *mac, time_t *timestamp)
+void arp_entry_print(void *ip, void *mac, time_t *timestamp, void *arg)
 {
     printf("%s | %s | %s\n", iptos(ip), mactos(mac), timetos(*timestamp));
 }
@@ -47,55 +53,67 @@ void arp_entry_print(void *ip, void *mac, time_t *timestamp)
 void arp_print()
 {
     printf("===ARP TABLE BEGIN===\n");
-    map_foreach(&arp_table, arp_entry_print);
+    map_foreach(&arp_table, arp_entry_print, NULL);
     printf("===ARP TABLE  END ===\n");
 }
 
 /**
  * @brief 发送一个arp请求
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 出口网卡
  * @param target_ip 想要知道的目标的ip地址
  */
-void arp_req(uint8_t *target_ip)
+void arp_req(net_ctx_t *ctx, netif_t *netif, uint8_t *target_ip)
 {
+    buf_t *txbuf = &ctx->txbuf;
     // 初始化txbuf
-    buf_init(&txbuf, sizeof(arp_pkt_t));
+    buf_init(txbuf, sizeof(arp_pkt_t));
     // 填写ARP报头，在arp_init_pkt的基础上修改参数
     arp_pkt_t arp_pkt = arp_init_pkt;
     arp_pkt.opcode16 = swap16(ARP_REQUEST); // 操作类型为请求，APR_REQUEST
+    memcpy(arp_pkt.sender_ip, netif->ip, NET_IP_LEN);
+    memcpy(arp_pkt.sender_mac, netif->mac, NET_MAC_LEN);
     memcpy(arp_pkt.target_ip, target_ip, NET_IP_LEN);
-    memcpy(txbuf.data, &arp_pkt, sizeof(arp_pkt));
+    memcpy(txbuf->data, &arp_pkt, sizeof(arp_pkt));
     // 发送ARP报文
-    ethernet_out(&txbuf, ether_broadcast_mac, NET_PROTOCOL_ARP);
+    ethernet_out(netif, txbuf, ether_broadcast_mac, NET_PROTOCOL_ARP);
 }
 
 /**
  * @brief 发送一个arp响应
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 出口网卡
  * @param target_ip 目标ip地址
  * @param target_mac 目标mac地址
  */
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac)
+void arp_resp(net_ctx_t *ctx, netif_t *netif, uint8_t *target_ip, uint8_t *target_mac)
 {
+    buf_t *txbuf = &ctx->txbuf;
     // 初始化txbuf
-    buf_init(&txbuf, sizeof(arp_pkt_t));
+    buf_init(txbuf, sizeof(arp_pkt_t));
     // 填写ARP报头
     arp_pkt_t arp_pkt = arp_init_pkt;
     arp_pkt.opcode16 = swap16(ARP_REPLY); // 操作类型为响应，ARP_REPLY
+    memcpy(arp_pkt.sender_ip, netif->ip, NET_IP_LEN);
+    memcpy(arp_pkt.sender_mac, netif->mac, NET_MAC_LEN);
     memcpy(arp_pkt.target_mac, target_mac, NET_MAC_LEN);
     memcpy(arp_pkt.target_ip, target_ip, NET_IP_LEN);
     // 发送ARP报文
-    memcpy(txbuf.data, &arp_pkt, sizeof(arp_pkt));
-    ethernet_out(&txbuf, target_mac, NET_PROTOCOL_ARP);
+    memcpy(txbuf->data, &arp_pkt, sizeof(arp_pkt));
+    ethernet_out(netif, txbuf, target_mac, NET_PROTOCOL_ARP);
 }
 
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 收到数据包的网卡
  * @param buf 要处理的数据包
  * @param src_mac 源mac地址
  */
-void arp_in(buf_t *buf, uint8_t *src_mac)
+void arp_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_mac)
 {
     // 判断数据包是否合法
     if (buf->len < sizeof(arp_pkt_t)) return;
@@ -107,17 +125,24 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
     uint16_t opcode = swap16(arp_pkt_in->opcode16);
     if (opcode != ARP_REQUEST && opcode != ARP_REPLY) return;
     // 对于合法的数据包，更新ARP表项，增加该数据包来源IP与MAC的映射
+    // 映射为新增或MAC发生变化时，IP层缓存的下一跳已失效
+    net_lock(&arp_lock);
+    uint8_t *old_mac = map_get(&arp_table, arp_pkt_in->sender_ip);
+    if (old_mac == NULL || memcmp(old_mac, src_mac, NET_MAC_LEN) != 0)
+        ip_dst_cache_flush();
     map_set(&arp_table, arp_pkt_in->sender_ip, src_mac);
     // 查看该接收报文的IP地址是否有对应的IP数据包缓存，若有则发送该IP数据包并从缓存中删除
     buf_t *buf_in_map = (buf_t *)map_get(&arp_buf, arp_pkt_in->sender_ip);
     if (buf_in_map != NULL) {
-        ethernet_out(buf_in_map, arp_pkt_in->sender_mac, NET_PROTOCOL_IP);
+        ethernet_out(netif, buf_in_map, arp_pkt_in->sender_mac, NET_PROTOCOL_IP);
         map_delete(&arp_buf, arp_pkt_in->sender_ip);
+        net_unlock(&arp_lock);
         return;
     }
+    net_unlock(&arp_lock);
     // 若没有缓存，判断该数据包是否为请求本机MAC的ARP请求，是则发送ARP响应
-    if (opcode == ARP_REQUEST && memcmp(arp_pkt_in->target_ip, net_if_ip, NET_IP_LEN) == 0) {
-        arp_resp(arp_pkt_in->sender_ip, arp_pkt_in->sender_mac);
+    if (opcode == ARP_REQUEST && memcmp(arp_pkt_in->target_ip, netif->ip, NET_IP_LEN) == 0) {
+        arp_resp(ctx, netif, arp_pkt_in->sender_ip, arp_pkt_in->sender_mac);
     }
     
 }
@@ -125,24 +150,48 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
 /**
  * @brief 处理一个要发送的数据包
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 出口网卡
  * @param buf 要处理的数据包
  * @param ip 目标ip地址
- * @param protocol 上层协议
  */
-void arp_out(buf_t *buf, uint8_t *ip)
+void arp_out(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *ip)
 {
     // 根据已知IP查ARP表，若存在对应MAC则直接发送传来的上层IP数据包
+    net_lock(&arp_lock);
     uint8_t *mac_in_map = (uint8_t *)map_get(&arp_table, ip);
     if (mac_in_map != NULL) {
-        ethernet_out(buf, mac_in_map, NET_PROTOCOL_IP);
+        uint8_t mac[NET_MAC_LEN];
+        memcpy(mac, mac_in_map, NET_MAC_LEN);
+        net_unlock(&arp_lock);
+        ethernet_out(netif, buf, mac, NET_PROTOCOL_IP);
         return;
     }
     // ARP表中不存在时，判断当前缓存中是否有数据包，若有则说明正在等待该IP回应ARP请求，此时不能再发送ARP请求
     // 若没有缓存，则缓存该数据包，然后先发送ARP请求以获得目标IP对应的MAC地址
-    if (map_get(&arp_buf, ip) == NULL) {
+    int pending = map_get(&arp_buf, ip) != NULL;
+    if (!pending)
         map_set(&arp_buf, ip, buf);
-        arp_req(ip);
-    }
+    net_unlock(&arp_lock);
+    if (!pending)
+        arp_req(ctx, netif, ip);
+}
+
+/**
+ * @brief 查询ip对应的mac地址
+ * 
+ * @param ip 要查询的ip地址
+ * @param mac 出口参数，查到的mac地址
+ * @return int 成功为0，不存在为-1
+ */
+int arp_lookup(uint8_t *ip, uint8_t *mac)
+{
+    net_lock(&arp_lock);
+    uint8_t *mac_in_map = map_get(&arp_table, ip);
+    if (mac_in_map != NULL)
+        memcpy(mac, mac_in_map, NET_MAC_LEN);
+    net_unlock(&arp_lock);
+    return mac_in_map != NULL ? 0 : -1;
 }
 
 /**
@@ -151,8 +200,10 @@ void arp_out(buf_t *buf, uint8_t *ip)
  */
 void arp_init()
 {
+    net_lock_init(&arp_lock);
     map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
     map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy);
     net_add_protocol(NET_PROTOCOL_ARP, arp_in);
-    arp_req(net_if_ip);
+    for (int i = 0; i < net_if_num; i++)
+        arp_req(&net_main_ctx, &net_ifs[i], net_ifs[i].ip);
 }
\ No newline at end of file
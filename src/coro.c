@@ -0,0 +1,338 @@
+#include <limits.h>
+#include "coro.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/**
+ * @brief 内部函数，从协程切回调度器，直到调度器再次运行它
+ *
+ * @param co 正在运行的协程
+ */
+static void coro_switch_out(coro_t *co)
+{
+#ifdef _WIN32
+    SwitchToFiber(co->sched->fiber);
+#else
+    swapcontext(&co->uctx, &co->sched->uctx);
+#endif
+}
+
+/**
+ * @brief 内部函数，协程的执行循环：运行入口函数，结束后切回调度器，
+ *        协程从空闲链表中复用时换上新的入口函数再次运行，栈与上下文不用重新创建
+ *
+ * @param co 协程
+ */
+static void coro_loop(coro_t *co)
+{
+    while (1)
+    {
+        co->fn(co, co->arg);
+        co->fn = NULL;
+        coro_switch_out(co);
+    }
+}
+
+#ifdef _WIN32
+static void WINAPI coro_main(void *arg)
+{
+    coro_loop(arg);
+}
+#else
+/**
+ * @brief 内部函数，协程栈上的第一个函数，makecontext只能传int参数，指针拆成高低两半传入
+ *
+ * @param hi 协程指针的高32位
+ * @param lo 协程指针的低32位
+ */
+static void coro_main(unsigned int hi, unsigned int lo)
+{
+    coro_loop((coro_t *)(uintptr_t)(((uint64_t)hi << 32) | lo));
+}
+#endif
+
+/**
+ * @brief 内部函数，取一个空闲的协程，没有时新建一个
+ *
+ * @param sched 调度器
+ * @return coro_t* 协程，内存不足为NULL
+ */
+static coro_t *coro_alloc(coro_sched_t *sched)
+{
+    coro_t *co = sched->free;
+    if (co)
+    {
+        sched->free = co->next;
+        sched->free_num--;
+        return co;
+    }
+    co = calloc(1, sizeof(coro_t));
+    if (co == NULL)
+        return NULL;
+    co->sched = sched;
+#ifdef _WIN32
+    co->fiber = CreateFiber(CORO_STACK_SIZE, coro_main, co);
+    if (co->fiber == NULL)
+    {
+        free(co);
+        return NULL;
+    }
+#else
+    co->stack = malloc(CORO_STACK_SIZE);
+    if (co->stack == NULL || getcontext(&co->uctx) != 0)
+    {
+        free(co->stack);
+        free(co);
+        return NULL;
+    }
+    co->uctx.uc_stack.ss_sp = co->stack;
+    co->uctx.uc_stack.ss_size = CORO_STACK_SIZE;
+    co->uctx.uc_link = NULL; // coro_loop不会返回
+    uint64_t p = (uintptr_t)co;
+    makecontext(&co->uctx, (void (*)(void))coro_main, 2, (unsigned int)(p >> 32), (unsigned int)p);
+#endif
+    return co;
+}
+
+/**
+ * @brief 内部函数，释放协程与它的栈
+ *
+ * @param co 不在运行的协程
+ */
+static void coro_free(coro_t *co)
+{
+#ifdef _WIN32
+    DeleteFiber(co->fiber);
+#else
+    free(co->stack);
+#endif
+    free(co);
+}
+
+/**
+ * @brief 内部函数，把协程加到运行队列的末尾
+ *
+ * @param sched 调度器
+ * @param co 协程
+ */
+static void coro_ready(coro_sched_t *sched, coro_t *co)
+{
+    co->next = NULL;
+    if (sched->run_tail)
+        sched->run_tail->next = co;
+    else
+        sched->run_head = co;
+    sched->run_tail = co;
+}
+
+/**
+ * @brief 内部函数，从调度器切换到协程运行，协程让出或结束后返回；
+ *        结束的协程的栈留在空闲链表中复用，空闲链表已满时归还系统
+ *
+ * @param sched 调度器
+ * @param co 运行队列中取出的协程
+ */
+static void coro_switch_in(coro_sched_t *sched, coro_t *co)
+{
+    sched->current = co;
+#ifdef _WIN32
+    SwitchToFiber(co->fiber);
+#else
+    swapcontext(&sched->uctx, &co->uctx);
+#endif
+    sched->current = NULL;
+    if (co->fn)
+        return;
+    sched->live--;
+    if (sched->free_num < CORO_POOL_MAX)
+    {
+        co->next = sched->free;
+        sched->free = co;
+        sched->free_num++;
+    }
+    else
+        coro_free(co);
+}
+
+/**
+ * @brief 初始化调度器，须在运行协程的线程中调用
+ *
+ * @param sched 要初始化的调度器
+ */
+void coro_sched_init(coro_sched_t *sched)
+{
+    memset(sched, 0, sizeof(coro_sched_t));
+    sock_poll_init(&sched->poll);
+#ifdef _WIN32
+    sched->fiber = ConvertThreadToFiber(NULL);
+    if (sched->fiber == NULL)
+        sched->fiber = GetCurrentFiber();
+#endif
+}
+
+/**
+ * @brief 创建协程，放入运行队列，下一次coro_sched_run时开始运行
+ *
+ * @param sched 调度器
+ * @param fn 入口函数，返回即结束
+ * @param arg 入口函数的参数
+ * @return coro_t* 协程，内存不足为NULL
+ */
+coro_t *coro_spawn(coro_sched_t *sched, coro_fn_t fn, void *arg)
+{
+    coro_t *co = coro_alloc(sched);
+    if (co == NULL)
+        return NULL;
+    co->fn = fn;
+    co->arg = arg;
+    sched->live++;
+    coro_ready(sched, co);
+    return co;
+}
+
+/**
+ * @brief 运行一轮：唤醒等待的句柄已就绪的协程，再让本轮开始时可以运行的协程各运行一次，不阻塞。
+ *        应在每次net_poll之后调用
+ *
+ * @param sched 调度器
+ * @return size_t 还没结束的协程数
+ */
+size_t coro_sched_run(coro_sched_t *sched)
+{
+    sock_event_t events[CORO_EVENT_BATCH];
+    int n;
+    do
+    {
+        n = sock_wait(&sched->poll, events, CORO_EVENT_BATCH, 0);
+        for (int i = 0; i < n; i++)
+        {
+            // 移出等待集，同一个协程只唤醒一次
+            sock_watch(&sched->poll, events[i].sock, 0, NULL);
+            coro_ready(sched, events[i].data);
+        }
+    } while (n == CORO_EVENT_BATCH);
+    // 本轮让出的协程排在末尾，下一轮才再次运行
+    coro_t *tail = sched->run_tail;
+    while (tail && sched->run_head)
+    {
+        coro_t *co = sched->run_head;
+        sched->run_head = co->next;
+        if (sched->run_head == NULL)
+            sched->run_tail = NULL;
+        coro_switch_in(sched, co);
+        if (co == tail)
+            break;
+    }
+    return sched->live;
+}
+
+/**
+ * @brief 释放空闲链表中的协程，须在所有协程结束之后调用
+ *
+ * @param sched 调度器
+ */
+void coro_sched_destroy(coro_sched_t *sched)
+{
+    while (sched->free)
+    {
+        coro_t *co = sched->free;
+        sched->free = co->next;
+        coro_free(co);
+    }
+    sched->free_num = 0;
+}
+
+/**
+ * @brief 让出处理器，下一轮再继续运行
+ *
+ * @param co 正在运行的协程
+ */
+void coro_yield(coro_t *co)
+{
+    coro_ready(co->sched, co);
+    coro_switch_out(co);
+}
+
+/**
+ * @brief 等待句柄的事件就绪，期间其他协程继续运行
+ *
+ * @param co 正在运行的协程
+ * @param sock 句柄，不能同时属于其他等待集
+ * @param events 等待的事件，SOCK_EV_HUP总会唤醒
+ * @return uint32_t 已就绪的事件
+ */
+uint32_t coro_wait(coro_t *co, sock_t *sock, uint32_t events)
+{
+    uint32_t ready = sock_events(sock) & (events | SOCK_EV_HUP);
+    if (ready)
+        return ready;
+    sock_watch(&co->sched->poll, sock, events, co);
+    coro_switch_out(co);
+    return sock_events(sock) & (events | SOCK_EV_HUP);
+}
+
+/**
+ * @brief 从监听句柄取走一个连接，没有时等待
+ *
+ * @param co 正在运行的协程
+ * @param sock 监听句柄
+ * @return sock_t* 连接句柄，内存不足为NULL
+ */
+sock_t *coro_accept(coro_t *co, sock_t *sock)
+{
+    sock_t *conn;
+    while ((conn = sock_accept(sock)) == NULL)
+    {
+        if (sock_events(sock) & SOCK_EV_IN)
+            return NULL; // 有连接却取不出来，说明内存不足
+        coro_wait(co, sock, SOCK_EV_IN);
+    }
+    return conn;
+}
+
+/**
+ * @brief 读取数据，没有数据时等待
+ *
+ * @param co 正在运行的协程
+ * @param sock 连接句柄
+ * @param data 读出的数据
+ * @param len 最多读取的字节数
+ * @return int 读到的字节数，对端已关闭为0，出错为SOCK_ERROR
+ */
+int coro_read(coro_t *co, sock_t *sock, uint8_t *data, size_t len)
+{
+    int n;
+    while ((n = sock_read(sock, data, len)) == SOCK_AGAIN)
+        coro_wait(co, sock, SOCK_EV_IN);
+    return n;
+}
+
+/**
+ * @brief 写入全部数据，发送缓存满时等待
+ *
+ * @param co 正在运行的协程
+ * @param sock 连接句柄
+ * @param data 要发送的数据
+ * @param len 字节数
+ * @return int 写入的字节数即len，连接已不可写或内存不足为SOCK_ERROR
+ */
+int coro_write(coro_t *co, sock_t *sock, const uint8_t *data, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len)
+    {
+        int n = sock_write(sock, data + sent, len - sent);
+        if (n == SOCK_ERROR)
+            return SOCK_ERROR;
+        if (n == SOCK_AGAIN)
+        {
+            if (sock_events(sock) & SOCK_EV_OUT)
+                return SOCK_ERROR; // 可写却写不进去，说明内存不足
+            coro_wait(co, sock, SOCK_EV_OUT);
+        }
+        else
+            sent += n;
+    }
+    return len > INT_MAX ? INT_MAX : (int)len;
+}
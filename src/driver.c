@@ -28,7 +28,6 @@ BOOL LoadNpcapDlls()
 }
 #endif
 
-pcap_t *pcap;
 char pcap_errbuf[PCAP_ERRBUF_SIZE];
 
 /**
@@ -82,7 +81,7 @@ int driver_find(uint8_t *ip, char *if_name, uint8_t *mask)
         ;
     if (max_match == 32)
     {
-        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(net_if_ip));
+        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(ip));
         return -1;
     }
     for (a = d->addresses; a; a = a->next)
@@ -94,11 +93,13 @@ int driver_find(uint8_t *ip, char *if_name, uint8_t *mask)
 }
 
 /**
- * @brief 打开网卡
+ * @brief 打开网卡。libpcap不保证同一句柄可以被多个线程同时使用，而多核模式下接收线程收包的同时工作线程在发包，
+ *        所以打开两个句柄：netif->driver只用于接收，netif->tx_driver只用于发送，发送之间再由tx_lock互斥
  * 
+ * @param netif 要打开的网卡
  * @return int 成功为0，失败为-1
  */
-int driver_open()
+int driver_open(netif_t *netif)
 {
 #ifdef _WIN32
     /* Load Npcap and its functions. */
@@ -111,12 +112,14 @@ int driver_open()
 
     char if_name[PCAP_BUF_SIZE];
     uint32_t mask;
-    if (driver_find(net_if_ip, if_name, (uint8_t *)&mask) < 0)
+    pcap_t *pcap;
+    if (driver_find(netif->ip, if_name, (uint8_t *)&mask) < 0)
     {
         fprintf(stderr, "Error in driver find.\n");
         return -1;
     }
-    printf("Using interface %s, my ip is %s.\n", if_name, iptos(net_if_ip));
+    printf("Using interface %s, my ip is %s.\n", if_name, iptos(netif->ip));
+    snprintf(netif->name, NET_IF_NAME_LEN, "%.*s", NET_IF_NAME_LEN - 1, if_name); // 过长的网卡名截断保存
 
     if ((pcap = pcap_open_live(if_name, 65536, 1, 10, pcap_errbuf)) == NULL) //混杂模式打开网卡
     {
@@ -130,7 +133,7 @@ int driver_open()
     }
     char filter_exp[PCAP_BUF_SIZE];
     struct bpf_program fp;
-    uint8_t mac_addr[6] = NET_IF_MAC;
+    uint8_t *mac_addr = netif->mac;
     sprintf(filter_exp, //过滤数据包
             "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
             mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
@@ -145,16 +148,32 @@ int driver_open()
         fprintf(stderr, "Error in pcap_setfilter.\n%s.\n", pcap_geterr(pcap));
         return -1;
     }
+    // 发送句柄不接收任何帧，过滤条件对以太网帧总不成立，免得收包缓冲区被填满
+    pcap_t *tx_pcap;
+    if ((tx_pcap = pcap_open_live(if_name, 65536, 0, 10, pcap_errbuf)) == NULL)
+    {
+        fprintf(stderr, "Error in pcap_open_live.\n%s.\n", pcap_errbuf);
+        return -1;
+    }
+    if (pcap_compile(tx_pcap, &fp, "less 1", 0, mask) < 0 || pcap_setfilter(tx_pcap, &fp) < 0)
+    {
+        fprintf(stderr, "Error in pcap_setfilter.\n%s.\n", pcap_geterr(tx_pcap));
+        return -1;
+    }
+    netif->driver = pcap;
+    netif->tx_driver = tx_pcap;
     return 0;
 }
 /**
  * @brief 试图从网卡接收数据包
  * 
+ * @param netif 接收的网卡
  * @param buf 收到的数据包
  * @return int 数据包的长度，未收到为0，错误为-1
  */
-int driver_recv(buf_t *buf)
+int driver_recv(netif_t *netif, buf_t *buf)
 {
+    pcap_t *pcap = netif->driver;
     struct pcap_pkthdr *pkt_hdr;
     const uint8_t *pkt_data;
     int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
@@ -162,8 +181,8 @@ int driver_recv(buf_t *buf)
         return 0;
     else if (ret == 1)
     {
+        buf_init(buf, pkt_hdr->len);
         memcpy(buf->data, pkt_data, pkt_hdr->len);
-        buf->len = pkt_hdr->len;
         return pkt_hdr->len;
     }
     fprintf(stderr, "Error in driver_recv.\n%s.\n", pcap_geterr(pcap));
@@ -172,11 +191,13 @@ int driver_recv(buf_t *buf)
 /**
  * @brief 使用网卡发送一个数据包
  * 
+ * @param netif 发送的网卡
  * @param buf 要发送的数据包
  * @return int 成功为0，失败为-1
  */
-int driver_send(buf_t *buf)
+int driver_send(netif_t *netif, buf_t *buf)
 {
+    pcap_t *pcap = netif->tx_driver;
     if (pcap_sendpacket(pcap, buf->data, buf->len) == -1)
     {
         fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(pcap));
@@ -185,11 +206,65 @@ int driver_send(buf_t *buf)
 
     return 0;
 }
+/**
+ * @brief 使用网卡一次发送多个数据包，调用方持有发送锁，期间不会插入其他数据包
+ * 
+ * @param netif 发送的网卡
+ * @param frames 要发送的以太网帧
+ * @param num 帧数
+ * @return int 从头开始成功发送的帧数，出错时其后的帧未发送
+ */
+int driver_send_many(netif_t *netif, const ether_frame_t *frames, int num)
+{
+    pcap_t *pcap = netif->tx_driver;
+#ifdef _WIN32
+    // npcap的发送队列由内核一次发出，只陷入内核一次
+    size_t size = 0;
+    for (int i = 0; i < num; i++)
+        size += sizeof(struct pcap_pkthdr) + frames[i].len;
+    pcap_send_queue *queue = pcap_sendqueue_alloc(size);
+    if (queue == NULL)
+        return 0;
+    struct pcap_pkthdr hdr;
+    memset(&hdr.ts, 0, sizeof(hdr.ts));
+    for (int i = 0; i < num; i++)
+    {
+        hdr.caplen = hdr.len = frames[i].len;
+        pcap_sendqueue_queue(queue, &hdr, frames[i].data);
+    }
+    u_int sent = pcap_sendqueue_transmit(pcap, queue, 0);
+    int n = num;
+    if (sent < queue->len)
+    {
+        fprintf(stderr, "Error in driver_send_many.\n%s.\n", pcap_geterr(pcap));
+        size_t done = 0;
+        for (n = 0; n < num && (done += sizeof(struct pcap_pkthdr) + frames[n].len) <= sent; n++)
+            ;
+    }
+    pcap_sendqueue_destroy(queue);
+    return n;
+#else
+    // libpcap没有批量发送接口，逐帧发送
+    for (int i = 0; i < num; i++)
+    {
+        if (pcap_sendpacket(pcap, frames[i].data, frames[i].len) == -1)
+        {
+            fprintf(stderr, "Error in driver_send_many.\n%s.\n", pcap_geterr(pcap));
+            return i;
+        }
+    }
+    return num;
+#endif
+}
 /**
  * @brief 关闭网卡
  * 
+ * @param netif 要关闭的网卡
  */
-void driver_close()
+void driver_close(netif_t *netif)
 {
-    pcap_close(pcap);
+    pcap_close(netif->driver);
+    pcap_close(netif->tx_driver);
+    netif->driver = NULL;
+    netif->tx_driver = NULL;
 }
@@ -6,58 +6,99 @@
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 收到数据包的网卡
  * @param buf 要处理的数据包
  */
-void ethernet_in(buf_t *buf)
+void ethernet_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf)
 {
+    netif->stats.rx_packets++;
+    netif->stats.rx_bytes += buf->len;
     // 检查数据包长度，若小于以太网头部长度则丢弃
-    if(buf->len < sizeof(ether_hdr_t)) return ;
+    if(buf->len < sizeof(ether_hdr_t)){
+        netif->stats.rx_dropped++;
+        return ;
+    }
 
     ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
 
     buf_remove_header(buf, sizeof(ether_hdr_t));
 
-    net_in(buf, swap16(hdr->protocol16), hdr->src);
+    if(net_in(ctx, netif, buf, swap16(hdr->protocol16), hdr->src) < 0)
+        netif->stats.rx_dropped++;
 }
 /**
  * @brief 处理一个要发送的数据包
  * 
+ * @param netif 出口网卡
  * @param buf 要处理的数据包
  * @param mac 目标MAC地址
  * @param protocol 上层协议
  */
-void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
+void ethernet_out(netif_t *netif, buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
+{
+    ether_hdr_t hdr;
+    memcpy(hdr.dst, mac, NET_MAC_LEN);
+    memcpy(hdr.src, netif->mac, NET_MAC_LEN);
+    hdr.protocol16 = swap16(protocol);
+    ethernet_out_hdr(netif, buf, &hdr);
+}
+
+/**
+ * @brief 使用已构造好的以太网头发送数据包，供缓存了头部模板的上层快速路径使用
+ * 
+ * @param netif 出口网卡
+ * @param buf 要发送的数据包
+ * @param hdr 以太网头模板
+ */
+void ethernet_out_hdr(netif_t *netif, buf_t *buf, const ether_hdr_t *hdr)
 {
     if(buf->len < ETHERNET_MIN_TRANSPORT_UNIT){
         buf_add_padding(buf, ETHERNET_MIN_TRANSPORT_UNIT - buf->len);
     }
 
     buf_add_header(buf, sizeof(ether_hdr_t));
+    memcpy(buf->data, hdr, sizeof(ether_hdr_t));
 
-    ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
-    memcpy(hdr->dst, mac, NET_MAC_LEN);
-    memcpy(hdr->src, net_if_mac, NET_MAC_LEN);
-    // *hdr->dst = *mac;
-    // *hdr->src = *net_if_mac;
-    hdr->protocol16 = swap16(protocol);
-
-    driver_send(buf);
+    net_lock(&netif->tx_lock);
+    int ret = driver_send(netif, buf);
+    net_unlock(&netif->tx_lock);
+    if(ret < 0){
+        netif->stats.tx_errors++;
+        return;
+    }
+    netif->stats.tx_packets++;
+    netif->stats.tx_bytes += buf->len;
 }
+
 /**
- * @brief 初始化以太网协议
+ * @brief 发送一批已封装好以太网头的帧，只取一次发送锁，由驱动一次发出
  * 
+ * @param netif 出口网卡
+ * @param frames 要发送的帧，长度不小于以太网最小帧长
+ * @param num 帧数
  */
-void ethernet_init()
+void ethernet_out_many(netif_t *netif, const ether_frame_t *frames, int num)
 {
-    buf_init(&rxbuf, ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+    net_lock(&netif->tx_lock);
+    int sent = driver_send_many(netif, frames, num);
+    net_unlock(&netif->tx_lock);
+    netif->stats.tx_errors += num - sent;
+    netif->stats.tx_packets += sent;
+    for (int i = 0; i < sent; i++)
+        netif->stats.tx_bytes += frames[i].len;
 }
-
 /**
- * @brief 一次以太网轮询
+ * @brief 一次以太网轮询，依次尝试从每个网卡接收一个数据包
  * 
+ * @param ctx 协议栈上下文，收到的数据包放在其接收缓冲区中
  */
-void ethernet_poll()
+void ethernet_poll(net_ctx_t *ctx)
 {
-    if (driver_recv(&rxbuf) > 0)
-        ethernet_in(&rxbuf);
+    for (int i = 0; i < net_if_num; i++)
+    {
+        netif_t *netif = &net_ifs[i];
+        if (driver_recv(netif, &ctx->rxbuf) > 0)
+            ethernet_in(ctx, netif, &ctx->rxbuf);
+    }
 }
@@ -1,85 +1,44 @@
 #include "http.h"
-#include "tcp.h"
+#include "sock.h"
+#include "coro.h"
 #include "net.h"
-#include "assert.h"
 
-#define TCP_FIFO_SIZE 40
+#define HTTP_BACKLOG 128 //accept队列长度，来不及取走的连接在队列中等待
 
-typedef struct http_fifo {
-    tcp_connect_t* buffer[TCP_FIFO_SIZE];
-    uint8_t front, tail, count;
-} http_fifo_t;
+static sock_t* http_sock;
+static coro_sched_t http_sched; // 每个连接一个协程，读写暂时无法进行时让出，慢客户端不会阻塞其他连接
 
-static http_fifo_t http_fifo_v;
-
-static void http_fifo_init(http_fifo_t* fifo) {
-    fifo->count = 0;
-    fifo->front = 0;
-    fifo->tail = 0;
-}
-
-static int http_fifo_in(http_fifo_t* fifo, tcp_connect_t* tcp) {
-    if (fifo->count >= TCP_FIFO_SIZE) {
-        return -1;
-    }
-    fifo->buffer[fifo->front] = tcp;
-    fifo->front++;
-    if (fifo->front >= TCP_FIFO_SIZE) {
-        fifo->front = 0;
-    }
-    fifo->count++;
-    return 0;
-}
-
-static tcp_connect_t* http_fifo_out(http_fifo_t* fifo) {
-    if (fifo->count == 0) {
-        return NULL;
-    }
-    tcp_connect_t* tcp = fifo->buffer[fifo->tail];
-    fifo->tail++;
-    if (fifo->tail >= TCP_FIFO_SIZE) {
-        fifo->tail = 0;
-    }
-    fifo->count--;
-    return tcp;
-}
-
-static size_t get_line(tcp_connect_t* tcp, char* buf, size_t size) {
+static size_t get_line(coro_t* co, sock_t* sock, char* buf, size_t size) {
     size_t i = 0;
     while (i < size) {
         char c;
-        if (tcp_connect_read(tcp, (uint8_t*)&c, 1) > 0) {
-            if (c == '\n') {
-                break;
-            }
-            if (c != '\n' && c != '\r') {
-                buf[i] = c;
-                i++;
-            }
+        if (coro_read(co, sock, (uint8_t*)&c, 1) <= 0) {
+            break;
+        }
+        if (c == '\n') {
+            break;
+        }
+        if (c != '\n' && c != '\r') {
+            buf[i] = c;
+            i++;
         }
-        net_poll();
     }
     buf[i] = '\0';
     return i;
 }
 
-static size_t http_send(tcp_connect_t* tcp, const char* buf, size_t size) {
-    size_t send = 0;
-    while (send < size) {
-        send += tcp_connect_write(tcp, (const uint8_t*)buf + send, size - send);
-        net_poll();
-    }
-    return send;
+static size_t http_send(coro_t* co, sock_t* sock, const char* buf, size_t size) {
+    return coro_write(co, sock, (const uint8_t*)buf, size) < 0 ? 0 : size;
 }
 
-static void close_http(tcp_connect_t* tcp) {
-    tcp_connect_close(tcp);
+static void close_http(sock_t* sock) {
+    sock_close(sock);
     printf("http closed.\n");
 }
 
 
 
-static void send_file(tcp_connect_t* tcp, const char* url) {
+static void send_file(coro_t* co, sock_t* sock, const char* url) {
     FILE* file;
     uint32_t size;
     const char* content_type = "text/html";
@@ -110,7 +69,7 @@ static void send_file(tcp_connect_t* tcp, const char* url) {
         strcat(tx_buffer, "Sever: \r\n");
         strcat(tx_buffer, "Content-Type: text/html\r\n");
         strcat(tx_buffer, "\r\n");
-        http_send(tcp, tx_buffer, strlen(tx_buffer));
+        http_send(co, sock, tx_buffer, strlen(tx_buffer));
         return;
     }
     // 准备HTTP报头
@@ -119,82 +78,86 @@ static void send_file(tcp_connect_t* tcp, const char* url) {
     strcat(tx_buffer, "Sever: \r\n");
     strcat(tx_buffer, "Content-Type: \r\n");
     strcat(tx_buffer, "\r\n");
-    http_send(tcp, tx_buffer, strlen(tx_buffer));
+    http_send(co, sock, tx_buffer, strlen(tx_buffer));
     // 读取文件并发送
     memset(tx_buffer, 0, sizeof(tx_buffer));
     while(fread(tx_buffer, sizeof(char), sizeof(tx_buffer), file) > 0){
-        http_send(tcp, tx_buffer, sizeof(tx_buffer));
+        http_send(co, sock, tx_buffer, sizeof(tx_buffer));
         memset(tx_buffer, 0, sizeof(tx_buffer));
     }
     // 发送完毕后关闭文件
     fclose(file);
 }
 
-static void http_handler(tcp_connect_t* tcp, connect_state_t state) {
-    if (state == TCP_CONN_CONNECTED) {
-        http_fifo_in(&http_fifo_v, tcp);
-        printf("http conntected.\n");
-    } else if (state == TCP_CONN_DATA_RECV) {
-    } else if (state == TCP_CONN_CLOSED) {
-        printf("http closed.\n");
-    } else {
-        assert(0);
+// 处理一个HTTP连接，读写暂时无法进行时让出，其他连接继续处理。
+
+static void http_conn(coro_t* co, void* arg) {
+    sock_t* sock = arg;
+    char url_path[255];
+    char rx_buffer[1024];
+    int i = 0;
+    char* c = rx_buffer;
+    /*
+    1、调用get_line从rx_buffer中获取一行数据，如果没有数据，则调用close_http关闭连接
+    */
+    if (get_line(co, sock, c, 100) == 0) {
+        close_http(sock);
+        return;
     }
+    //printf("http_conn: c len:%d, c:%s\n",strlen(c),c);
+    /*
+    2、检查是否有GET请求，如果没有，则调用close_http关闭连接
+    */
+    char method_type[4];
+    memcpy(method_type, c, 3);
+    method_type[3] = '\0';
+    if (strcmp(method_type, "GET") != 0) {
+        close_http(sock);
+        return;
+    }
+    /*
+    3、解析GET请求的路径，注意跳过空格，找到GET请求的文件，调用send_file发送文件
+    */
+    while(c[i+4] != ' ' && c[i+4] != '\0'){
+        url_path[i] = c[i+4];
+        printf("%c",c[i+4]);
+        i++;
+    }
+    url_path[i] = '\0';
+    //printf("http_conn: url_path len:%d, url_path:%s\n",strlen(url_path),url_path);
+    // 塞住发送，报头与文件内容合并成满长度的报文段，最后一段随关闭时的FIN一起发出
+    sock_set_cork(sock, 1);
+    send_file(co, sock, url_path);
+    /*
+    4、调用close_http关掉连接
+    */
+    close_http(sock);
+    printf("!! final close\n");
 }
 
+// 从accept队列取出连接，每个连接交给一个新的协程。
+
+static void http_accept(coro_t* co, void* arg) {
+    sock_t* sock;
+    while ((sock = coro_accept(co, http_sock)) != NULL) {
+        printf("http conntected.\n");
+        if (coro_spawn(&http_sched, http_conn, sock) == NULL)
+            close_http(sock);
+    }
+}
 
 // 在端口上创建服务器。
 
 int http_server_open(uint16_t port) {
-    if (!tcp_open(port, http_handler)) {
+    coro_sched_init(&http_sched);
+    http_sock = sock_listen(&net_main_ctx, port, HTTP_BACKLOG);
+    if (http_sock == NULL)
         return -1;
-    }
-    http_fifo_init(&http_fifo_v);
-    return 0;
+    return coro_spawn(&http_sched, http_accept, NULL) ? 0 : -1;
 }
 
-// 从FIFO取出请求并处理。新的HTTP请求时会发送到FIFO中等待处理。
+// 运行一轮HTTP协程，每次net_poll之后调用。
 
 void http_server_run(void) {
-    tcp_connect_t* tcp;
-    char url_path[255];
-    char rx_buffer[1024];
-
-    while ((tcp = http_fifo_out(&http_fifo_v)) != NULL) {
-        int i = 0, j = 0;
-        char* c = rx_buffer;
-        /*
-        1、调用get_line从rx_buffer中获取一行数据，如果没有数据，则调用close_http关闭tcp，并继续循环
-        */
-        if (get_line(tcp, c, 100) == 0) {
-            close_http(tcp);
-            continue;
-        }
-        //printf("http_server_run: c len:%d, c:%s\n",strlen(c),c);
-        /*
-        2、检查是否有GET请求，如果没有，则调用close_http关闭tcp，并继续循环
-        */
-        char method_type[4];
-        memcpy(method_type, c, 3);
-        if (strcmp(method_type, "GET") != 0) {
-            close_http(tcp);
-            continue;
-        }
-        /*
-        3、解析GET请求的路径，注意跳过空格，找到GET请求的文件，调用send_file发送文件
-        */
-        while(c[i+4] != ' '){
-            url_path[i] = c[i+4];
-            printf("%c",c[i+4]);
-            i++;
-        }
-        url_path[i] = '\0';
-        //printf("http_server_run: url_path len:%d, url_path:%s\n",strlen(url_path),url_path);
-        send_file(tcp, url_path);
-        /*
-        4、调用close_http关掉连接
-        */
-        close_http(tcp);
-        printf("!! final close\n");
-    }
+    coro_sched_run(&http_sched);
 }
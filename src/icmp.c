@@ -10,8 +10,14 @@
  */
 map_t icmp_buf;
 
+/**
+ * @brief 保护icmp_buf，应答由0号工作线程写入、由主循环中的ping读取
+ * 
+ */
+static net_lock_t icmp_lock;
+
 
-void icmp_ping_test(uint8_t* target_ip, int times)
+void icmp_ping_test(net_ctx_t *ctx, uint8_t* target_ip, int times)
 {
     static int pkt_send_num = 0;
     static int pkt_rec_num = 0;
@@ -33,12 +39,13 @@ void icmp_ping_test(uint8_t* target_ip, int times)
     
     if (first_flag) {
         printf("Ping %s %lld bytes of data.\n",iptos(target_ip), sizeof(icmp_hdr_t) + sizeof(struct timeval));
-        icmp_req(target_ip);
+        icmp_req(ctx, target_ip);
         first_flag = 0;
         lasttime = nowtime;
         pkt_send_num++;
         return;
     }
+    net_lock(&icmp_lock);
     buf_t *icmp_in_buf = map_get(&icmp_buf, &pid);
     if (icmp_in_buf != NULL && last_received_flag == 0) {
         last_received_flag = 1;
@@ -51,15 +58,18 @@ void icmp_ping_test(uint8_t* target_ip, int times)
         if (min_use_time_ms > use_time_ms) min_use_time_ms = use_time_ms;
         if (max_use_time_ms < use_time_ms) max_use_time_ms = use_time_ms;
     }
+    net_unlock(&icmp_lock);
     // 收到回复，间隔1s发送ping
     if (nowtime.tv_sec >= lasttime.tv_sec + 1 && last_received_flag) {
         // 从map中删除已接收的报文
+        net_lock(&icmp_lock);
         map_delete(&icmp_buf, &pid);
+        net_unlock(&icmp_lock);
         last_received_flag = 0;
         last_lost_flag = 0;
         // 发送下一个ping
         printf("1 Ping %s %lld bytes of data.\n",iptos(target_ip), sizeof(icmp_hdr_t) + sizeof(struct timeval));
-        icmp_req(target_ip);
+        icmp_req(ctx, target_ip);
         pkt_send_num++;
         lasttime = nowtime;
         return;
@@ -71,7 +81,7 @@ void icmp_ping_test(uint8_t* target_ip, int times)
         last_received_flag = 0;
         // ping
         printf("Ping %s %lld bytes of data.\n",iptos(target_ip), sizeof(icmp_hdr_t) + sizeof(struct timeval));
-        icmp_req(target_ip);
+        icmp_req(ctx, target_ip);
         pkt_send_num++;
         lasttime = nowtime;
         return;
@@ -88,10 +98,11 @@ long get_time_ms_from_now(struct timeval *rec_time)
 /**
  * @brief 发送icmp回显请求
  * 
+ * @param ctx 协议栈上下文
  * @param dst_ip 目标ip地址
  * @return buf_t 发送的ICMP请求数据包
  */
-void icmp_req(uint8_t *dst_ip)
+void icmp_req(net_ctx_t *ctx, uint8_t *dst_ip)
 {
     buf_t buf;
     // 数据包包括ICMP头部 + 时间戳数据
@@ -112,7 +123,7 @@ void icmp_req(uint8_t *dst_ip)
     // 计算校验和
     icmp_hdr_req->checksum16 = checksum16((uint16_t *)buf.data, buf.len);
     // 发送数据包
-    ip_out(&buf, dst_ip, NET_PROTOCOL_ICMP);
+    ip_out(ctx, &buf, dst_ip, NET_PROTOCOL_ICMP);
     seq++;
     return buf;
 }
@@ -120,35 +131,39 @@ void icmp_req(uint8_t *dst_ip)
 /**
  * @brief 发送icmp响应
  * 
+ * @param ctx 协议栈上下文
  * @param req_buf 收到的icmp请求包
  * @param src_ip 源ip地址
  */
-static void icmp_resp(buf_t *req_buf, uint8_t *src_ip)
+static void icmp_resp(net_ctx_t *ctx, buf_t *req_buf, uint8_t *src_ip)
 {
+    buf_t *txbuf = &ctx->txbuf;
     // 直接复制整个请求报文至txbuf，包括报头+数据
     // 然后修改报头为响应报头，此时txbuf中即为数据部分与请求报文相同的响应报文
-    buf_init(&txbuf, req_buf->len);
-    memcpy(txbuf.data, req_buf->data, req_buf->len);
+    buf_init(txbuf, req_buf->len);
+    memcpy(txbuf->data, req_buf->data, req_buf->len);
     // 修改响应报头，其中id和seq与请求报文相同，不用修改
-    icmp_hdr_t *icmp_hdr_resp = (icmp_hdr_t *)txbuf.data;
+    icmp_hdr_t *icmp_hdr_resp = (icmp_hdr_t *)txbuf->data;
     icmp_hdr_resp->type = ICMP_TYPE_ECHO_REPLY;
     icmp_hdr_resp->code = 0;
     // 计算校验和，范围为整个报文
     icmp_hdr_resp->checksum16 = 0;
-    icmp_hdr_resp->checksum16 = checksum16((uint16_t *)txbuf.data, txbuf.len);
+    icmp_hdr_resp->checksum16 = checksum16((uint16_t *)txbuf->data, txbuf->len);
     // 发送数据包
-    ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
+    ip_out(ctx, txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
 
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 收到数据包的网卡
  * @param buf 要处理的数据包
  * @param src_ip 源ip地址
  * 
  * 新增对ICMP应答的处理
  */
-void icmp_in(buf_t *buf, uint8_t *src_ip)
+void icmp_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_ip)
 {
     // 数据包长小于ICMP头部长度，则丢弃不处理
     if (buf->len < sizeof(icmp_hdr_t)) return;
@@ -161,7 +176,7 @@ void icmp_in(buf_t *buf, uint8_t *src_ip)
     // 响应不同类型的ICMP报文
     if (icmp_in->type == ICMP_TYPE_ECHO_REQUEST) {
         // 报文若为回显请求，发送回显应答
-        icmp_resp(buf, src_ip);
+        icmp_resp(ctx, buf, src_ip);
     } else if (icmp_in->type == ICMP_TYPE_ECHO_REPLY) {
         // 报文若为回显应答，按照PING的格式进行打印
         // 获得发送与接收时间
@@ -177,7 +192,9 @@ void icmp_in(buf_t *buf, uint8_t *src_ip)
         rec_time->tv_usec = use_time_usec;
         
         int id = swap16(icmp_in->id16);
+        net_lock(&icmp_lock);
         map_set(&icmp_buf, &id, buf);
+        net_unlock(&icmp_lock);
         
         printf("%lld bytes from %s: ", buf->len, iptos(src_ip));
         printf("icmp_id=%d, icmp_seq=%d, time=%ld ms.\n",swap16(icmp_in->id16), swap16(icmp_in->seq16), time_ms);
@@ -187,30 +204,72 @@ void icmp_in(buf_t *buf, uint8_t *src_ip)
 }
 
 /**
- * @brief 发送icmp不可达
+ * @brief 发送icmp差错报文
  * 
+ * @param ctx 协议栈上下文
  * @param recv_buf 收到的ip数据包
  * @param src_ip 源ip地址
- * @param code icmp code，协议不可达或端口不可达
+ * @param type icmp type
+ * @param code icmp code
+ * @param mtu 需要分片时下一跳的MTU，填在报头的seq字段，见RFC 1191第4节；其他差错为0
  */
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+static void icmp_error(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip, icmp_type_t type, icmp_code_t code, uint16_t mtu)
 {
+    buf_t *txbuf = &ctx->txbuf;
     // 差错报文数据只需包括IP报头与报文前8字节
-    buf_init(&txbuf, sizeof(ip_hdr_t) + 8);
-    memcpy(txbuf.data, recv_buf->data, sizeof(ip_hdr_t) + 8);
+    buf_init(txbuf, sizeof(ip_hdr_t) + 8);
+    memcpy(txbuf->data, recv_buf->data, sizeof(ip_hdr_t) + 8);
     // 添加ICMP报头
-    buf_add_header(&txbuf, sizeof(icmp_hdr_t));
-    icmp_hdr_t *icmp_hdr_unreachable = (icmp_hdr_t *)txbuf.data;
-    icmp_hdr_unreachable->type = ICMP_TYPE_UNREACH;
-    icmp_hdr_unreachable->code = code;
-    // id与seq字段在差错报文中未用，必须为0
-    icmp_hdr_unreachable->id16 = 0;
-    icmp_hdr_unreachable->seq16 = 0;
+    buf_add_header(txbuf, sizeof(icmp_hdr_t));
+    icmp_hdr_t *icmp_hdr_error = (icmp_hdr_t *)txbuf->data;
+    icmp_hdr_error->type = type;
+    icmp_hdr_error->code = code;
+    // id与seq字段在差错报文中未用，必须为0，需要分片的差错在seq字段中给出下一跳MTU
+    icmp_hdr_error->id16 = 0;
+    icmp_hdr_error->seq16 = swap16(mtu);
     // 计算校验和，范围为整个ICMP报文
-    icmp_hdr_unreachable->checksum16 = 0;
-    icmp_hdr_unreachable->checksum16 = checksum16((uint16_t *)txbuf.data, txbuf.len);
+    icmp_hdr_error->checksum16 = 0;
+    icmp_hdr_error->checksum16 = checksum16((uint16_t *)txbuf->data, txbuf->len);
     // 发送数据包
-    ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
+    ip_out(ctx, txbuf, src_ip, NET_PROTOCOL_ICMP);
+}
+
+/**
+ * @brief 发送icmp不可达
+ * 
+ * @param ctx 协议栈上下文
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param code icmp code，协议不可达或端口不可达，需要分片用icmp_frag_needed
+ */
+void icmp_unreachable(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+{
+    icmp_error(ctx, recv_buf, src_ip, ICMP_TYPE_UNREACH, code, 0);
+}
+
+/**
+ * @brief 发送icmp需要分片但设置了DF，附带下一跳MTU供源主机做路径MTU发现
+ * 
+ * @param ctx 协议栈上下文
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param mtu 下一跳的MTU
+ */
+void icmp_frag_needed(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu)
+{
+    icmp_error(ctx, recv_buf, src_ip, ICMP_TYPE_UNREACH, ICMP_CODE_FRAG_NEEDED, mtu);
+}
+
+/**
+ * @brief 发送icmp传输中TTL超时
+ * 
+ * @param ctx 协议栈上下文
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ */
+void icmp_time_exceeded(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip)
+{
+    icmp_error(ctx, recv_buf, src_ip, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0);
 }
 
 /**
@@ -218,6 +277,7 @@ void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
  * 
  */
 void icmp_init(){
+    net_lock_init(&icmp_lock);
     map_init(&icmp_buf, sizeof(uint16_t), sizeof(icmp_hdr_t) + sizeof(struct timeval), 0, 4, NULL);
     net_add_protocol(NET_PROTOCOL_ICMP, icmp_in);
 }
\ No newline at end of file
@@ -3,9 +3,85 @@
 #include "ethernet.h"
 #include "arp.h"
 #include "icmp.h"
+#include "route.h"
 #include "sys/time.h"
 
-map_t ip_defrag_map;
+/**
+ * @brief 分片重组表，每个上下文一份，按ip数据包id索引
+ * 
+ */
+static map_t ip_defrag_map[NET_CTX_NUM];
+
+/**
+ * @brief 目的地缓存，每个上下文一份，按目的ip哈希直接映射，冲突时覆盖旧项
+ * 
+ */
+static ip_dst_t ip_dst_cache[NET_CTX_NUM][IP_DST_CACHE_SIZE];
+
+/**
+ * @brief 目的地缓存当前代数，ARP等变化时递增以使所有上下文的全部缓存项失效
+ * 
+ */
+static net_counter_t ip_dst_gen = 1;
+
+/**
+ * @brief 是否转发目的地址不是本机的数据包
+ * 
+ */
+static int ip_forwarding = 0;
+
+/**
+ * @brief 使全部目的地缓存失效，下一跳或路径发生变化时调用
+ * 
+ */
+void ip_dst_cache_flush()
+{
+    ip_dst_gen++;
+}
+
+/**
+ * @brief 在上下文自己的缓存中查找到目的ip的缓存项，不存在时若下一跳已解析则建立缓存项
+ * 
+ * @param ctx 协议栈上下文
+ * @param ip 目的ip地址
+ * @return ip_dst_t* 缓存项，下一跳未解析时为NULL
+ */
+ip_dst_t *ip_dst_lookup(net_ctx_t *ctx, uint8_t *ip)
+{
+    ip_dst_t *dst = &ip_dst_cache[ctx->id][(ip[0] ^ ip[1] ^ ip[2] ^ ip[3]) & (IP_DST_CACHE_SIZE - 1)];
+    time_t now = time(NULL);
+    uint64_t gen = ip_dst_gen;
+    if (dst->gen == gen && dst->expire >= now && memcmp(dst->ip, ip, NET_IP_LEN) == 0)
+        return dst;
+    // 未命中，查路由表得到出口网卡与下一跳，再查ARP表获取其MAC
+    uint8_t next_hop[NET_IP_LEN];
+    uint8_t mac[NET_MAC_LEN];
+    netif_t *netif = route_lookup(ip, next_hop);
+    if (arp_lookup(next_hop, mac) < 0)
+        return NULL;
+    memcpy(dst->ip, ip, NET_IP_LEN);
+    memcpy(dst->next_hop, next_hop, NET_IP_LEN);
+    dst->netif = netif;
+    // 使用查ARP表之前读到的代数，其间若有刷新该项会在下次查找时重建
+    dst->gen = gen;
+    dst->expire = now + IP_DST_CACHE_TIMEOUT_SEC;
+    dst->mtu = netif->mtu;
+    // 构造以太网头模板
+    memcpy(dst->ether_hdr.dst, mac, NET_MAC_LEN);
+    memcpy(dst->ether_hdr.src, netif->mac, NET_MAC_LEN);
+    dst->ether_hdr.protocol16 = swap16(NET_PROTOCOL_IP);
+    // 构造IP头模板，随报文变化的字段留0
+    memset(&dst->ip_hdr, 0, sizeof(ip_hdr_t));
+    dst->ip_hdr.version = IP_VERSION_4;
+    dst->ip_hdr.hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+    dst->ip_hdr.ttl = IP_DEFALUT_TTL;
+    memcpy(dst->ip_hdr.dst_ip, ip, NET_IP_LEN);
+    memcpy(dst->ip_hdr.src_ip, netif->ip, NET_IP_LEN);
+    // 预先累加模板中不变的16位字：第0字及源、目的IP，第4字(ttl与协议)随协议变化不计入
+    uint16_t *p = (uint16_t *)&dst->ip_hdr;
+    dst->hdr_sum = p[0] + p[6] + p[7] + p[8] + p[9];
+    return dst;
+}
 
 /**
  * @brief 将node插入queue对应位置中
@@ -37,9 +113,11 @@ ipq_t* ip_defrag_insert(ipq_t *queue, ipq_t *node)
 /**
  * @brief 将已集齐所有分片的ipq链表组合为完整数据包向上层发送
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 数据包所属网卡
  * @param queue 已按offset排序的所有分片到齐的ipq链表
 */
-void ip_defrag(ipq_t *queue, int len, uint8_t protocol, uint8_t *src_ip)
+void ip_defrag(net_ctx_t *ctx, netif_t *netif, ipq_t *queue, int len, uint8_t protocol, uint8_t *src_ip)
 {
     // 准备数据包
     buf_t buf;
@@ -52,7 +130,7 @@ void ip_defrag(ipq_t *queue, int len, uint8_t protocol, uint8_t *src_ip)
     }
     memcpy(buf.data + p->offset, p->data, p->len);
     // 向上层传递
-    net_in(&buf, protocol, src_ip);
+    net_in(ctx, netif, &buf, protocol, src_ip);
 }
 
 /**
@@ -83,9 +161,11 @@ int is_defrag_over(ipq_t *queue)
 /**
  * @brief 传入分片的IP数据包，若分片到齐则重组并传至上层；维护
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 数据包所属网卡
  * @param buf_frag 已去除IP报头的数据包
  */
-void ip_frag_in(buf_t *buf_frag, uint8_t *src_ip, net_protocol_t protocol, uint16_t id, uint16_t offset, int mf)
+void ip_frag_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf_frag, uint8_t *src_ip, net_protocol_t protocol, uint16_t id, uint16_t offset, int mf)
 {
     // 为传入的分片新建节点
     ipq_t *new_node = (ipq_t *)malloc(sizeof(ipq_t));
@@ -98,10 +178,10 @@ void ip_frag_in(buf_t *buf_frag, uint8_t *src_ip, net_protocol_t protocol, uint1
     gettimeofday(&new_node->time, NULL);
 
     // 查找id是否已有分片
-    ipq_t *ip_defrag_queue = (ipq_t *)map_get(&ip_defrag_map, &id);
+    ipq_t *ip_defrag_queue = (ipq_t *)map_get(&ip_defrag_map[ctx->id], &id);
     if (ip_defrag_queue == NULL) {
         // 收到的为该id第一个分片，新建ipq队列装入map
-        map_set(&ip_defrag_map, &id, new_node);
+        map_set(&ip_defrag_map[ctx->id], &id, new_node);
         // 存入map会复制数据，清理node所占空间（但data所未被复制，其空间不可清理）
         free(new_node);
     } else {
@@ -111,7 +191,7 @@ void ip_frag_in(buf_t *buf_frag, uint8_t *src_ip, net_protocol_t protocol, uint1
         int len = is_defrag_over(queue);
         if (len > 0) {
             // 若是，重组完整的数据包并传入上层，并清理queue占用空间(除队头外，其会在map_delete得到删除)
-            ip_defrag(queue, len, protocol, src_ip);
+            ip_defrag(ctx, netif, queue, len, protocol, src_ip);
             ipq_t *p = queue->next, *next;
             while (p != NULL) {
                 next = p->next;
@@ -120,23 +200,173 @@ void ip_frag_in(buf_t *buf_frag, uint8_t *src_ip, net_protocol_t protocol, uint1
                 p = next;
             }
             free(queue->data);
-            map_delete(&ip_defrag_map, &id);
+            map_delete(&ip_defrag_map[ctx->id], &id);
         } else {
             // 否则将queue存入map
-            map_set(&ip_defrag_map, &id, queue);
+            map_set(&ip_defrag_map[ctx->id], &id, queue);
         }
     }
     
 }
 
 
+/**
+ * @brief 内部函数，获取到目的ip的路径MTU，缓存未命中时查路由取出口网卡的MTU，与命中时一致
+ * 
+ * @param dst 目的地缓存项，可以为NULL
+ * @param ip 目的ip地址
+ * @return int MTU
+ */
+static int ip_dst_mtu(ip_dst_t *dst, uint8_t *ip)
+{
+    if (dst)
+        return dst->mtu;
+    uint8_t next_hop[NET_IP_LEN];
+    return route_lookup(ip, next_hop)->mtu;
+}
+
+/**
+ * @brief 内部函数，把报头已处理好的转发数据包送往下一跳
+ * 
+ * @param ctx 协议栈上下文
+ * @param buf 要转发的ip数据包
+ * @param dst 目的地缓存项，为NULL则查路由后交由arp发送
+ */
+static void ip_forward_xmit(net_ctx_t *ctx, buf_t *buf, ip_dst_t *dst)
+{
+    if (dst) {
+        ethernet_out_hdr(dst->netif, buf, &dst->ether_hdr);
+    } else {
+        uint8_t next_hop[NET_IP_LEN];
+        netif_t *out = route_lookup(((ip_hdr_t *)buf->data)->dst_ip, next_hop);
+        arp_out(ctx, out, buf, next_hop);
+    }
+}
+
+/**
+ * @brief 内部函数，把超过出口MTU且没有设置DF的转发数据包分片发出。
+ *        各分片沿用原报头的源地址、标识与TTL，偏移在原偏移上累加，原数据包本身是带MF的分片时最后一片也保留MF
+ * 
+ * @param ctx 协议栈上下文，分片在其发送缓冲区中封装
+ * @param buf 要转发的ip数据包，TTL已经减一
+ * @param mtu 出口MTU
+ * @param dst 目的地缓存项，可以为NULL
+ */
+static void ip_forward_fragment(net_ctx_t *ctx, buf_t *buf, int mtu, ip_dst_t *dst)
+{
+    uint8_t hdr[15 * IP_HDR_LEN_PER_BYTE];
+    int hdr_len = ((ip_hdr_t *)buf->data)->hdr_len * IP_HDR_LEN_PER_BYTE;
+    memcpy(hdr, buf->data, hdr_len);
+    uint16_t flags_fragment = swap16(((ip_hdr_t *)hdr)->flags_fragment16);
+    size_t offset = (flags_fragment & 0x1fff) * IP_HDR_OFFSET_PER_BYTE;
+    int mf = flags_fragment & IP_MORE_FRAGMENT;
+    size_t fragment_size = (mtu - hdr_len) & ~(IP_HDR_OFFSET_PER_BYTE - 1);
+    buf_remove_header(buf, hdr_len);
+    buf_t *txbuf = &ctx->txbuf;
+    for (size_t done = 0; done < buf->len; done += fragment_size) {
+        size_t len = buf->len - done < fragment_size ? buf->len - done : fragment_size;
+        buf_init(txbuf, len);
+        memcpy(txbuf->data, buf->data + done, len);
+        buf_add_header(txbuf, hdr_len);
+        memcpy(txbuf->data, hdr, hdr_len);
+        ip_hdr_t *ip_hdr_out = (ip_hdr_t *)txbuf->data;
+        ip_hdr_out->total_len16 = swap16(txbuf->len);
+        int more = mf || done + len < buf->len;
+        ip_hdr_out->flags_fragment16 = swap16((more ? IP_MORE_FRAGMENT : 0) | (offset + done) / IP_HDR_OFFSET_PER_BYTE);
+        ip_hdr_out->hdr_checksum16 = 0;
+        ip_hdr_out->hdr_checksum16 = checksum16((uint16_t *)ip_hdr_out, hdr_len);
+        ip_forward_xmit(ctx, txbuf, dst);
+    }
+}
+
+/**
+ * @brief 判断转发失败时能否为该数据包回送ICMP差错报文
+ *        按RFC 1122 3.2.2与RFC 1812 4.3.2.7，非首个分片、ICMP差错报文本身、
+ *        源地址为全0/广播/组播的数据包都不回送差错报文
+ * 
+ * @param buf 要转发的数据包，包含IP报头
+ * @return int 可以回送返回1，否则返回0
+ */
+static int ip_icmp_error_allowed(buf_t *buf)
+{
+    ip_hdr_t *ip_hdr = (ip_hdr_t *)buf->data;
+    int hdr_len = ip_hdr->hdr_len * IP_HDR_LEN_PER_BYTE;
+    if (swap16(ip_hdr->flags_fragment16) & 0x1fff) return 0;
+    if (ip_hdr->src_ip[0] >= 224 || memcmp(ip_hdr->src_ip, "\0\0\0\0", NET_IP_LEN) == 0) return 0;
+    if (ip_hdr->protocol == NET_PROTOCOL_ICMP && buf->len > hdr_len) {
+        switch (buf->data[hdr_len]) {
+        case ICMP_TYPE_UNREACH:
+        case ICMP_TYPE_SOURCE_QUENCH:
+        case ICMP_TYPE_REDIRECT:
+        case ICMP_TYPE_TIME_EXCEEDED:
+        case ICMP_TYPE_PARAM_PROBLEM:
+            return 0;
+        default:
+            break;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief 转发一个目的地址不是本机的数据包，不做重组，分片原样转发
+ * 
+ * @param ctx 协议栈上下文
+ * @param buf 要转发的数据包，包含IP报头
+ */
+static void ip_forward(net_ctx_t *ctx, buf_t *buf)
+{
+    ip_hdr_t *ip_hdr_in = (ip_hdr_t *)buf->data;
+    // 不转发广播与组播
+    if (ip_hdr_in->dst_ip[0] >= 224) return;
+    // TTL耗尽，丢弃并按需通知源主机
+    if (ip_hdr_in->ttl <= 1) {
+        if (ip_icmp_error_allowed(buf))
+            icmp_time_exceeded(ctx, buf, ip_hdr_in->src_ip);
+        return;
+    }
+    // TTL减一，按RFC 1624增量更新校验和：HC' = ~(~HC + ~m + m')
+    uint16_t *ttl_word = (uint16_t *)&ip_hdr_in->ttl;
+    uint16_t old_word = *ttl_word;
+    ip_hdr_in->ttl--;
+    uint32_t checksum = (uint16_t)~ip_hdr_in->hdr_checksum16 + (uint16_t)~old_word + *ttl_word;
+    while (checksum > 0xffff)
+        checksum = (checksum >> 16) + (checksum & 0xffff);
+    ip_hdr_in->hdr_checksum16 = ~(uint16_t)checksum;
+    // 经路由与ARP送往下一跳，缓存命中时直接使用其以太网头
+    ip_dst_t *dst = ip_dst_lookup(ctx, ip_hdr_in->dst_ip);
+    int mtu = ip_dst_mtu(dst, ip_hdr_in->dst_ip);
+    if (buf->len <= mtu) {
+        ip_forward_xmit(ctx, buf, dst);
+        return;
+    }
+    // 设置了DF时丢弃并按需把下一跳MTU告诉源主机，否则分片转发
+    if (swap16(ip_hdr_in->flags_fragment16) & IP_DONT_FRAGMENT) {
+        if (ip_icmp_error_allowed(buf))
+            icmp_frag_needed(ctx, buf, ip_hdr_in->src_ip, mtu);
+    } else
+        ip_forward_fragment(ctx, buf, mtu, dst);
+}
+
+/**
+ * @brief 开启或关闭ip转发
+ * 
+ * @param enable 非0为开启
+ */
+void ip_forward_set(int enable)
+{
+    ip_forwarding = enable;
+}
+
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 收到数据包的网卡
  * @param buf 要处理的数据包
  * @param src_mac 源mac地址
  */
-void ip_in(buf_t *buf, uint8_t *src_mac)
+void ip_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_mac)
 {
     // 判断数据包是否合法
     if (buf->len < sizeof(ip_hdr_t)) return;
@@ -153,10 +383,14 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
     ip_hdr_in->hdr_checksum16 = 0;
     if (checksum_received != checksum16((uint16_t *)ip_hdr_in, hdr_len)) return;
     ip_hdr_in->hdr_checksum16 = checksum_received;
-    // 检验数据包目标IP是否为本机IP
-    if (memcmp(ip_hdr_in->dst_ip, net_if_ip, NET_IP_LEN) != 0) return;
     // 判断数据包是否存在填充，若是则剔除填充
     if (buf->len > total_len) buf_remove_padding(buf, buf->len - total_len);
+    // 检验数据包目标IP是否为本机任一网卡的IP，不是则按需转发
+    netif_t *local = net_if_find(ip_hdr_in->dst_ip);
+    if (local == NULL) {
+        if (ip_forwarding) ip_forward(ctx, buf);
+        return;
+    }
     // 识别协议，合法的包括ICMP=1,TCP=6,UDP=17，否则发送ICMP协议不可达
     if (ip_hdr_in->protocol == NET_PROTOCOL_UDP ||
         ip_hdr_in->protocol == NET_PROTOCOL_TCP ||
@@ -166,30 +400,49 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
         int offset = (flags_fragment & 0x1fff)<< 3;
         buf_remove_header(buf, hdr_len);
         if (mf > 0 || offset > 0) {
-            ip_frag_in(buf, ip_hdr_in->src_ip, ip_hdr_in->protocol, id, offset, mf);
+            ip_frag_in(ctx, local, buf, ip_hdr_in->src_ip, ip_hdr_in->protocol, id, offset, mf);
         } else {
-            net_in(buf, ip_hdr_in->protocol, ip_hdr_in->src_ip);
+            // 向上层传递目的地址所属的网卡，上层据此确定本端地址
+            net_in(ctx, local, buf, ip_hdr_in->protocol, ip_hdr_in->src_ip);
         }
     } else {
-        icmp_unreachable(buf, ip_hdr_in->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+        icmp_unreachable(ctx, buf, ip_hdr_in->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
     }
 }
 
 /**
- * @brief 处理一个要发送的ip分片
+ * @brief 内部函数，封装并发送一个ip分片
  * 
+ * @param ctx 协议栈上下文
  * @param buf 要发送的分片
  * @param ip 目标ip地址
  * @param protocol 上层协议
  * @param id 数据包id
  * @param offset 分片offset，必须被8整除
  * @param mf 分片mf标志，是否有下一个分片
+ * @param dst 目的地缓存项，为NULL则逐字段构造报头并交由arp发送
+ * @param src_ip 源ip地址，为NULL时使用出口网卡的地址
  */
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+static void ip_fragment_xmit(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf, ip_dst_t *dst,
+                             const uint8_t *src_ip)
 {
     // 添加IP报头空间
     buf_add_header(buf, sizeof(ip_hdr_t));
     ip_hdr_t *ip_hdr_out = (ip_hdr_t *)buf->data;
+    if (dst) {
+        // 命中缓存：拷贝模板，只填写随报文变化的字段，校验和在模板累加和上补充这些字段
+        ip_dst_hdr(dst, ip_hdr_out, buf->len, id, mf ? IP_MORE_FRAGMENT | (offset >> 3) : offset >> 3, protocol);
+        // 上层指定了出口网卡以外的源地址（如连接建立在另一块网卡的地址上），改写后重算校验和
+        if (src_ip && memcmp(src_ip, ip_hdr_out->src_ip, NET_IP_LEN) != 0) {
+            memcpy(ip_hdr_out->src_ip, src_ip, NET_IP_LEN);
+            ip_hdr_out->hdr_checksum16 = 0;
+            ip_hdr_out->hdr_checksum16 = checksum16((uint16_t *)ip_hdr_out, sizeof(ip_hdr_t));
+        }
+        ethernet_out_hdr(dst->netif, buf, &dst->ether_hdr);
+        return;
+    }
+    uint8_t next_hop[NET_IP_LEN];
+    netif_t *netif = route_lookup(ip, next_hop);
     // 填充IP报头
     ip_hdr_out->version = IP_VERSION_4;
     ip_hdr_out->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
@@ -200,33 +453,73 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     ip_hdr_out->ttl = IP_DEFALUT_TTL;
     ip_hdr_out->protocol = protocol;
     memcpy(ip_hdr_out->dst_ip, ip, NET_IP_LEN);
-    memcpy(ip_hdr_out->src_ip, net_if_ip, NET_IP_LEN);
+    memcpy(ip_hdr_out->src_ip, src_ip ? src_ip : netif->ip, NET_IP_LEN);
     // 校验和先填0，计算出结果后再填入字段
     ip_hdr_out->hdr_checksum16 = 0;
     ip_hdr_out->hdr_checksum16 = checksum16((uint16_t *)ip_hdr_out, sizeof(ip_hdr_t));
     // 发送封装好的数据包
-    arp_out(buf, ip);
+    arp_out(ctx, netif, buf, next_hop);
+}
+
+/**
+ * @brief 处理一个要发送的ip分片
+ * 
+ * @param ctx 协议栈上下文
+ * @param buf 要发送的分片
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ * @param id 数据包id
+ * @param offset 分片offset，必须被8整除
+ * @param mf 分片mf标志，是否有下一个分片
+ */
+void ip_fragment_out(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+{
+    ip_fragment_xmit(ctx, buf, ip, protocol, id, offset, mf, ip_dst_lookup(ctx, ip), NULL);
+}
+
+/**
+ * @brief 处理一个要发送的ip数据包，源地址为出口网卡的地址
+ * 
+ * @param ctx 协议栈上下文，数据包id取自其中
+ * @param buf 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void ip_out(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+    ip_out_src(ctx, buf, ip, protocol, NULL);
 }
 
 /**
- * @brief 处理一个要发送的ip数据包
+ * @brief 以指定的源地址发送一个ip数据包，出口仍按路由选择。
+ *        上层校验和的伪头部含本端地址时（如TCP连接）须用这个函数，保证报头的源地址与校验和一致
  * 
+ * @param ctx 协议栈上下文，数据包id取自其中
  * @param buf 要处理的包
  * @param ip 目标ip地址
  * @param protocol 上层协议
+ * @param src_ip 源ip地址，为NULL时使用出口网卡的地址
  */
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+void ip_out_src(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol, const uint8_t *src_ip)
 {   
-    int fragment_size = ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t);
-    static int id = 0;
+    // 每个数据包只查一次目的地缓存，各分片共用
+    ip_dst_t *dst = ip_dst_lookup(ctx, ip);
+    int mtu = ip_dst_mtu(dst, ip);
+    int fragment_size = (mtu - sizeof(ip_hdr_t)) & ~(IP_HDR_OFFSET_PER_BYTE - 1);
+    int id = ctx->ip_id++;
     int offset = 0; // 已发送的分片数，实际字节偏移量需乘fragment_size
     buf_t ip_buf;
     
+    // 不需分片时直接在原buf上添加报头发送，省去一次拷贝
+    if (buf->len <= fragment_size) {
+        ip_fragment_xmit(ctx, buf, ip, protocol, id, 0, 0, dst, src_ip);
+        return;
+    }
     while (buf->len > fragment_size) {
         // 分片发送，每片数据长度为MTU - IP报头长度（本实验中IP报头始终为20bytes）
         buf_init(&ip_buf, fragment_size);
         memcpy(ip_buf.data, buf->data, fragment_size);
-        ip_fragment_out(&ip_buf, ip, protocol, id, offset * fragment_size ,1);
+        ip_fragment_xmit(ctx, &ip_buf, ip, protocol, id, offset * fragment_size ,1, dst, src_ip);
         offset++;
         // 剔除已发送部分
         buf_remove_header(buf, fragment_size);
@@ -234,8 +527,7 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
     // 发送占用不满的数据包（或分片最后剩余部分）
     buf_init(&ip_buf, buf->len);
     memcpy(ip_buf.data, buf->data, buf->len);
-    ip_fragment_out(&ip_buf, ip, protocol, id, offset * fragment_size, 0);
-    id++;
+    ip_fragment_xmit(ctx, &ip_buf, ip, protocol, id, offset * fragment_size, 0, dst, src_ip);
 }
 
 /**
@@ -244,6 +536,7 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
  */
 void ip_init()
 {
-    map_init(&ip_defrag_map, sizeof(uint16_t), sizeof(ipq_t), 0, 0, NULL);
+    for (int i = 0; i < NET_CTX_NUM; i++)
+        map_init(&ip_defrag_map[i], sizeof(uint16_t), sizeof(ipq_t), 0, 0, NULL);
     net_add_protocol(NET_PROTOCOL_IP, ip_in);
 }
\ No newline at end of file
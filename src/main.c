@@ -6,24 +6,30 @@
 #include "time.h"
 #include "icmp.h"
 
+#if defined(HTTP) && defined(NET_MULTICORE)
+#error "HTTP服务器的协程调度器只服务0号上下文，而多核模式下TCP连接都由工作线程的上下文处理，不能与NET_MULTICORE同时开启"
+#endif
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat="
 #pragma GCC diagnostic ignored "-Wformat-extra-args"
 
 
 #ifdef UDP
-void udp_handler(uint8_t* data, size_t len, uint8_t* src_ip, uint16_t src_port) 
+void udp_handler(net_ctx_t* ctx, uint8_t* data, size_t len, uint8_t* src_ip, uint16_t src_port) 
 {
     printf("recv udp packet from %s:%u len=%zu\n", iptos(src_ip), src_port, len);
     for (int i = 0; i < len; i++)
         putchar(data[i]);
     putchar('\n');
-    udp_send(data, len, 60000, src_ip, src_port); //发送udp包
+    udp_send(ctx, data, len, 60000, src_ip, src_port); //发送udp包
 }
 #endif
 
 #ifdef TCP
 void tcp_handler(tcp_connect_t* connect, connect_state_t state) {
+    if (state != TCP_CONN_DATA_RECV)
+        return;
     uint8_t buf[512];
     size_t len = tcp_connect_read(connect, buf, sizeof(buf) - 1);
     buf[len] = 0;
@@ -61,7 +67,7 @@ int main(int argc, char const *argv[])
         // 测试ICMP请求
         // 每隔1秒发送ICMP请求，共4次
         static uint8_t target_ip[NET_IP_LEN] = {192,168,56,1};
-        icmp_ping_test(target_ip, 4);
+        icmp_ping_test(&net_main_ctx, target_ip, 4);
         // 节约用电
         struct timespec sleepTime = { 0, 1000000 };
         nanosleep(&sleepTime, NULL);
@@ -139,14 +139,15 @@ void map_delete(map_t *map, const void *key)
  * @brief 遍历map
  * 
  * @param map 要遍历的map
- * @param handler 对每个键值对应用的回调函数，参数为（键指针，值指针，更新时间指针）
+ * @param handler 对每个键值对应用的回调函数，参数为（键指针，值指针，更新时间指针，arg）
+ * @param arg 原样传给handler的参数
  */
-void map_foreach(map_t *map, map_entry_handler_t handler)
+void map_foreach(map_t *map, map_entry_handler_t handler, void *arg)
 {
     for (size_t i = 0; i < map->max_size; i++)
     {
         uint8_t *entry = map_entry_get(map, i);
         if (map_entry_valid(map, entry))
-            handler(entry, entry + map->key_len, (time_t *)(entry + map->key_len + map->value_len));
+            handler(entry, entry + map->key_len, (time_t *)(entry + map->key_len + map->value_len), arg);
     }
 }
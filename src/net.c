@@ -1,3 +1,4 @@
+#include <assert.h>
 #include "net.h"
 #include "driver.h"
 #include "ethernet.h"
@@ -6,6 +7,8 @@
 #include "icmp.h"
 #include "udp.h"
 #include "tcp.h"
+#include "route.h"
+#include "worker.h"
 
 /**
  * @brief 协议表 <协议号,处理程序>的容器
@@ -14,38 +17,125 @@
 map_t net_table;
 
 /**
- * @brief 网卡MAC地址
+ * @brief 网卡表，0号为config.h中配置的默认网卡
  * 
  */
-uint8_t net_if_mac[NET_MAC_LEN] = NET_IF_MAC;
+netif_t net_ifs[NET_IF_MAX] = {
+    {.index = 0, .mac = NET_IF_MAC, .ip = NET_IF_IP, .prefix_len = NET_IF_PREFIX_LEN, .mtu = ETHERNET_MAX_TRANSPORT_UNIT},
+};
 
 /**
- * @brief 网卡IP地址
+ * @brief 已添加的网卡数
  * 
  */
-uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
+int net_if_num = 1;
 
 /**
- * @brief 网卡接收和发送缓冲区
+ * @brief 主循环使用的协议栈上下文
  * 
  */
-buf_t rxbuf, txbuf; //一个buf足够单线程使用
+net_ctx_t net_main_ctx;
 
 /**
- * @brief 初始化协议栈
+ * @brief 初始化一个协议栈上下文，上下文较大，工作线程可将其放在自己的栈上。
+ *        上下文只划分了连接表、目的地缓存、分片重组表等按编号索引的状态，ARP与ICMP的共享表由锁保护，
+ *        但接收句柄只有一个且收到的帧需按流分发，所以多个上下文只能经worker_dispatch并行运行，不能各自轮询网卡
  * 
+ * @param ctx 要初始化的上下文
+ * @param id 上下文编号，0号为主循环，其余为工作线程
+ */
+void net_ctx_init(net_ctx_t *ctx, int id)
+{
+    assert(id >= 0 && id < NET_CTX_NUM);
+    ctx->id = id;
+    // 各上下文的ip数据包id从不同区间开始，减少发往同一目的地的id冲突
+    ctx->ip_id = id * (UINT16_MAX / NET_CTX_NUM + 1);
+    buf_init(&ctx->rxbuf, ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+    buf_init(&ctx->txbuf, 0);
+    ctx->now = time_ms();
+    timer_wheel_init(&ctx->timers, ctx->now);
+}
+
+/**
+ * @brief 在默认网卡之外再添加一个网卡，须在net_init之前调用
+ * 
+ * @param ip 网卡ip地址
+ * @param mac 网卡mac地址
+ * @param prefix_len 子网前缀长度
+ * @return netif_t* 添加的网卡，失败为NULL
+ */
+netif_t *net_if_add(const uint8_t *ip, const uint8_t *mac, uint8_t prefix_len)
+{
+    if (net_if_num == NET_IF_MAX)
+        return NULL;
+    netif_t *netif = &net_ifs[net_if_num];
+    memset(netif, 0, sizeof(netif_t));
+    netif->index = net_if_num++;
+    memcpy(netif->ip, ip, NET_IP_LEN);
+    memcpy(netif->mac, mac, NET_MAC_LEN);
+    netif->prefix_len = prefix_len;
+    netif->mtu = ETHERNET_MAX_TRANSPORT_UNIT;
+    return netif;
+}
+
+/**
+ * @brief 查找拥有指定ip地址的网卡
+ * 
+ * @param ip ip地址
+ * @return netif_t* 网卡，不是本机地址为NULL
+ */
+netif_t *net_if_find(const uint8_t *ip)
+{
+    for (int i = 0; i < net_if_num; i++)
+        if (memcmp(net_ifs[i].ip, ip, NET_IP_LEN) == 0)
+            return &net_ifs[i];
+    return NULL;
+}
+
+/**
+ * @brief 打印所有网卡及其收发统计
+ * 
+ */
+void net_if_print()
+{
+    printf("===NET IF BEGIN===\n");
+    for (int i = 0; i < net_if_num; i++)
+    {
+        netif_t *netif = &net_ifs[i];
+        printf("%d | %s/%d | ", netif->index, iptos(netif->ip), netif->prefix_len);
+        printf("%s | mtu %d | %s\n", mactos(netif->mac), netif->mtu, netif->name);
+        printf("  rx %llu pkts %llu bytes %llu dropped | tx %llu pkts %llu bytes %llu errors\n",
+               (unsigned long long)netif->stats.rx_packets, (unsigned long long)netif->stats.rx_bytes,
+               (unsigned long long)netif->stats.rx_dropped, (unsigned long long)netif->stats.tx_packets,
+               (unsigned long long)netif->stats.tx_bytes, (unsigned long long)netif->stats.tx_errors);
+    }
+    printf("===NET IF  END ===\n");
+}
+
+/**
+ * @brief 初始化协议栈，多核模式下同时启动工作线程，应用须在第一次net_poll之前注册好端口
+ * 
+ * @return int 成功为0，失败为-1
  */
 int net_init()
 {
     map_init(&net_table, sizeof(uint16_t), sizeof(net_handler_t), 0, 0, NULL);
-    if (driver_open() == -1)
-        return -1;
+    net_ctx_init(&net_main_ctx, 0);
+    for (int i = 0; i < net_if_num; i++)
+    {
+        net_lock_init(&net_ifs[i].tx_lock);
+        if (driver_open(&net_ifs[i]) == -1)
+            return -1;
+    }
 #ifdef ETHERNET
-    ethernet_init();
 #ifdef ARP
     arp_init();
 #ifdef IP
+    route_init();
     ip_init();
+#ifdef IP_FORWARD
+    ip_forward_set(1);
+#endif
 #ifdef ICMP
     icmp_init();
 #endif
@@ -53,10 +143,15 @@ int net_init()
     udp_init();
 #endif
 #ifdef TCP
-    tcp_init();
+    if (tcp_init() != 0)
+        return -1;
 #endif
 #endif
 #endif
+#endif
+#ifdef NET_MULTICORE
+    if (worker_start() != 0)
+        return -1;
 #endif
     return 0;
 }
@@ -75,29 +170,59 @@ void net_add_protocol(uint16_t protocol, net_handler_t handler)
 /**
  * @brief 向协议栈的上层协议传递数据包
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 数据包所属网卡
  * @param buf 要传递的数据包
  * @param protocol 上层协议号
  * @param src 源的本层协议地址，如mac或ip地址
  * @return int 成功为0，失败为-1
  */
-int net_in(buf_t *buf, uint16_t protocol, uint8_t *src)
+int net_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint16_t protocol, uint8_t *src)
 {
     net_handler_t *handler = map_get(&net_table, &protocol);
     if (handler)
     {
-        (*handler)(buf, src);
+        (*handler)(ctx, netif, buf, src);
         return 0;
     }
     return -1;
 }
 
 /**
- * @brief 一次协议栈轮询
+ * @brief 更新上下文的当前时间并运行到期的定时器
  * 
+ * @param ctx 协议栈上下文
  */
-void net_poll()
+void net_ctx_tick(net_ctx_t *ctx)
 {
+    ctx->now = time_ms();
+    timer_wheel_run(&ctx->timers, ctx->now, ctx);
+}
+
+#ifndef NET_MULTICORE
+/**
+ * @brief 内部函数，单核模式下使用指定上下文进行一次协议栈轮询，直接从网卡接收，只能由主循环调用
+ * 
+ * @param ctx 协议栈上下文
+ */
+static void net_ctx_poll(net_ctx_t *ctx)
+{
+    net_ctx_tick(ctx);
 #ifdef ETHERNET
-    ethernet_poll();
+    ethernet_poll(ctx);
+#endif
+}
+#endif
+
+/**
+ * @brief 一次协议栈轮询，多核模式下只接收数据包并分发给工作线程
+ * 
+ */
+void net_poll()
+{
+#ifdef NET_MULTICORE
+    worker_dispatch(&net_main_ctx);
+#else
+    net_ctx_poll(&net_main_ctx);
 #endif
 }
\ No newline at end of file
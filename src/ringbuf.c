@@ -0,0 +1,187 @@
+#include <string.h>
+#include "ringbuf.h"
+
+/**
+ * @brief 初始化环形缓冲区并分配空间
+ *
+ * @param ring 要初始化的缓冲区
+ * @param size 容量，会向上取整到2的幂
+ * @return int 成功为0，内存不足为-1
+ */
+int ringbuf_init(ringbuf_t *ring, uint32_t size)
+{
+    memset(ring, 0, sizeof(ringbuf_t));
+    return ringbuf_resize(ring, size);
+}
+
+/**
+ * @brief 改变容量，已缓存的数据保留并从新缓冲区开头排列，写指针之后用ringbuf_write_at写入的数据也一并保留
+ *        仅在自动调整缓冲区大小时调用，收发数据的路径上不会移动数据
+ *
+ * @param ring 缓冲区
+ * @param size 新容量，会向上取整到2的幂，不能小于已缓存的字节数
+ * @return int 成功为0，内存不足或容量不够为-1
+ */
+int ringbuf_resize(ringbuf_t *ring, uint32_t size)
+{
+    size = ringbuf_roundup(size);
+    uint32_t len = ringbuf_len(ring);
+    if (size < len)
+        return -1;
+    if (size == ring->size)
+        return 0;
+    uint8_t *data = malloc(size);
+    if (data == NULL)
+        return -1;
+    // 按读指针起的逻辑顺序拷贝旧缓冲区的全部内容，而不只是已缓存的部分
+    uint32_t keep = ring->size < size ? ring->size : size;
+    if (keep)
+    {
+        uint32_t pos = ring->head & (ring->size - 1);
+        uint32_t first = ring->size - pos;
+        if (first > keep)
+            first = keep;
+        memcpy(data, ring->data + pos, first);
+        memcpy(data + first, ring->data, keep - first);
+    }
+    free(ring->data);
+    ring->data = data;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = len;
+    return 0;
+}
+
+/**
+ * @brief 释放缓冲区空间
+ *
+ * @param ring 缓冲区
+ */
+void ringbuf_free(ringbuf_t *ring)
+{
+    free(ring->data);
+    memset(ring, 0, sizeof(ringbuf_t));
+}
+
+/**
+ * @brief 写入数据，空间不足时只写入能放下的部分
+ *
+ * @param ring 缓冲区
+ * @param data 数据
+ * @param len 数据长度
+ * @return uint32_t 写入的字节数
+ */
+uint32_t ringbuf_write(ringbuf_t *ring, const uint8_t *data, uint32_t len)
+{
+    uint32_t space = ringbuf_space(ring);
+    if (len > space)
+        len = space;
+    if (len == 0)
+        return 0;
+    uint32_t pos = ring->tail & (ring->size - 1);
+    uint32_t first = ring->size - pos;
+    if (first > len)
+        first = len;
+    memcpy(ring->data + pos, data, first);
+    memcpy(ring->data, data + first, len - first);
+    ring->tail += len;
+    return len;
+}
+
+/**
+ * @brief 在写指针后offset字节处写入数据，不移动写指针，用于先存放乱序到达的数据
+ *        超出剩余空间的部分被丢弃
+ *
+ * @param ring 缓冲区
+ * @param offset 相对写指针的偏移
+ * @param data 数据
+ * @param len 数据长度
+ * @return uint32_t 写入的字节数
+ */
+uint32_t ringbuf_write_at(ringbuf_t *ring, uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    uint32_t space = ringbuf_space(ring);
+    if (offset >= space)
+        return 0;
+    if (len > space - offset)
+        len = space - offset;
+    uint32_t pos = (ring->tail + offset) & (ring->size - 1);
+    uint32_t first = ring->size - pos;
+    if (first > len)
+        first = len;
+    memcpy(ring->data + pos, data, first);
+    memcpy(ring->data, data + first, len - first);
+    return len;
+}
+
+/**
+ * @brief 把写指针之后已经用ringbuf_write_at写好的数据计入缓存
+ *
+ * @param ring 缓冲区
+ * @param len 字节数，超出剩余空间时截断
+ * @return uint32_t 计入的字节数
+ */
+uint32_t ringbuf_commit(ringbuf_t *ring, uint32_t len)
+{
+    uint32_t space = ringbuf_space(ring);
+    if (len > space)
+        len = space;
+    ring->tail += len;
+    return len;
+}
+
+/**
+ * @brief 从读指针后offset字节处拷贝数据，不移动读指针
+ *
+ * @param ring 缓冲区
+ * @param offset 相对读指针的偏移
+ * @param data 输出缓冲区
+ * @param len 最多拷贝的字节数
+ * @return uint32_t 拷贝的字节数
+ */
+uint32_t ringbuf_peek(const ringbuf_t *ring, uint32_t offset, uint8_t *data, uint32_t len)
+{
+    uint32_t avail = ringbuf_len(ring);
+    if (offset >= avail)
+        return 0;
+    if (len > avail - offset)
+        len = avail - offset;
+    uint32_t pos = (ring->head + offset) & (ring->size - 1);
+    uint32_t first = ring->size - pos;
+    if (first > len)
+        first = len;
+    memcpy(data, ring->data + pos, first);
+    memcpy(data + first, ring->data, len - first);
+    return len;
+}
+
+/**
+ * @brief 读出数据并移动读指针
+ *
+ * @param ring 缓冲区
+ * @param data 输出缓冲区
+ * @param len 最多读出的字节数
+ * @return uint32_t 读出的字节数
+ */
+uint32_t ringbuf_read(ringbuf_t *ring, uint8_t *data, uint32_t len)
+{
+    len = ringbuf_peek(ring, 0, data, len);
+    ring->head += len;
+    return len;
+}
+
+/**
+ * @brief 丢弃开头的数据
+ *
+ * @param ring 缓冲区
+ * @param len 最多丢弃的字节数
+ * @return uint32_t 丢弃的字节数
+ */
+uint32_t ringbuf_drop(ringbuf_t *ring, uint32_t len)
+{
+    uint32_t avail = ringbuf_len(ring);
+    if (len > avail)
+        len = avail;
+    ring->head += len;
+    return len;
+}
@@ -0,0 +1,139 @@
+#include <string.h>
+#include <stdio.h>
+#include "route.h"
+#include "ip.h"
+
+/**
+ * @brief 路由表，按最长前缀匹配查找
+ * 
+ */
+static route_entry_t route_table[ROUTE_MAX_NUM];
+
+/**
+ * @brief 全0地址，网关为此值表示直连
+ * 
+ */
+static const uint8_t route_zero_ip[NET_IP_LEN] = {0};
+
+/**
+ * @brief 初始化路由表，为每个网卡添加其子网的直连路由
+ * 
+ */
+void route_init()
+{
+    memset(route_table, 0, sizeof(route_table));
+    for (int i = 0; i < net_if_num; i++)
+        route_add(net_ifs[i].ip, net_ifs[i].prefix_len, NULL, &net_ifs[i]);
+}
+
+/**
+ * @brief 添加或更新一条路由
+ * 
+ * @param dst 目的网络
+ * @param prefix_len 前缀长度，0为默认路由
+ * @param gateway 网关地址，NULL或全0表示直连
+ * @param netif 出口网卡，为NULL则按网关所在的直连网段选取
+ * @return int 成功为0，失败为-1
+ */
+int route_add(uint8_t *dst, uint8_t prefix_len, uint8_t *gateway, netif_t *netif)
+{
+    if (prefix_len > 32)
+        return -1;
+    if (netif == NULL)
+    {
+        uint8_t next_hop[NET_IP_LEN];
+        netif = route_lookup(gateway ? gateway : dst, next_hop);
+    }
+    route_entry_t *free_entry = NULL;
+    for (size_t i = 0; i < ROUTE_MAX_NUM; i++)
+    {
+        route_entry_t *entry = &route_table[i];
+        if (!entry->valid)
+        {
+            if (free_entry == NULL)
+                free_entry = entry;
+            continue;
+        }
+        if (entry->prefix_len == prefix_len && ip_prefix_match(entry->dst, dst) >= prefix_len)
+        {
+            free_entry = entry;
+            break;
+        }
+    }
+    if (free_entry == NULL)
+        return -1;
+    memcpy(free_entry->dst, dst, NET_IP_LEN);
+    memcpy(free_entry->gateway, gateway ? gateway : route_zero_ip, NET_IP_LEN);
+    free_entry->prefix_len = prefix_len;
+    free_entry->netif = netif;
+    free_entry->valid = 1;
+    // 下一跳可能变化，缓存的目的地失效
+    ip_dst_cache_flush();
+    return 0;
+}
+
+/**
+ * @brief 删除一条路由
+ * 
+ * @param dst 目的网络
+ * @param prefix_len 前缀长度
+ */
+void route_delete(uint8_t *dst, uint8_t prefix_len)
+{
+    for (size_t i = 0; i < ROUTE_MAX_NUM; i++)
+    {
+        route_entry_t *entry = &route_table[i];
+        if (entry->valid && entry->prefix_len == prefix_len && ip_prefix_match(entry->dst, dst) >= prefix_len)
+        {
+            entry->valid = 0;
+            ip_dst_cache_flush();
+        }
+    }
+}
+
+/**
+ * @brief 查找到目的ip的出口网卡与下一跳
+ * 
+ * @param ip 目的ip地址
+ * @param next_hop 出口参数，下一跳ip地址，直连或无匹配路由时即为目的ip本身
+ * @return netif_t* 出口网卡，无匹配路由时为默认网卡
+ */
+netif_t *route_lookup(uint8_t *ip, uint8_t *next_hop)
+{
+    route_entry_t *best = NULL;
+    for (size_t i = 0; i < ROUTE_MAX_NUM; i++)
+    {
+        route_entry_t *entry = &route_table[i];
+        if (entry->valid && ip_prefix_match(entry->dst, ip) >= entry->prefix_len &&
+            (best == NULL || entry->prefix_len > best->prefix_len))
+            best = entry;
+    }
+    if (best == NULL)
+    {
+        memcpy(next_hop, ip, NET_IP_LEN);
+        return net_if_default;
+    }
+    if (memcmp(best->gateway, route_zero_ip, NET_IP_LEN) == 0)
+        memcpy(next_hop, ip, NET_IP_LEN);
+    else
+        memcpy(next_hop, best->gateway, NET_IP_LEN);
+    return best->netif;
+}
+
+/**
+ * @brief 打印路由表
+ * 
+ */
+void route_print()
+{
+    printf("===ROUTE TABLE BEGIN===\n");
+    for (size_t i = 0; i < ROUTE_MAX_NUM; i++)
+    {
+        route_entry_t *entry = &route_table[i];
+        if (!entry->valid)
+            continue;
+        printf("%s/%d | ", iptos(entry->dst), entry->prefix_len);
+        printf("%s | if %d\n", iptos(entry->gateway), entry->netif->index);
+    }
+    printf("===ROUTE TABLE  END ===\n");
+}
@@ -0,0 +1,80 @@
+#include <string.h>
+#include "siphash.h"
+
+#define ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+/**
+ * @brief 按小端序读取8字节
+ *
+ * @param p 数据
+ * @return uint64_t
+ */
+static uint64_t siphash_load64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+/**
+ * @brief 一轮SipRound
+ *
+ * @param v 内部状态
+ */
+static inline void siphash_round(uint64_t v[4])
+{
+    v[0] += v[1];
+    v[1] = ROTL64(v[1], 13);
+    v[1] ^= v[0];
+    v[0] = ROTL64(v[0], 32);
+    v[2] += v[3];
+    v[3] = ROTL64(v[3], 16);
+    v[3] ^= v[2];
+    v[0] += v[3];
+    v[3] = ROTL64(v[3], 21);
+    v[3] ^= v[0];
+    v[2] += v[1];
+    v[1] = ROTL64(v[1], 17);
+    v[1] ^= v[2];
+    v[2] = ROTL64(v[2], 32);
+}
+
+/**
+ * @brief SipHash-2-4，带密钥的64位散列。输入短时很快，不知道密钥就无法预测或构造碰撞，
+ *        用于初始序号、SYN cookie等需要对外保密的散列值
+ *
+ * @param key 128位密钥
+ * @param data 数据
+ * @param len 数据长度
+ * @return uint64_t 散列值
+ */
+uint64_t siphash(const uint8_t key[SIPHASH_KEY_LEN], const void *data, size_t len)
+{
+    const uint8_t *in = data;
+    uint64_t k0 = siphash_load64(key), k1 = siphash_load64(key + 8);
+    uint64_t v[4] = {k0 ^ 0x736f6d6570736575ull, k1 ^ 0x646f72616e646f6dull, k0 ^ 0x6c7967656e657261ull,
+                     k1 ^ 0x7465646279746573ull};
+    const uint8_t *end = in + (len & ~(size_t)7);
+    for (; in != end; in += 8)
+    {
+        uint64_t m = siphash_load64(in);
+        v[3] ^= m;
+        siphash_round(v);
+        siphash_round(v);
+        v[0] ^= m;
+    }
+    // 最后不足8字节的部分补零，最高字节是长度的低8位
+    uint8_t tail[8] = {0};
+    memcpy(tail, in, len & 7);
+    tail[7] = (uint8_t)len;
+    uint64_t m = siphash_load64(tail);
+    v[3] ^= m;
+    siphash_round(v);
+    siphash_round(v);
+    v[0] ^= m;
+    v[2] ^= 0xff;
+    for (int i = 0; i < 4; i++)
+        siphash_round(v);
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "slab.h"
+
+/**
+ * @brief 初始化分配器，此时不申请内存
+ *
+ * @param slab 要初始化的分配器
+ * @param obj_size 对象大小
+ * @param chunk_objs 每次向系统申请的对象个数
+ */
+void slab_init(slab_t *slab, size_t obj_size, size_t chunk_objs)
+{
+    if (obj_size < sizeof(void *))
+        obj_size = sizeof(void *);
+    memset(slab, 0, sizeof(slab_t));
+    slab->obj_size = (obj_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    slab->chunk_objs = chunk_objs ? chunk_objs : 1;
+}
+
+/**
+ * @brief 内部函数，申请一个新块并把其中的对象全部挂到空闲链表上
+ *
+ * @param slab 分配器
+ * @return int 成功为0，内存不足为-1
+ */
+static int slab_grow(slab_t *slab)
+{
+    // 块头部存放下一块的指针，对象紧随其后
+    uint8_t *chunk = malloc(sizeof(void *) + slab->obj_size * slab->chunk_objs);
+    if (chunk == NULL)
+        return -1;
+    *(void **)chunk = slab->chunks;
+    slab->chunks = chunk;
+    uint8_t *obj = chunk + sizeof(void *);
+    for (size_t i = 0; i < slab->chunk_objs; i++, obj += slab->obj_size)
+    {
+        *(void **)obj = slab->free_list;
+        slab->free_list = obj;
+    }
+    slab->total += slab->chunk_objs;
+    return 0;
+}
+
+/**
+ * @brief 分配一个清零的对象
+ *
+ * @param slab 分配器
+ * @return void* 对象指针，内存不足为NULL
+ */
+void *slab_alloc(slab_t *slab)
+{
+    if (slab->free_list == NULL && slab_grow(slab) < 0)
+        return NULL;
+    void *obj = slab->free_list;
+    slab->free_list = *(void **)obj;
+    slab->used++;
+    memset(obj, 0, slab->obj_size);
+    return obj;
+}
+
+/**
+ * @brief 归还一个对象，块内存不归还给系统，留给之后的分配复用
+ *
+ * @param slab 分配器
+ * @param obj 由slab_alloc分配的对象
+ */
+void slab_free(slab_t *slab, void *obj)
+{
+    if (obj == NULL)
+        return;
+    *(void **)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->used--;
+}
+
+/**
+ * @brief 释放全部块，之前分配的对象全部失效
+ *
+ * @param slab 分配器
+ */
+void slab_destroy(slab_t *slab)
+{
+    void *chunk = slab->chunks;
+    while (chunk)
+    {
+        void *next = *(void **)chunk;
+        free(chunk);
+        chunk = next;
+    }
+    slab_init(slab, slab->obj_size, slab->chunk_objs);
+}
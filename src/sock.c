@@ -0,0 +1,420 @@
+#include <limits.h>
+#include "sock.h"
+#include "slab.h"
+
+#define SOCK_SLAB_CHUNK 256 //句柄每次向系统申请的个数
+
+/**
+ * @brief 句柄分配器，每个上下文一个，多核模式下各工作线程互不干扰
+ *
+ */
+static slab_t sock_slab[NET_CTX_NUM];
+
+/**
+ * @brief 内部函数，在上下文中分配一个清零的句柄
+ *
+ * @param ctx 协议栈上下文
+ * @param type 句柄类型
+ * @return sock_t* 新句柄，内存不足为NULL
+ */
+static sock_t *sock_new(net_ctx_t *ctx, sock_type_t type)
+{
+    slab_t *slab = &sock_slab[ctx->id];
+    if (slab->obj_size == 0)
+        slab_init(slab, sizeof(sock_t), SOCK_SLAB_CHUNK);
+    sock_t *sock = slab_alloc(slab);
+    if (sock == NULL)
+        return NULL;
+    memset(sock, 0, sizeof(sock_t));
+    sock->type = type;
+    sock->ctx = ctx;
+    return sock;
+}
+
+/**
+ * @brief 内部函数，把句柄加到等待集就绪链表的末尾
+ *
+ * @param poll 等待集
+ * @param sock 不在链表中的句柄
+ */
+static void sock_ready_append(sock_poll_t *poll, sock_t *sock)
+{
+    sock->ready = 1;
+    sock->ready_next = NULL;
+    sock->ready_prev = poll->tail;
+    if (poll->tail)
+        poll->tail->ready_next = sock;
+    else
+        poll->head = sock;
+    poll->tail = sock;
+    poll->num++;
+}
+
+/**
+ * @brief 内部函数，把句柄从等待集的就绪链表中摘下
+ *
+ * @param poll 等待集
+ * @param sock 在链表中的句柄
+ */
+static void sock_ready_unlink(sock_poll_t *poll, sock_t *sock)
+{
+    if (sock->ready_prev)
+        sock->ready_prev->ready_next = sock->ready_next;
+    else
+        poll->head = sock->ready_next;
+    if (sock->ready_next)
+        sock->ready_next->ready_prev = sock->ready_prev;
+    else
+        poll->tail = sock->ready_prev;
+    sock->ready = 0;
+    sock->ready_prev = sock->ready_next = NULL;
+    poll->num--;
+}
+
+/**
+ * @brief 内部函数，句柄的状态变化后调用，关注的事件已就绪时加入就绪链表
+ *
+ * @param sock 句柄
+ */
+static void sock_notify(sock_t *sock)
+{
+    if (sock->poll && !sock->ready && (sock_events(sock) & (sock->events | SOCK_EV_HUP)))
+        sock_ready_append(sock->poll, sock);
+}
+
+/**
+ * @brief 句柄持有的连接的回调函数。连接释放时把没读走的接收缓存留在句柄中，
+ *        句柄关闭后连接的user为NULL，之后的回调直接忽略
+ *
+ * @param connect 连接
+ * @param state 事件
+ */
+static void sock_tcp_handler(tcp_connect_t *connect, connect_state_t state)
+{
+    sock_t *sock = connect->user;
+    if (sock == NULL)
+        return;
+    if (state == TCP_CONN_CLOSED)
+    {
+        sock->rest = connect->rx_buf;
+        memset(&connect->rx_buf, 0, sizeof(ringbuf_t));
+        connect->user = NULL;
+        sock->connect = NULL;
+        sock->hup = 1;
+    }
+    sock_notify(sock);
+}
+
+/**
+ * @brief 监听端口的accept队列由空变为非空时调用
+ *
+ * @param listen 监听端口
+ * @param ctx 完成握手的上下文
+ */
+static void sock_listen_ready(tcp_listen_t *listen, net_ctx_t *ctx)
+{
+    sock_t *sock = listen->user;
+    if (sock->ctx == ctx)
+        sock_notify(sock);
+}
+
+/**
+ * @brief udp套接字的接收队列由空变为非空时调用
+ *
+ * @param socket udp套接字
+ * @param ctx 收到数据报的上下文
+ */
+static void sock_udp_ready(udp_socket_t *socket, net_ctx_t *ctx)
+{
+    sock_t *sock = socket->user;
+    if (sock->ctx == ctx)
+        sock_notify(sock);
+}
+
+/**
+ * @brief 初始化等待集
+ *
+ * @param poll 要初始化的等待集
+ */
+void sock_poll_init(sock_poll_t *poll)
+{
+    memset(poll, 0, sizeof(sock_poll_t));
+}
+
+/**
+ * @brief 打开监听句柄，握手完成的连接在accept队列中等待sock_accept取走
+ *
+ * @param ctx 协议栈上下文，只接受在这个上下文中完成握手的连接
+ * @param port 端口号
+ * @param backlog accept队列的长度上限，须大于0
+ * @return sock_t* 监听句柄，端口已被占用或内存不足为NULL
+ */
+sock_t *sock_listen(net_ctx_t *ctx, uint16_t port, uint32_t backlog)
+{
+    sock_t *sock = sock_new(ctx, SOCK_TCP_LISTEN);
+    if (sock == NULL)
+        return NULL;
+    sock->listen = tcp_listen(port, backlog ? backlog : 1, sock_tcp_handler, sock_listen_ready);
+    if (sock->listen == NULL)
+    {
+        slab_free(&sock_slab[ctx->id], sock);
+        return NULL;
+    }
+    sock->listen->user = sock;
+    return sock;
+}
+
+/**
+ * @brief 从监听句柄取走一个握手已完成的连接
+ *
+ * @param sock 监听句柄
+ * @return sock_t* 连接句柄，没有等待的连接或内存不足为NULL，内存不足时连接留在队列中
+ */
+sock_t *sock_accept(sock_t *sock)
+{
+    if (sock->type != SOCK_TCP_LISTEN || sock->listen->queue[sock->ctx->id].head == NULL)
+        return NULL;
+    sock_t *conn = sock_new(sock->ctx, SOCK_TCP);
+    if (conn == NULL)
+        return NULL;
+    conn->connect = tcp_accept(sock->ctx, sock->listen);
+    conn->connect->user = conn;
+    return conn;
+}
+
+/**
+ * @brief 主动打开连接，连接建立后句柄变为可写，被拒绝或超时时报告SOCK_EV_HUP
+ *
+ * @param ctx 协议栈上下文
+ * @param ip 对端ip
+ * @param port 对端端口
+ * @return sock_t* 连接句柄，没有可用的本地端口或内存不足为NULL
+ */
+sock_t *sock_connect(net_ctx_t *ctx, uint8_t *ip, uint16_t port)
+{
+    sock_t *sock = sock_new(ctx, SOCK_TCP);
+    if (sock == NULL)
+        return NULL;
+    sock->connect = tcp_connect(ctx, ip, port, sock_tcp_handler);
+    if (sock->connect == NULL)
+    {
+        slab_free(&sock_slab[ctx->id], sock);
+        return NULL;
+    }
+    sock->connect->user = sock;
+    return sock;
+}
+
+/**
+ * @brief 打开udp句柄，到达端口的数据报在接收队列中等待sock_recvmmsg批量取走
+ *
+ * @param ctx 协议栈上下文，只接收在这个上下文中收到的数据报
+ * @param port 端口号
+ * @return sock_t* udp句柄，端口已有udp句柄或内存不足为NULL
+ */
+sock_t *sock_udp(net_ctx_t *ctx, uint16_t port)
+{
+    sock_t *sock = sock_new(ctx, SOCK_UDP);
+    if (sock == NULL)
+        return NULL;
+    sock->udp = udp_socket_open(port, sock_udp_ready);
+    if (sock->udp == NULL)
+    {
+        slab_free(&sock_slab[ctx->id], sock);
+        return NULL;
+    }
+    sock->udp->user = sock;
+    return sock;
+}
+
+/**
+ * @brief 非阻塞读
+ *
+ * @param sock 连接句柄
+ * @param data 读出的数据
+ * @param len 最多读取的字节数
+ * @return int 读到的字节数；对端已关闭且数据已读完为0；暂时没有数据为SOCK_AGAIN；不是TCP连接句柄为SOCK_ERROR
+ */
+int sock_read(sock_t *sock, uint8_t *data, size_t len)
+{
+    if (sock->type != SOCK_TCP)
+        return SOCK_ERROR;
+    if (len > INT_MAX)
+        len = INT_MAX;
+    if (sock->connect == NULL)
+        return ringbuf_read(&sock->rest, data, len);
+    int n = tcp_connect_read(sock->connect, data, len);
+    if (n > 0 || len == 0)
+        return n;
+    tcp_state_t state = sock->connect->state;
+    return state == TCP_CLOSE_WAIT || state == TCP_LAST_ACK ? 0 : SOCK_AGAIN;
+}
+
+/**
+ * @brief 非阻塞写，只写入发送缓存放得下的部分
+ *
+ * @param sock 连接句柄
+ * @param data 要发送的数据
+ * @param len 字节数
+ * @return int 写入的字节数；还在握手或发送缓存已满为SOCK_AGAIN；连接已释放或对端已关闭为SOCK_ERROR
+ */
+int sock_write(sock_t *sock, const uint8_t *data, size_t len)
+{
+    if (sock->type != SOCK_TCP || sock->connect == NULL)
+        return SOCK_ERROR;
+    if (sock->connect->state == TCP_SYN_SEND)
+        return SOCK_AGAIN;
+    if (sock->connect->state != TCP_ESTABLISHED)
+        return SOCK_ERROR;
+    if (len > INT_MAX)
+        len = INT_MAX;
+    int n = tcp_connect_write(sock->connect, data, len);
+    return n > 0 || len == 0 ? n : SOCK_AGAIN;
+}
+
+/**
+ * @brief 塞住或解除塞住连接的发送，见tcp_connect_set_cork
+ *
+ * @param sock 连接句柄，连接已释放时不做处理
+ * @param on 非0为塞住
+ */
+void sock_set_cork(sock_t *sock, int on)
+{
+    if (sock->type == SOCK_TCP && sock->connect)
+        tcp_connect_set_cork(sock->connect, on);
+}
+
+/**
+ * @brief 非阻塞地批量接收数据报
+ *
+ * @param sock udp句柄
+ * @param msgs 接收的数据报，data与len须由调用者填好
+ * @param num msgs的长度
+ * @return int 收到的数据报数；接收队列为空为SOCK_AGAIN；不是udp句柄为SOCK_ERROR
+ */
+int sock_recvmmsg(sock_t *sock, udp_msg_t *msgs, int num)
+{
+    if (sock->type != SOCK_UDP)
+        return SOCK_ERROR;
+    int n = udp_socket_recv(sock->ctx, sock->udp, msgs, num);
+    return n > 0 || num == 0 ? n : SOCK_AGAIN;
+}
+
+/**
+ * @brief 批量发送数据报，udp发送不会阻塞
+ *
+ * @param sock udp句柄
+ * @param msgs 要发送的数据报
+ * @param num msgs的长度
+ * @return int 发送的数据报数，遇到超长的数据报时停止；不是udp句柄为SOCK_ERROR
+ */
+int sock_sendmmsg(sock_t *sock, udp_msg_t *msgs, int num)
+{
+    if (sock->type != SOCK_UDP)
+        return SOCK_ERROR;
+    return udp_socket_send(sock->ctx, sock->udp, msgs, num);
+}
+
+/**
+ * @brief 句柄当前已就绪的事件
+ *
+ * @param sock 句柄
+ * @return uint32_t SOCK_EV_IN、SOCK_EV_OUT、SOCK_EV_HUP的组合
+ */
+uint32_t sock_events(sock_t *sock)
+{
+    if (sock->type == SOCK_TCP_LISTEN)
+        return sock->listen->queue[sock->ctx->id].len ? SOCK_EV_IN : 0;
+    if (sock->type == SOCK_UDP)
+        return (udp_socket_pending(sock->ctx, sock->udp) ? SOCK_EV_IN : 0) | SOCK_EV_OUT;
+    if (sock->connect == NULL)
+        return SOCK_EV_IN | SOCK_EV_HUP;
+    tcp_connect_t *connect = sock->connect;
+    uint32_t events = 0;
+    if (ringbuf_len(&connect->rx_buf) || connect->state == TCP_CLOSE_WAIT || connect->state == TCP_LAST_ACK)
+        events |= SOCK_EV_IN;
+    if (tcp_connect_write_space(connect))
+        events |= SOCK_EV_OUT;
+    return events;
+}
+
+/**
+ * @brief 设置等待集关注句柄的哪些事件，事件已就绪时立即加入就绪链表
+ *
+ * @param poll 等待集
+ * @param sock 句柄，同一时刻只能属于一个等待集
+ * @param events 关注的事件，0表示移出等待集
+ * @param data 应用的私有数据，随事件返回
+ * @return int 成功为0，句柄已属于其他等待集为-1
+ */
+int sock_watch(sock_poll_t *poll, sock_t *sock, uint32_t events, void *data)
+{
+    if (sock->poll && sock->poll != poll)
+        return -1;
+    if (sock->ready)
+        sock_ready_unlink(poll, sock);
+    sock->events = events;
+    sock->data = data;
+    sock->poll = events ? poll : NULL;
+    sock_notify(sock);
+    return 0;
+}
+
+/**
+ * @brief 等待句柄就绪，水平触发：就绪的句柄报告后仍留在就绪链表的末尾，下次等待时再检查，
+ *        不再就绪时才移出，因此没有读完或写完的句柄不会丢失事件，也不会饿死链表后面的句柄。
+ *        等待时轮询主循环的上下文，其他上下文的句柄只能以timeout_ms为0调用
+ *
+ * @param poll 等待集
+ * @param events 就绪的句柄
+ * @param max events的长度
+ * @param timeout_ms 超时时间，毫秒，0为立即返回，负数为一直等待
+ * @return int 就绪的句柄数
+ */
+int sock_wait(sock_poll_t *poll, sock_event_t *events, int max, int timeout_ms)
+{
+    uint64_t deadline = time_ms() + (timeout_ms > 0 ? timeout_ms : 0);
+    while (1)
+    {
+        int n = 0;
+        // 只检查本次等待开始时在链表中的句柄，重新加到末尾的不会在同一次中再被检查
+        for (uint32_t num = poll->num; num > 0 && n < max; num--)
+        {
+            sock_t *sock = poll->head;
+            sock_ready_unlink(poll, sock);
+            uint32_t ready = sock_events(sock) & (sock->events | SOCK_EV_HUP);
+            if (ready == 0)
+                continue;
+            events[n].sock = sock;
+            events[n].events = ready;
+            events[n].data = sock->data;
+            n++;
+            sock_ready_append(poll, sock);
+        }
+        if (n > 0 || timeout_ms == 0 || (timeout_ms > 0 && time_ms() >= deadline))
+            return n;
+        net_poll();
+    }
+}
+
+/**
+ * @brief 关闭句柄，之后sock不可再访问。连接发完剩余数据后关闭，监听端口复位还没取走的连接，udp端口丢弃还没取走的数据报
+ *
+ * @param sock 句柄
+ */
+void sock_close(sock_t *sock)
+{
+    if (sock->poll)
+        sock_watch(sock->poll, sock, 0, NULL);
+    if (sock->type == SOCK_TCP_LISTEN)
+        tcp_listen_close(sock->listen);
+    else if (sock->type == SOCK_UDP)
+        udp_socket_close(sock->udp);
+    else if (sock->connect)
+    {
+        sock->connect->user = NULL;
+        tcp_connect_close(sock->connect);
+    }
+    ringbuf_free(&sock->rest);
+    slab_free(&sock_slab[sock->ctx->id], sock);
+}
@@ -1,7 +1,17 @@
 #include <assert.h>
 #include "map.h"
 #include "tcp.h"
+#include "tcp_hash.h"
+#include "tcp_timewait.h"
+#include "tcp_cc.h"
+#include "siphash.h"
 #include "ip.h"
+#include "route.h"
+#include "worker.h"
+
+#define TCP_DUPACK_THRESH 3 //触发快速重传的重复ACK数
+#define TCP_DELACK_SEGS 2   //收到这么多个报文段后立即确认，不再延迟
+#define TCP_COOKIE_PERIOD_MS (64 * 1000) //SYN cookie计数器的周期，cookie在1到2个周期内有效
 
 static void panic(const char* msg, int line) {
     printf("panic %s! at line %d\n", msg, line);
@@ -21,15 +31,25 @@ static void display_flags(tcp_flags_t flags) {
     );
 }
 
-// dst-port -> handler
-static map_t tcp_table; //tcp_table里面放了一个dst_port的回调函数
+// dst-port -> tcp_listen_t*
+static map_t tcp_table; //tcp_table里面放了dst_port的监听端口，监听端口malloc分配，地址在tcp_close前不变
 
 // tcp_key_t[IP, src port, dst port] -> tcp_connect_t
 
 /* Connect_table放置了一堆TCP连接，
-    KEY为[IP，src port，dst port], 即tcp_key_t，VALUE为tcp_connect_t。
+    KEY为[IP，src port，dst port], 即tcp_key_t，VALUE为slab分配的tcp_connect_t，地址在连接关闭前不变。
+    每个协议栈上下文各有一张，多核模式下同一条流总由同一工作线程处理，各线程只访问自己的那张。
 */
-static map_t connect_table; 
+static tcp_hash_t connect_table[NET_CTX_NUM];
+static tcp_timewait_table_t timewait_table[NET_CTX_NUM]; //各上下文中处于TIME_WAIT的连接，只保存精简记录
+static uint32_t syn_rcvd_num[NET_CTX_NUM]; //各上下文中处于TCP_SYN_RCVD的半连接数
+static uint8_t tcp_secret[SIPHASH_KEY_LEN]; //初始序号、SYN cookie与连接表散列的密钥，启动时随机生成
+static uint64_t listen_bitmap[65536 / 64]; //tcp_table中注册了的端口，分配临时端口时不必逐个查map
+static uint64_t port_bitmap[NET_CTX_NUM][65536 / 64]; //各上下文中主动打开的连接占用的本地端口，每位一个端口
+static uint32_t port_next[NET_CTX_NUM]; //各上下文分配临时端口的次数，加在起始偏移上，同一目的地的连续分配不会从同一处开始
+
+//SYN cookie能编码的MSS，用3位下标表示，取不超过对端MSS的最大值
+static const uint16_t cookie_mss[8] = {TCP_MIN_MSS, 256, 536, 1024, 1220, 1300, 1440, 1460};
 
 /**
  * @brief 生成一个用于 connect_table 的 key
@@ -51,56 +71,432 @@ static tcp_key_t new_tcp_key(uint8_t ip[NET_IP_LEN], uint16_t src_port, uint16_t
  * @brief 初始化tcp在静态区的map
  *        供应用层使用
  *
+ * @return int 成功为0；没有密码学安全的随机数源时为-1，不用可预测的密钥生成初始序号与SYN cookie
  */
-void tcp_init() {
-    map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_handler_t), 0, 0, NULL);
-    map_init(&connect_table, sizeof(tcp_key_t), sizeof(tcp_connect_t), 0, 0, NULL);
+int tcp_init() {
+    map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_listen_t*), 0, 0, NULL);
+    for (int i = 0; i < NET_CTX_NUM; i++) {
+        tcp_hash_init(&connect_table[i]);
+        tcp_timewait_init(&timewait_table[i]);
+    }
+    if (random_bytes(tcp_secret, sizeof(tcp_secret)) != 0) {
+        printf("tcp init: no secure random source\n");
+        return -1;
+    }
     net_add_protocol(NET_PROTOCOL_TCP, tcp_in);
+    return 0;
+}
+
+/**
+ * @brief 在 port 上监听，握手完成的连接放入accept队列，由应用调用tcp_accept按自己的节奏取走。
+ *        队列满时丢弃握手的最后一个ACK，对端重传时再试，已建立的连接不会因为应用来不及处理而被丢弃
+ *        供应用层使用
+ *
+ * @param port 端口
+ * @param backlog 每个上下文accept队列的长度上限，0表示不排队，握手完成即以TCP_CONN_CONNECTED调用handler
+ * @param handler 连接的回调函数，从accept队列取走后才开始调用
+ * @param ready accept队列由空变为非空时调用，可以为NULL
+ * @return tcp_listen_t* 监听端口，端口表已满时为NULL
+ */
+tcp_listen_t* tcp_listen(uint16_t port, uint32_t backlog, tcp_handler_t handler, tcp_listen_handler_t ready) {
+    printf("tcp open\n");
+    tcp_listen_t* listen = calloc(1, sizeof(tcp_listen_t));
+    if (listen == NULL)
+        return NULL;
+    listen->port = port;
+    listen->backlog = backlog;
+    listen->handler = handler;
+    listen->ready = ready;
+    if (map_set(&tcp_table, &port, &listen) < 0) {
+        free(listen);
+        return NULL;
+    }
+    listen_bitmap[port / 64] |= 1ull << (port % 64);
+    return listen;
 }
 
 /**
- * @brief 向 port 注册一个 TCP 连接以及关联的回调函数
+ * @brief 向 port 注册一个 TCP 连接以及关联的回调函数，握手完成即调用回调函数，不排队
  *        供应用层使用
  *
  * @param port
  * @param handler
- * @return int
+ * @return int 成功为0，失败为-1
  */
 int tcp_open(uint16_t port, tcp_handler_t handler) {
-    printf("tcp open\n");
-    return map_set(&tcp_table, &port, &handler);
+    return tcp_listen(port, 0, handler, NULL) ? 0 : -1;
 }
 
 /**
- * @brief 完成了缓存分配工作，状态也会切换为TCP_SYN_RCVD
- *        rx_buf和tx_buf在触及边界时会把数据重新移动到头部，防止溢出。
+ * @brief 在accept队列中等待的连接的回调函数，应用还没取走连接，不通知任何事件，收到的数据留在接收缓存中
  *
  * @param connect
+ * @param state
  */
-static void init_tcp_connect_rcvd(tcp_connect_t* connect) {
-    if (connect->state == TCP_LISTEN) {
-        connect->rx_buf = malloc(sizeof(buf_t));
-        connect->tx_buf = malloc(sizeof(buf_t));
+static void tcp_pending_handler(tcp_connect_t* connect, connect_state_t state) {
+}
+
+/**
+ * @brief 把连接从所在的accept队列中摘下
+ *
+ * @param connect 在队列中的连接
+ */
+static void tcp_accept_unlink(tcp_connect_t* connect) {
+    tcp_accept_queue_t* queue = &connect->listener->queue[connect->ctx->id];
+    if (connect->accept_prev)
+        connect->accept_prev->accept_next = connect->accept_next;
+    else
+        queue->head = connect->accept_next;
+    if (connect->accept_next)
+        connect->accept_next->accept_prev = connect->accept_prev;
+    else
+        queue->tail = connect->accept_prev;
+    connect->accept_prev = connect->accept_next = NULL;
+    connect->queued = 0;
+    queue->len--;
+}
+
+/**
+ * @brief 被动打开的连接握手完成：不排队的监听端口直接调用回调函数，否则放入accept队列，队列由空变为非空时通知应用
+ *
+ * @param connect 刚建立的连接
+ */
+static void tcp_listen_connected(tcp_connect_t* connect) {
+    tcp_listen_t* listen = connect->listener;
+    if (listen->backlog == 0) {
+        listen->handler(connect, TCP_CONN_CONNECTED);
+        return;
     }
-    buf_init(connect->rx_buf, 0);
-    buf_init(connect->tx_buf, 0);
+    tcp_accept_queue_t* queue = &listen->queue[connect->ctx->id];
+    connect->handler = tcp_pending_handler;
+    connect->queued = 1;
+    connect->accept_prev = queue->tail;
+    connect->accept_next = NULL;
+    if (queue->tail)
+        queue->tail->accept_next = connect;
+    else
+        queue->head = connect;
+    queue->tail = connect;
+    if (++queue->len == 1 && listen->ready)
+        listen->ready(listen, connect->ctx);
+}
+
+/**
+ * @brief 监听端口在该上下文中的accept队列是否已满，满时不再完成新的握手
+ *
+ * @param listen 监听端口
+ * @param ctx 协议栈上下文
+ * @return int
+ */
+static int tcp_listen_full(tcp_listen_t* listen, net_ctx_t* ctx) {
+    return listen->backlog && listen->queue[ctx->id].len >= listen->backlog;
+}
+
+/**
+ * @brief 从accept队列取走最早建立的连接，之后的事件通过监听端口的handler通知。
+ *        排队期间收到的数据已在接收缓存中，可以直接读取
+ *        供应用层使用，须在ctx所在的线程中调用
+ *
+ * @param ctx 协议栈上下文
+ * @param listen 监听端口
+ * @return tcp_connect_t* 连接，队列为空时为NULL
+ */
+tcp_connect_t* tcp_accept(net_ctx_t* ctx, tcp_listen_t* listen) {
+    tcp_connect_t* connect = listen->queue[ctx->id].head;
+    if (connect == NULL)
+        return NULL;
+    tcp_accept_unlink(connect);
+    connect->handler = listen->handler;
+    return connect;
+}
+
+/**
+ * @brief 状态切换为TCP_SYN_RCVD并计入半连接数。
+ *        收发缓存推迟到握手完成时才分配，伪造源地址的SYN不会占用缓存
+ *
+ * @param connect
+ */
+static void init_tcp_connect_rcvd(tcp_connect_t* connect) {
+    memset(&connect->rx_buf, 0, sizeof(ringbuf_t));
+    memset(&connect->tx_buf, 0, sizeof(ringbuf_t));
     connect->state = TCP_SYN_RCVD;
+    syn_rcvd_num[connect->ctx->id]++;
+}
+
+/**
+ * @brief 握手完成，离开半连接队列，状态切换为TCP_ESTABLISHED。
+ *        rx_buf和tx_buf是环形缓存，这时才按TCP_BUF_INIT_SIZE分配，之后由tcp_buf_autotune按需增长。
+ *
+ * @param connect
+ */
+static void tcp_connect_established(tcp_connect_t* connect) {
+    if (connect->state == TCP_SYN_RCVD)
+        syn_rcvd_num[connect->ctx->id]--;
+    ringbuf_init(&connect->rx_buf, TCP_BUF_INIT_SIZE);
+    ringbuf_init(&connect->tx_buf, TCP_BUF_INIT_SIZE);
+    connect->state = TCP_ESTABLISHED;
+}
+
+/**
+ * @brief 归还主动打开的连接占用的临时端口
+ *
+ * @param ctx 协议栈上下文
+ * @param port 本地端口
+ */
+static void tcp_port_free(net_ctx_t* ctx, uint16_t port) {
+    port_bitmap[ctx->id][port / 64] &= ~(1ull << (port % 64));
 }
 
 /**
  * @brief 释放TCP连接，这会释放分配的空间，并把状态变回LISTEN。
- *        一般这个后边都会跟个map_delete(&connect_table, &key)把状态变回CLOSED
+ *        一般这个后边都会跟个tcp_hash_delete(&connect_table, &key)把状态变回CLOSED
  *
  * @param connect
  */
 static void release_tcp_connect(tcp_connect_t* connect) {
     if (connect->state == TCP_LISTEN)
         return;
-    free(connect->rx_buf);
-    free(connect->tx_buf);
+    if (connect->state == TCP_SYN_RCVD)
+        syn_rcvd_num[connect->ctx->id]--;
+    timer_cancel(&connect->rto_timer);
+    timer_cancel(&connect->ack_timer);
+    ringbuf_free(&connect->rx_buf);
+    ringbuf_free(&connect->tx_buf);
+    if (connect->active)
+        tcp_port_free(connect->ctx, connect->local_port);
+    if (connect->queued)
+        tcp_accept_unlink(connect);
+    connect->active = 0;
     connect->state = TCP_LISTEN;
 }
 
+/**
+ * @brief 自动调整缓存大小：剩余空间放不下need字节时把容量翻倍到够用，但不超过limit
+ *        容量只增不减，因此只有流量大的连接才会占用大缓存。
+ *
+ * @param ring 收发缓存
+ * @param need 将要写入的字节数
+ * @param limit 容量上限
+ */
+static void tcp_buf_autotune(ringbuf_t* ring, uint32_t need, uint32_t limit) {
+    if (ringbuf_space(ring) >= need || ring->size >= limit)
+        return;
+    uint32_t size = ringbuf_roundup(ringbuf_len(ring) + need);
+    ringbuf_resize(ring, size < limit ? size : limit);
+}
+
+/**
+ * @brief 发送缓存的容量上限，取对端窗口的两倍，使一个窗口在途时应用还能写入下一个窗口
+ *
+ * @param connect
+ * @return uint32_t
+ */
+static uint32_t tcp_tx_buf_limit(tcp_connect_t* connect) {
+    if (connect->remote_win >= TCP_BUF_MAX_SIZE / 2) return TCP_BUF_MAX_SIZE;
+    uint32_t limit = ringbuf_roundup(2 * connect->remote_win);
+    if (limit < TCP_BUF_INIT_SIZE) return TCP_BUF_INIT_SIZE;
+    if (limit > TCP_BUF_MAX_SIZE) return TCP_BUF_MAX_SIZE;
+    return limit;
+}
+
+/**
+ * @brief 本端使用的窗口扩大因子：使接收缓存的上限能用16位窗口字段表示
+ *
+ * @return uint8_t
+ */
+static uint8_t tcp_rcv_wscale() {
+    uint8_t shift = 0;
+    while (shift < TCP_WSCALE_MAX && (TCP_BUF_MAX_SIZE >> shift) > UINT16_MAX)
+        shift++;
+    return shift;
+}
+
+/**
+ * @brief 本端通告的接收窗口：接收缓存还能增长到的剩余空间，按窗口扩大因子右移。
+ *        已读出的数据越多窗口越大，窗口右沿只会前移
+ *
+ * @param connect
+ * @param syn 是否为SYN报文段，SYN中的窗口不扩大
+ * @return uint16_t
+ */
+static uint16_t tcp_rcv_window(tcp_connect_t* connect, int syn) {
+    uint32_t free = TCP_BUF_MAX_SIZE - ringbuf_len(&connect->rx_buf);
+    if (!syn)
+        free >>= connect->rcv_wscale;
+    return free > UINT16_MAX ? UINT16_MAX : free;
+}
+
+/**
+ * @brief 解析TCP头部之后的选项，不认识的选项按长度跳过，格式错误时停止解析
+ *
+ * @param hdr TCP头部，长度已检查过
+ * @param opts 解析结果
+ */
+static void tcp_parse_options(tcp_hdr_t* hdr, tcp_opts_t* opts) {
+    memset(opts, 0, sizeof(tcp_opts_t));
+    opts->wscale = -1;
+    uint8_t* p = (uint8_t*)(hdr + 1);
+    uint8_t* end = (uint8_t*)hdr + hdr->data_offset * 4;
+    while (p < end && *p != TCP_OPT_EOL) {
+        if (*p == TCP_OPT_NOP) {
+            p++;
+            continue;
+        }
+        if (end - p < 2 || p[1] < 2 || p[1] > end - p)
+            break;
+        switch (p[0]) {
+        case TCP_OPT_MSS:
+            if (p[1] == 4) opts->mss = (p[2] << 8) | p[3];
+            break;
+        case TCP_OPT_WSCALE:
+            if (p[1] == 3) opts->wscale = p[2] < TCP_WSCALE_MAX ? p[2] : TCP_WSCALE_MAX;
+            break;
+        case TCP_OPT_SACK_PERM:
+            if (p[1] == 2) opts->sack_ok = 1;
+            break;
+        case TCP_OPT_SACK:
+            for (int i = 0; i < (p[1] - 2) / 8 && opts->sack_num < TCP_SACK_BLOCKS; i++) {
+                tcp_range_t* block = &opts->sack[opts->sack_num++];
+                memcpy(&block->start, p + 2 + 8 * i, 4);
+                memcpy(&block->end, p + 6 + 8 * i, 4);
+                block->start = swap32(block->start);
+                block->end = swap32(block->end);
+            }
+            break;
+        case TCP_OPT_TIMESTAMP:
+            if (p[1] == 10) {
+                opts->ts_ok = 1;
+                memcpy(&opts->tsval, p + 2, 4);
+                memcpy(&opts->tsecr, p + 6, 4);
+                opts->tsval = swap32(opts->tsval);
+                opts->tsecr = swap32(opts->tsecr);
+            }
+            break;
+        default:
+            break;
+        }
+        p += p[1];
+    }
+}
+
+/**
+ * @brief 选项中还能放下的SACK块数，不超过乱序队列中的区间数
+ *
+ * @param connect
+ * @param used 其余选项已占用的字节数
+ * @return int 块数，没有协商SACK时为0
+ */
+static int tcp_sack_blocks(tcp_connect_t* connect, size_t used) {
+    if (!connect->sack_ok)
+        return 0;
+    int max = (TCP_OPT_MAX_LEN - used - 4) / 8;
+    return connect->ooo_num < max ? connect->ooo_num : max;
+}
+
+/**
+ * @brief 数据报文段的负载上限：SMSS再减去要携带的SACK选项，使报文段加上ip头不超过MTU，ip层无需分片。
+ *        时间戳选项已在协商SMSS时扣除
+ *
+ * @param connect
+ * @return uint32_t
+ */
+static uint32_t tcp_send_mss(tcp_connect_t* connect) {
+    int num = tcp_sack_blocks(connect, connect->ts_ok ? TCP_OPT_TS_LEN : 0);
+    return connect->mss - (num ? 4 + 8 * num : 0);
+}
+
+/**
+ * @brief 生成要发送的选项。SYN中通告MSS，并回应对端提出的窗口扩大、SACK与时间戳；
+ *        协商了时间戳时每个报文段都带时间戳，乱序队列不空时带上SACK块。总长度是4的倍数
+ *
+ * @param connect
+ * @param flags 报文段标志
+ * @param opt 输出缓冲区，至少TCP_OPT_MAX_LEN字节
+ * @return size_t 选项长度
+ */
+static size_t tcp_build_options(tcp_connect_t* connect, tcp_flags_t flags, uint8_t* opt) {
+    size_t len = 0;
+    if (flags.syn) {
+        uint16_t mss = TCP_MAX_MSS;
+        opt[len++] = TCP_OPT_MSS;
+        opt[len++] = 4;
+        opt[len++] = mss >> 8;
+        opt[len++] = mss & 0xff;
+        if (connect->sack_ok) {
+            opt[len++] = TCP_OPT_NOP;
+            opt[len++] = TCP_OPT_NOP;
+            opt[len++] = TCP_OPT_SACK_PERM;
+            opt[len++] = 2;
+        }
+        if (connect->rcv_wscale || connect->snd_wscale) {
+            opt[len++] = TCP_OPT_NOP;
+            opt[len++] = TCP_OPT_WSCALE;
+            opt[len++] = 3;
+            opt[len++] = connect->rcv_wscale;
+        }
+    }
+    if (connect->ts_ok && !flags.rst) {
+        uint32_t tsval = swap32((uint32_t)connect->ctx->now);
+        uint32_t tsecr = swap32(connect->ts_recent);
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_TIMESTAMP;
+        opt[len++] = 10;
+        memcpy(opt + len, &tsval, 4);
+        memcpy(opt + len + 4, &tsecr, 4);
+        len += 8;
+    }
+    int num = flags.syn || flags.rst ? 0 : tcp_sack_blocks(connect, len);
+    if (num) {
+        // 第一个块是包含最近收到的乱序报文段的区间，其余按序号升序，见RFC 2018第4节
+        int first = 0;
+        for (int i = 0; i < connect->ooo_num; i++)
+            if (tcp_seq_leq(connect->ooo[i].start, connect->ooo_recent) && tcp_seq_lt(connect->ooo_recent, connect->ooo[i].end))
+                first = i;
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_SACK;
+        opt[len++] = 2 + 8 * num;
+        for (int i = -1, n = 0; n < num; i++) {
+            if (i == first)
+                continue;
+            tcp_range_t* range = &connect->ooo[i < 0 ? first : i];
+            uint32_t start = swap32(range->start), end = swap32(range->end);
+            memcpy(opt + len, &start, 4);
+            memcpy(opt + len + 4, &end, 4);
+            len += 8;
+            n++;
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief 按对端SYN中的选项协商：对端提出的才启用，SMSS取双方MSS的较小值再扣除每个报文段都带的时间戳
+ *
+ * @param connect
+ * @param opts 对端SYN中的选项
+ */
+static void tcp_negotiate_options(tcp_connect_t* connect, tcp_opts_t* opts) {
+    connect->remote_mss = opts->mss ? opts->mss : TCP_DEFAULT_MSS;
+    if (connect->remote_mss < TCP_MIN_MSS)
+        connect->remote_mss = TCP_MIN_MSS;
+    if (opts->wscale >= 0) {
+        connect->snd_wscale = opts->wscale;
+        connect->rcv_wscale = tcp_rcv_wscale();
+    } else {
+        // 主动打开时本端已在SYN中提出，对端没有回应则双方都不缩放
+        connect->snd_wscale = 0;
+        connect->rcv_wscale = 0;
+    }
+    connect->sack_ok = opts->sack_ok;
+    connect->ts_ok = opts->ts_ok;
+    connect->ts_recent = opts->tsval;
+    connect->mss = connect->remote_mss < TCP_MAX_MSS ? connect->remote_mss : TCP_MAX_MSS;
+    if (connect->ts_ok)
+        connect->mss -= TCP_OPT_TS_LEN;
+}
+
 static uint16_t tcp_checksum(buf_t* buf, uint8_t* src_ip, uint8_t* dst_ip) {
     int len = buf->len;
     buf_add_header(buf, sizeof(tcp_peso_hdr_t));
@@ -131,116 +527,761 @@ static uint16_t tcp_checksum(buf_t* buf, uint8_t* src_ip, uint8_t* dst_ip) {
     return checksum;
 }
 
-static _Thread_local uint16_t delete_port;
-
 /**
- * @brief tcp_close使用这个函数来查找可以关闭的连接，使用thread-local变量delete_port传递端口号。
+ * @brief tcp_close使用这个函数来查找可以关闭的连接，端口号经tcp_hash_foreach的arg传入。
  *
- * @param key,value,timestamp
+ * @param connect
+ * @param arg 指向要关闭的端口号
+ * @return int 为1时从连接表中删除
  */
-static void close_port_fn(void* key, void* value, time_t* timestamp) {
-    tcp_key_t* tcp_key = key;
-    tcp_connect_t* connect = value;
-    if (tcp_key->dst_port == delete_port) {
-        release_tcp_connect(connect);
-    }
+static int close_port_fn(tcp_connect_t* connect, void* arg) {
+    if (connect->local_port != *(uint16_t*)arg)
+        return 0;
+    release_tcp_connect(connect);
+    return 1;
 }
 
 /**
  * @brief 关闭 port 上的 TCP 连接
- *        供应用层使用
+ *        供应用层使用，会遍历所有上下文的连接表，多核模式下须在worker_stop之后调用
  *
  * @param port
  */
 void tcp_close(uint16_t port) {
-    delete_port = port;
-    map_foreach(&connect_table, close_port_fn);
+    for (int i = 0; i < NET_CTX_NUM; i++)
+        tcp_hash_foreach(&connect_table[i], close_port_fn, &port);
+    tcp_listen_t** listen = map_get(&tcp_table, &port);
+    if (listen)
+        free(*listen);
     map_delete(&tcp_table, &port);
+    listen_bitmap[port / 64] &= ~(1ull << (port % 64));
+}
+
+/**
+ * @brief 把[start, end)并入区间表，与之重叠或相邻的区间合并成一个
+ *
+ * @param ranges 区间表，按序号升序排列，互不重叠也不相邻
+ * @param num 区间数
+ * @param max 区间表容量
+ * @param start 起始序号
+ * @param end 结束序号
+ * @return int 成功为0，区间表满且不能合并时为-1
+ */
+static int tcp_range_insert(tcp_range_t* ranges, uint8_t* num, int max, uint32_t start, uint32_t end) {
+    // 找到与[start, end)重叠或相邻的区间[i, j)，合并成一个
+    int i = 0, j;
+    while (i < *num && tcp_seq_lt(ranges[i].end, start))
+        i++;
+    for (j = i; j < *num && tcp_seq_leq(ranges[j].start, end); j++) {
+        if (tcp_seq_lt(ranges[j].start, start)) start = ranges[j].start;
+        if (tcp_seq_lt(end, ranges[j].end)) end = ranges[j].end;
+    }
+    if (i == j && *num == max)
+        return -1;
+    memmove(&ranges[i + 1], &ranges[j], (*num - j) * sizeof(tcp_range_t));
+    ranges[i].start = start;
+    ranges[i].end = end;
+    *num += 1 - (j - i);
+    return 0;
+}
+
+/**
+ * @brief 去掉区间表中序号在seq之前的部分
+ *
+ * @param ranges 区间表
+ * @param num 区间数
+ * @param seq 序号
+ */
+static void tcp_range_trim(tcp_range_t* ranges, uint8_t* num, uint32_t seq) {
+    int i = 0;
+    while (i < *num && tcp_seq_leq(ranges[i].end, seq))
+        i++;
+    *num -= i;
+    memmove(&ranges[0], &ranges[i], *num * sizeof(tcp_range_t));
+    if (*num && tcp_seq_lt(ranges[0].start, seq))
+        ranges[0].start = seq;
 }
 
 /**
- * @brief 从 buf 中读取数据到 connect->rx_buf
+ * @brief 把乱序到达的报文段存入rx_buf写指针之后的对应位置，并把序号区间记入乱序队列。
+ *        超出缓存上限的部分被丢弃；队列满且不能与已有区间合并时整段丢弃，等对端重传
  *
  * @param connect
- * @param buf
- * @return uint16_t 字节数
+ * @param seq 报文段的序号，在connect->ack之后
+ * @param buf 报文段数据
+ * @param fin 报文段是否带FIN
  */
-static uint16_t tcp_read_from_buf(tcp_connect_t* connect, buf_t* buf) {
-    uint8_t* dst = connect->rx_buf->data + connect->rx_buf->len;
-    int ret = buf_add_padding(connect->rx_buf, buf->len);
-    if (ret != 0) {
-        memmove(connect->rx_buf->payload, connect->rx_buf->data, connect->rx_buf->len);
-        connect->rx_buf->data = connect->rx_buf->payload;
-        dst = connect->rx_buf->data + connect->rx_buf->len;
+static void tcp_ooo_insert(tcp_connect_t* connect, uint32_t seq, buf_t* buf, int fin) {
+    uint32_t offset = seq - connect->ack;
+    if (offset >= TCP_BUF_MAX_SIZE)
+        return;
+    tcp_buf_autotune(&connect->rx_buf, offset + buf->len, TCP_BUF_MAX_SIZE);
+    uint32_t len = ringbuf_write_at(&connect->rx_buf, offset, buf->data, buf->len);
+    if (fin && len == buf->len) {
+        connect->ooo_fin = 1;
+        connect->ooo_fin_seq = seq + len;
     }
-    memcpy(dst, buf->data, buf->len);
-    connect->ack += buf->len;
-    return buf->len;
+    if (len == 0)
+        return;
+    if (tcp_range_insert(connect->ooo, &connect->ooo_num, TCP_OOO_MAX, seq, seq + len) == 0)
+        connect->ooo_recent = seq;
 }
 
 /**
- * @brief 把connect内tx_buf的数据写入到buf里面供tcp_send使用，buf原来的内容会无效。
+ * @brief 空洞补齐后，把乱序队列中已经连续的数据计入rx_buf
+ *
+ * @param connect
+ * @return uint32_t 计入的字节数
+ */
+static uint32_t tcp_ooo_advance(tcp_connect_t* connect) {
+    uint32_t total = 0;
+    tcp_range_t* ooo = connect->ooo;
+    while (connect->ooo_num && tcp_seq_leq(ooo[0].start, connect->ack)) {
+        if (tcp_seq_lt(connect->ack, ooo[0].end)) {
+            uint32_t len = ringbuf_commit(&connect->rx_buf, ooo[0].end - connect->ack);
+            connect->ack += len;
+            total += len;
+        }
+        connect->ooo_num--;
+        memmove(&ooo[0], &ooo[1], connect->ooo_num * sizeof(tcp_range_t));
+    }
+    return total;
+}
+
+/**
+ * @brief 从 buf 中读取数据到 connect->rx_buf，缓存满时只接收放得下的部分，只确认接收的部分。
+ *        接上的乱序数据一并计入
  *
  * @param connect
  * @param buf
- * @return uint16_t 字节数
- */
-static uint16_t tcp_write_to_buf(tcp_connect_t* connect, buf_t* buf) {
-    uint16_t sent = connect->next_seq - connect->unack_seq;
-    uint16_t size = min32(connect->tx_buf->len - sent, connect->remote_win);
-    buf_init(buf, size);
-    memcpy(buf->data, connect->tx_buf->data + sent, size);
-    connect->next_seq += size;
-    return size;
+ * @return uint32_t 字节数
+ */
+static uint32_t tcp_read_from_buf(tcp_connect_t* connect, buf_t* buf) {
+    tcp_buf_autotune(&connect->rx_buf, buf->len, TCP_BUF_MAX_SIZE);
+    uint32_t len = ringbuf_write(&connect->rx_buf, buf->data, buf->len);
+    connect->ack += len;
+    return len + tcp_ooo_advance(connect);
 }
 
 /**
- * @brief 发送TCP包, seq_number32 = connect->next_seq - buf->len
- *        buf里的数据将作为负载，加上tcp头发送出去。如果flags包含syn或fin，seq会递增。
+ * @brief 给buf加上选项与tcp头并交给ip层发送，不改变连接的发送状态
  *
  * @param buf
  * @param connect
+ * @param seq
  * @param flags
  */
-static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
+static void tcp_xmit(buf_t* buf, tcp_connect_t* connect, uint32_t seq, tcp_flags_t flags) {
     // printf("<< tcp send >> sz=%zu\n", buf->len);
     display_flags(flags);
-    size_t prev_len = buf->len;
+    uint8_t opt[TCP_OPT_MAX_LEN];
+    size_t opt_len = tcp_build_options(connect, flags, opt);
+    buf_add_header(buf, opt_len);
+    memcpy(buf->data, opt, opt_len);
     buf_add_header(buf, sizeof(tcp_hdr_t));
     tcp_hdr_t* hdr = (tcp_hdr_t*)buf->data;
     hdr->src_port16 = swap16(connect->local_port);
     hdr->dst_port16 = swap16(connect->remote_port);
-    hdr->seq_number32 = swap32(connect->next_seq - prev_len);
+    hdr->seq_number32 = swap32(seq);
     hdr->ack_number32 = swap32(connect->ack);
-    hdr->data_offset = sizeof(tcp_hdr_t) / sizeof(uint32_t);
+    hdr->data_offset = (sizeof(tcp_hdr_t) + opt_len) / sizeof(uint32_t);
     hdr->reserved = 0;
     hdr->flags = flags;
-    hdr->window_size16 = swap16(connect->remote_win);
+    hdr->window_size16 = swap16(tcp_rcv_window(connect, flags.syn));
     hdr->chunksum16 = 0;
     hdr->urgent_pointer16 = 0;
-    hdr->chunksum16 = tcp_checksum(buf, connect->ip, net_if_ip);
-    ip_out(buf, connect->ip, NET_PROTOCOL_TCP);
+    hdr->chunksum16 = tcp_checksum(buf, connect->ip, connect->netif->ip);
+    // 源地址与校验和用同一个本端地址，出口网卡由路由决定，可以与连接所在的网卡不同
+    ip_out_src(connect->ctx, buf, connect->ip, NET_PROTOCOL_TCP, connect->netif->ip);
+}
+
+/**
+ * @brief 发送TCP包，序号为seq，buf里的数据将作为负载，加上tcp头发送出去。
+ *        占用序号的报文段会启动重传定时器，全新的报文段还会用来测量往返时间。
+ *
+ * @param buf
+ * @param connect
+ * @param seq
+ * @param flags
+ */
+static void tcp_send_seq(buf_t* buf, tcp_connect_t* connect, uint32_t seq, tcp_flags_t flags) {
+    size_t prev_len = buf->len;
+    tcp_xmit(buf, connect, seq, flags);
+    // 每个带ACK的报文段都确认了目前收到的全部数据，延迟的确认不必再单独发送
+    if (flags.ack && connect->ack_pending) {
+        connect->ack_pending = 0;
+        timer_cancel(&connect->ack_timer);
+    }
+    // 占用序号的报文段需要确认：启动重传定时器，对全新的报文段测量往返时间
+    uint32_t end = seq + prev_len + (flags.syn || flags.fin);
+    if (end == seq || flags.rst)
+        return;
+    if (tcp_seq_lt(connect->max_seq, end)) {
+        if (!connect->rtt_timing && tcp_seq_leq(connect->max_seq, seq)) {
+            connect->rtt_timing = 1;
+            connect->rtt_seq = seq;
+            connect->rtt_time = connect->ctx->now;
+        }
+        connect->max_seq = end;
+    }
+    if (!timer_pending(&connect->rto_timer))
+        timer_add(&connect->ctx->timers, &connect->rto_timer, connect->ctx->now + connect->rto);
+}
+
+/**
+ * @brief 发送TCP包, seq_number32 = connect->next_seq - buf->len
+ *        buf里的数据将作为负载，加上tcp头发送出去。如果flags包含syn或fin，seq会递增。
+ *
+ * @param buf
+ * @param connect
+ * @param flags
+ */
+static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
+    tcp_send_seq(buf, connect, connect->next_seq - buf->len, flags);
     if (flags.syn || flags.fin) {
         connect->next_seq += 1;
     }
 }
 
+/**
+ * @brief 本端的FIN是否已被确认
+ *
+ * @param connect
+ * @return int
+ */
+static int tcp_fin_acked(tcp_connect_t* connect) {
+    return connect->fin_sent && tcp_seq_lt(connect->fin_seq, connect->unack_seq);
+}
+
+/**
+ * @brief 记分板上最高SACK区间的末尾，没有SACK块时为unack_seq
+ *
+ * @param connect
+ * @return uint32_t
+ */
+static uint32_t tcp_sack_high(tcp_connect_t* connect) {
+    if (connect->sacked_num)
+        return connect->sacked[connect->sacked_num - 1].end;
+    return connect->unack_seq;
+}
+
+/**
+ * @brief 记分板上被视为丢失的空洞的上界，即RFC 6675中的IsLost：某个序号之上已有DupThresh个不连续的SACK区间，
+ *        或被SACK的字节超过(DupThresh - 1) * SMSS时，它之前没被SACK的字节视为丢失
+ *
+ * @param connect
+ * @return uint32_t 上界，没有被视为丢失的字节时为unack_seq
+ */
+static uint32_t tcp_sack_lost(tcp_connect_t* connect) {
+    uint32_t sacked = 0;
+    for (int i = connect->sacked_num - 1; i >= 0; i--) {
+        sacked += connect->sacked[i].end - connect->sacked[i].start;
+        if (connect->sacked_num - i >= TCP_DUPACK_THRESH || sacked > (TCP_DUPACK_THRESH - 1) * connect->mss)
+            return connect->sacked[i].start;
+    }
+    return connect->unack_seq;
+}
+
+/**
+ * @brief 记分板上seq之前的空洞字节数
+ *
+ * @param connect
+ * @param seq 不小于unack_seq
+ * @return uint32_t
+ */
+static uint32_t tcp_sack_holes(tcp_connect_t* connect, uint32_t seq) {
+    uint32_t holes = seq - connect->unack_seq;
+    for (int i = 0; i < connect->sacked_num && tcp_seq_lt(connect->sacked[i].start, seq); i++)
+        holes -= (tcp_seq_lt(connect->sacked[i].end, seq) ? connect->sacked[i].end : seq) - connect->sacked[i].start;
+    return holes;
+}
+
+/**
+ * @brief 估计还在网络中的字节数（RFC 6675中的pipe）。
+ *        SACK恢复期间没被SACK的字节中，未被视为丢失的计一次，重传过的再计一次；
+ *        其余时候就是已发送未确认的字节数
+ *
+ * @param connect
+ * @return uint32_t
+ */
+static uint32_t tcp_pipe(tcp_connect_t* connect) {
+    if (!connect->in_recovery || !connect->sack_ok)
+        return connect->next_seq - connect->unack_seq;
+    uint32_t lost = tcp_sack_lost(connect);
+    if (tcp_seq_lt(connect->next_seq, lost))
+        lost = connect->next_seq;
+    uint32_t rxt = tcp_seq_lt(connect->high_rxt, connect->unack_seq) ? connect->unack_seq : connect->high_rxt;
+    return tcp_sack_holes(connect, connect->next_seq) - tcp_sack_holes(connect, lost) + tcp_sack_holes(connect, rxt);
+}
+
+/**
+ * @brief 发送tx_buf中还没发送的数据，把数据按tcp_send_mss切成多个报文段，ip层不再分片，在途字节数不超过min(cwnd, 对端窗口)。
+ *        本端已关闭时FIN跟在最后一个数据报文段上，数据发完后单独发送。
+ *
+ * @param connect
+ * @return int 发送的报文段数
+ */
+static int tcp_output(tcp_connect_t* connect) {
+    switch (connect->state) {
+    case TCP_ESTABLISHED:
+    case TCP_CLOSE_WAIT:
+    case TCP_FIN_WAIT_1:
+    case TCP_CLOSING:
+    case TCP_LAST_ACK:
+        break;
+    default:
+        return 0;
+    }
+    if (tcp_fin_acked(connect))
+        return 0;
+    buf_t* buf = &connect->ctx->txbuf;
+    uint32_t data_end = connect->unack_seq + ringbuf_len(&connect->tx_buf);
+    // 有限传输：前两个重复ACK各允许多发一个新报文段，使窗口很小时也能凑够触发快速重传的重复ACK，见RFC 3042
+    uint32_t cwnd = connect->cwnd;
+    if (!connect->in_recovery)
+        cwnd += min32(connect->dupacks, TCP_DUPACK_THRESH - 1) * connect->mss;
+    // 乱序队列在一次发送中不变，每个报文段的负载上限相同，按它把待发数据切成多个报文段
+    uint32_t mss = tcp_send_mss(connect);
+    int sent = 0;
+    for (;;) {
+        // cwnd限制在网络中的字节数，对端窗口限制从unack_seq起的序号范围
+        uint32_t inflight = connect->next_seq - connect->unack_seq;
+        uint32_t pipe = tcp_pipe(connect);
+        uint32_t room = min32(cwnd > pipe ? cwnd - pipe : 0,
+                              connect->remote_win > inflight ? connect->remote_win - inflight : 0);
+        uint32_t unsent = tcp_seq_lt(connect->next_seq, data_end) ? data_end - connect->next_seq : 0;
+        if (unsent == 0) {
+            // FIN不受窗口限制
+            if (connect->fin_queued && connect->next_seq == data_end) {
+                buf_init(buf, 0);
+                connect->fin_sent = 1;
+                connect->fin_seq = connect->next_seq;
+                tcp_send(buf, connect, tcp_flags_ack_fin);
+                sent++;
+            }
+            break;
+        }
+        if (room == 0)
+            break;
+        uint32_t len = min32(min32(unsent, room), mss);
+        if (len < mss) {
+            // 避免糊涂窗口：还有数据在途时不因窗口剩余太小而发送小报文段
+            if (len < unsent && inflight > 0)
+                break;
+            // Nagle算法：不足一个报文段的尾部数据等在途数据都被确认后再发，凑成更大的报文段，见RFC 896；
+            // 塞住时一直等到解除，关闭前的最后一段数据不等
+            if (len == unsent && !connect->fin_queued && (connect->cork || (!connect->nodelay && inflight > 0)))
+                break;
+        }
+        tcp_flags_t flags = tcp_flags_ack;
+        if (connect->fin_queued && len == unsent) {
+            flags = tcp_flags_ack_fin;
+            connect->fin_sent = 1;
+            connect->fin_seq = connect->next_seq + len;
+        }
+        buf_init(buf, len);
+        ringbuf_peek(&connect->tx_buf, inflight, buf->data, len);
+        connect->next_seq += len;
+        tcp_send(buf, connect, flags);
+        sent++;
+        if (flags.fin)
+            break;
+    }
+    return sent;
+}
+
+/**
+ * @brief 重传第一个未确认的报文段，用于快速重传与快速恢复中的部分确认
+ *
+ * @param connect
+ * @return uint32_t 重传的报文段之后的序号，没有可重传的数据时为unack_seq
+ */
+static uint32_t tcp_retransmit_head(tcp_connect_t* connect) {
+    buf_t* buf = &connect->ctx->txbuf;
+    uint32_t len = min32(min32(ringbuf_len(&connect->tx_buf), connect->next_seq - connect->unack_seq), tcp_send_mss(connect));
+    tcp_flags_t flags = tcp_flags_ack;
+    if (connect->fin_sent && connect->fin_seq == connect->unack_seq + len)
+        flags = tcp_flags_ack_fin;
+    else if (len == 0)
+        return connect->unack_seq;
+    connect->rtt_timing = 0; // Karn算法：不用重传的报文段测量往返时间
+    buf_init(buf, len);
+    ringbuf_peek(&connect->tx_buf, 0, buf->data, len);
+    tcp_send_seq(buf, connect, connect->unack_seq, flags);
+    return connect->unack_seq + len + flags.fin;
+}
+
+/**
+ * @brief SACK恢复：pipe小于cwnd时按序号顺序重传记分板上被视为丢失的空洞，每次不超过一个SMSS，见RFC 6675中的NextSeg。
+ *        还有新数据可发时只重传视为丢失的空洞（规则1），新数据留给tcp_output（规则2）；
+ *        没有新数据可发时最高SACK区间之下的空洞都重传（规则3）
+ *
+ * @param connect
+ */
+static void tcp_sack_retransmit(tcp_connect_t* connect) {
+    buf_t* buf = &connect->ctx->txbuf;
+    uint32_t data_end = connect->unack_seq + ringbuf_len(&connect->tx_buf);
+    uint32_t bound = tcp_seq_lt(connect->next_seq, data_end) && connect->next_seq - connect->unack_seq < connect->remote_win ?
+                     tcp_sack_lost(connect) : tcp_sack_high(connect);
+    uint32_t mss = tcp_send_mss(connect);
+    while (tcp_pipe(connect) < connect->cwnd) {
+        // 从上次重传到的位置起找下一个空洞[start, end)
+        uint32_t start = tcp_seq_lt(connect->high_rxt, connect->unack_seq) ? connect->unack_seq : connect->high_rxt;
+        uint32_t end = bound;
+        for (int i = 0; i < connect->sacked_num; i++) {
+            if (tcp_seq_lt(start, connect->sacked[i].start)) {
+                end = connect->sacked[i].start;
+                break;
+            }
+            if (tcp_seq_lt(start, connect->sacked[i].end))
+                start = connect->sacked[i].end;
+        }
+        if (!tcp_seq_lt(start, end))
+            break;
+        // 空洞可能延伸到发送缓存之外的FIN
+        uint32_t len = min32(min32(end - start, mss), ringbuf_len(&connect->tx_buf) - (start - connect->unack_seq));
+        tcp_flags_t flags = tcp_flags_ack;
+        if (connect->fin_sent && connect->fin_seq == start + len && tcp_seq_lt(start + len, end))
+            flags = tcp_flags_ack_fin;
+        else if (len == 0)
+            break;
+        connect->rtt_timing = 0;
+        buf_init(buf, len);
+        ringbuf_peek(&connect->tx_buf, start - connect->unack_seq, buf->data, len);
+        tcp_send_seq(buf, connect, start, flags);
+        connect->high_rxt = start + len + flags.fin;
+    }
+}
+
+/**
+ * @brief 记分板满时腾出一个区间的位置。最低的空洞已经重传过时把它两侧的区间合并，超时前本来也不会再重传它，
+ *        只是pipe少算了这次重传；否则丢掉最低的区间，这段数据会多重传一次
+ *
+ * @param connect
+ */
+static void tcp_sack_evict(tcp_connect_t* connect) {
+    if (connect->in_recovery && connect->sacked_num > 1 && tcp_seq_leq(connect->sacked[1].start, connect->high_rxt))
+        connect->sacked[1].start = connect->sacked[0].start;
+    connect->sacked_num--;
+    memmove(&connect->sacked[0], &connect->sacked[1], connect->sacked_num * sizeof(tcp_range_t));
+}
+
+/**
+ * @brief 把ACK中的SACK块记入记分板，只接受落在[unack_seq, max_seq]内的块，并去掉已被累计确认的部分
+ *
+ * @param connect
+ * @param opts ACK中的选项
+ */
+static void tcp_sack_update(tcp_connect_t* connect, tcp_opts_t* opts) {
+    for (int i = 0; i < opts->sack_num; i++) {
+        tcp_range_t* block = &opts->sack[i];
+        if (!tcp_seq_lt(block->start, block->end) || tcp_seq_lt(block->start, connect->unack_seq) ||
+            tcp_seq_lt(connect->max_seq, block->end))
+            continue;
+        // 记分板满时为更高处的区间腾出位置，否则最高SACK区间不再前进，pipe会一直停在cwnd之上
+        while (tcp_range_insert(connect->sacked, &connect->sacked_num, TCP_SACK_MAX, block->start, block->end) < 0 &&
+               tcp_seq_lt(connect->sacked[0].start, block->start))
+            tcp_sack_evict(connect);
+    }
+    tcp_range_trim(connect->sacked, &connect->sacked_num, connect->unack_seq);
+}
+
+/**
+ * @brief 用一个往返时间样本更新SRTT、RTTVAR与RTO，见RFC 6298第2节
+ *
+ * @param connect
+ * @param rtt 往返时间，毫秒
+ */
+static void tcp_rtt_update(tcp_connect_t* connect, uint32_t rtt) {
+    if (rtt == 0) rtt = 1; // 时钟粒度为1毫秒
+    if (connect->srtt == 0) {
+        connect->srtt = rtt;
+        connect->rttvar = rtt / 2;
+    } else {
+        uint32_t delta = connect->srtt > rtt ? connect->srtt - rtt : rtt - connect->srtt;
+        connect->rttvar = (3 * connect->rttvar + delta) / 4;
+        connect->srtt = (7 * connect->srtt + rtt) / 8;
+    }
+    uint32_t rto = connect->srtt + (4 * connect->rttvar > 1 ? 4 * connect->rttvar : 1);
+    if (rto < TCP_RTO_MIN_MS) rto = TCP_RTO_MIN_MS;
+    if (rto > TCP_RTO_MAX_MS) rto = TCP_RTO_MAX_MS;
+    connect->rto = rto;
+}
+
+/**
+ * @brief 处理对端的确认号：丢弃已确认的数据，取往返时间样本，重启或停止重传定时器
+ *        超时重传后next_seq会退回unack_seq，因此确认号的上限是发送过的最大序号max_seq
+ *
+ * @param connect
+ * @param ack_number 对端的确认号
+ * @return uint32_t 新确认的序号数，重复或无效的确认为0
+ */
+static uint32_t tcp_ack_update(tcp_connect_t* connect, uint32_t ack_number) {
+    if (!tcp_seq_lt(connect->unack_seq, ack_number) || !tcp_seq_leq(ack_number, connect->max_seq))
+        return 0;
+    uint32_t acked = ack_number - connect->unack_seq;
+    // SYN与FIN占用序号但不在发送缓存中，丢弃时按缓存长度截断即可
+    ringbuf_drop(&connect->tx_buf, acked);
+    connect->unack_seq = ack_number;
+    if (tcp_seq_lt(connect->next_seq, ack_number))
+        connect->next_seq = ack_number;
+    if (connect->ts_ecr_valid) {
+        // 有时间戳时每个确认新数据的ACK都能取样，回显的是对端按序收到的报文段的时间戳，重传也不会取错
+        tcp_rtt_update(connect, (uint32_t)connect->ctx->now - connect->ts_ecr);
+        connect->rtt_timing = 0;
+    } else if (connect->rtt_timing && tcp_seq_lt(connect->rtt_seq, ack_number)) {
+        tcp_rtt_update(connect, connect->ctx->now - connect->rtt_time);
+        connect->rtt_timing = 0;
+    }
+    connect->retries = 0;
+    if (connect->unack_seq == connect->max_seq)
+        timer_cancel(&connect->rto_timer);
+    else
+        timer_add(&connect->ctx->timers, &connect->rto_timer, connect->ctx->now + connect->rto);
+    return acked;
+}
+
+/**
+ * @brief 处理已建立连接上的ACK：更新对端窗口，做快速重传与快速恢复，其余时间由拥塞控制算法增长cwnd。
+ *        协商了SACK时按记分板只重传丢失的区间（RFC 6675），否则按NewReno（RFC 5681、RFC 6582）每个往返重传一个报文段
+ *
+ * @param connect
+ * @param ack_number 确认号
+ * @param window 对端通告的窗口，已按窗口扩大因子左移
+ * @param seg_len 报文段负载长度
+ * @param flags 报文段标志
+ * @param opts 报文段中的选项
+ */
+static void tcp_ack_in(tcp_connect_t* connect, uint32_t ack_number, uint32_t window, size_t seg_len, tcp_flags_t flags,
+                       tcp_opts_t* opts) {
+    const tcp_cc_ops_t* cc = connect->cc;
+    uint32_t acked = tcp_ack_update(connect, ack_number);
+    if (connect->sack_ok)
+        tcp_sack_update(connect, opts);
+    if (acked) {
+        connect->remote_win = window;
+        connect->dupacks = 0;
+        if (!connect->in_recovery) {
+            cc->cong_avoid(connect, acked);
+        } else if (!tcp_seq_lt(ack_number, connect->recover)) {
+            // 完全确认，退出快速恢复，cwnd收缩到ssthresh，避免突发
+            uint32_t flight = tcp_cc_flight(connect);
+            connect->cwnd = min32(connect->ssthresh, (flight > connect->mss ? flight : connect->mss) + connect->mss);
+            connect->in_recovery = 0;
+        } else if (connect->sack_ok) {
+            // 部分确认，继续重传记分板上的空洞
+            tcp_sack_retransmit(connect);
+        } else {
+            // 部分确认，说明同一窗口里还有丢失的报文段，立即重传下一个，cwnd减去已确认的量
+            tcp_retransmit_head(connect);
+            connect->cwnd = connect->cwnd > acked ? connect->cwnd - acked : 0;
+            if (acked >= connect->mss)
+                connect->cwnd += connect->mss;
+            if (connect->cwnd < connect->mss)
+                connect->cwnd = connect->mss;
+        }
+        if (cc->pkts_acked)
+            cc->pkts_acked(connect, acked);
+        // 发送缓存腾出了空间，等待写入的应用可以继续
+        if (connect->state == TCP_ESTABLISHED)
+            ((tcp_handler_t)connect->handler)(connect, TCP_CONN_DATA_SENT);
+        return;
+    }
+    int duplicate = ack_number == connect->unack_seq && seg_len == 0 && !flags.syn && !flags.fin &&
+                    window == connect->remote_win && connect->unack_seq != connect->max_seq;
+    if (!duplicate) {
+        // 窗口更新
+        if (ack_number == connect->unack_seq)
+            connect->remote_win = window;
+        return;
+    }
+    connect->dupacks++;
+    if (connect->in_recovery && connect->sack_ok) {
+        // 被SACK的数据已离开网络，pipe随之减小
+        tcp_sack_retransmit(connect);
+    } else if (connect->in_recovery) {
+        // 每个重复ACK说明有一个报文段离开了网络，cwnd膨胀一个SMSS以发送新数据
+        connect->cwnd += connect->mss;
+    } else if ((connect->dupacks == TCP_DUPACK_THRESH || tcp_sack_lost(connect) != connect->unack_seq) &&
+               tcp_seq_leq(connect->recover, ack_number)) {
+        // 重复ACK够数，或记分板已说明第一个未确认的报文段丢失时进入快速恢复；
+        // recover是上次恢复开始时max_seq的值，确认号到达它时上次恢复的数据已全部确认，可以开始新的恢复
+        connect->ssthresh = cc->ssthresh(connect);
+        connect->cwnd_cnt = 0;
+        connect->recover = connect->max_seq;
+        connect->in_recovery = 1;
+        if (connect->sack_ok) {
+            connect->cwnd = connect->ssthresh;
+            // 第一个未确认的报文段不论pipe都立即重传，其余空洞按记分板重传
+            connect->high_rxt = tcp_retransmit_head(connect);
+            tcp_sack_retransmit(connect);
+        } else {
+            connect->cwnd = connect->ssthresh + TCP_DUPACK_THRESH * connect->mss;
+            tcp_retransmit_head(connect);
+        }
+    }
+}
+
+/**
+ * @brief 延迟确认定时器到期：等待期间没有数据报文段可以捎带确认，单独发送ACK
+ *
+ * @param node 连接的ack_timer
+ * @param arg 协议栈上下文
+ */
+static void tcp_delack_expire(timer_node_t* node, void* arg) {
+    tcp_connect_t* connect = timer_entry(node, tcp_connect_t, ack_timer);
+    net_ctx_t* ctx = arg;
+    buf_init(&ctx->txbuf, 0);
+    tcp_send(&ctx->txbuf, connect, tcp_flags_ack);
+}
+
+/**
+ * @brief 确认收到的按序数据：累计到第二个报文段，或报文段填补了乱序队列的空洞时立即发送ACK，
+ *        否则启动延迟确认定时器，期间发出的数据报文段会捎带确认，见RFC 1122第4.2.3.2节与RFC 5681第4.2节
+ *
+ * @param connect
+ * @param quick 是否需要立即确认
+ */
+static void tcp_ack_delayed(tcp_connect_t* connect, int quick) {
+    if (quick || connect->ack_pending >= TCP_DELACK_SEGS) {
+        buf_init(&connect->ctx->txbuf, 0);
+        tcp_send(&connect->ctx->txbuf, connect, tcp_flags_ack);
+        return;
+    }
+    if (!timer_pending(&connect->ack_timer))
+        timer_add(&connect->ctx->timers, &connect->ack_timer, connect->ctx->now + TCP_DELACK_MS);
+}
+
+/**
+ * @brief 关闭连接并从连接表中删除，之后connect不可再访问
+ *
+ * @param connect
+ */
+static void tcp_connect_drop(tcp_connect_t* connect) {
+    tcp_key_t key = new_tcp_key(connect->ip, connect->remote_port, connect->local_port);
+    release_tcp_connect(connect);
+    tcp_hash_delete(&connect_table[connect->ctx->id], &key);
+}
+
+/**
+ * @brief 重传定时器到期：RTO加倍，cwnd降为一个SMSS，从第一个未确认的字节开始重发，重传次数过多时放弃连接
+ *
+ * @param node 连接的rto_timer
+ * @param arg 协议栈上下文
+ */
+static void tcp_rto_expire(timer_node_t* node, void* arg) {
+    tcp_connect_t* connect = timer_entry(node, tcp_connect_t, rto_timer);
+    net_ctx_t* ctx = arg;
+    buf_init(&ctx->txbuf, 0);
+    uint8_t limit = connect->state == TCP_SYN_RCVD ? TCP_SYNACK_RETRIES :
+                    connect->state == TCP_SYN_SEND ? TCP_SYN_RETRIES : TCP_RETRIES_MAX;
+    if (++connect->retries > limit) {
+        // 对端没有回应过SYN，没有可以复位的连接
+        if (connect->state != TCP_SYN_SEND)
+            tcp_send(&ctx->txbuf, connect, tcp_flags_ack_rst);
+        if ((connect->state >= TCP_ESTABLISHED || connect->state == TCP_SYN_SEND) && connect->handler)
+            (*(tcp_handler_t)connect->handler)(connect, TCP_CONN_CLOSED);
+        tcp_connect_drop(connect);
+        return;
+    }
+    connect->rto = connect->rto * 2 < TCP_RTO_MAX_MS ? connect->rto * 2 : TCP_RTO_MAX_MS;
+    connect->rtt_timing = 0; // Karn算法：不用重传的报文段测量往返时间
+    if (connect->state != TCP_SYN_RCVD && connect->state != TCP_SYN_SEND && connect->retries == 1) {
+        // 同一段数据再次超时时ssthresh保持不变，见RFC 5681第3.1节
+        connect->ssthresh = connect->cc->ssthresh(connect);
+    }
+    connect->cwnd = connect->mss;
+    connect->cwnd_cnt = 0;
+    connect->dupacks = 0;
+    connect->in_recovery = 0;
+    connect->recover = connect->max_seq;
+    connect->next_seq = connect->unack_seq;
+    connect->sacked_num = 0; // 超时后从unack_seq起全部重发，不再相信对端可能反悔的SACK信息
+    if (connect->state == TCP_SYN_RCVD) {
+        tcp_send(&ctx->txbuf, connect, tcp_flags_ack_syn);
+    } else if (connect->state == TCP_SYN_SEND) {
+        tcp_send(&ctx->txbuf, connect, tcp_flags_syn);
+    } else if (tcp_output(connect) == 0) {
+        // 对端窗口为0时发不出数据，发一个ACK探测窗口
+        buf_init(&ctx->txbuf, 0);
+        tcp_send(&ctx->txbuf, connect, tcp_flags_ack);
+    }
+    // 重传的报文段不占用新的序号时tcp_send不会启动定时器
+    if (!timer_pending(&connect->rto_timer))
+        timer_add(&ctx->timers, &connect->rto_timer, ctx->now + connect->rto);
+}
+
+/**
+ * @brief 应用关闭连接后使用的回调函数，之后的事件都不再通知应用
+ *
+ * @param connect
+ * @param state
+ */
+static void tcp_closed_handler(tcp_connect_t* connect, connect_state_t state) {
+}
+
 /**
  * @brief 从外部关闭一个TCP连接, 会发送剩余数据
- *        供应用层使用
+ *        供应用层使用，之后connect不可再访问。握手完成前直接删除连接；
+ *        其余状态下连接留在连接表中，发完剩余数据与FIN，FIN被确认或重传超时后由协议栈释放
  *
  * @param connect
  */
 void tcp_connect_close(tcp_connect_t* connect) {
-    if (connect->state == TCP_ESTABLISHED) {
-        tcp_write_to_buf(connect, &txbuf);
-        tcp_send(&txbuf, connect, tcp_flags_ack_fin);
+    switch (connect->state) {
+    case TCP_ESTABLISHED:
+        connect->fin_queued = 1;
         connect->state = TCP_FIN_WAIT_1;
-        return;
+        // fall through
+    case TCP_CLOSE_WAIT:
+    case TCP_LAST_ACK:
+    case TCP_FIN_WAIT_1:
+    case TCP_FIN_WAIT_2:
+    case TCP_CLOSING:
+        connect->handler = tcp_closed_handler;
+        connect->user = NULL;
+        tcp_output(connect);
+        break;
+    default:
+        tcp_connect_drop(connect);
+        break;
     }
-    tcp_key_t key = new_tcp_key(connect->ip, connect->remote_port, connect->local_port);
+}
+
+/**
+ * @brief tcp_listen_close使用这个函数处理监听端口的连接，监听端口经tcp_hash_foreach的arg传入。
+ *        握手还没完成或还在accept队列中的连接复位并删除，应用已取走的连接不受影响
+ *
+ * @param connect
+ * @param arg 指向要关闭的监听端口
+ * @return int 为1时从连接表中删除
+ */
+static int close_listen_fn(tcp_connect_t* connect, void* arg) {
+    if (connect->listener != arg)
+        return 0;
+    if (connect->state != TCP_SYN_RCVD && !connect->queued) {
+        connect->listener = NULL;
+        return 0;
+    }
+    buf_init(&connect->ctx->txbuf, 0);
+    tcp_send(&connect->ctx->txbuf, connect, tcp_flags_ack_rst);
     release_tcp_connect(connect);
-    map_delete(&connect_table, &key);
+    return 1;
+}
+
+/**
+ * @brief 关闭监听端口，之后listen不可再访问
+ *        供应用层使用，会遍历所有上下文的连接表，多核模式下须在worker_stop之后调用
+ *
+ * @param listen 监听端口
+ */
+void tcp_listen_close(tcp_listen_t* listen) {
+    uint16_t port = listen->port;
+    for (int i = 0; i < NET_CTX_NUM; i++)
+        tcp_hash_foreach(&connect_table[i], close_listen_fn, listen);
+    map_delete(&tcp_table, &port);
+    listen_bitmap[port / 64] &= ~(1ull << (port % 64));
+    free(listen);
 }
 
 /**
@@ -253,19 +1294,27 @@ void tcp_connect_close(tcp_connect_t* connect) {
  * @return size_t
  */
 size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len) {
-    buf_t* rx_buf = connect->rx_buf;
-    size_t size = min32(rx_buf->len, len);
-    if (size == 0) return;
-    memcpy(data, rx_buf->data, size);
-    if (buf_remove_header(rx_buf, size) != 0) {
-        memmove(rx_buf->payload, rx_buf->data, rx_buf->len);
-        rx_buf->data = rx_buf->payload;
-    }
-    return size;
+    return ringbuf_read(&connect->rx_buf, data, len > UINT32_MAX ? UINT32_MAX : len);
+}
+
+/**
+ * @brief 发送缓存还能写入的字节数，缓存自动增长后能放下的也计入
+ *        供应用层使用
+ *
+ * @param connect
+ * @return size_t 已建立的连接之外为0
+ */
+size_t tcp_connect_write_space(tcp_connect_t* connect) {
+    if (connect->state != TCP_ESTABLISHED)
+        return 0;
+    uint32_t limit = tcp_tx_buf_limit(connect);
+    uint32_t size = connect->tx_buf.size > limit ? connect->tx_buf.size : limit;
+    return size - ringbuf_len(&connect->tx_buf);
 }
 
 /**
- * @brief 往connect的tx_buf里面写东西，返回成功的字节数，这里要判断窗口够不够，否则图片显示不全。
+ * @brief 往connect的tx_buf里面写东西，返回成功的字节数，缓存容量受对端窗口限制，否则图片显示不全。
+ *        写入后立即尝试发送，不足一个报文段的数据按Nagle算法与cork设置合并到后续写入中。
  *        供应用层使用
  *
  * @param connect
@@ -274,48 +1323,395 @@ size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len) {
  */
 size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len) {
     // printf("tcp_connect_write size: %zu\n", len);
-    buf_t* tx_buf = connect->tx_buf;
+    ringbuf_t* tx_buf = &connect->tx_buf;
+    if (len > UINT32_MAX) len = UINT32_MAX;
+    tcp_buf_autotune(tx_buf, len, tcp_tx_buf_limit(connect));
+    size_t size = ringbuf_write(tx_buf, data, len);
+    tcp_output(connect);
+    return size;
+}
 
-    uint8_t* dst = tx_buf->data + tx_buf->len;
-    size_t size = min32(&tx_buf->payload[BUF_MAX_LEN] - dst, len);
+/**
+ * @brief 设置是否关闭Nagle算法，类似TCP_NODELAY。关闭后立即发出已缓存的小报文段，适合交互式的应用
+ *        供应用层使用
+ *
+ * @param connect
+ * @param on 非0为关闭Nagle算法
+ */
+void tcp_connect_set_nodelay(tcp_connect_t* connect, int on) {
+    connect->nodelay = on != 0;
+    if (connect->nodelay)
+        tcp_output(connect);
+}
 
-    if (connect->next_seq - connect->unack_seq + len >= connect->remote_win) {
+/**
+ * @brief 塞住或解除塞住发送，类似TCP_CORK。塞住期间只发送满长度的报文段，
+ *        应用分多次写入的报头与正文因此合并成尽量大的报文段；解除时不按Nagle算法等待，立即发出剩余的数据
+ *        供应用层使用
+ *
+ * @param connect
+ * @param on 非0为塞住
+ */
+void tcp_connect_set_cork(tcp_connect_t* connect, int on) {
+    connect->cork = on != 0;
+    if (connect->cork)
+        return;
+    // 解除塞住时剩余的数据不再等待在途数据被确认
+    uint8_t nodelay = connect->nodelay;
+    connect->nodelay = 1;
+    tcp_output(connect);
+    connect->nodelay = nodelay;
+}
+
+/**
+ * @brief 按对端SYN中的选项协商，再按协商出的SMSS初始化拥塞控制状态
+ *
+ * @param connect
+ * @param opts 对端SYN中的选项
+ */
+static void tcp_connect_negotiate(tcp_connect_t* connect, tcp_opts_t* opts) {
+    tcp_negotiate_options(connect, opts);
+    // 初始窗口见RFC 6928，慢启动阈值初始为无穷大
+    connect->cwnd = min32(10 * connect->mss, 2 * connect->mss > 14600 ? 2 * connect->mss : 14600);
+    connect->ssthresh = UINT32_MAX;
+    connect->recover = connect->unack_seq;
+    connect->cc = tcp_cc_default();
+    if (connect->cc->init)
+        connect->cc->init(connect);
+}
+
+/**
+ * @brief 初始化新连接：记录地址与端口，初始化序号、重传与延迟确认状态。
+ *        被动打开时随后按对端SYN中的选项调用tcp_connect_negotiate，主动打开时等收到SYN+ACK再协商
+ *
+ * @param connect 新连接
+ * @param ctx 协议栈上下文
+ * @param netif 收发报文段的网卡
+ * @param key 连接的[IP, src port, dst port]
+ * @param handler 回调函数
+ * @param isn 本端的初始序号
+ * @param peer_isn 对端的初始序号，主动打开时还不知道
+ */
+static void tcp_connect_setup(tcp_connect_t* connect, net_ctx_t* ctx, netif_t* netif, const tcp_key_t* key,
+                              tcp_handler_t handler, uint32_t isn, uint32_t peer_isn) {
+    connect->ctx = ctx;
+    connect->netif = netif;
+    memcpy(connect->ip, key->ip, NET_IP_LEN);
+    connect->local_port = key->dst_port;
+    connect->remote_port = key->src_port;
+    connect->unack_seq = isn;
+    connect->next_seq = isn;
+    connect->max_seq = isn;
+    connect->ack = peer_isn + 1;
+    connect->handler = handler;
+    connect->rto = TCP_RTO_INIT_MS;
+    timer_init(&connect->rto_timer, tcp_rto_expire);
+    timer_init(&connect->ack_timer, tcp_delack_expire);
+    connect->ack_pending = 0;
+    connect->nodelay = 0;
+    connect->cork = 0;
+    connect->active = 0;
+    connect->listener = NULL;
+    connect->queued = 0;
+}
+
+/**
+ * @brief 不建立连接，直接回复一个报文段，用于SYN cookie的SYN+ACK、对未知连接的RST与TIME_WAIT中的ACK
+ *
+ * @param ctx 协议栈上下文
+ * @param netif 网卡
+ * @param key 报文段所属的[IP, src port, dst port]
+ * @param seq 序号
+ * @param ack 确认号
+ * @param flags 标志
+ */
+static void tcp_send_stateless(net_ctx_t* ctx, netif_t* netif, const tcp_key_t* key, uint32_t seq, uint32_t ack,
+                               tcp_flags_t flags) {
+    tcp_connect_t tmp = CONNECT_LISTEN; // 不协商任何选项，SYN+ACK中只通告MSS
+    tmp.ctx = ctx;
+    tmp.netif = netif;
+    memcpy(tmp.ip, key->ip, NET_IP_LEN);
+    tmp.local_port = key->dst_port;
+    tmp.remote_port = key->src_port;
+    tmp.ack = ack;
+    buf_init(&ctx->txbuf, 0);
+    tcp_xmit(&ctx->txbuf, &tmp, seq, flags);
+}
+
+/**
+ * @brief 2MSL定时器到期，回收TIME_WAIT记录，主动打开的连接这时才归还本地端口
+ *
+ * @param node 记录的timer
+ * @param arg 协议栈上下文
+ */
+static void tcp_timewait_expire(timer_node_t* node, void* arg) {
+    tcp_timewait_t* tw = timer_entry(node, tcp_timewait_t, timer);
+    net_ctx_t* ctx = arg;
+    if (tw->active)
+        tcp_port_free(ctx, tw->key.dst_port);
+    tcp_timewait_delete(&timewait_table[ctx->id], tw);
+}
+
+/**
+ * @brief 本端先关闭的连接双方的FIN都已确认，进入TIME_WAIT：只留下一条精简记录等待2MSL，连接对象与收发缓存立即释放。
+ *        记录数达到上限时直接关闭
+ *
+ * @param connect 连接，之后不可再访问
+ */
+static void tcp_timewait_enter(tcp_connect_t* connect) {
+    net_ctx_t* ctx = connect->ctx;
+    tcp_key_t key = new_tcp_key(connect->ip, connect->remote_port, connect->local_port);
+    tcp_timewait_t* tw = tcp_timewait_add(&timewait_table[ctx->id], &key);
+    if (tw != NULL) {
+        tw->snd_nxt = connect->fin_seq + 1;
+        tw->rcv_nxt = connect->ack;
+        tw->netif = connect->netif;
+        tw->active = connect->active;
+        connect->active = 0;
+        timer_init(&tw->timer, tcp_timewait_expire);
+        timer_add(&ctx->timers, &tw->timer, ctx->now + TCP_TIMEWAIT_MS);
+    }
+    release_tcp_connect(connect);
+    tcp_hash_delete(&connect_table[ctx->id], &key);
+}
+
+/**
+ * @brief TIME_WAIT中收到报文段：RST忽略，不让它提前结束TIME_WAIT，见RFC 1337；
+ *        被动打开的连接收到序号在旧连接之后的SYN，回收记录，按新连接处理，见RFC 1122第4.2.2.13节；
+ *        其余的报文段，如对端因最后的ACK丢失而重传的FIN，重发最后的ACK，FIN还会重启2MSL定时器
+ *
+ * @param ctx 协议栈上下文
+ * @param tw 记录
+ * @param seq 报文段的序号
+ * @param flags 报文段的标志
+ * @return int 记录已回收、报文段按没有连接处理为1，报文段已处理完为0
+ */
+static int tcp_timewait_in(net_ctx_t* ctx, tcp_timewait_t* tw, uint32_t seq, tcp_flags_t flags) {
+    if (flags.rst)
         return 0;
+    if (flags.syn && !flags.ack && !tw->active && tcp_seq_lt(tw->rcv_nxt, seq)) {
+        timer_cancel(&tw->timer);
+        tcp_timewait_delete(&timewait_table[ctx->id], tw);
+        return 1;
     }
-    if (buf_add_padding(tx_buf, size) != 0) {
-        memmove(tx_buf->payload, tx_buf->data, tx_buf->len);
-        tx_buf->data = tx_buf->payload;
-        dst = tx_buf->data + tx_buf->len;
-        if (tcp_write_to_buf(connect, &txbuf)) {
-            tcp_send(&txbuf, connect, tcp_flags_ack);
-        }
+    tcp_send_stateless(ctx, tw->netif, &tw->key, tw->snd_nxt, tw->rcv_nxt, tcp_flags_ack);
+    if (flags.fin)
+        timer_add(&ctx->timers, &tw->timer, ctx->now + TCP_TIMEWAIT_MS);
+    return 0;
+}
+
+/**
+ * @brief 以tcp_secret为密钥，对用途、连接的[IP, src port, dst port]与附加数据做SipHash。
+ *        各用途共用一个密钥，用途不同的散列值互不相关
+ *
+ * @param use 用途，TCP_SECRET_*
+ * @param key 连接的[IP, src port, dst port]
+ * @param extra 附加数据
+ * @return uint64_t
+ */
+uint64_t tcp_secret_hash(uint32_t use, const tcp_key_t* key, uint64_t extra) {
+    uint8_t data[sizeof(use) + sizeof(tcp_key_t) + sizeof(extra)];
+    memcpy(data, &use, sizeof(use));
+    memcpy(data + sizeof(use), key, sizeof(tcp_key_t));
+    memcpy(data + sizeof(use) + sizeof(tcp_key_t), &extra, sizeof(extra));
+    return siphash(tcp_secret, data, sizeof(data));
+}
+
+/**
+ * @brief 生成初始序号：每4微秒加1的时钟加上连接四元组的带密钥散列，见RFC 6528。
+ *        同一四元组先后的连接序号随时间递增，不同四元组之间无法相互推测
+ *
+ * @param key 连接的[IP, src port, dst port]
+ * @param local_ip 本端ip
+ * @return uint32_t
+ */
+static uint32_t tcp_isn(const tcp_key_t* key, const uint8_t* local_ip) {
+    uint32_t ip;
+    memcpy(&ip, local_ip, NET_IP_LEN);
+    // 时钟取自微秒级的单调时钟而不是按毫秒推进的ctx->now，同一毫秒内的序号也能递增
+    return (uint32_t)tcp_secret_hash(TCP_SECRET_ISN, key, ip) + (uint32_t)(time_us() / 4);
+}
+
+/**
+ * @brief SYN cookie中的24位散列值，由密钥、连接的地址端口、对端初始序号、计数器与MSS下标决定
+ *
+ * @param key 连接的[IP, src port, dst port]
+ * @param peer_isn 对端的初始序号
+ * @param count 计数器
+ * @param mss_index MSS下标
+ * @return uint32_t
+ */
+static uint32_t tcp_cookie_hash(const tcp_key_t* key, uint32_t peer_isn, uint32_t count, uint32_t mss_index) {
+    uint64_t extra = (uint64_t)peer_isn << 32 | count << 3 | mss_index;
+    return (uint32_t)tcp_secret_hash(TCP_SECRET_COOKIE, key, extra) & 0xffffff;
+}
+
+/**
+ * @brief 生成SYN cookie作为本端的初始序号：高5位是64秒一跳的计数器，其后3位是MSS下标，低24位是散列值，见RFC 4987第3.6节
+ *
+ * @param ctx 协议栈上下文
+ * @param key 连接的[IP, src port, dst port]
+ * @param peer_isn 对端的初始序号
+ * @param mss 对端通告的MSS，没有时为0
+ * @return uint32_t
+ */
+static uint32_t tcp_cookie_make(net_ctx_t* ctx, const tcp_key_t* key, uint32_t peer_isn, uint16_t mss) {
+    uint32_t count = (ctx->now / TCP_COOKIE_PERIOD_MS) & 31;
+    uint32_t mss_index = 0;
+    if (mss == 0)
+        mss = TCP_DEFAULT_MSS;
+    while (mss_index < 7 && cookie_mss[mss_index + 1] <= mss)
+        mss_index++;
+    return count << 27 | mss_index << 24 | tcp_cookie_hash(key, peer_isn, count, mss_index);
+}
+
+/**
+ * @brief 检查握手第三个报文段确认的SYN cookie，计数器只接受当前与上一个周期
+ *
+ * @param ctx 协议栈上下文
+ * @param key 连接的[IP, src port, dst port]
+ * @param peer_isn 对端的初始序号
+ * @param cookie 本端的初始序号，即确认号减1
+ * @return uint16_t cookie中编码的MSS，无效时为0
+ */
+static uint16_t tcp_cookie_check(net_ctx_t* ctx, const tcp_key_t* key, uint32_t peer_isn, uint32_t cookie) {
+    uint32_t count = cookie >> 27, mss_index = (cookie >> 24) & 7;
+    uint32_t age = ((ctx->now / TCP_COOKIE_PERIOD_MS) - count) & 31;
+    if (age > 1 || tcp_cookie_hash(key, peer_isn, count, mss_index) != (cookie & 0xffffff))
         return 0;
+    return cookie_mss[mss_index];
+}
+
+/**
+ * @brief 收到确认了有效SYN cookie的ACK，直接建立连接。
+ *        cookie只保存了MSS，窗口扩大、SACK与时间戳在这样的连接上都不启用
+ *
+ * @param ctx 协议栈上下文
+ * @param netif 网卡
+ * @param key 连接的[IP, src port, dst port]
+ * @param listen 监听端口
+ * @param seq ACK的序号
+ * @param ack ACK的确认号
+ * @param window ACK中的窗口
+ * @return tcp_connect_t* 新连接，cookie无效或连接表已满时为NULL
+ */
+static tcp_connect_t* tcp_cookie_accept(net_ctx_t* ctx, netif_t* netif, const tcp_key_t* key, tcp_listen_t* listen,
+                                        uint32_t seq, uint32_t ack, uint16_t window) {
+    tcp_opts_t opts = {.wscale = -1};
+    opts.mss = tcp_cookie_check(ctx, key, seq - 1, ack - 1);
+    if (opts.mss == 0)
+        return NULL;
+    tcp_connect_t* connect = tcp_hash_add(&connect_table[ctx->id], key);
+    if (connect == NULL)
+        return NULL;
+    tcp_connect_setup(connect, ctx, netif, key, listen->handler, ack, seq - 1);
+    tcp_connect_negotiate(connect, &opts);
+    connect->listener = listen;
+    connect->remote_win = window;
+    tcp_connect_established(connect);
+    tcp_listen_connected(connect);
+    return connect;
+}
+
+/**
+ * @brief 为到ip:port的连接分配一个临时端口，见RFC 6056第3.3.3节。
+ *        起始偏移是目的地址端口的带密钥散列加上分配次数，外部无法预测；从起始偏移开始在位图中找空闲端口，
+ *        整字已满时一次跳过64个端口，即使同一目的地已有数万条连接，也只需扫描几百个字
+ *        跳过已注册监听的端口；多核模式下只取回来的报文段会分发到本上下文的端口
+ *
+ * @param ctx 协议栈上下文
+ * @param netif 发出连接的网卡
+ * @param ip 对端ip
+ * @param port 对端端口
+ * @return uint16_t 本地端口，没有可用的端口时为0
+ */
+static uint16_t tcp_port_alloc(net_ctx_t* ctx, netif_t* netif, uint8_t* ip, uint16_t port) {
+    uint64_t* bitmap = port_bitmap[ctx->id];
+    uint32_t range = TCP_PORT_MAX - TCP_PORT_MIN + 1;
+    tcp_key_t key = new_tcp_key(ip, port, 0);
+    uint32_t offset = ((uint32_t)tcp_secret_hash(TCP_SECRET_PORT, &key, 0) + port_next[ctx->id]++) % range;
+    for (uint32_t i = 0; i < range; i++) {
+        uint16_t local = TCP_PORT_MIN + (offset + i) % range;
+        uint64_t word = bitmap[local / 64];
+        if (word == UINT64_MAX) {
+            // 范围外的位从不置位，满的字一定整个在范围内，跳到下一个字
+            i += 63 - local % 64;
+            continue;
+        }
+        if ((word >> (local % 64)) & 1 || (listen_bitmap[local / 64] >> (local % 64)) & 1)
+            continue;
+#ifdef NET_MULTICORE
+        uint16_t ports[2] = {swap16(port), swap16(local)};
+        if (worker_steer_flow(ip, netif->ip, (uint8_t*)ports) + 1 != ctx->id)
+            continue;
+#endif
+        bitmap[local / 64] |= 1ull << (local % 64);
+        return local;
     }
-    memcpy(dst, data, size);
-    return size;
+    return 0;
+}
+
+/**
+ * @brief 主动打开到ip:port的连接：分配临时端口，发送SYN后立即返回。
+ *        握手完成时以TCP_CONN_CONNECTED调用handler，被拒绝或超时以TCP_CONN_CLOSED调用，之后连接不可再访问
+ *        供应用层使用，须在处理该连接的上下文所在的线程中调用，多核模式下即工作线程的上下文
+ *
+ * @param ctx 协议栈上下文
+ * @param ip 对端ip
+ * @param port 对端端口
+ * @param handler 回调函数
+ * @return tcp_connect_t* 新连接，没有可用的临时端口或连接表已满时为NULL
+ */
+tcp_connect_t* tcp_connect(net_ctx_t* ctx, uint8_t* ip, uint16_t port, tcp_handler_t handler) {
+    uint8_t next_hop[NET_IP_LEN];
+    netif_t* netif = route_lookup(ip, next_hop);
+    uint16_t local_port = tcp_port_alloc(ctx, netif, ip, port);
+    if (local_port == 0)
+        return NULL;
+    tcp_key_t key = new_tcp_key(ip, port, local_port);
+    tcp_connect_t* connect = tcp_hash_add(&connect_table[ctx->id], &key);
+    if (connect == NULL) {
+        tcp_port_free(ctx, local_port);
+        return NULL;
+    }
+    tcp_connect_setup(connect, ctx, netif, &key, handler, tcp_isn(&key, netif->ip), 0);
+    connect->active = 1;
+    // SYN中提出全部选项，收到SYN+ACK后按对端的回应协商
+    connect->sack_ok = 1;
+    connect->ts_ok = 1;
+    connect->ts_recent = 0;
+    connect->rcv_wscale = tcp_rcv_wscale();
+    memset(&connect->rx_buf, 0, sizeof(ringbuf_t));
+    memset(&connect->tx_buf, 0, sizeof(ringbuf_t));
+    connect->state = TCP_SYN_SEND;
+    buf_init(&ctx->txbuf, 0);
+    tcp_send(&ctx->txbuf, connect, tcp_flags_syn);
+    return connect;
 }
 
 /**
  * @brief 服务器端TCP收包
  *
+ * @param ctx
+ * @param netif
  * @param buf
  * @param src_ip
  */
-void tcp_in(buf_t* buf, uint8_t* src_ip) {
+void tcp_in(net_ctx_t* ctx, netif_t* netif, buf_t* buf, uint8_t* src_ip) {
     // printf("<<< tcp_in >>>\n");
     /*
     1、大小检查，检查buf长度是否小于tcp头部，如果是，则丢弃
     */
     if (buf->len < sizeof(tcp_hdr_t)) return;
-    tcp_hdr_t *tcp_hdr_in = buf->data;
-    if (tcp_hdr_in->data_offset * 4 < sizeof(tcp_hdr_t)) return;
+    tcp_hdr_t *tcp_hdr_in = (tcp_hdr_t *)buf->data;
+    if (tcp_hdr_in->data_offset * 4 < sizeof(tcp_hdr_t) || tcp_hdr_in->data_offset * 4u > buf->len) return;
     /*
     2、检查checksum字段，如果checksum出错，则丢弃
     */
     // 检验校验和，不一致则丢弃，一致则恢复校验和字段
     uint16_t chunksum_received = tcp_hdr_in->chunksum16;
     tcp_hdr_in->chunksum16 = 0;
-    if (chunksum_received != tcp_checksum(buf, src_ip, net_if_ip)) {
+    if (chunksum_received != tcp_checksum(buf, src_ip, netif->ip)) {
         printf("checksum wrong!\n");
         return;
     };
@@ -331,45 +1727,87 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     uint32_t ack_number = swap32(tcp_hdr_in->ack_number32);
     uint8_t data_offset = tcp_hdr_in->data_offset;
     tcp_flags_t flags = tcp_hdr_in->flags;
+    tcp_opts_t opts;
+    tcp_parse_options(tcp_hdr_in, &opts);
     /*
-    4、调用map_get函数，根据destination port查找对应的handler函数
+    4、调用new_tcp_key函数，根据通信五元组中的源IP地址、目标IP地址、目标端口号确定一个tcp链接key，
+       再调用tcp_hash_get函数，根据key查找一个tcp_connect_t* connect
     */
-    tcp_handler_t *handler = map_get(&tcp_table, &dst_port);
-    if (handler == NULL) return;
+    tcp_key_t key = new_tcp_key(src_ip, src_port, dst_port);
+    tcp_hash_t *table = &connect_table[ctx->id];
+    tcp_connect_t *connect = tcp_hash_get(table, &key);
     /*
-    5、调用new_tcp_key函数，根据通信五元组中的源IP地址、目标IP地址、目标端口号确定一个tcp链接key
+    5、确定handler函数：已有的连接用自己的handler，主动打开的连接的本地端口不在tcp_table中；
+       没有连接时先查TIME_WAIT表，由tcp_timewait_in处理属于已关闭连接的报文段，
+       再调用map_get函数，根据destination port查找监听端口，端口没有注册则丢弃
     */
-    tcp_key_t key = new_tcp_key(src_ip, src_port, dst_port);
+    tcp_handler_t handler;
+    tcp_listen_t *listen = NULL;
+    if (connect != NULL) {
+        handler = connect->handler;
+        listen = connect->listener;
+    } else {
+        tcp_timewait_t *tw = tcp_timewait_get(&timewait_table[ctx->id], &key);
+        if (tw != NULL && !tcp_timewait_in(ctx, tw, seq_number, flags)) return;
+        tcp_listen_t **entry = map_get(&tcp_table, &dst_port);
+        if (entry == NULL) return;
+        listen = *entry;
+        handler = listen->handler;
+    }
     /*
-    6、调用map_get函数，根据key查找一个tcp_connect_t* connect，
-    如果没有找到，则调用map_set建立新的链接，并设置为CONNECT_LISTEN状态，然后调用mag_get获取到该链接。
+    6、如果没有找到连接：
+        （1）RST直接丢弃
+        （2）不是SYN的报文段，确认了有效SYN cookie的ACK直接建立连接，其余回复RST，都不预先分配连接：
+            带ACK的回复<SEQ=SEG.ACK><CTL=RST>，不带ACK的回复<SEQ=0><ACK=SEG.SEQ+SEG.LEN><CTL=RST,ACK>；
+            accept队列已满时丢弃，等对端重传
+        （3）SYN在半连接数未达上限时调用tcp_hash_add建立新的链接，新链接清零即为TCP_LISTEN状态；
+            半连接队列或连接表已满时回复以SYN cookie为序号的SYN+ACK，不保存任何状态
     */
-    tcp_connect_t *connect = (tcp_connect_t *)map_get(&connect_table, &key);
     if (connect == NULL) {
-        connect = (tcp_connect_t *)malloc(sizeof(tcp_connect_t));
-        connect->state = TCP_LISTEN;
-        map_set(&connect_table, &key, connect);
-        connect = (tcp_connect_t *)map_get(&connect_table, &key);
+        if (flags.rst) return;
+        if (!flags.syn) {
+            if (flags.ack && tcp_listen_full(listen, ctx)) return;
+            if (!flags.ack ||
+                (connect = tcp_cookie_accept(ctx, netif, &key, listen, seq_number, ack_number,
+                                             swap16(tcp_hdr_in->window_size16))) == NULL) {
+                // 复位序号按RFC 793第3.4节：带ACK的报文段以其确认号为序号，不带ACK的确认其全部序号
+                if (flags.ack)
+                    tcp_send_stateless(ctx, netif, &key, ack_number, 0, tcp_flags_rst);
+                else
+                    tcp_send_stateless(ctx, netif, &key, 0, seq_number + buf->len - data_offset * 4 + flags.fin,
+                                       tcp_flags_ack_rst);
+                return;
+            }
+        } else if (syn_rcvd_num[ctx->id] >= TCP_SYN_BACKLOG || (connect = tcp_hash_add(table, &key)) == NULL) {
+            uint32_t cookie = tcp_cookie_make(ctx, &key, seq_number, opts.mss);
+            tcp_send_stateless(ctx, netif, &key, cookie, seq_number + 1, tcp_flags_ack_syn);
+            return;
+        }
     }
     /*
-    7、从TCP头部字段中获取对方的窗口大小，注意大小端转换
+    7、从TCP头部字段中获取对方的窗口大小，注意大小端转换，SYN以外的报文段按窗口扩大因子左移
     */
-    uint16_t window_size = swap16(tcp_hdr_in->window_size16);
+    uint32_t window_size = swap16(tcp_hdr_in->window_size16);
+    if (!flags.syn)
+        window_size <<= connect->snd_wscale;
     /*
     8、如果为TCP_LISTEN状态，则需要完成如下功能：
         （1）如果收到的flag带有rst，则close_tcp关闭tcp链接
         （2）如果收到的flag不是syn，则reset_tcp复位通知。因为收到的第一个包必须是syn
-        （3）调用init_tcp_connect_rcvd函数，初始化connect，将状态设为TCP_SYN_RCVD
-        （4）填充connect字段，包括
+        （3）调用tcp_connect_setup填充connect字段，包括
             local_port、remote_port、ip、
-            unack_seq（设为随机值）、由于是对syn的ack应答包，next_seq与unack_seq一致
+            unack_seq（由tcp_isn生成）、由于是对syn的ack应答包，next_seq与unack_seq一致
             ack设为对方的sequence number+1
-            设置remote_win为对方的窗口大小，注意大小端转换
+            按SYN中的选项协商MSS、窗口扩大因子、SACK与时间戳
+            再设置remote_win为对方的窗口大小，注意大小端转换
+        （4）调用init_tcp_connect_rcvd函数，将状态设为TCP_SYN_RCVD，收发缓存等握手完成再分配
         （5）调用buf_init初始化txbuf
         （6）调用tcp_send将txbuf发送出去，也就是回复一个tcp_flags_ack_syn（SYN+ACK）报文
         （7）处理结束，返回。
     */
     if (connect->state == TCP_LISTEN) {
+        connect->netif = netif;
+        connect->ctx = ctx;
         // rst = 1，close_tcp关闭tcp链接
         if (flags.rst) {
             goto close_tcp;
@@ -381,35 +1819,85 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
         }
         // rst = 0, syn = 1:
         // 初始化connect，填充字段
+        tcp_connect_setup(connect, ctx, netif, &key, handler, tcp_isn(&key, netif->ip), seq_number);
+        tcp_connect_negotiate(connect, &opts);
+        connect->listener = listen;
+        connect->remote_win = window_size;
         init_tcp_connect_rcvd(connect);
-        connect->local_port = dst_port;
-        connect->remote_port = src_port;
-        memcpy(connect->ip, src_ip, NET_IP_LEN);
-        srand((unsigned)time(NULL));
-        connect->unack_seq = rand();
-        connect->next_seq = connect->unack_seq;
+        buf_init(&ctx->txbuf, 0);
+        tcp_send(&ctx->txbuf, connect, tcp_flags_ack_syn);
+        return;
+    }
+    /*
+    如果为TCP_SYN_SEND状态（主动打开），则等待SYN+ACK：
+        （1）确认号不是本端ISN+1的报文段丢弃；带RST且确认号正确，说明对端拒绝连接，调用handler通知TCP_CONN_CLOSED，再close_tcp
+        （2）没有SYN的报文段丢弃；同时打开（只有SYN）不支持，也丢弃，等对端重传
+        （3）ack设为对方的sequence number+1，按SYN+ACK中的选项协商，再调用tcp_ack_update确认本端的SYN
+        （4）调用tcp_connect_established分配收发缓存，调用回调函数进入TCP_CONN_CONNECTED
+        （5）应用在回调中写入的数据捎带确认，否则回复一个ACK完成三次握手
+    */
+    if (connect->state == TCP_SYN_SEND) {
+        if (!flags.ack || ack_number != connect->next_seq) return;
+        if (flags.rst) {
+            handler(connect, TCP_CONN_CLOSED);
+            goto close_tcp;
+        }
+        if (!flags.syn) return;
         connect->ack = seq_number + 1;
         connect->remote_win = window_size;
-        buf_init(&txbuf, 0);
-        tcp_send(&txbuf, connect, tcp_flags_ack_syn);
+        tcp_connect_negotiate(connect, &opts);
+        connect->ts_ecr_valid = connect->ts_ok;
+        connect->ts_ecr = opts.tsecr;
+        tcp_ack_update(connect, ack_number);
+        tcp_connect_established(connect);
+        handler(connect, TCP_CONN_CONNECTED);
+        if (connect->state == TCP_ESTABLISHED && tcp_output(connect) == 0) {
+            buf_init(&ctx->txbuf, 0);
+            tcp_send(&ctx->txbuf, connect, tcp_flags_ack);
+        }
         return;
     }
-    /* 
-    9、检查接收到的sequence number，如果与ack序号不一致,则reset_tcp复位通知。
+    /*
+    9、记录时间戳：按序的报文段的时间戳留待回显，ACK回显的时间戳用于测量往返时间，见RFC 7323第4节。
+       然后调用buf_remove_header去除头部，剩下的都是数据
+    */
+    connect->ts_ecr_valid = connect->ts_ok && opts.ts_ok && flags.ack;
+    connect->ts_ecr = opts.tsecr;
+    if (connect->ts_ok && opts.ts_ok && tcp_seq_leq(seq_number, connect->ack) && tcp_seq_leq(connect->ts_recent, opts.tsval))
+        connect->ts_recent = opts.tsval;
+    buf_remove_header(buf, data_offset * 4);
+    /*
+    10、检查接收到的sequence number：
+        开头一部分已经收到过的报文段，去掉重复的部分后按序处理；
+        仍与ack序号不一致的，是重传的旧报文段或乱序报文段，不能复位，否则任何一次丢包都会断开连接。
+        ESTABLISHED状态下把乱序报文段存入乱序队列，空洞补齐后一起交给应用；
+        都要处理其中的确认号，并立即回复一个ACK告诉对端期望的序号，连续的重复ACK会触发对端快速重传。
     */
+    if (tcp_seq_lt(seq_number, connect->ack) && tcp_seq_lt(connect->ack, seq_number + buf->len + flags.fin)) {
+        uint32_t dup = connect->ack - seq_number;
+        buf_remove_header(buf, dup < buf->len ? dup : buf->len);
+        seq_number = connect->ack;
+    }
     if (seq_number != connect->ack) {
-        goto reset_tcp;
+        if (flags.rst) return;
+        if (connect->state == TCP_ESTABLISHED && tcp_seq_lt(connect->ack, seq_number))
+            tcp_ooo_insert(connect, seq_number, buf, flags.fin);
+        if (flags.ack && connect->state != TCP_SYN_RCVD) {
+            tcp_ack_in(connect, ack_number, window_size, buf->len, flags, &opts);
+            tcp_output(connect);
+        }
+        buf_init(&ctx->txbuf, 0);
+        tcp_send(&ctx->txbuf, connect, tcp_flags_ack);
+        return;
     }
     /* 
-    10、检查flags是否有rst标志，如果有，则close_tcp连接重置
+    11、检查flags是否有rst标志，如果有，则close_tcp连接重置，已建立的连接先调用handler通知TCP_CONN_CLOSED
     */
     if (flags.rst) {
+        if (connect->state >= TCP_ESTABLISHED)
+            handler(connect, TCP_CONN_CLOSED);
         goto close_tcp;
     }
-    /*
-    11、序号相同时的处理，调用buf_remove_header去除头部后剩下的都是数据
-    */
-    buf_remove_header(buf, data_offset * 4);
     /* 状态转换
     */
     switch (connect->state) {
@@ -424,14 +1912,14 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
         if (!flags.ack) return;
         /*
         13、如果是ack包，需要完成如下功能：
-            （1）将unack_seq +1
+            （1）调用tcp_ack_update确认SYN，unack_seq +1，停止重传定时器；确认号不对则不处理
             （2）将状态转成ESTABLISHED
-            （3）调用回调函数，完成三次握手，进入连接状态TCP_CONN_CONNECTED。
+            （3）调用tcp_listen_connected完成三次握手：不排队时调用回调函数，进入连接状态TCP_CONN_CONNECTED，
+                否则放入accept队列；队列已满时不处理这个ACK，SYN+ACK由重传定时器重发
         */
-        connect->unack_seq++;
-        connect->state = TCP_ESTABLISHED;
-        
-        (*handler)(connect, TCP_CONN_CONNECTED);
+        if (tcp_listen_full(listen, ctx) || !tcp_ack_update(connect, ack_number)) return;
+        tcp_connect_established(connect);
+        tcp_listen_connected(connect);
         break;
 
     case TCP_ESTABLISHED:
@@ -443,46 +1931,54 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
         /*
         15、这里先处理ACK的值，
             如果是ack包，
-            且unack_seq小于sequence number（说明有部分数据被对端接收确认了，否则可能是之前重发的ack，可以不处理），
-            且next_seq大于sequence number
-            则调用buf_remove_header函数，去掉被对端接收确认的部分数据，并更新unack_seq值
+            且unack_seq小于acknowledge number（说明有部分数据被对端接收确认了，否则可能是之前重发的ack，可以不处理），
+            且next_seq不小于acknowledge number
+            则调用tcp_ack_in函数，去掉被对端接收确认的部分数据，更新unack_seq值、重传定时器与拥塞窗口
             
         */
-        if (flags.ack && connect->unack_seq < ack_number && connect->next_seq > ack_number) {
-            buf_remove_header(connect->tx_buf, ack_number - connect->unack_seq);
-            connect->unack_seq = ack_number;
+        if (flags.ack) {
+            tcp_ack_in(connect, ack_number, window_size, buf->len, flags, &opts);
         }
         /*
         16、然后接收数据
-            调用tcp_read_from_buf函数，把buf放入rx_buf中
+            调用tcp_read_from_buf函数，把buf放入rx_buf中，接上乱序队列中已经连续的数据；
+            乱序到达的FIN也在这时生效
         */
-        int read_buf_len = tcp_read_from_buf(connect, buf);
+        int filled = connect->ooo_num > 0;
+        uint32_t read_buf_len = tcp_read_from_buf(connect, buf);
+        if (connect->ooo_fin && connect->ack == connect->ooo_fin_seq)
+            flags.fin = 1;
 
         /*
         17、再然后，根据当前的标志位进一步处理
             （1）首先调用buf_init初始化txbuf
-            （2）判断是否收到关闭请求（FIN），如果是，将状态改为TCP_LAST_ACK，ack +1，再发送一个ACK + FIN包，并退出，
-                这样就无需进入CLOSE_WAIT，直接等待对方的ACK
-            （3）如果不是FIN，则看看是否有数据，如果有，则发ACK相应，并调用handler回调函数进行处理
-            （4）调用tcp_write_to_buf函数，看看是否有数据需要发送，如果有，同时发数据和ACK
-            （5）没有收到数据，可能对方只发一个ACK，可以不响应
+            （2）判断是否收到关闭请求（FIN），如果是，将状态改为TCP_LAST_ACK，ack +1，调用handler通知应用读取剩余数据，
+                读到0字节即知对端已关闭；发完剩余数据后带上FIN，并退出，这样就无需进入CLOSE_WAIT，直接等待对方的ACK
+            （3）如果不是FIN，则看看是否有数据，如果有，则记下待确认的报文段，并调用handler回调函数进行处理
+            （4）调用tcp_output函数，在拥塞窗口与对端窗口允许的范围内发送数据，数据报文段捎带确认
+            （5）确认没有被捎带时调用tcp_ack_delayed，每两个报文段或填补空洞时立即确认，否则延迟确认
+            （6）没有收到数据，可能对方只发一个ACK，可以不响应
 
         */
-        buf_init(&txbuf, 0);
+        buf_init(&ctx->txbuf, 0);
         if (flags.fin) {
             connect->state = TCP_LAST_ACK;
             connect->ack++;
-            tcp_send(&txbuf, connect, tcp_flags_ack_fin);
+            connect->fin_queued = 1;
+            handler(connect, TCP_CONN_DATA_RECV);
+            if (tcp_output(connect) == 0) {
+                buf_init(&ctx->txbuf, 0);
+                tcp_send(&ctx->txbuf, connect, tcp_flags_ack);
+            }
             return;
         }
         if (read_buf_len > 0) {
-            (*handler)(connect, TCP_CONN_DATA_RECV);
-            tcp_send(&txbuf, connect, tcp_flags_ack);
-        }
-        int write_buf_len = tcp_write_to_buf(connect, &txbuf);
-        if (write_buf_len > 0) {
-            tcp_send(&txbuf, connect, tcp_flags_ack);
+            connect->ack_pending++;
+            handler(connect, TCP_CONN_DATA_RECV);
         }
+        tcp_output(connect);
+        if (connect->ack_pending)
+            tcp_ack_delayed(connect, filled);
         break;
 
     case TCP_CLOSE_WAIT:
@@ -491,36 +1987,65 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
 
     case TCP_FIN_WAIT_1:
         /*
-        18、如果收到FIN && ACK，则close_tcp直接关闭TCP
-            如果只收到ACK，则将状态转为TCP_FIN_WAIT_2
+        18、先处理ACK并继续发送FIN之前剩余的数据，unack_seq越过fin_seq说明我们的FIN已被确认
+            如果收到FIN，则将ACK +1并回复ACK：FIN已被确认则进入TIME_WAIT，否则进入TCP_CLOSING等待确认
+            如果只收到对FIN的确认，则将状态转为TCP_FIN_WAIT_2
         */
-        if (flags.fin && flags.ack) {
-            goto close_tcp;
-        }
         if (flags.ack) {
+            tcp_ack_in(connect, ack_number, window_size, buf->len, flags, &opts);
+            tcp_output(connect);
+        }
+        if (flags.fin) {
+            connect->ack++;
+            buf_init(&ctx->txbuf, 0);
+            tcp_send(&ctx->txbuf, connect, tcp_flags_ack);
+            if (tcp_fin_acked(connect)) {
+                goto time_wait;
+            }
+            connect->state = TCP_CLOSING;
+            break;
+        }
+        if (tcp_fin_acked(connect)) {
             connect->state = TCP_FIN_WAIT_2;
         }
         break;
 
+    case TCP_CLOSING:
+        /*
+        双方同时关闭，等待对端确认我们的FIN，确认后进入TIME_WAIT
+        */
+        if (!flags.ack) return;
+        tcp_ack_in(connect, ack_number, window_size, buf->len, flags, &opts);
+        if (tcp_fin_acked(connect)) {
+            goto time_wait;
+        }
+        tcp_output(connect);
+        break;
+
     case TCP_FIN_WAIT_2:
         /*
         19、如果不是FIN，则不做处理
-            如果是，则将ACK +1，调用buf_init初始化txbuf，调用tcp_send发送一个ACK数据包，再close_tcp关闭TCP
+            如果是，则将ACK +1，调用buf_init初始化txbuf，调用tcp_send发送一个ACK数据包，再进入TIME_WAIT
         */
         if (!flags.fin) return;
         connect->ack++;
-        buf_init(&txbuf, 0);
-        tcp_send(&txbuf, connect, tcp_flags_ack);
-        goto close_tcp;
+        buf_init(&ctx->txbuf, 0);
+        tcp_send(&ctx->txbuf, connect, tcp_flags_ack);
+        goto time_wait;
         break;
 
     case TCP_LAST_ACK:
         /*
-        20、如果不是ACK，则不做处理
+        20、如果不是ACK，或没有确认我们的FIN，则不做处理，FIN由重传定时器重发
             如果是，则调用handler函数，进入TCP_CONN_CLOSED状态，，再close_tcp关闭TCP
         */
         if (!flags.ack) return;
-        (*handler)(connect, TCP_CONN_CLOSED);
+        tcp_ack_in(connect, ack_number, window_size, buf->len, flags, &opts);
+        if (!tcp_fin_acked(connect)) {
+            tcp_output(connect);
+            return;
+        }
+        handler(connect, TCP_CONN_CLOSED);
         goto close_tcp;
         break;
 
@@ -534,10 +2059,14 @@ reset_tcp:
     printf("!!! reset tcp !!!\n");
     connect->next_seq = 0;
     connect->ack = seq_number + 1;
-    buf_init(&txbuf, 0);
-    tcp_send(&txbuf, connect, tcp_flags_ack_rst);
+    buf_init(&ctx->txbuf, 0);
+    tcp_send(&ctx->txbuf, connect, tcp_flags_ack_rst);
 close_tcp:
     release_tcp_connect(connect);
-    map_delete(&connect_table, &key);
+    tcp_hash_delete(table, &key);
+    return;
+
+time_wait:
+    tcp_timewait_enter(connect);
     return;
 }
@@ -0,0 +1,150 @@
+#include <string.h>
+#include "tcp_cc.h"
+
+/**
+ * @brief 已注册的拥塞控制算法，须在net_init启动工作线程之前注册
+ *
+ */
+static const tcp_cc_ops_t *tcp_cc_table[TCP_CC_MAX] = {&tcp_newreno, &tcp_cubic};
+
+/**
+ * @brief 注册一个拥塞控制算法
+ *
+ * @param ops 算法，须一直有效
+ * @return int 成功为0，重名或表满为-1
+ */
+int tcp_cc_register(const tcp_cc_ops_t *ops)
+{
+    if (tcp_cc_find(ops->name))
+        return -1;
+    for (int i = 0; i < TCP_CC_MAX; i++)
+        if (tcp_cc_table[i] == NULL)
+        {
+            tcp_cc_table[i] = ops;
+            return 0;
+        }
+    return -1;
+}
+
+/**
+ * @brief 按名字查找拥塞控制算法
+ *
+ * @param name 算法名
+ * @return const tcp_cc_ops_t* 算法，找不到为NULL
+ */
+const tcp_cc_ops_t *tcp_cc_find(const char *name)
+{
+    for (int i = 0; i < TCP_CC_MAX && tcp_cc_table[i]; i++)
+        if (strcmp(tcp_cc_table[i]->name, name) == 0)
+            return tcp_cc_table[i];
+    return NULL;
+}
+
+/**
+ * @brief 获取新连接使用的算法，即config.h中的TCP_CC_DEFAULT
+ *
+ * @return const tcp_cc_ops_t* 算法，名字无效时退回NewReno
+ */
+const tcp_cc_ops_t *tcp_cc_default()
+{
+    const tcp_cc_ops_t *ops = tcp_cc_find(TCP_CC_DEFAULT);
+    return ops ? ops : &tcp_newreno;
+}
+
+/**
+ * @brief 为连接切换拥塞控制算法，cwnd与ssthresh保留
+ *        供应用层使用
+ *
+ * @param connect 连接
+ * @param name 算法名
+ * @return int 成功为0，找不到为-1
+ */
+int tcp_connect_set_cc(tcp_connect_t *connect, const char *name)
+{
+    const tcp_cc_ops_t *ops = tcp_cc_find(name);
+    if (ops == NULL)
+        return -1;
+    connect->cc = ops;
+    memset(connect->cc_priv, 0, sizeof(connect->cc_priv));
+    if (ops->init)
+        ops->init(connect);
+    return 0;
+}
+
+/**
+ * @brief 在途字节数，含已发送未确认的SYN与FIN
+ *
+ * @param connect 连接
+ * @return uint32_t 字节数
+ */
+uint32_t tcp_cc_flight(tcp_connect_t *connect)
+{
+    return connect->next_seq - connect->unack_seq;
+}
+
+/**
+ * @brief 慢启动：cwnd低于ssthresh时每确认一个字节cwnd增长一个字节，每次最多增长两个SMSS，
+ *        使延迟确认的对端也能让cwnd每个RTT翻倍（RFC 5681，RFC 3465 L=2）
+ *
+ * @param connect 连接
+ * @param acked 新确认的字节数
+ * @return uint32_t cwnd达到ssthresh后剩余的、应交给拥塞避免处理的字节数
+ */
+uint32_t tcp_cc_slow_start(tcp_connect_t *connect, uint32_t acked)
+{
+    uint32_t inc = acked < 2 * connect->mss ? acked : 2 * connect->mss;
+    uint32_t room = connect->ssthresh > connect->cwnd ? connect->ssthresh - connect->cwnd : 0;
+    if (inc > room)
+        inc = room;
+    connect->cwnd += inc;
+    return connect->cwnd < connect->ssthresh ? 0 : acked - inc;
+}
+
+/**
+ * @brief 加性增长：每确认w字节cwnd增长一个SMSS
+ *
+ * @param connect 连接
+ * @param w 增长一个SMSS需要确认的字节数，Reno取cwnd
+ * @param acked 新确认的字节数
+ */
+void tcp_cc_cong_avoid_ai(tcp_connect_t *connect, uint32_t w, uint32_t acked)
+{
+    connect->cwnd_cnt += acked;
+    if (connect->cwnd_cnt >= w)
+    {
+        connect->cwnd_cnt -= w;
+        connect->cwnd += connect->mss;
+    }
+}
+
+/**
+ * @brief NewReno：丢包后窗口减半
+ *
+ * @param connect 连接
+ * @return uint32_t 新的ssthresh
+ */
+static uint32_t newreno_ssthresh(tcp_connect_t *connect)
+{
+    uint32_t half = tcp_cc_flight(connect) / 2;
+    return half > 2 * connect->mss ? half : 2 * connect->mss;
+}
+
+/**
+ * @brief NewReno：慢启动，之后每个RTT增长一个SMSS
+ *
+ * @param connect 连接
+ * @param acked 新确认的字节数
+ */
+static void newreno_cong_avoid(tcp_connect_t *connect, uint32_t acked)
+{
+    if (connect->cwnd < connect->ssthresh)
+        acked = tcp_cc_slow_start(connect, acked);
+    if (acked)
+        tcp_cc_cong_avoid_ai(connect, connect->cwnd, acked);
+}
+
+const tcp_cc_ops_t tcp_newreno = {
+    .name = "newreno",
+    .ssthresh = newreno_ssthresh,
+    .cong_avoid = newreno_cong_avoid,
+};
@@ -0,0 +1,131 @@
+#include <string.h>
+#include "tcp_cc.h"
+
+// CUBIC拥塞控制，见RFC 9438。窗口以字节计，时间以毫秒计，全部用整数运算
+#define CUBIC_BETA_NUM 7        //乘性减小因子beta=0.7
+#define CUBIC_BETA_DEN 10
+#define CUBIC_ALPHA_NUM 529     //Reno友好区的加性增长因子3*(1-beta)/(1+beta)≈0.529
+#define CUBIC_ALPHA_DEN 1000
+#define CUBIC_MAX_DELTA_MS 100000 //计算立方项时|t-K|的上限，防止溢出
+
+typedef struct cubic //CUBIC的连接状态，放在tcp_connect_t的cc_priv中
+{
+    uint32_t w_max;       //上次拥塞事件前的窗口
+    uint32_t k;           //从本轮拥塞避免开始到窗口回到w_max所需的时间，毫秒
+    uint32_t origin;      //立方曲线的中心窗口
+    uint32_t w_est;       //按Reno速度增长时的估计窗口
+    uint64_t epoch_start; //本轮拥塞避免开始的时间，毫秒
+    uint32_t cnt;         //cwnd增长量的余数
+    uint32_t est_cnt;     //w_est增长量的余数
+    uint8_t in_epoch;     //是否已开始本轮拥塞避免
+} cubic_t;
+
+_Static_assert(sizeof(cubic_t) <= sizeof(((tcp_connect_t *)0)->cc_priv), "cubic_t does not fit in cc_priv");
+
+/**
+ * @brief 整数立方根，向下取整
+ *
+ * @param v 被开方数
+ * @return uint32_t 立方根
+ */
+static uint32_t cubic_cbrt(uint64_t v)
+{
+    uint64_t lo = 0, hi = 2642246; // 2642246^3 > 2^64
+    while (lo + 1 < hi)
+    {
+        uint64_t mid = (lo + hi) / 2;
+        if (mid * mid * mid <= v)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return (uint32_t)lo;
+}
+
+static void cubic_init(tcp_connect_t *connect)
+{
+    memset(connect->cc_priv, 0, sizeof(cubic_t));
+}
+
+/**
+ * @brief 拥塞事件：记录w_max（快速收敛时取更小的值），窗口乘以beta
+ *
+ * @param connect 连接
+ * @return uint32_t 新的ssthresh
+ */
+static uint32_t cubic_ssthresh(tcp_connect_t *connect)
+{
+    cubic_t *cubic = (cubic_t *)connect->cc_priv;
+    if (connect->cwnd < cubic->w_max)
+        cubic->w_max = (uint64_t)connect->cwnd * (CUBIC_BETA_DEN + CUBIC_BETA_NUM) / (2 * CUBIC_BETA_DEN);
+    else
+        cubic->w_max = connect->cwnd;
+    cubic->in_epoch = 0;
+    uint32_t ssthresh = (uint64_t)connect->cwnd * CUBIC_BETA_NUM / CUBIC_BETA_DEN;
+    return ssthresh > 2 * connect->mss ? ssthresh : 2 * connect->mss;
+}
+
+/**
+ * @brief 拥塞避免：cwnd朝W_cubic(t+RTT)增长，低于Reno估计窗口时取Reno窗口
+ *
+ * @param connect 连接
+ * @param acked 新确认的字节数
+ */
+static void cubic_cong_avoid(tcp_connect_t *connect, uint32_t acked)
+{
+    cubic_t *cubic = (cubic_t *)connect->cc_priv;
+    if (connect->cwnd < connect->ssthresh)
+    {
+        acked = tcp_cc_slow_start(connect, acked);
+        if (acked == 0)
+            return;
+    }
+    uint64_t now = connect->ctx->now;
+    if (!cubic->in_epoch)
+    {
+        cubic->in_epoch = 1;
+        cubic->epoch_start = now;
+        cubic->w_est = connect->cwnd;
+        cubic->cnt = cubic->est_cnt = 0;
+        if (connect->cwnd < cubic->w_max)
+        {
+            // K = cbrt((W_max - cwnd) / C)，C=0.4个SMSS每立方秒
+            cubic->k = cubic_cbrt((uint64_t)(cubic->w_max - connect->cwnd) * 2500000000ull / connect->mss);
+            cubic->origin = cubic->w_max;
+        }
+        else
+        {
+            cubic->k = 0;
+            cubic->origin = connect->cwnd;
+        }
+    }
+    // W_cubic(t) = C * (t - K)^3 + W_max，t取一个RTT之后
+    int64_t d = (int64_t)(now - cubic->epoch_start + connect->srtt) - cubic->k;
+    uint64_t abs_d = d < 0 ? -d : d;
+    if (abs_d > CUBIC_MAX_DELTA_MS)
+        abs_d = CUBIC_MAX_DELTA_MS;
+    uint64_t delta = abs_d * abs_d * abs_d / 1000 * 4 * connect->mss / 10000000;
+    uint64_t target = d < 0 ? (delta < cubic->origin ? cubic->origin - delta : 0) : cubic->origin + delta;
+    if (target < connect->cwnd)
+        target = connect->cwnd;
+    if (target > connect->cwnd + connect->cwnd / 2)
+        target = connect->cwnd + connect->cwnd / 2;
+    // 每确认一个cwnd的数据，cwnd增长(target - cwnd)
+    uint64_t cnt = cubic->cnt + (target - connect->cwnd) * acked;
+    uint32_t cwnd = connect->cwnd;
+    connect->cwnd += cnt / cwnd;
+    cubic->cnt = cnt % cwnd;
+    // Reno友好区：估计窗口每个RTT增长alpha个SMSS
+    uint64_t est_cnt = cubic->est_cnt + (uint64_t)CUBIC_ALPHA_NUM * connect->mss * acked / CUBIC_ALPHA_DEN;
+    cubic->w_est += est_cnt / cwnd;
+    cubic->est_cnt = est_cnt % cwnd;
+    if (cubic->w_est > connect->cwnd)
+        connect->cwnd = cubic->w_est;
+}
+
+const tcp_cc_ops_t tcp_cubic = {
+    .name = "cubic",
+    .init = cubic_init,
+    .ssthresh = cubic_ssthresh,
+    .cong_avoid = cubic_cong_avoid,
+};
@@ -0,0 +1,221 @@
+#include <string.h>
+#include "tcp_hash.h"
+
+#define TCP_HASH_SLAB_CHUNK 256 //连接对象每次向系统申请的个数
+#define TCP_HASH_LOAD_NUM 7     //负载因子上限为7/8，超过后槽数翻倍
+#define TCP_HASH_LOAD_DEN 8
+
+/**
+ * @brief 内部函数，计算键的哈希值，使用带密钥的tcp_secret_hash，对端不知道密钥就无法构造大量冲突
+ *
+ * @param key 键
+ * @return uint32_t 哈希值
+ */
+static uint32_t tcp_hash_key(const tcp_key_t *key)
+{
+    return (uint32_t)tcp_secret_hash(TCP_SECRET_TABLE, key, 0);
+}
+
+/**
+ * @brief 内部函数，把一个槽的内容插入到槽数组中，不检查重复与容量
+ *        沿探测序列前进时，遇到探测距离比自己短的槽就交换，使各键的探测距离尽量平均
+ *
+ * @param table 哈希表
+ * @param entry 要插入的槽内容，dist会被重置
+ */
+static void tcp_hash_place(tcp_hash_t *table, tcp_hash_entry_t entry)
+{
+    entry.dist = 1;
+    for (size_t i = entry.hash & table->mask;; i = (i + 1) & table->mask, entry.dist++)
+    {
+        tcp_hash_entry_t *slot = &table->entries[i];
+        if (slot->dist == 0)
+        {
+            *slot = entry;
+            return;
+        }
+        if (slot->dist < entry.dist)
+        {
+            tcp_hash_entry_t tmp = *slot;
+            *slot = entry;
+            entry = tmp;
+        }
+    }
+}
+
+/**
+ * @brief 内部函数，把槽数改为capacity并重新插入全部键，连接对象不移动
+ *
+ * @param table 哈希表
+ * @param capacity 新槽数，须为2的幂
+ * @return int 成功为0，内存不足为-1
+ */
+static int tcp_hash_resize(tcp_hash_t *table, size_t capacity)
+{
+    tcp_hash_entry_t *entries = calloc(capacity, sizeof(tcp_hash_entry_t));
+    if (entries == NULL)
+        return -1;
+    tcp_hash_entry_t *old = table->entries;
+    size_t old_capacity = old ? table->mask + 1 : 0;
+    table->entries = entries;
+    table->mask = capacity - 1;
+    for (size_t i = 0; i < old_capacity; i++)
+        if (old[i].dist)
+            tcp_hash_place(table, old[i]);
+    free(old);
+    return 0;
+}
+
+/**
+ * @brief 内部函数，查找键所在的槽
+ *
+ * @param table 哈希表
+ * @param key 键
+ * @return size_t 槽下标，找不到为SIZE_MAX
+ */
+static size_t tcp_hash_find(tcp_hash_t *table, const tcp_key_t *key)
+{
+    uint32_t hash = tcp_hash_key(key);
+    uint32_t dist = 1;
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask, dist++)
+    {
+        tcp_hash_entry_t *slot = &table->entries[i];
+        // 槽的探测距离比当前还短，说明键若存在早该放在这里之前
+        if (slot->dist < dist)
+            return SIZE_MAX;
+        if (slot->hash == hash && memcmp(&slot->key, key, sizeof(tcp_key_t)) == 0)
+            return i;
+    }
+}
+
+/**
+ * @brief 初始化连接表
+ *
+ * @param table 要初始化的连接表
+ * @return int 成功为0，内存不足为-1
+ */
+int tcp_hash_init(tcp_hash_t *table)
+{
+    memset(table, 0, sizeof(tcp_hash_t));
+    slab_init(&table->slab, sizeof(tcp_connect_t), TCP_HASH_SLAB_CHUNK);
+    return tcp_hash_resize(table, TCP_CONN_HASH_INIT_SIZE);
+}
+
+/**
+ * @brief 获取连接数
+ *
+ * @param table 连接表
+ * @return size_t 连接数
+ */
+size_t tcp_hash_size(tcp_hash_t *table)
+{
+    return table->size;
+}
+
+/**
+ * @brief 根据键查找连接
+ *
+ * @param table 连接表
+ * @param key 键
+ * @return tcp_connect_t* 连接，找不到为NULL
+ */
+tcp_connect_t *tcp_hash_get(tcp_hash_t *table, const tcp_key_t *key)
+{
+    size_t i = tcp_hash_find(table, key);
+    return i == SIZE_MAX ? NULL : table->entries[i].connect;
+}
+
+/**
+ * @brief 为键分配一个清零的连接并加入表中，调用者须保证键尚不存在
+ *
+ * @param table 连接表
+ * @param key 键
+ * @return tcp_connect_t* 新连接，连接数达到TCP_CONN_MAX或内存不足为NULL
+ */
+tcp_connect_t *tcp_hash_add(tcp_hash_t *table, const tcp_key_t *key)
+{
+    if (table->size >= TCP_CONN_MAX)
+        return NULL;
+    size_t capacity = table->mask + 1;
+    if ((table->size + 1) * TCP_HASH_LOAD_DEN > capacity * TCP_HASH_LOAD_NUM && tcp_hash_resize(table, capacity * 2) < 0)
+        return NULL;
+    tcp_connect_t *connect = slab_alloc(&table->slab);
+    if (connect == NULL)
+        return NULL;
+    tcp_hash_entry_t entry = {.hash = tcp_hash_key(key), .key = *key, .connect = connect};
+    tcp_hash_place(table, entry);
+    table->size++;
+    return connect;
+}
+
+/**
+ * @brief 内部函数，删除一个槽并归还其连接对象
+ *        后继槽依次前移一格，直到遇到空槽或已在理想位置的槽，无需墓碑
+ *
+ * @param table 连接表
+ * @param i 槽下标
+ */
+static void tcp_hash_remove(tcp_hash_t *table, size_t i)
+{
+    slab_free(&table->slab, table->entries[i].connect);
+    for (;;)
+    {
+        size_t next = (i + 1) & table->mask;
+        if (table->entries[next].dist <= 1)
+        {
+            table->entries[i].dist = 0;
+            break;
+        }
+        table->entries[i] = table->entries[next];
+        table->entries[i].dist--;
+        i = next;
+    }
+    table->size--;
+}
+
+/**
+ * @brief 删除键对应的连接，连接对象归还分配器，之后不可再访问
+ *
+ * @param table 连接表
+ * @param key 键
+ */
+void tcp_hash_delete(tcp_hash_t *table, const tcp_key_t *key)
+{
+    size_t i = tcp_hash_find(table, key);
+    if (i != SIZE_MAX)
+        tcp_hash_remove(table, i);
+}
+
+/**
+ * @brief 遍历全部连接，handler返回非0时删除该连接
+ *
+ * @param table 连接表
+ * @param handler 处理函数
+ * @param arg 传给handler的参数
+ */
+void tcp_hash_foreach(tcp_hash_t *table, tcp_hash_handler_t handler, void *arg)
+{
+    // 从一个空槽之后开始，删除时前移的槽不会绕回已访问过的位置
+    size_t start = 0;
+    while (table->entries[start].dist)
+        start++;
+    for (size_t n = 1; n <= table->mask + 1; n++)
+    {
+        size_t i = (start + n) & table->mask;
+        // 删除后后继槽会前移到i，需要再检查一次同一位置
+        while (table->entries[i].dist && handler(table->entries[i].connect, arg))
+            tcp_hash_remove(table, i);
+    }
+}
+
+/**
+ * @brief 释放连接表的全部内存，之前的连接全部失效
+ *
+ * @param table 连接表
+ */
+void tcp_hash_destroy(tcp_hash_t *table)
+{
+    free(table->entries);
+    slab_destroy(&table->slab);
+    memset(table, 0, sizeof(tcp_hash_t));
+}
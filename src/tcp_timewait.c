@@ -0,0 +1,114 @@
+#include <string.h>
+#include "tcp_timewait.h"
+
+#define TCP_TIMEWAIT_BUCKETS 4096    //桶数，须为2的幂
+#define TCP_TIMEWAIT_SLAB_CHUNK 1024 //记录每次向系统申请的个数
+
+/**
+ * @brief 内部函数，计算键所在的桶，与连接表使用同一个带密钥的散列
+ *
+ * @param table 哈希表
+ * @param key 键
+ * @return size_t 桶下标
+ */
+static size_t tcp_timewait_bucket(tcp_timewait_table_t *table, const tcp_key_t *key)
+{
+    return (size_t)tcp_secret_hash(TCP_SECRET_TABLE, key, 0) & table->mask;
+}
+
+/**
+ * @brief 初始化TIME_WAIT表
+ *
+ * @param table 要初始化的表
+ * @return int 成功为0，内存不足为-1
+ */
+int tcp_timewait_init(tcp_timewait_table_t *table)
+{
+    memset(table, 0, sizeof(tcp_timewait_table_t));
+    slab_init(&table->slab, sizeof(tcp_timewait_t), TCP_TIMEWAIT_SLAB_CHUNK);
+    table->buckets = calloc(TCP_TIMEWAIT_BUCKETS, sizeof(tcp_timewait_t *));
+    if (table->buckets == NULL)
+        return -1;
+    table->mask = TCP_TIMEWAIT_BUCKETS - 1;
+    return 0;
+}
+
+/**
+ * @brief 获取记录数
+ *
+ * @param table TIME_WAIT表
+ * @return size_t 记录数
+ */
+size_t tcp_timewait_size(tcp_timewait_table_t *table)
+{
+    return table->size;
+}
+
+/**
+ * @brief 根据键查找记录
+ *
+ * @param table TIME_WAIT表
+ * @param key 键
+ * @return tcp_timewait_t* 记录，找不到为NULL
+ */
+tcp_timewait_t *tcp_timewait_get(tcp_timewait_table_t *table, const tcp_key_t *key)
+{
+    if (table->size == 0)
+        return NULL;
+    for (tcp_timewait_t *tw = table->buckets[tcp_timewait_bucket(table, key)]; tw; tw = tw->next)
+        if (memcmp(&tw->key, key, sizeof(tcp_key_t)) == 0)
+            return tw;
+    return NULL;
+}
+
+/**
+ * @brief 为键分配一条清零的记录并加入表中，调用者须保证键尚不存在
+ *
+ * @param table TIME_WAIT表
+ * @param key 键
+ * @return tcp_timewait_t* 新记录，记录数达到TCP_TIMEWAIT_MAX或内存不足为NULL
+ */
+tcp_timewait_t *tcp_timewait_add(tcp_timewait_table_t *table, const tcp_key_t *key)
+{
+    if (table->size >= TCP_TIMEWAIT_MAX)
+        return NULL;
+    tcp_timewait_t *tw = slab_alloc(&table->slab);
+    if (tw == NULL)
+        return NULL;
+    tcp_timewait_t **bucket = &table->buckets[tcp_timewait_bucket(table, key)];
+    tw->key = *key;
+    tw->next = *bucket;
+    *bucket = tw;
+    table->size++;
+    return tw;
+}
+
+/**
+ * @brief 删除一条记录并归还分配器，调用者须先停止其定时器，之后不可再访问
+ *
+ * @param table TIME_WAIT表
+ * @param tw 记录
+ */
+void tcp_timewait_delete(tcp_timewait_table_t *table, tcp_timewait_t *tw)
+{
+    tcp_timewait_t **p = &table->buckets[tcp_timewait_bucket(table, &tw->key)];
+    while (*p && *p != tw)
+        p = &(*p)->next;
+    if (*p == NULL)
+        return;
+    *p = tw->next;
+    slab_free(&table->slab, tw);
+    table->size--;
+}
+
+/**
+ * @brief 释放TIME_WAIT表的全部内存，之前的记录全部失效
+ *
+ * @param table TIME_WAIT表
+ */
+void tcp_timewait_destroy(tcp_timewait_table_t *table)
+{
+    free(table->buckets);
+    slab_destroy(&table->slab);
+    memset(table, 0, sizeof(tcp_timewait_table_t));
+}
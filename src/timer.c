@@ -0,0 +1,105 @@
+#include "timer.h"
+
+/**
+ * @brief 初始化时间轮
+ *
+ * @param wheel 要初始化的时间轮
+ * @param now 当前时间，毫秒
+ */
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now)
+{
+    for (int i = 0; i < TIMER_WHEEL_SIZE; i++)
+        wheel->slots[i].prev = wheel->slots[i].next = &wheel->slots[i];
+    wheel->now = now;
+}
+
+/**
+ * @brief 初始化定时器，不启动
+ *
+ * @param node 定时器
+ * @param handler 到期回调
+ */
+void timer_init(timer_node_t *node, timer_handler_t handler)
+{
+    node->prev = node->next = NULL;
+    node->expire = 0;
+    node->handler = handler;
+}
+
+/**
+ * @brief 启动定时器，已启动的会先取消
+ *
+ * @param wheel 时间轮
+ * @param node 定时器
+ * @param expire 到期时间，毫秒，早于当前时间的在下次运行时间轮时到期
+ */
+void timer_add(timer_wheel_t *wheel, timer_node_t *node, uint64_t expire)
+{
+    timer_cancel(node);
+    node->expire = expire;
+    // 不能放进本轮已经处理过的槽，否则要等一整圈
+    if (expire <= wheel->now)
+        expire = wheel->now + 1;
+    timer_node_t *head = &wheel->slots[expire & (TIMER_WHEEL_SIZE - 1)];
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+/**
+ * @brief 取消定时器，未启动时无操作
+ *
+ * @param node 定时器
+ */
+void timer_cancel(timer_node_t *node)
+{
+    if (!timer_pending(node))
+        return;
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+}
+
+/**
+ * @brief 推进时间轮到now，调用全部到期定时器的回调，回调中可以再次启动定时器
+ *
+ * @param wheel 时间轮
+ * @param now 当前时间，毫秒
+ * @param arg 传给回调的参数
+ */
+void timer_wheel_run(timer_wheel_t *wheel, uint64_t now, void *arg)
+{
+    if (now <= wheel->now)
+        return;
+    // 超过一圈没有运行时每个槽只需检查一次
+    uint64_t ticks = now - wheel->now;
+    if (ticks > TIMER_WHEEL_SIZE)
+        ticks = TIMER_WHEEL_SIZE;
+    uint64_t from = wheel->now + 1;
+    wheel->now = now;
+    for (uint64_t t = from; t < from + ticks; t++)
+    {
+        timer_node_t *head = &wheel->slots[t & (TIMER_WHEEL_SIZE - 1)];
+        // 先把到期的摘到临时链表上，避免回调修改本槽链表
+        timer_node_t expired = {.prev = &expired, .next = &expired};
+        for (timer_node_t *node = head->next, *next; node != head; node = next)
+        {
+            next = node->next;
+            if (node->expire > now)
+                continue;
+            node->prev->next = node->next;
+            node->next->prev = node->prev;
+            node->prev = expired.prev;
+            node->next = &expired;
+            expired.prev->next = node;
+            expired.prev = node;
+        }
+        while (expired.next != &expired)
+        {
+            timer_node_t *node = expired.next;
+            timer_cancel(node);
+            node->handler(node, arg);
+        }
+    }
+}
@@ -1,6 +1,28 @@
 #include "udp.h"
 #include "ip.h"
 #include "icmp.h"
+#include "route.h"
+#include "slab.h"
+#include "ethernet.h"
+
+#define UDP_DGRAM_SLAB_CHUNK 256 //接收队列中的数据报每次向系统申请的个数
+#define UDP_TX_FRAME_LEN (sizeof(ether_hdr_t) + ETHERNET_MAX_TRANSPORT_UNIT + 1) //发送帧池中每帧的大小，多1字节用于奇数长度数据计算校验和时补0
+
+typedef struct udp_tx //一个上下文的发送帧池，数据报直接在帧中封装全部首部，攒成一批交给驱动
+{
+    uint8_t *frames;                   // UDP_TX_BATCH个帧的存储，首次发送时分配
+    ether_frame_t batch[UDP_TX_BATCH]; // 已封装、等待发出的帧
+    int num;                           // batch中的帧数
+    netif_t *netif;                    // 这批帧的出口网卡
+} udp_tx_t;
+
+typedef struct udp_tx_tmpl //发往同一目的地址与端口的数据报共用的首部模板
+{
+    const ip_dst_t *dst;   // 目的地缓存项，提供以太网头与ip头模板
+    uint16_t src_port16;   // 网络字节序的源端口
+    uint16_t dst_port16;   // 网络字节序的目的端口
+    uint32_t sum;          // 校验和中地址、协议与端口的16位累加和
+} udp_tx_tmpl_t;
 
 /**
  * @brief udp处理程序表
@@ -8,6 +30,24 @@
  */
 map_t udp_table;
 
+/**
+ * @brief 按端口直接索引的udp套接字表，收包时不用查找处理程序表
+ * 
+ */
+static udp_socket_t *udp_sockets[UINT16_MAX + 1];
+
+/**
+ * @brief 接收队列中数据报的分配器，每个上下文一个，多核模式下各工作线程互不干扰
+ * 
+ */
+static slab_t udp_dgram_slab[NET_CTX_NUM];
+
+/**
+ * @brief 各上下文的发送帧池，多核模式下各工作线程只使用自己的帧池
+ * 
+ */
+static udp_tx_t udp_tx[NET_CTX_NUM];
+
 /**
  * @brief udp伪校验和计算
  * 
@@ -53,13 +93,177 @@ static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip)
     return checksum;
 }
 
+/**
+ * @brief 内部函数，为发往同一目的地址与端口的数据报准备首部模板，并预先累加校验和中不随数据报变化的部分
+ * 
+ * @param tmpl 要准备的模板
+ * @param dst 目的地缓存项
+ * @param src_port 源端口号
+ * @param dst_port 目的端口号
+ */
+static void udp_tx_tmpl_init(udp_tx_tmpl_t *tmpl, const ip_dst_t *dst, uint16_t src_port, uint16_t dst_port)
+{
+    tmpl->dst = dst;
+    tmpl->src_port16 = swap16(src_port);
+    tmpl->dst_port16 = swap16(dst_port);
+    // 伪头部中的源、目的ip与协议号，加上udp首部中的两个端口；两处长度字段随数据报变化，另行累加
+    const uint16_t *src_ip = (const uint16_t *)dst->ip_hdr.src_ip;
+    const uint16_t *dst_ip = (const uint16_t *)dst->ip_hdr.dst_ip;
+    tmpl->sum = src_ip[0] + src_ip[1] + dst_ip[0] + dst_ip[1] + swap16(NET_PROTOCOL_UDP) + tmpl->src_port16 + tmpl->dst_port16;
+}
+
+/**
+ * @brief 内部函数，判断数据报能否在发送帧池中封装：不需分片，且放得进按以太网最大传输单元分配的帧
+ * 
+ * @param dst 目的地缓存项
+ * @param len 数据长度
+ * @return int 能为1，否则为0
+ */
+static int udp_tx_fits(const ip_dst_t *dst, size_t len)
+{
+    return len <= UDP_DGRAM_INLINE && len + sizeof(ip_hdr_t) + sizeof(udp_hdr_t) <= dst->mtu;
+}
+
+/**
+ * @brief 内部函数，把帧池中已封装的帧一次交给驱动
+ * 
+ * @param tx 发送帧池
+ */
+static void udp_tx_flush(udp_tx_t *tx)
+{
+    if (tx->num == 0)
+        return;
+    ethernet_out_many(tx->netif, tx->batch, tx->num);
+    tx->num = 0;
+}
+
+/**
+ * @brief 内部函数，为发往指定网卡的下一帧腾出位置，帧池已满或出口网卡不同时先发出已封装的帧
+ * 
+ * @param tx 发送帧池
+ * @param netif 出口网卡
+ * @return int 成功为0，内存不足为-1
+ */
+static int udp_tx_reserve(udp_tx_t *tx, netif_t *netif)
+{
+    if (tx->frames == NULL && (tx->frames = malloc(UDP_TX_BATCH * UDP_TX_FRAME_LEN)) == NULL)
+        return -1;
+    if (tx->num == UDP_TX_BATCH || (tx->num && tx->netif != netif))
+        udp_tx_flush(tx);
+    tx->netif = netif;
+    return 0;
+}
+
+/**
+ * @brief 内部函数，按首部模板在帧池的下一帧中封装一个数据报，数据只拷贝这一次，
+ *        校验和在模板的累加和上补充长度与数据
+ * 
+ * @param ctx 协议栈上下文，数据包id取自其中
+ * @param tx 已用udp_tx_reserve腾出位置的发送帧池
+ * @param tmpl 首部模板
+ * @param data 数据
+ * @param len 数据长度，须满足udp_tx_fits
+ */
+static void udp_tx_put(net_ctx_t *ctx, udp_tx_t *tx, const udp_tx_tmpl_t *tmpl, const uint8_t *data, size_t len)
+{
+    uint8_t *frame = tx->frames + tx->num * UDP_TX_FRAME_LEN;
+    size_t udp_len = sizeof(udp_hdr_t) + len;
+    size_t frame_len = sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + udp_len;
+    memcpy(frame, &tmpl->dst->ether_hdr, sizeof(ether_hdr_t));
+    ip_hdr_t *ip_hdr = (ip_hdr_t *)(frame + sizeof(ether_hdr_t));
+    ip_dst_hdr(tmpl->dst, ip_hdr, sizeof(ip_hdr_t) + udp_len, ctx->ip_id++, 0, NET_PROTOCOL_UDP);
+    udp_hdr_t *udp_hdr = (udp_hdr_t *)(ip_hdr + 1);
+    udp_hdr->src_port16 = tmpl->src_port16;
+    udp_hdr->dst_port16 = tmpl->dst_port16;
+    udp_hdr->total_len16 = swap16(udp_len);
+    memcpy(udp_hdr + 1, data, len);
+    // 补足以太网最小帧长，奇数长度时补的0也用于计算校验和
+    size_t min_len = sizeof(ether_hdr_t) + ETHERNET_MIN_TRANSPORT_UNIT;
+    size_t pad_end = frame_len + len % 2 > min_len ? frame_len + len % 2 : min_len;
+    memset(frame + frame_len, 0, pad_end - frame_len);
+    // 长度在伪头部与udp首部中各出现一次
+    uint32_t checksum = tmpl->sum + 2 * (uint32_t)udp_hdr->total_len16 + (uint16_t)~checksum16((uint16_t *)(udp_hdr + 1), len + len % 2);
+    while (checksum > 0xffff)
+        checksum = (checksum >> 16) + (checksum & 0xffff);
+    udp_hdr->checksum16 = ~(uint16_t)checksum;
+    tx->batch[tx->num].data = frame;
+    tx->batch[tx->num].len = frame_len > min_len ? frame_len : min_len;
+    tx->num++;
+}
+
+/**
+ * @brief 从上下文的池中分配一个数据报，数据放不下时另行分配缓冲区
+ * 
+ * @param ctx 协议栈上下文
+ * @param len 数据长度
+ * @return udp_dgram_t* 数据报，内存不足为NULL
+ */
+static udp_dgram_t *udp_dgram_alloc(net_ctx_t *ctx, size_t len)
+{
+    slab_t *slab = &udp_dgram_slab[ctx->id];
+    if (slab->obj_size == 0)
+        slab_init(slab, sizeof(udp_dgram_t), UDP_DGRAM_SLAB_CHUNK);
+    udp_dgram_t *dgram = slab_alloc(slab);
+    if (dgram == NULL)
+        return NULL;
+    dgram->data = len <= UDP_DGRAM_INLINE ? dgram->inline_data : malloc(len);
+    if (dgram->data == NULL)
+    {
+        slab_free(slab, dgram);
+        return NULL;
+    }
+    dgram->len = len;
+    return dgram;
+}
+
+/**
+ * @brief 把数据报归还上下文的池
+ * 
+ * @param id 分配该数据报的上下文的编号
+ * @param dgram 数据报
+ */
+static void udp_dgram_free(int id, udp_dgram_t *dgram)
+{
+    if (dgram->data != dgram->inline_data)
+        free(dgram->data);
+    slab_free(&udp_dgram_slab[id], dgram);
+}
+
+/**
+ * @brief 把收到的数据报放入套接字在本上下文的接收队列，队列满时丢弃
+ * 
+ * @param ctx 协议栈上下文
+ * @param socket udp套接字
+ * @param buf 去掉udp报头的数据
+ * @param src_ip 源ip地址
+ * @param src_port 源端口号
+ */
+static void udp_socket_enqueue(net_ctx_t *ctx, udp_socket_t *socket, buf_t *buf, uint8_t *src_ip, uint16_t src_port)
+{
+    udp_ring_t *ring = &socket->ring[ctx->id];
+    udp_dgram_t *dgram;
+    if (ring->tail - ring->head == UDP_RX_QUEUE_LEN || (dgram = udp_dgram_alloc(ctx, buf->len)) == NULL)
+    {
+        socket->drops++;
+        return;
+    }
+    memcpy(dgram->data, buf->data, buf->len);
+    memcpy(dgram->src_ip, src_ip, NET_IP_LEN);
+    dgram->src_port = src_port;
+    ring->slots[ring->tail++ & (UDP_RX_QUEUE_LEN - 1)] = dgram;
+    if (ring->tail - ring->head == 1 && socket->ready)
+        socket->ready(socket, ctx);
+}
+
 /**
  * @brief 处理一个收到的udp数据包
  * 
+ * @param ctx 协议栈上下文
+ * @param netif 目的地址所属的网卡
  * @param buf 要处理的包
  * @param src_ip 源ip地址
  */
-void udp_in(buf_t *buf, uint8_t *src_ip)
+void udp_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_ip)
 {
     // 判断数据包是否合法
     if (buf->len < sizeof(udp_hdr_t)) return;
@@ -68,31 +272,38 @@ void udp_in(buf_t *buf, uint8_t *src_ip)
     // 检验校验和，不一致则丢弃，一致则恢复校验和字段
     uint16_t checksum_received = udp_hdr_in->checksum16;
     udp_hdr_in->checksum16 = 0;
-    if (checksum_received != udp_checksum(buf, src_ip, net_if_ip)) return;
+    if (checksum_received != udp_checksum(buf, src_ip, netif->ip)) return;
     udp_hdr_in->checksum16 = checksum_received;
-    // 查找目的端口号对应的处理函数
+    // 端口上有套接字时放入接收队列，否则查找目的端口号对应的处理函数
     uint16_t dst_port16 = swap16(udp_hdr_in->dst_port16);
+    udp_socket_t *socket = udp_sockets[dst_port16];
+    if (socket) {
+        buf_remove_header(buf, sizeof(udp_hdr_t));
+        udp_socket_enqueue(ctx, socket, buf, src_ip, swap16(udp_hdr_in->src_port16));
+        return;
+    }
     udp_handler_t *handler = map_get(&udp_table, &dst_port16);
     if (handler == NULL) {
         // 若没找到，增加IPv4数据报头部，然后发送一个端口不可达的ICMP差错报文
         buf_add_header(buf, sizeof(ip_hdr_t));
-        icmp_unreachable(buf, src_ip, ICMP_CODE_PORT_UNREACH);
+        icmp_unreachable(ctx, buf, src_ip, ICMP_CODE_PORT_UNREACH);
     } else {
         // 去掉UDP报头，调用对应处理函数
         buf_remove_header(buf, sizeof(udp_hdr_t));
-        (*handler)(buf->data, buf->len, src_ip, swap16(udp_hdr_in->src_port16));
+        (*handler)(ctx, buf->data, buf->len, src_ip, swap16(udp_hdr_in->src_port16));
     }
 }
 
 /**
  * @brief 处理一个要发送的数据包
  * 
+ * @param ctx 协议栈上下文
  * @param buf 要处理的包
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
  */
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+void udp_out(net_ctx_t *ctx, buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
 {
     // 为数据包添加UDP首部并填充字段
     buf_add_header(buf, sizeof(udp_hdr_t));
@@ -100,11 +311,13 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
     udp_hdr_out->src_port16 = swap16(src_port);
     udp_hdr_out->dst_port16 = swap16(dst_port);
     udp_hdr_out->total_len16 = swap16(buf->len);
-    // 计算校验和
+    // 计算校验和，源地址为出口网卡的地址
+    uint8_t next_hop[NET_IP_LEN];
+    netif_t *netif = route_lookup(dst_ip, next_hop);
     udp_hdr_out->checksum16 = 0;
-    udp_hdr_out->checksum16 = udp_checksum(buf, net_if_ip, dst_ip);
+    udp_hdr_out->checksum16 = udp_checksum(buf, netif->ip, dst_ip);
     // 发送UDP数据包
-    ip_out(buf, dst_ip, NET_PROTOCOL_UDP);
+    ip_out(ctx, buf, dst_ip, NET_PROTOCOL_UDP);
 }
 
 /**
@@ -139,18 +352,221 @@ void udp_close(uint16_t port)
     map_delete(&udp_table, &port);
 }
 
+/**
+ * @brief 内部函数，把数据拷贝到发送缓冲区，经ip层逐层封装发送，可以分片
+ * 
+ * @param ctx 协议栈上下文，数据在其发送缓冲区中封装
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ */
+static void udp_send_copy(net_ctx_t *ctx, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    buf_t *txbuf = &ctx->txbuf;
+    buf_init(txbuf, len);
+    memcpy(txbuf->data, data, len);
+    udp_out(ctx, txbuf, src_port, dst_ip, dst_port);
+}
+
 /**
  * @brief 发送一个udp包
  * 
+ * @param ctx 协议栈上下文
  * @param data 要发送的数据
  * @param len 数据长度
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
  */
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+void udp_send(net_ctx_t *ctx, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    udp_msg_t msg = {.data = data, .len = len, .port = dst_port};
+    memcpy(msg.ip, dst_ip, NET_IP_LEN);
+    udp_sendmany(ctx, src_port, &msg, 1);
+}
+
+/**
+ * @brief 从同一端口批量发送数据报。不需分片且下一跳已解析的数据报直接在发送帧池中封装全部首部，
+ *        连续发往同一目的地时共用一次目的地缓存查找，攒成一批后只交给驱动一次；
+ *        其余数据报在发出此前已封装的帧之后交给ip层逐个发送，各数据报按数组顺序发出
+ * 
+ * @param ctx 协议栈上下文
+ * @param src_port 源端口号
+ * @param msgs 要发送的数据报，ip与port为目的地址
+ * @param num msgs的长度
+ * @return int 发送的数据报数，遇到超长的数据报时停止
+ */
+int udp_sendmany(net_ctx_t *ctx, uint16_t src_port, udp_msg_t *msgs, int num)
+{
+    udp_tx_t *tx = &udp_tx[ctx->id];
+    udp_tx_tmpl_t tmpl;
+    ip_dst_t *dst = NULL;
+    int n = 0;
+    for (; n < num && msgs[n].len <= UDP_MAX_PAYLOAD; n++)
+    {
+        udp_msg_t *msg = &msgs[n];
+        if (dst == NULL || memcmp(dst->ip, msg->ip, NET_IP_LEN) != 0)
+            dst = ip_dst_lookup(ctx, msg->ip);
+        if (dst == NULL || !udp_tx_fits(dst, msg->len) || udp_tx_reserve(tx, dst->netif) < 0)
+        {
+            udp_tx_flush(tx);
+            udp_send_copy(ctx, msg->data, msg->len, src_port, msg->ip, msg->port);
+            // ip层可能重建了缓存项
+            dst = NULL;
+            continue;
+        }
+        udp_tx_tmpl_init(&tmpl, dst, src_port, msg->port);
+        udp_tx_put(ctx, tx, &tmpl, msg->data, msg->len);
+    }
+    udp_tx_flush(tx);
+    return n;
+}
+
+/**
+ * @brief 把一段数据按段长切成多个数据报发往同一地址，效仿网卡的分段卸载：目的地缓存只查一次，
+ *        各数据报共用一份首部模板，只补充长度、id与各自的校验和，攒成批次交给驱动；
+ *        段长超出路径MTU或下一跳未解析时各段交给ip层逐个发送
+ * 
+ * @param ctx 协议栈上下文
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ * @param data 要发送的数据
+ * @param len 数据长度，为0时不发送
+ * @param seg_size 每个数据报的数据长度，最后一个数据报可以更短
+ * @return int 发送的数据报数，段长为0或超过一个数据报的最大数据长度时为-1
+ */
+int udp_send_gso(net_ctx_t *ctx, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port, uint8_t *data, size_t len, uint16_t seg_size)
+{
+    if (seg_size == 0 || seg_size > UDP_MAX_PAYLOAD)
+        return -1;
+    udp_tx_t *tx = &udp_tx[ctx->id];
+    udp_tx_tmpl_t tmpl;
+    ip_dst_t *dst = ip_dst_lookup(ctx, dst_ip);
+    int fast = dst && udp_tx_fits(dst, seg_size);
+    if (fast)
+        udp_tx_tmpl_init(&tmpl, dst, src_port, dst_port);
+    int n = 0;
+    for (size_t offset = 0; offset < len; offset += seg_size, n++)
+    {
+        size_t seg = len - offset < seg_size ? len - offset : seg_size;
+        if (!fast || udp_tx_reserve(tx, dst->netif) < 0)
+        {
+            udp_tx_flush(tx);
+            udp_send_copy(ctx, data + offset, seg, src_port, dst_ip, dst_port);
+            // ip层可能重建了缓存项，模板不再可用
+            fast = 0;
+            continue;
+        }
+        udp_tx_put(ctx, tx, &tmpl, data + offset, seg);
+    }
+    udp_tx_flush(tx);
+    return n;
+}
+
+/**
+ * @brief 在端口上打开udp套接字，之后到达该端口的数据报放入接收队列，不再调用udp_open注册的处理程序
+ * 
+ * @param port 端口号
+ * @param ready 接收队列由空变为非空时调用，可以为NULL
+ * @return udp_socket_t* udp套接字，端口已有套接字或内存不足为NULL
+ */
+udp_socket_t *udp_socket_open(uint16_t port, udp_socket_handler_t ready)
+{
+    if (udp_sockets[port])
+        return NULL;
+    udp_socket_t *socket = calloc(1, sizeof(udp_socket_t));
+    if (socket == NULL)
+        return NULL;
+    for (int i = 0; i < NET_CTX_NUM; i++)
+    {
+        socket->ring[i].slots = malloc(UDP_RX_QUEUE_LEN * sizeof(udp_dgram_t *));
+        if (socket->ring[i].slots == NULL)
+        {
+            udp_socket_close(socket);
+            return NULL;
+        }
+    }
+    socket->port = port;
+    socket->ready = ready;
+    udp_sockets[port] = socket;
+    return socket;
+}
+
+/**
+ * @brief 从套接字在本上下文的接收队列中批量取出数据报，不等待
+ * 
+ * @param ctx 协议栈上下文
+ * @param socket udp套接字
+ * @param msgs 接收的数据报，data与len须由调用者填好
+ * @param num msgs的长度
+ * @return int 取出的数据报数
+ */
+int udp_socket_recv(net_ctx_t *ctx, udp_socket_t *socket, udp_msg_t *msgs, int num)
 {
-    buf_init(&txbuf, len);
-    memcpy(txbuf.data, data, len);
-    udp_out(&txbuf, src_port, dst_ip, dst_port);
-}
\ No newline at end of file
+    udp_ring_t *ring = &socket->ring[ctx->id];
+    int n = 0;
+    for (; n < num && ring->head != ring->tail; n++)
+    {
+        udp_dgram_t *dgram = ring->slots[ring->head++ & (UDP_RX_QUEUE_LEN - 1)];
+        udp_msg_t *msg = &msgs[n];
+        msg->trunc = dgram->len > msg->len;
+        if (!msg->trunc)
+            msg->len = dgram->len;
+        memcpy(msg->data, dgram->data, msg->len);
+        memcpy(msg->ip, dgram->src_ip, NET_IP_LEN);
+        msg->port = dgram->src_port;
+        udp_dgram_free(ctx->id, dgram);
+    }
+    return n;
+}
+
+/**
+ * @brief 从套接字的端口批量发送数据报
+ * 
+ * @param ctx 协议栈上下文
+ * @param socket udp套接字
+ * @param msgs 要发送的数据报
+ * @param num msgs的长度
+ * @return int 发送的数据报数，遇到超长的数据报时停止
+ */
+int udp_socket_send(net_ctx_t *ctx, udp_socket_t *socket, udp_msg_t *msgs, int num)
+{
+    return udp_sendmany(ctx, socket->port, msgs, num);
+}
+
+/**
+ * @brief 套接字在本上下文的接收队列中等待取出的数据报数
+ * 
+ * @param ctx 协议栈上下文
+ * @param socket udp套接字
+ * @return uint32_t 数据报数
+ */
+uint32_t udp_socket_pending(net_ctx_t *ctx, udp_socket_t *socket)
+{
+    udp_ring_t *ring = &socket->ring[ctx->id];
+    return ring->tail - ring->head;
+}
+
+/**
+ * @brief 关闭udp套接字并丢弃还没取出的数据报，之后socket不可再访问
+ *        会访问所有上下文的接收队列，多核模式下须在worker_stop之后调用
+ * 
+ * @param socket udp套接字
+ */
+void udp_socket_close(udp_socket_t *socket)
+{
+    if (udp_sockets[socket->port] == socket)
+        udp_sockets[socket->port] = NULL;
+    for (int i = 0; i < NET_CTX_NUM; i++)
+    {
+        udp_ring_t *ring = &socket->ring[i];
+        // 数据报由收到它的上下文分配，归还到同一个上下文的池
+        while (ring->head != ring->tail)
+            udp_dgram_free(i, ring->slots[ring->head++ & (UDP_RX_QUEUE_LEN - 1)]);
+        free(ring->slots);
+    }
+    free(socket);
+}
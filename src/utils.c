@@ -1,6 +1,13 @@
+#ifdef _WIN32
+#define _CRT_RAND_S // 使stdlib.h声明rand_s，须在包含任何头文件前定义
+#endif
 #include "utils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
 /**
  * @brief ip转字符串
  * 
@@ -44,6 +51,70 @@ char *timetos(time_t timestamp)
 #pragma GCC diagnostic pop
 }
 
+/**
+ * @brief 获取单调时钟的毫秒数，不受系统时间调整影响，用于协议定时器
+ * 
+ * @return uint64_t 毫秒数
+ */
+uint64_t time_ms()
+{
+#ifdef _WIN32
+    return GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/**
+ * @brief 获取单调时钟的微秒数，用于需要比毫秒更细的时间的场合，如初始序号
+ * 
+ * @return uint64_t 微秒数
+ */
+uint64_t time_us()
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (uint64_t)(count.QuadPart / freq.QuadPart * 1000000 + count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/**
+ * @brief 从系统的密码学安全随机数源读取随机字节，用于生成密钥
+ *        Windows下使用rand_s，其他系统读取/dev/urandom
+ * 
+ * @param buf 输出缓冲区
+ * @param len 字节数
+ * @return int 成功为0，没有可用的随机数源时为-1
+ */
+int random_bytes(void *buf, size_t len)
+{
+    uint8_t *out = buf;
+#ifdef _WIN32
+    for (size_t i = 0; i < len; i += sizeof(unsigned int)) {
+        unsigned int r;
+        if (rand_s(&r) != 0)
+            return -1;
+        memcpy(out + i, &r, len - i < sizeof(r) ? len - i : sizeof(r));
+    }
+    return 0;
+#else
+    FILE *urandom = fopen("/dev/urandom", "rb");
+    if (urandom == NULL)
+        return -1;
+    size_t n = fread(out, 1, len, urandom);
+    fclose(urandom);
+    return n == len ? 0 : -1;
+#endif
+}
+
 /**
  * @brief ip前缀匹配
  * 
@@ -0,0 +1,237 @@
+#include "worker.h"
+
+#ifdef NET_MULTICORE
+#include <sched.h>
+#include "driver.h"
+#include "ip.h"
+
+#define WORKER_BURST 32                    //每次轮询从一个网卡最多接收的帧数
+#define WORKER_STACK_SIZE (4 * 1024 * 1024) //工作线程栈大小，上下文放在栈上
+
+/**
+ * @brief 工作线程表
+ *
+ */
+static worker_t workers[NET_WORKER_NUM];
+
+/**
+ * @brief 初始化环形队列
+ *
+ * @param ring 要初始化的队列
+ */
+void worker_ring_init(worker_ring_t *ring)
+{
+    atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief 生产者向队列写入一帧，只能由唯一的生产者线程调用
+ *
+ * @param ring 队列
+ * @param netif 收到该帧的网卡
+ * @param data 帧数据
+ * @param len 帧长度
+ * @return int 成功为0，队列满或帧过长为-1
+ */
+int worker_ring_push(worker_ring_t *ring, netif_t *netif, const uint8_t *data, size_t len)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head == NET_RING_SIZE || len > WORKER_FRAME_MAX)
+        return -1;
+    worker_frame_t *frame = &ring->slots[tail & (NET_RING_SIZE - 1)];
+    frame->netif = netif;
+    frame->len = len;
+    memcpy(frame->data, data, len);
+    // release保证消费者看到新的tail时帧内容已写好
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief 消费者查看队首的帧，只能由唯一的消费者线程调用
+ *
+ * @param ring 队列
+ * @return worker_frame_t* 队首的帧，队列空为NULL；处理完后调用worker_ring_pop归还
+ */
+worker_frame_t *worker_ring_peek(worker_ring_t *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == tail)
+        return NULL;
+    return &ring->slots[head & (NET_RING_SIZE - 1)];
+}
+
+/**
+ * @brief 消费者归还队首的帧槽
+ *
+ * @param ring 队列
+ */
+void worker_ring_pop(worker_ring_t *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief 根据帧的流确定处理它的工作线程
+ *        未分片的TCP/UDP数据包按<源ip,目的ip,源端口,目的端口>哈希，同一条流总由同一工作线程处理；
+ *        ARP、ICMP与ip分片等其余数据包都交给0号工作线程
+ *
+ * @param frame 以太网帧
+ * @param len 帧长度
+ * @return int 工作线程编号
+ */
+int worker_steer(const uint8_t *frame, size_t len)
+{
+    if (len < sizeof(ether_hdr_t) + sizeof(ip_hdr_t))
+        return 0;
+    const ether_hdr_t *ether_hdr = (const ether_hdr_t *)frame;
+    if (ether_hdr->protocol16 != swap16(NET_PROTOCOL_IP))
+        return 0;
+    const ip_hdr_t *ip_hdr = (const ip_hdr_t *)(frame + sizeof(ether_hdr_t));
+    size_t hdr_len = ip_hdr->hdr_len * IP_HDR_LEN_PER_BYTE;
+    if (ip_hdr->protocol != NET_PROTOCOL_TCP && ip_hdr->protocol != NET_PROTOCOL_UDP)
+        return 0;
+    // 分片只有首片带端口，全部交给0号线程重组
+    if (swap16(ip_hdr->flags_fragment16) & (IP_MORE_FRAGMENT | 0x1fff))
+        return 0;
+    if (len < sizeof(ether_hdr_t) + hdr_len + 2 * sizeof(uint16_t))
+        return 0;
+    return worker_steer_flow(ip_hdr->src_ip, ip_hdr->dst_ip, frame + sizeof(ether_hdr_t) + hdr_len);
+}
+
+/**
+ * @brief 计算一条流由哪个工作线程处理，与worker_steer对收到的帧的结果一致
+ *        主动打开连接时据此挑选本地端口，使回来的报文段落在发起连接的工作线程上
+ *
+ * @param src_ip 源ip
+ * @param dst_ip 目的ip
+ * @param ports 源端口与目的端口，按网络字节序依次排列，共4字节
+ * @return int 工作线程编号
+ */
+int worker_steer_flow(const uint8_t *src_ip, const uint8_t *dst_ip, const uint8_t *ports)
+{
+    uint32_t src, dst, port;
+    memcpy(&src, src_ip, NET_IP_LEN);
+    memcpy(&dst, dst_ip, NET_IP_LEN);
+    memcpy(&port, ports, sizeof(port));
+    // 乘法散列后取高位映射到[0, NET_WORKER_NUM)，避免取模
+    uint32_t hash = (src * 0x9E3779B1u) ^ (dst * 0x85EBCA77u) ^ (port * 0xC2B2AE3Du);
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    hash ^= hash >> 12;
+    return (int)(((uint64_t)hash * NET_WORKER_NUM) >> 32);
+}
+
+/**
+ * @brief 工作线程主循环，从自己的队列中取帧并在自己的上下文中处理
+ *
+ * @param arg 工作线程
+ * @return void* 未使用
+ */
+static void *worker_run(void *arg)
+{
+    worker_t *worker = arg;
+    net_ctx_t ctx; // 上下文放在本线程栈上，0号上下文留给主循环
+    net_ctx_init(&ctx, worker->index + 1);
+    while (atomic_load_explicit(&worker->running, memory_order_relaxed))
+    {
+        net_ctx_tick(&ctx);
+        worker_frame_t *frame = worker_ring_peek(&worker->ring);
+        if (frame == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+        netif_t *netif = frame->netif;
+        buf_init(&ctx.rxbuf, frame->len);
+        memcpy(ctx.rxbuf.data, frame->data, frame->len);
+        worker_ring_pop(&worker->ring);
+        ethernet_in(&ctx, netif, &ctx.rxbuf);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 启动全部工作线程，由net_init在各协议初始化完成后调用。
+ *        工作线程只处理worker_dispatch放入队列的帧，入队的release与出队的acquire使主线程此前的写入对其可见，
+ *        所以应用在net_init之后、第一次net_poll之前注册端口即可；此后端口表、路由表等共享表不能再修改
+ *
+ * @return int 成功为0，失败为-1
+ */
+int worker_start()
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+    for (int i = 0; i < NET_WORKER_NUM; i++)
+    {
+        worker_t *worker = &workers[i];
+        worker->index = i;
+        worker->dropped = 0;
+        worker_ring_init(&worker->ring);
+        atomic_store(&worker->running, 1);
+        if (pthread_create(&worker->thread, &attr, worker_run, worker) != 0)
+        {
+            fprintf(stderr, "Error in worker_start: cannot create worker %d.\n", i);
+            pthread_attr_destroy(&attr);
+            return -1;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    return 0;
+}
+
+/**
+ * @brief 停止并等待全部工作线程退出
+ *
+ */
+void worker_stop()
+{
+    for (int i = 0; i < NET_WORKER_NUM; i++)
+        atomic_store(&workers[i].running, 0);
+    for (int i = 0; i < NET_WORKER_NUM; i++)
+        pthread_join(workers[i].thread, NULL);
+}
+
+/**
+ * @brief 一次接收轮询：从每个网卡接收一批帧，按流分发到工作线程的队列
+ *
+ * @param ctx 接收线程的上下文，帧先收到其接收缓冲区中
+ */
+void worker_dispatch(net_ctx_t *ctx)
+{
+    for (int i = 0; i < net_if_num; i++)
+    {
+        netif_t *netif = &net_ifs[i];
+        for (int n = 0; n < WORKER_BURST && driver_recv(netif, &ctx->rxbuf) > 0; n++)
+        {
+            worker_t *worker = &workers[worker_steer(ctx->rxbuf.data, ctx->rxbuf.len)];
+            if (worker_ring_push(&worker->ring, netif, ctx->rxbuf.data, ctx->rxbuf.len) < 0)
+            {
+                worker->dropped++;
+                netif->stats.rx_dropped++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief 打印各工作线程的队列状态
+ *
+ */
+void worker_print()
+{
+    printf("===WORKER BEGIN===\n");
+    for (int i = 0; i < NET_WORKER_NUM; i++)
+    {
+        worker_t *worker = &workers[i];
+        size_t used = atomic_load(&worker->ring.tail) - atomic_load(&worker->ring.head);
+        printf("%d | queued %zu/%d | dropped %llu\n", i, used, NET_RING_SIZE, (unsigned long long)worker->dropped);
+    }
+    printf("===WORKER  END ===\n");
+}
+#endif
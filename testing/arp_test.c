@@ -47,7 +47,7 @@ int main(int argc, char* argv[]){
         log_tab_buf();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(net_if_default, &buf)) > 0){
                 printf("\b\b%02d",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
                 if(memcmp(buf.data,my_mac,6) && memcmp(buf.data,boardcast_mac,6)){
@@ -57,16 +57,16 @@ int main(int argc, char* argv[]){
                         buf_remove_header(&buf2, sizeof(ether_hdr_t));
                         uint8_t * ip = buf.data + 30;
                         // net_protocol_t pro = buf.data[13] ? NET_PROTOCOL_ARP : NET_PROTOCOL_IP;
-                        arp_out(&buf2, ip);
+                        arp_out(&net_main_ctx, net_if_default, &buf2, ip);
                 }else{
-                        ethernet_in(&buf);
+                        ethernet_in(&net_main_ctx, net_if_default, &buf);
                 }
                 log_tab_buf();
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on receive,exiting\n");
         }
-        driver_close();
+        driver_close(net_if_default);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(control_flow);
@@ -33,15 +33,15 @@ int main(int argc, char* argv[]){
         net_init();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(net_if_default, &buf)) > 0){
                 printf("\b\b%02d",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
-                ethernet_in(&buf);
+                ethernet_in(&net_main_ctx, net_if_default, &buf);
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
         }
-        driver_close();
+        driver_close(net_if_default);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(ip_fout);
@@ -33,7 +33,7 @@ int main(int argc, char* argv[]){
         net_init();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(net_if_default, &buf)) > 0){
                 printf("\b\b%02d",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
                 buf_copy(&buf2, &buf, 0);
@@ -42,12 +42,12 @@ int main(int argc, char* argv[]){
                 int proto = buf2.data[12];
                 proto <<= 8;
                 proto |= buf2.data[13];
-                ethernet_out(&buf,buf2.data,proto);
+                ethernet_out(net_if_default, &buf,buf2.data,proto);
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
         }
-        driver_close();
+        driver_close(net_if_default);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(control_flow);
@@ -22,20 +22,29 @@ map_t arp_buf;
 //         fprintf(arp_fout,"state:%d\n",state);
 // }
 
-void arp_in(buf_t *buf, uint8_t *src_mac)
+void arp_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_mac)
 {
         fprintf(arp_fout,"arp_in:\n");
         fprintf(arp_fout,"\tmac:%s\n", print_mac(src_mac));
         fprint_buf(arp_fout,buf);
 }
 
-void arp_out(buf_t *buf, uint8_t *ip)
+void arp_out(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *ip)
 {
         fprintf(arp_fout,"arp_out:\n");
         fprintf(arp_fout,"\tip:%s\n",print_ip(ip));
         fprint_buf(arp_fout,buf);
 }
 
+int arp_lookup(uint8_t *ip, uint8_t *mac)
+{
+        uint8_t *mac_in_map = map_get(&arp_table, ip);
+        if (mac_in_map == NULL)
+                return -1;
+        memcpy(mac, mac_in_map, NET_MAC_LEN);
+        return 0;
+}
+
 void arp_init()
 {
     map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
@@ -2,7 +2,9 @@
 #include <string.h>
 #include <utils.h>
 #include "config.h"
-#include "buf.h"
+#include "net.h"
+#include "ethernet.h"
+#include "../test.h"
 
 static pcap_t *pcap;
 static pcap_dumper_t *pdump;
@@ -11,6 +13,9 @@ extern FILE* pcap_in;
 extern FILE* pcap_out;
 extern FILE *control_flow;
 
+driver_capture_t driver_capture;
+int driver_flushes;
+
 #ifdef _WIN32
 #include <tchar.h>
 BOOL LoadNpcapDlls()
@@ -33,7 +38,7 @@ BOOL LoadNpcapDlls()
 }
 #endif
 
-int driver_open()
+int driver_open(netif_t *netif)
 {
 #ifdef _WIN32
         /* Load Npcap and its functions. */
@@ -55,11 +60,12 @@ int driver_open()
                 return -1;
         }
 
+        netif->driver = pcap;
         fprintf(control_flow,"driver opened\n");
         return 0;
 }
 
-int driver_recv(buf_t *buf)
+int driver_recv(netif_t *netif, buf_t *buf)
 {
         struct pcap_pkthdr *pkt_hdr;
         const uint8_t *pkt_data;
@@ -77,8 +83,12 @@ int driver_recv(buf_t *buf)
         }
 }
 
-int driver_send(buf_t *buf)
+int driver_send(netif_t *netif, buf_t *buf)
 {
+        if (driver_capture) {
+                driver_capture(netif, buf->data, buf->len);
+                return 0;
+        }
         struct pcap_pkthdr header;
         memset(&header.ts,0,sizeof(header.ts));
         header.caplen = buf->len;
@@ -87,9 +97,28 @@ int driver_send(buf_t *buf)
         return 0;
 }
 
-void driver_close()
+int driver_send_many(netif_t *netif, const ether_frame_t *frames, int num)
+{
+        driver_flushes++;
+        if (driver_capture) {
+                for (int i = 0; i < num; i++)
+                        driver_capture(netif, frames[i].data, frames[i].len);
+                return num;
+        }
+        struct pcap_pkthdr header;
+        memset(&header.ts,0,sizeof(header.ts));
+        for (int i = 0; i < num; i++) {
+                header.caplen = frames[i].len;
+                header.len = frames[i].len;
+                pcap_dump((u_char *)pdump,&header,frames[i].data);
+        }
+        return num;
+}
+
+void driver_close(netif_t *netif)
 {
         fprintf(control_flow,"\ndriver closed\n");
         pcap_dump_close(pdump);
         pcap_close(pcap);
+        netif->driver = NULL;
 }
@@ -14,7 +14,7 @@ void fprint_buf(FILE* f, buf_t* buf);
 //         fprint_buf(icmp_fout, req_buf);
 // }
 
-void icmp_in(buf_t *buf, uint8_t *src_ip)
+void icmp_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_ip)
 {
         fprintf(icmp_fout,"icmp_in:\n");
         fprintf(icmp_fout,"\tip: %s\n",print_ip(src_ip));
@@ -22,7 +22,7 @@ void icmp_in(buf_t *buf, uint8_t *src_ip)
 }
 
 
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+void icmp_unreachable(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
 {
         fprintf(icmp_fout,"icmp_unreachable:\n");
         fprintf(icmp_fout,"\tip: %s\n",src_ip ? print_ip(src_ip) : "null");
@@ -30,6 +30,21 @@ void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
         fprint_buf(icmp_fout, recv_buf);
 }
 
+void icmp_frag_needed(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu)
+{
+        fprintf(icmp_fout,"icmp_frag_needed:\n");
+        fprintf(icmp_fout,"\tip: %s\n",src_ip ? print_ip(src_ip) : "null");
+        fprintf(icmp_fout,"\tmtu: %u\n",mtu);
+        fprint_buf(icmp_fout, recv_buf);
+}
+
+void icmp_time_exceeded(net_ctx_t *ctx, buf_t *recv_buf, uint8_t *src_ip)
+{
+        fprintf(icmp_fout,"icmp_time_exceeded:\n");
+        fprintf(icmp_fout,"\tip: %s\n",src_ip ? print_ip(src_ip) : "null");
+        fprint_buf(icmp_fout, recv_buf);
+}
+
 void icmp_init(){
     net_add_protocol(NET_PROTOCOL_ICMP, icmp_in);
 }
\ No newline at end of file
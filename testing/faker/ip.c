@@ -11,14 +11,14 @@ char* print_ip(uint8_t *ip);
 char* print_mac(uint8_t *mac);
 void fprint_buf(FILE* f, buf_t* buf);
 
-void ip_in(buf_t *buf, uint8_t *src_mac)
+void ip_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_mac)
 {
         fprintf(ip_fout,"ip_in:\n");
         fprintf(ip_fout,"\tmac:%s\n", print_mac(src_mac));
         fprint_buf(ip_fout, buf);
 }
 
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+void ip_fragment_out(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
 {
         fprintf(ip_fout,"ip_fragment_out:\n");        
         fprintf(ip_fout,"\tip: %s\n", print_ip(ip));
@@ -29,7 +29,7 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
         fprint_buf(ip_fout, buf);
 }
 
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+void ip_out(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol)
 {
         fprintf(ip_fout,"\tip_out:\n");
         fprintf(ip_fout,"\tip: %s\n", print_ip(ip));
@@ -37,6 +37,10 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
         fprint_buf(ip_fout, buf);
 }
 
+void ip_dst_cache_flush()
+{
+}
+
 void ip_init()
 {
     net_add_protocol(NET_PROTOCOL_IP, ip_in);
@@ -1,6 +1,17 @@
 #include "tcp.h"
+#include "siphash.h"
 
-void tcp_init() {}
+int tcp_init() {
+    return 0;
+}
 int tcp_open(uint16_t port, tcp_handler_t handler) {
     return 0;
 }
+uint64_t tcp_secret_hash(uint32_t use, const tcp_key_t* key, uint64_t extra) {
+    static const uint8_t secret[SIPHASH_KEY_LEN] = {0};
+    uint8_t data[sizeof(use) + sizeof(tcp_key_t) + sizeof(extra)];
+    memcpy(data, &use, sizeof(use));
+    memcpy(data + sizeof(use), key, sizeof(tcp_key_t));
+    memcpy(data + sizeof(use) + sizeof(tcp_key_t), &extra, sizeof(extra));
+    return siphash(secret, data, sizeof(data));
+}
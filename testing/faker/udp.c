@@ -8,7 +8,7 @@ extern FILE *udp_fout;
 char* print_ip(uint8_t *ip);
 void fprint_buf(FILE* f, buf_t* buf);
 
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+void udp_out(net_ctx_t *ctx, buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
 {
         fprintf(udp_fout,"udp_out:\n");
         fprintf(udp_fout,"\tsrc_port: %d\n", src_port);
@@ -35,7 +35,7 @@ void udp_close(uint16_t port)
 }
 
 
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+void udp_send(net_ctx_t *ctx, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
 {
         fprintf(udp_fout,"udp_send:\n\tlen:%d\n",len);
         fprintf(udp_fout,"\tsrc_port:%d\n",src_port);
@@ -52,7 +52,7 @@ void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip,
         }
 }
 
-void udp_in(buf_t *buf, uint8_t *src_ip)
+void udp_in(net_ctx_t *ctx, netif_t *netif, buf_t *buf, uint8_t *src_ip)
 {
         fprintf(udp_fout,"udp_in:\n\tsrc_ip:%s\n",print_ip(src_ip));
         fprint_buf(udp_fout, buf);
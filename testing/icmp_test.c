@@ -47,7 +47,7 @@ int main(int argc, char* argv[]){
         log_tab_buf();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(net_if_default, &buf)) > 0){
                 printf("\b\b%02d",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
                 if(memcmp(buf.data,my_mac,6) && memcmp(buf.data,boardcast_mac,6)){
@@ -60,16 +60,16 @@ int main(int argc, char* argv[]){
                         net_protocol_t pro = buf2.data[9];
                         memset(buf2.data,0,sizeof(len));
                         buf_remove_header(&buf2, len);
-                        ip_out(&buf2,ip,pro);
+                        ip_out(&net_main_ctx, &buf2,ip,pro);
                 }else{
-                        ethernet_in(&buf);
+                        ethernet_in(&net_main_ctx, net_if_default, &buf);
                 }
                 log_tab_buf();
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
         }
-        driver_close();
+        driver_close(net_if_default);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(control_flow);
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "route.h"
+
+extern FILE *pcap_in;
+extern FILE *pcap_out;
+extern FILE *pcap_demo;
+extern FILE *control_flow;
+extern FILE *icmp_fout;
+extern FILE *udp_fout;
+extern FILE *demo_log;
+extern FILE *out_log;
+extern FILE *arp_log_f;
+
+int check_log();
+int check_pcap();
+void log_tab_buf();
+FILE* open_file(char * path, char * name, char * mode);
+
+#define BENCH_MAX_FRAMES 64
+
+uint8_t route_net[] = {10, 0, 0, 0};
+uint8_t route_gw[] = {192, 168, 163, 1};
+
+buf_t buf;
+
+/**
+ * @brief 把in.pcap中需要转发的帧载入内存后反复送入协议栈，测量转发速率
+ * 
+ * @param path 测试数据目录
+ * @param rounds 重放轮数
+ */
+void bench(char *path, int rounds)
+{
+        uint8_t *frames[BENCH_MAX_FRAMES];
+        size_t frame_len[BENCH_MAX_FRAMES];
+        int frame_num = 0;
+        int ret;
+
+        // 重新打开驱动，输出写入临时文件，不影响上面的校验结果
+        pcap_in = open_file(path, "in.pcap", "r");
+        pcap_out = tmpfile();
+        control_flow = tmpfile();
+        icmp_fout = udp_fout = arp_log_f = control_flow;
+        if (pcap_in == 0 || pcap_out == 0 || control_flow == 0 || driver_open(net_if_default) < 0) {
+                printf("\e[1;31mFailed to prepare benchmark\n\e[0m");
+                return;
+        }
+        while ((ret = driver_recv(net_if_default, &buf)) > 0 && frame_num < BENCH_MAX_FRAMES) {
+                // ARP等帧先正常处理以建立ARP表，只重放目的地址不是本机的IPv4帧
+                ether_hdr_t *hdr = (ether_hdr_t *)buf.data;
+                ip_hdr_t *ip_hdr = (ip_hdr_t *)(buf.data + sizeof(ether_hdr_t));
+                if (hdr->protocol16 == swap16(NET_PROTOCOL_IP) && memcmp(ip_hdr->dst_ip, net_if_ip, NET_IP_LEN) != 0 &&
+                    ip_hdr->dst_ip[0] < 224 && ip_hdr->ttl > 1) {
+                        frames[frame_num] = malloc(buf.len);
+                        memcpy(frames[frame_num], buf.data, buf.len);
+                        frame_len[frame_num++] = buf.len;
+                }
+                ethernet_in(&net_main_ctx, net_if_default, &buf);
+        }
+        if (frame_num == 0) {
+                printf("\e[1;31mNo frame to forward\n\e[0m");
+                driver_close(net_if_default);
+                return;
+        }
+
+        struct timeval begin, end;
+        gettimeofday(&begin, NULL);
+        for (int r = 0; r < rounds; r++) {
+                for (int i = 0; i < frame_num; i++) {
+                        buf_init(&buf, frame_len[i]);
+                        memcpy(buf.data, frames[i], frame_len[i]);
+                        ethernet_in(&net_main_ctx, net_if_default, &buf);
+                }
+        }
+        gettimeofday(&end, NULL);
+        double sec = (end.tv_sec - begin.tv_sec) + (end.tv_usec - begin.tv_usec) / 1e6;
+        long total = (long)rounds * frame_num;
+        printf("\e[0;34mForwarded %ld packets in %.3f s, %.0f pps\n\e[0m", total, sec, sec > 0 ? total / sec : 0);
+
+        for (int i = 0; i < frame_num; i++)
+                free(frames[i]);
+        driver_close(net_if_default);
+}
+
+int main(int argc, char* argv[]){
+        int ret;
+        int rounds = argc > 2 ? atoi(argv[2]) : 10000;
+        printf("\e[0;34mTest begin.\n");
+        pcap_in = open_file(argv[1], "in.pcap","r");
+        pcap_out = open_file(argv[1], "out.pcap","w");
+        control_flow = open_file(argv[1], "log","w");
+        if(pcap_in == 0 || pcap_out == 0 || control_flow == 0){
+                if(pcap_in) fclose(pcap_in); else printf("\e[1;31mFailed to open in.pcap\n");
+                if(pcap_out)fclose(pcap_out); else printf("\e[1;31mFailed to open out.pcap\n");
+                if(control_flow) fclose(control_flow); else printf("\e[1;31mFailed to open log\n");
+                printf("\e[0m");
+                return -1;
+        }
+        icmp_fout = control_flow;
+        udp_fout = control_flow;
+        arp_log_f = control_flow;
+
+        net_init();
+        ip_forward_set(1);
+        route_add(route_net, 8, route_gw, NULL);
+        log_tab_buf();
+        int i = 1;
+        printf("\e[0;34mFeeding input %02d",i);
+        while((ret = driver_recv(net_if_default, &buf)) > 0){
+                printf("\b\b%02d",i);
+                fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
+                ethernet_in(&net_main_ctx, net_if_default, &buf);
+                log_tab_buf();
+        }
+        if(ret < 0){
+                fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
+        }
+        driver_close(net_if_default);
+        printf("\e[0;34m\nSample input all processed, checking output\n");
+
+        fclose(control_flow);
+
+        demo_log = open_file(argv[1], "demo_log","r");
+        out_log = open_file(argv[1], "log","r");
+        pcap_out = open_file(argv[1], "out.pcap","r");
+        pcap_demo = open_file(argv[1], "demo_out.pcap","r");
+        if(demo_log == 0 || out_log == 0 || pcap_out == 0 || pcap_demo == 0){
+                if(demo_log) fclose(demo_log); else printf("\e[1;31mFailed to open demo_log\n");
+                if(out_log) fclose(out_log); else printf("\e[1;31mFailed to open log\n");
+                if(pcap_demo) fclose(pcap_demo); else printf("\e[1;31mFailed to open demo_out.pcap\n");
+                if(pcap_out) fclose(pcap_out); else printf("\e[1;31mFailed to open out.pcap\n");
+                printf("\e[0m");
+                return -1;
+        }
+        ret = check_log();
+        ret = check_pcap() || ret;
+        fclose(demo_log);
+        fclose(out_log);
+
+        printf("\e[0;34mBenchmark begin.\n\e[0m");
+        bench(argv[1], rounds);
+        return ret ? -1 : 0;
+}
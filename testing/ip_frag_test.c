@@ -31,7 +31,7 @@ int main(int argc, char* argv[])
                 buf.len++;
         }
         printf("\e[0;34mFeeding input.\n");
-        ip_out(&buf,net_if_ip,NET_PROTOCOL_TCP);
+        ip_out(&net_main_ctx, &buf,net_if_ip,NET_PROTOCOL_TCP);
 
         fclose(in);
         fclose(control_flow);
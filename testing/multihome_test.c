@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "tcp.h"
+#include "ip.h"
+#include "arp.h"
+#include "route.h"
+#include "driver.h"
+#include "test.h"
+
+#define LISTEN_PORT 80
+#define PEER_PORT 40000
+
+uint8_t eth0_ip[NET_IP_LEN] = {192, 168, 163, 103};
+uint8_t eth0_mac[NET_MAC_LEN] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+uint8_t eth1_ip[NET_IP_LEN] = {10, 1, 0, 1};
+uint8_t eth1_mac[NET_MAC_LEN] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x77};
+uint8_t gw_ip[NET_IP_LEN] = {192, 168, 163, 1};
+uint8_t gw_mac[NET_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+uint8_t unresolved_gw_ip[NET_IP_LEN] = {192, 168, 163, 2};
+uint8_t peer_net[NET_IP_LEN] = {172, 16, 0, 0};
+uint8_t far_net[NET_IP_LEN] = {172, 17, 0, 0};
+
+extern map_t arp_table;
+extern FILE *arp_fout;
+net_ctx_t *ctx = &net_main_ctx;
+netif_t *eth0, *eth1;
+netif_t *sent_netif; //最近一帧的出口网卡
+uint8_t sent[BUF_MAX_LEN]; //最近发出的一帧
+size_t sent_len;
+int sent_num;
+buf_t rx;
+
+/**
+ * @brief 捕获协议栈发出的帧，记录最近一帧与出口网卡
+ *
+ */
+void capture(netif_t *netif, const uint8_t *frame, size_t len)
+{
+        sent_netif = netif;
+        memcpy(sent, frame, len);
+        sent_len = len;
+        sent_num++;
+}
+
+void handler(tcp_connect_t *connect, connect_state_t state)
+{
+}
+
+/**
+ * @brief 计算TCP报文段连同伪头部的校验和，报文段完好时为0
+ *
+ */
+uint16_t tcp_sum(const uint8_t *src_ip, const uint8_t *dst_ip, const uint8_t *seg, size_t len)
+{
+        static uint8_t data[sizeof(tcp_peso_hdr_t) + BUF_MAX_LEN + 1];
+        tcp_peso_hdr_t *peso = (tcp_peso_hdr_t *)data;
+        memcpy(peso->src_ip, src_ip, NET_IP_LEN);
+        memcpy(peso->dst_ip, dst_ip, NET_IP_LEN);
+        peso->placeholder = 0;
+        peso->protocol = NET_PROTOCOL_TCP;
+        peso->total_len16 = swap16(len);
+        memcpy(data + sizeof(tcp_peso_hdr_t), seg, len);
+        data[sizeof(tcp_peso_hdr_t) + len] = 0;
+        return checksum16((uint16_t *)data, sizeof(tcp_peso_hdr_t) + len + len % 2);
+}
+
+/**
+ * @brief 以对端身份向eth1的地址发送SYN，从eth1收到
+ *
+ */
+void peer_syn(uint8_t *peer_ip)
+{
+        buf_init(&rx, sizeof(tcp_hdr_t));
+        tcp_hdr_t *hdr = (tcp_hdr_t *)rx.data;
+        memset(hdr, 0, sizeof(tcp_hdr_t));
+        hdr->src_port16 = swap16(PEER_PORT);
+        hdr->dst_port16 = swap16(LISTEN_PORT);
+        hdr->seq_number32 = swap32(1000);
+        hdr->data_offset = sizeof(tcp_hdr_t) / 4;
+        hdr->flags = tcp_flags_syn;
+        hdr->window_size16 = swap16(65535);
+        hdr->chunksum16 = tcp_sum(peer_ip, eth1_ip, rx.data, rx.len);
+        tcp_in(ctx, eth1, &rx, peer_ip);
+}
+
+/**
+ * @brief 非对称路由：连接建立在eth1的地址上，回程路由从eth0出去，
+ *        报文段的源地址仍是eth1的地址，与TCP校验和的伪头部一致
+ *
+ * @return int 失败数
+ */
+int test_asymmetric()
+{
+        int fail = 0;
+        uint8_t peer_ip[NET_IP_LEN] = {172, 16, 0, 9};
+        sent_num = 0;
+        peer_syn(peer_ip);
+        ip_hdr_t *ip_hdr = (ip_hdr_t *)(sent + sizeof(ether_hdr_t));
+        tcp_hdr_t *hdr = (tcp_hdr_t *)(ip_hdr + 1);
+        if (sent_num != 1) {
+                printf("\e[0;31mSYN+ACK not sent.\n");
+                return 1;
+        }
+        CHECK(sent_netif == eth0 && memcmp(((ether_hdr_t *)sent)->dst, gw_mac, NET_MAC_LEN) == 0,
+              "SYN+ACK not routed through eth0 to the gateway.");
+        CHECK(memcmp(ip_hdr->src_ip, eth1_ip, NET_IP_LEN) == 0, "SYN+ACK sent from %s, expected the connection's address.",
+              iptos(ip_hdr->src_ip));
+        CHECK(checksum16((uint16_t *)ip_hdr, sizeof(ip_hdr_t)) == 0, "IP header checksum wrong after rewriting the source.");
+        CHECK(hdr->flags.syn && hdr->flags.ack &&
+              tcp_sum(ip_hdr->src_ip, ip_hdr->dst_ip, (uint8_t *)hdr, swap16(ip_hdr->total_len16) - sizeof(ip_hdr_t)) == 0,
+              "TCP checksum does not match the IP source address.");
+
+        // 下一跳未解析时走逐字段构造报头的路径，交给arp的数据包源地址同样是连接的地址
+        uint8_t far_ip[NET_IP_LEN] = {172, 17, 0, 9};
+        rewind(arp_fout);
+        peer_syn(far_ip);
+        fflush(arp_fout);
+        char log[4096] = {0};
+        rewind(arp_fout);
+        fread(log, 1, sizeof(log) - 1, arp_fout);
+        CHECK(strstr(log, "0a 01 00 01 ac 11 00 09") != NULL, "Unresolved SYN+ACK not queued with the connection's address.");
+        return fail;
+}
+
+/**
+ * @brief 出口网卡的MTU小于以太网默认值时，下一跳已解析与未解析的数据包都按出口网卡的MTU分片
+ *
+ * @return int 失败数
+ */
+int test_mtu()
+{
+        int fail = 0;
+        int mtu = eth0->mtu;
+        uint8_t peer_ip[NET_IP_LEN] = {172, 16, 0, 9};
+        uint8_t far_ip[NET_IP_LEN] = {172, 17, 0, 9};
+        eth0->mtu = 576;
+        ip_dst_cache_flush();
+
+        // 下一跳已解析，经目的地缓存发出
+        sent_num = 0;
+        buf_init(&rx, 1000);
+        memset(rx.data, 0, rx.len);
+        ip_out(ctx, &rx, peer_ip, NET_PROTOCOL_UDP);
+        CHECK(sent_num == 2, "Resolved 1000-byte datagram sent as %d frames over a 576-byte MTU, expected 2.", sent_num);
+
+        // 下一跳未解析，交给arp的各分片同样不超过出口网卡的MTU
+        rewind(arp_fout);
+        buf_init(&rx, 1000);
+        memset(rx.data, 0, rx.len);
+        ip_out(ctx, &rx, far_ip, NET_PROTOCOL_UDP);
+        fflush(arp_fout);
+        long end = ftell(arp_fout);
+        static char log[8192];
+        memset(log, 0, sizeof(log));
+        rewind(arp_fout);
+        fread(log, 1, end < (long)sizeof(log) - 1 ? end : (long)sizeof(log) - 1, arp_fout);
+        int queued = 0;
+        for (char *p = log; (p = strstr(p, "arp_out:")) != NULL; p++)
+                queued++;
+        CHECK(queued == 2, "Unresolved 1000-byte datagram queued as %d packets over a 576-byte MTU, expected 2.", queued);
+        CHECK(strstr(log, "buf: 45 00 02 3c") != NULL, "First unresolved fragment is not 572 bytes long.");
+
+        eth0->mtu = mtu;
+        ip_dst_cache_flush();
+        return fail;
+}
+
+int main(int argc, char* argv[])
+{
+        int fail = 0;
+        arp_fout = tmpfile();
+        if (arp_fout == NULL)
+                return -1;
+        driver_capture = capture;
+        net_ctx_init(ctx, 0);
+        eth0 = net_if_add(eth0_ip, eth0_mac, 24);
+        eth1 = net_if_add(eth1_ip, eth1_mac, 24);
+        arp_init();
+        ip_init();
+        tcp_init();
+        route_add(peer_net, 16, gw_ip, eth0);
+        route_add(far_net, 16, unresolved_gw_ip, eth0);
+        map_set(&arp_table, gw_ip, gw_mac);
+        tcp_open(LISTEN_PORT, handler);
+
+        printf("\e[0;34mChecking the source address on an asymmetric route.\n\e[0m");
+        fail += test_asymmetric();
+        printf("\e[0;34mChecking the MTU on a destination cache miss.\n\e[0m");
+        fail += test_mtu();
+        if (fail == 0)
+                printf("\e[1;32mMultihome check passed\n");
+        printf("\e[0m");
+        return fail ? -1 : 0;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "ringbuf.h"
+
+#define STREAM_LEN (1024 * 1024)
+
+ringbuf_t ring;
+uint8_t chunk[4096];
+
+int main(int argc, char* argv[])
+{
+        int fail = 0;
+        uint32_t written = 0, read = 0;
+        srand(1);
+        ringbuf_init(&ring, 1000);
+        if (ring.size != 1024) {
+                printf("\e[0;31mSize %u not rounded up to 1024.\n", ring.size);
+                fail++;
+        }
+        printf("\e[0;34mStreaming %d bytes through the ring with random chunk sizes.\n", STREAM_LEN);
+        while (read < STREAM_LEN) {
+                uint32_t len = rand() % sizeof(chunk);
+                for (uint32_t i = 0; i < len; i++)
+                        chunk[i] = (uint8_t)(written + i);
+                written += ringbuf_write(&ring, chunk, len);
+                if (ringbuf_len(&ring) > ring.size) {
+                        printf("\e[0;31mRing overfilled.\n");
+                        fail++;
+                        break;
+                }
+                // 中途扩容一次，数据须保持顺序
+                if (written > STREAM_LEN / 2 && ring.size == 1024)
+                        ringbuf_resize(&ring, 4096);
+                uint8_t peek;
+                if (ringbuf_len(&ring) > 1 && (ringbuf_peek(&ring, 1, &peek, 1) != 1 || peek != (uint8_t)(read + 1))) {
+                        printf("\e[0;31mPeek at offset 1 returned wrong byte.\n");
+                        fail++;
+                        break;
+                }
+                len = ringbuf_read(&ring, chunk, rand() % sizeof(chunk));
+                for (uint32_t i = 0; i < len; i++)
+                        if (chunk[i] != (uint8_t)(read + i)) {
+                                printf("\e[0;31mByte %u corrupted.\n", read + i);
+                                fail++;
+                                read = STREAM_LEN;
+                                break;
+                        }
+                read += len;
+        }
+        if (ring.size != 4096) {
+                printf("\e[0;31mResize did not take effect.\n");
+                fail++;
+        }
+        uint32_t left = ringbuf_len(&ring);
+        if (ringbuf_drop(&ring, left + 10) != left || ringbuf_len(&ring) != 0) {
+                printf("\e[0;31mDrop did not empty the ring.\n");
+                fail++;
+        }
+        ringbuf_free(&ring);
+
+        // 先写入后面的数据，扩容后再补上前面的空洞并计入，整体顺序不变
+        printf("\e[0;34mChecking writes past the tail.\n");
+        ringbuf_init(&ring, 16);
+        ringbuf_write(&ring, (const uint8_t *)"0123456789", 10);
+        ringbuf_drop(&ring, 8);
+        if (ringbuf_write_at(&ring, 4, (const uint8_t *)"6789abcdefghij", 14) != 10) {
+                printf("\e[0;31mWrite past the tail not clipped to free space.\n");
+                fail++;
+        }
+        ringbuf_resize(&ring, 64);
+        ringbuf_write(&ring, (const uint8_t *)"2345", 4);
+        ringbuf_commit(&ring, 10);
+        memset(chunk, 0, sizeof(chunk));
+        if (ringbuf_read(&ring, chunk, sizeof(chunk)) != 16 || memcmp(chunk, "892345", 6) != 0 ||
+            memcmp(chunk + 6, "6789abcdef", 10) != 0) {
+                printf("\e[0;31mData written past the tail lost or reordered: %.16s.\n", chunk);
+                fail++;
+        }
+        ringbuf_free(&ring);
+
+        if (fail == 0)
+                printf("\e[1;32mRing buffer check passed\n");
+        printf("\e[0m");
+        return fail ? -1 : 0;
+}
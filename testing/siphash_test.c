@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <string.h>
+#include "siphash.h"
+
+/**
+ * @brief 参考实现的测试向量：密钥为00..0f，消息为00..len-1
+ *
+ */
+static const struct
+{
+        size_t len;
+        uint64_t hash;
+} vectors[] = {
+        {0, 0x726fdb47dd0e0e31ull},
+        {1, 0x74f839c593dc67fdull},
+        {15, 0xa129ca6149be45e5ull},
+};
+
+int main(int argc, char* argv[])
+{
+        int fail = 0;
+        uint8_t key[SIPHASH_KEY_LEN], msg[64];
+        for (int i = 0; i < SIPHASH_KEY_LEN; i++)
+                key[i] = i;
+        for (int i = 0; i < 64; i++)
+                msg[i] = i;
+        printf("\e[0;34mChecking reference vectors.\n");
+        for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+                uint64_t hash = siphash(key, msg, vectors[i].len);
+                if (hash != vectors[i].hash) {
+                        printf("\e[0;31mLength %zu hashed to %016llx, expected %016llx.\n", vectors[i].len,
+                               (unsigned long long)hash, (unsigned long long)vectors[i].hash);
+                        fail++;
+                }
+        }
+        printf("\e[0;34mChecking key and input sensitivity.\n");
+        uint64_t base = siphash(key, msg, 20);
+        key[0] ^= 1;
+        if (siphash(key, msg, 20) == base) {
+                printf("\e[0;31mHash does not depend on the key.\n");
+                fail++;
+        }
+        key[0] ^= 1;
+        msg[19] ^= 0x80;
+        if (siphash(key, msg, 20) == base) {
+                printf("\e[0;31mHash does not depend on the last byte.\n");
+                fail++;
+        }
+        if (fail == 0)
+                printf("\e[1;32mSipHash check passed\n");
+        printf("\e[0m");
+        return fail ? -1 : 0;
+}
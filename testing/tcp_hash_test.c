@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "tcp_hash.h"
+
+#define CONN_NUM 50000
+#define LOOKUP_ROUNDS 20
+
+tcp_hash_t table;
+tcp_key_t keys[CONN_NUM];
+tcp_connect_t *connects[CONN_NUM];
+
+/**
+ * @brief 生成第i个连接的键，ip与端口都随i变化
+ *
+ * @param i 序号
+ * @return tcp_key_t 键
+ */
+tcp_key_t make_key(int i)
+{
+        tcp_key_t key;
+        uint8_t ip[NET_IP_LEN] = {10, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        memcpy(key.ip, ip, NET_IP_LEN);
+        key.src_port = 1024 + i % 50000;
+        key.dst_port = 80;
+        return key;
+}
+
+/**
+ * @brief tcp_hash_foreach的回调，删除远端端口为奇数的连接
+ *
+ * @param connect 连接
+ * @param arg 出口参数，删除计数
+ * @return int 为1时删除
+ */
+int remove_odd(tcp_connect_t *connect, void *arg)
+{
+        if (connect->remote_port % 2 == 0)
+                return 0;
+        (*(int *)arg)++;
+        return 1;
+}
+
+int main(int argc, char* argv[])
+{
+        int fail = 0;
+        tcp_hash_init(&table);
+        printf("\e[0;34mInserting %d connections.\n", CONN_NUM);
+        for (int i = 0; i < CONN_NUM; i++) {
+                keys[i] = make_key(i);
+                connects[i] = tcp_hash_add(&table, &keys[i]);
+                if (connects[i] == NULL) {
+                        printf("\e[0;31mFailed to add connection %d.\n", i);
+                        return -1;
+                }
+                connects[i]->remote_port = i;
+        }
+        if (tcp_hash_size(&table) != CONN_NUM) {
+                printf("\e[0;31mSize %zu, expected %d.\n", tcp_hash_size(&table), CONN_NUM);
+                fail++;
+        }
+
+        // 表扩容多次后连接对象地址不变
+        clock_t begin = clock();
+        for (int round = 0; round < LOOKUP_ROUNDS; round++)
+                for (int i = 0; i < CONN_NUM; i++)
+                        if (tcp_hash_get(&table, &keys[i]) != connects[i] || connects[i]->remote_port != i) {
+                                printf("\e[0;31mLookup %d returned a different connection.\n", i);
+                                fail++;
+                                round = LOOKUP_ROUNDS;
+                                break;
+                        }
+        double sec = (double)(clock() - begin) / CLOCKS_PER_SEC;
+        printf("\e[0;34m%d lookups in %.3f s, %.1f ns per lookup.\n", CONN_NUM * LOOKUP_ROUNDS, sec, sec * 1e9 / CONN_NUM / LOOKUP_ROUNDS);
+
+        tcp_key_t missing = make_key(CONN_NUM);
+        if (tcp_hash_get(&table, &missing) != NULL) {
+                printf("\e[0;31mFound a connection that was never added.\n");
+                fail++;
+        }
+
+        printf("\e[0;34mRemoving odd connections while iterating.\n");
+        int removed = 0;
+        tcp_hash_foreach(&table, remove_odd, &removed);
+        if (removed != CONN_NUM / 2 || tcp_hash_size(&table) != CONN_NUM - removed) {
+                printf("\e[0;31mRemoved %d, size %zu.\n", removed, tcp_hash_size(&table));
+                fail++;
+        }
+        for (int i = 0; i < CONN_NUM; i++) {
+                tcp_connect_t *connect = tcp_hash_get(&table, &keys[i]);
+                if ((i % 2 && connect != NULL) || (i % 2 == 0 && connect != connects[i])) {
+                        printf("\e[0;31mConnection %d in wrong state after foreach.\n", i);
+                        fail++;
+                        break;
+                }
+        }
+
+        printf("\e[0;34mDeleting the rest and reusing freed objects.\n");
+        for (int i = 0; i < CONN_NUM; i += 2)
+                tcp_hash_delete(&table, &keys[i]);
+        size_t total = table.slab.total;
+        for (int i = 0; i < CONN_NUM; i++)
+                if (tcp_hash_add(&table, &keys[i]) == NULL) {
+                        fail++;
+                        break;
+                }
+        if (tcp_hash_size(&table) != CONN_NUM || table.slab.total != total) {
+                printf("\e[0;31mSlab grew from %zu to %zu although objects were free.\n", total, table.slab.total);
+                fail++;
+        }
+        tcp_hash_destroy(&table);
+
+        if (fail == 0)
+                printf("\e[1;32mTCP connection table check passed\n");
+        printf("\e[0m");
+        return fail ? -1 : 0;
+}
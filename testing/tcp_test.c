@@ -0,0 +1,1498 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "tcp.h"
+#include "ip.h"
+#include "tcp_cc.h"
+#include "sock.h"
+#include "coro.h"
+#include "test.h"
+
+#define SEG_MAX 64
+#define SERVER_PORT 80
+#define PEER_PORT 40000
+#define ACCEPT_PORT 8000
+
+#define LINK_RATE 1000                    //瓶颈链路速率，字节/毫秒
+#define LINK_DELAY_US 10000               //单向传播时延，微秒
+#define LINK_QUEUE_BYTES (30 * 1500)      //瓶颈队列长度，约30个报文段
+#define LINK_FIFO_SIZE 1024               //链路上同时存在的报文段上限
+#define GOODPUT_BYTES (2 * 1024 * 1024)   //每次传输的数据量
+#define GOODPUT_TIMEOUT_MS 120000         //模拟时间上限
+#define GOODPUT_SEEDS 4                   //有随机丢包时每种配置依次使用的随机种子数，比较总的吞吐量
+
+typedef struct seg //协议栈发出的一个TCP报文段
+{
+        uint16_t src_port;
+        uint32_t seq, ack;
+        tcp_flags_t flags;
+        uint16_t win;
+        uint16_t len;
+        tcp_opts_t opts;
+        uint8_t data[BUF_MAX_LEN];
+} seg_t;
+
+typedef struct link_pkt //模拟链路上的一个报文段
+{
+        uint64_t arrive_us;
+        uint32_t seq;
+        tcp_flags_t flags;
+        uint16_t len;
+        uint8_t data[ETHERNET_MAX_TRANSPORT_UNIT];
+} link_pkt_t;
+
+uint8_t peer_ip[NET_IP_LEN] = {192, 168, 163, 1};
+uint16_t peer_port = PEER_PORT;
+uint16_t stack_port = SERVER_PORT; //对端发往的协议栈端口
+uint16_t peer_win = 65535;
+net_ctx_t *ctx = &net_main_ctx;
+seg_t segs[SEG_MAX];
+int seg_num;
+buf_t rx;
+
+// 模拟链路：协议栈发出的报文段经过瓶颈队列与传播时延到达对端，对端的ACK只有传播时延
+int link_on;
+uint64_t link_now_us, link_busy_us;
+uint32_t link_loss_permille, link_rand = 1;
+link_pkt_t link_fifo[LINK_FIFO_SIZE];
+size_t link_head, link_tail;
+struct {
+        uint64_t arrive_us;
+        uint32_t ack;
+        uint8_t opt[4 + 8 * TCP_SACK_BLOCKS]; //SACK选项
+        uint8_t opt_len;
+} ack_fifo[LINK_FIFO_SIZE];
+int peer_sack;
+tcp_range_t peer_ooo[LINK_FIFO_SIZE]; //对端收到的乱序区间，按序号升序
+int peer_ooo_num;
+size_t ack_head, ack_tail;
+uint64_t link_drops;
+int oversize; //加上ip头超过MTU、需要ip分片的报文段数
+
+uint8_t app_data[GOODPUT_BYTES], peer_data[GOODPUT_BYTES], peer_got[GOODPUT_BYTES];
+
+tcp_connect_t *server;
+int connected, closed;
+int ready; //accept队列由空变为非空的次数
+int echo; //收到数据时是否原样写回
+
+/**
+ * @brief 解析协议栈发出的报文段中的选项
+ *
+ */
+void parse_opts(tcp_hdr_t *hdr, tcp_opts_t *opts)
+{
+        memset(opts, 0, sizeof(tcp_opts_t));
+        opts->wscale = -1;
+        uint8_t *p = (uint8_t *)(hdr + 1), *end = (uint8_t *)hdr + hdr->data_offset * 4;
+        while (p < end && *p != TCP_OPT_EOL) {
+                if (*p == TCP_OPT_NOP) {
+                        p++;
+                        continue;
+                }
+                if (p[0] == TCP_OPT_MSS)
+                        opts->mss = (p[2] << 8) | p[3];
+                else if (p[0] == TCP_OPT_WSCALE)
+                        opts->wscale = p[2];
+                else if (p[0] == TCP_OPT_SACK_PERM)
+                        opts->sack_ok = 1;
+                else if (p[0] == TCP_OPT_SACK)
+                        for (int i = 0; i < (p[1] - 2) / 8 && opts->sack_num < TCP_SACK_BLOCKS; i++) {
+                                uint8_t *b = p + 2 + 8 * i;
+                                opts->sack[opts->sack_num].start = ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+                                opts->sack[opts->sack_num++].end = ((uint32_t)b[4] << 24) | (b[5] << 16) | (b[6] << 8) | b[7];
+                        }
+                else if (p[0] == TCP_OPT_TIMESTAMP) {
+                        opts->ts_ok = 1;
+                        opts->tsval = (p[2] << 24) | (p[3] << 16) | (p[4] << 8) | p[5];
+                        opts->tsecr = ((uint32_t)p[6] << 24) | (p[7] << 16) | (p[8] << 8) | p[9];
+                }
+                p += p[1];
+        }
+}
+
+/**
+ * @brief 替代ip层，记录协议栈发出的TCP报文段
+ *
+ */
+void ip_out_src(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol, const uint8_t *src_ip)
+{
+        tcp_hdr_t *hdr = (tcp_hdr_t *)buf->data;
+        if (buf->len + sizeof(ip_hdr_t) > ETHERNET_MAX_TRANSPORT_UNIT)
+                oversize++;
+        if (link_on) {
+                // 随机丢包，或瓶颈队列已满时丢弃（drop-tail）
+                link_rand = link_rand * 1103515245 + 12345;
+                uint64_t backlog = link_busy_us > link_now_us ? (link_busy_us - link_now_us) * LINK_RATE / 1000 : 0;
+                if ((link_rand >> 16) % 1000 < link_loss_permille || backlog + buf->len > LINK_QUEUE_BYTES ||
+                    link_tail - link_head == LINK_FIFO_SIZE) {
+                        link_drops++;
+                        return;
+                }
+                link_busy_us = (link_busy_us > link_now_us ? link_busy_us : link_now_us) + (uint64_t)buf->len * 1000 / LINK_RATE;
+                link_pkt_t *pkt = &link_fifo[link_tail++ % LINK_FIFO_SIZE];
+                pkt->arrive_us = link_busy_us + LINK_DELAY_US;
+                pkt->seq = swap32(hdr->seq_number32);
+                pkt->flags = hdr->flags;
+                pkt->len = buf->len - hdr->data_offset * 4;
+                memcpy(pkt->data, buf->data + hdr->data_offset * 4, pkt->len);
+                return;
+        }
+        if (seg_num == SEG_MAX)
+                return;
+        seg_t *seg = &segs[seg_num++];
+        seg->src_port = swap16(hdr->src_port16);
+        seg->seq = swap32(hdr->seq_number32);
+        seg->ack = swap32(hdr->ack_number32);
+        seg->flags = hdr->flags;
+        seg->win = swap16(hdr->window_size16);
+        seg->len = buf->len - hdr->data_offset * 4;
+        parse_opts(hdr, &seg->opts);
+        memcpy(seg->data, buf->data + hdr->data_offset * 4, seg->len);
+}
+
+void ip_out(net_ctx_t *ctx, buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+        ip_out_src(ctx, buf, ip, protocol, NULL);
+}
+
+void ip_init()
+{
+}
+
+void ip_dst_cache_flush()
+{
+}
+
+/**
+ * @brief 不建立目的地缓存，udp数据报都经ip_out发出
+ *
+ */
+ip_dst_t *ip_dst_lookup(net_ctx_t *ctx, uint8_t *ip)
+{
+        return NULL;
+}
+
+/**
+ * @brief 以对端身份向协议栈发送一个带选项的报文段
+ *
+ * @param opt 选项，长度须为4的倍数
+ * @param opt_len 选项长度
+ */
+void peer_send_opts(tcp_flags_t flags, uint32_t seq, uint32_t ack, const uint8_t *opt, size_t opt_len, const uint8_t *data, size_t len)
+{
+        size_t hdr_len = sizeof(tcp_hdr_t) + opt_len;
+        len += opt_len;
+        buf_init(&rx, len + sizeof(tcp_hdr_t));
+        tcp_hdr_t *hdr = (tcp_hdr_t *)rx.data;
+        memset(hdr, 0, sizeof(tcp_hdr_t));
+        hdr->src_port16 = swap16(peer_port);
+        hdr->dst_port16 = swap16(stack_port);
+        hdr->seq_number32 = swap32(seq);
+        hdr->ack_number32 = swap32(ack);
+        hdr->data_offset = hdr_len / 4;
+        hdr->flags = flags;
+        hdr->window_size16 = swap16(peer_win);
+        if (opt_len)
+                memcpy(rx.data + sizeof(tcp_hdr_t), opt, opt_len);
+        if (len > opt_len)
+                memcpy(rx.data + hdr_len, data, len - opt_len);
+        // 伪头部放在报文段之前计算校验和
+        buf_add_header(&rx, sizeof(tcp_peso_hdr_t));
+        tcp_peso_hdr_t *peso = (tcp_peso_hdr_t *)rx.data;
+        memcpy(peso->src_ip, peer_ip, NET_IP_LEN);
+        memcpy(peso->dst_ip, net_if_ip, NET_IP_LEN);
+        peso->placeholder = 0;
+        peso->protocol = NET_PROTOCOL_TCP;
+        peso->total_len16 = swap16(len + sizeof(tcp_hdr_t));
+        if (rx.len % 2)
+                buf_add_padding(&rx, 1);
+        uint16_t checksum = checksum16((uint16_t *)rx.data, rx.len);
+        if ((len + sizeof(tcp_hdr_t)) % 2)
+                buf_remove_padding(&rx, 1);
+        buf_remove_header(&rx, sizeof(tcp_peso_hdr_t));
+        ((tcp_hdr_t *)rx.data)->chunksum16 = checksum;
+        tcp_in(ctx, net_if_default, &rx, peer_ip);
+}
+
+/**
+ * @brief 以对端身份向协议栈发送一个不带选项的报文段
+ *
+ */
+void peer_send(tcp_flags_t flags, uint32_t seq, uint32_t ack, const uint8_t *data, size_t len)
+{
+        peer_send_opts(flags, seq, ack, NULL, 0, data, len);
+}
+
+/**
+ * @brief 推进模拟时钟并运行到期的定时器
+ *
+ */
+void advance(uint64_t ms)
+{
+        ctx->now += ms;
+        timer_wheel_run(&ctx->timers, ctx->now, ctx);
+}
+
+void handler(tcp_connect_t *connect, connect_state_t state)
+{
+        if (state == TCP_CONN_CONNECTED) {
+                server = connect;
+                connected++;
+        } else if (state == TCP_CONN_DATA_RECV && echo) {
+                uint8_t data[BUF_MAX_LEN];
+                tcp_connect_write(connect, data, tcp_connect_read(connect, data, sizeof(data)));
+        } else if (state == TCP_CONN_CLOSED) {
+                closed++;
+        }
+}
+
+/**
+ * @brief 握手：SYN+ACK丢失后按1、2秒退避重传，对端确认后建立连接
+ *
+ * @param isn 出口参数，协议栈的初始序号
+ * @return int 失败数
+ */
+int test_handshake(uint32_t *isn)
+{
+        int fail = 0;
+        seg_num = 0;
+        peer_send(tcp_flags_syn, 1000, 0, NULL, 0);
+        CHECK(seg_num == 1 && segs[0].flags.syn && segs[0].flags.ack && segs[0].ack == 1001, "No SYN+ACK.");
+        *isn = segs[0].seq;
+        advance(TCP_RTO_INIT_MS - 1);
+        CHECK(seg_num == 1, "SYN+ACK retransmitted too early.");
+        advance(1);
+        CHECK(seg_num == 2 && segs[1].flags.syn && segs[1].seq == *isn, "SYN+ACK not retransmitted after initial RTO.");
+        advance(2 * TCP_RTO_INIT_MS);
+        CHECK(seg_num == 3 && segs[2].flags.syn, "SYN+ACK not retransmitted with doubled RTO.");
+        peer_send(tcp_flags_ack, 1001, *isn + 1, NULL, 0);
+        CHECK(connected == 1 && server != NULL, "Connection not established.");
+        CHECK(server && server->srtt == 0, "RTT sampled from a retransmitted SYN+ACK.");
+        seg_num = 0;
+        advance(10 * TCP_RTO_MAX_MS);
+        CHECK(seg_num == 0, "Timer still running after SYN+ACK acknowledged.");
+        return fail;
+}
+
+/**
+ * @brief 数据：第一次发送测得RTT，丢失后按RTO重传，重传的确认不计入RTT
+ *
+ * @param isn 协议栈的初始序号
+ * @return int 失败数
+ */
+int test_retransmit(uint32_t isn)
+{
+        int fail = 0;
+        uint8_t data[100];
+        memset(data, 'a', sizeof(data));
+        uint32_t snd = isn + 1;
+
+        // 一次正常往返：50ms后确认，第一个样本SRTT=R，RTTVAR=R/2，RTO取下限
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+        tcp_connect_write(server, data, sizeof(data));
+        CHECK(seg_num == 1 && segs[0].len == sizeof(data) && segs[0].seq == snd, "Data not sent.");
+        advance(50);
+        snd += sizeof(data);
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+        CHECK(server->srtt == 50 && server->rttvar == 25, "SRTT %u RTTVAR %u, expected 50 and 25.", server->srtt, server->rttvar);
+        CHECK(server->rto == TCP_RTO_MIN_MS, "RTO %u not clamped to minimum.", server->rto);
+
+        // 第二个样本：R=130，RTTVAR=(3*25+80)/4=38，SRTT=(7*50+130)/8=60，RTO=60+4*38=212
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+        tcp_connect_write(server, data, sizeof(data));
+        advance(130);
+        snd += sizeof(data);
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+        CHECK(server->srtt == 60 && server->rttvar == 38 && server->rto == 212,
+              "SRTT %u RTTVAR %u RTO %u, expected 60 38 212.", server->srtt, server->rttvar, server->rto);
+
+        // 丢失后重传，RTO加倍，重传的确认不更新RTT
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+        tcp_connect_write(server, data, sizeof(data));
+        advance(212);
+        CHECK(seg_num == 2 && segs[1].seq == snd && segs[1].len == sizeof(data), "Lost data not retransmitted.");
+        CHECK(server->rto == 424, "RTO %u not backed off.", server->rto);
+        advance(10);
+        snd += sizeof(data);
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+        CHECK(server->srtt == 60 && server->rto == 424, "Retransmitted segment was sampled (Karn).");
+        seg_num = 0;
+        advance(10 * TCP_RTO_MAX_MS);
+        CHECK(seg_num == 0, "Timer still running after data acknowledged.");
+
+        // 对端重传已确认过的数据时回复ACK，不复位连接
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001 - sizeof(data), snd, data, sizeof(data));
+        CHECK(seg_num == 1 && !segs[0].flags.rst && segs[0].ack == 1001, "Duplicate segment not answered with an ACK.");
+        return fail;
+}
+
+/**
+ * @brief 对端一直不确认：超过重传次数上限后发送RST并关闭连接
+ *
+ * @return int 失败数
+ */
+int test_give_up()
+{
+        int fail = 0;
+        uint8_t data[10] = {0};
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, server->unack_seq, NULL, 0);
+        tcp_connect_write(server, data, sizeof(data));
+        for (int i = 0; i <= TCP_RETRIES_MAX; i++)
+                advance(TCP_RTO_MAX_MS);
+        CHECK(seg_num == TCP_RETRIES_MAX + 2 && segs[seg_num - 1].flags.rst, "%d segments, expected %d retransmissions and RST.",
+              seg_num, TCP_RETRIES_MAX);
+        CHECK(closed == 1, "Application not notified of the aborted connection.");
+        seg_num = 0;
+        advance(10 * TCP_RTO_MAX_MS);
+        CHECK(seg_num == 0, "Timer still running after connection dropped.");
+        return fail;
+}
+
+/**
+ * @brief 对端从一个新端口发起连接并完成三次握手
+ *
+ * @return uint32_t 协议栈第一个数据字节的序号，握手失败时server为NULL
+ */
+uint32_t peer_connect(const uint8_t *opt, size_t opt_len)
+{
+        server = NULL;
+        peer_port++;
+        seg_num = 0;
+        peer_send_opts(tcp_flags_syn, 1000, 0, opt, opt_len, NULL, 0);
+        if (seg_num != 1)
+                return 0;
+        uint32_t base = segs[0].seq + 1;
+        peer_send(tcp_flags_ack, 1001, base, NULL, 0);
+        return base;
+}
+
+/**
+ * @brief 初始序号：不同四元组的序号互不相关，同一四元组的序号按4微秒一跳的时钟递增
+ *
+ * @return int 失败数
+ */
+int test_isn()
+{
+        int fail = 0;
+        uint32_t a = peer_connect(NULL, 0);
+        peer_send(tcp_flags_ack_rst, 1001, 0, NULL, 0);
+        uint32_t b = peer_connect(NULL, 0);
+        peer_send(tcp_flags_ack_rst, 1001, 0, NULL, 0);
+        CHECK(a != b && a != b - 1 && a != b + 1, "ISNs %u and %u of different ports are related.", a, b);
+        // 时钟与协议栈的毫秒时间无关，按真实经过的时间推进
+        uint64_t start = time_us();
+        while (time_us() - start < 1000)
+                ;
+        peer_port--;
+        uint32_t c = peer_connect(NULL, 0);
+        uint64_t elapsed = time_us() - start;
+        peer_send(tcp_flags_ack_rst, 1001, 0, NULL, 0);
+        CHECK(c - b >= 250 && c - b <= elapsed / 4 + 1000, "ISN advanced by %u in %llu us, expected about %llu.", c - b,
+              (unsigned long long)elapsed, (unsigned long long)elapsed / 4);
+        return fail;
+}
+
+/**
+ * @brief SYN洪泛：半连接队列满后回复SYN cookie，只有确认了有效cookie的ACK才建立连接，半连接超时后被丢弃
+ *
+ * @return int 失败数
+ */
+int test_syn_flood()
+{
+        int fail = 0;
+        uint8_t mss_opt[] = {TCP_OPT_MSS, 4, 1400 >> 8, 1400 & 0xff};
+        uint8_t data[10] = {0};
+        int replies = 0;
+        uint16_t first = peer_port + 1;
+        uint32_t first_isn = 0;
+        for (int i = 0; i < TCP_SYN_BACKLOG; i++) {
+                peer_port++;
+                seg_num = 0;
+                peer_send_opts(tcp_flags_syn, 1000, 0, mss_opt, sizeof(mss_opt), NULL, 0);
+                replies += seg_num == 1 && segs[0].flags.syn;
+                if (i == 0)
+                        first_isn = segs[0].seq;
+        }
+        CHECK(replies == TCP_SYN_BACKLOG, "%d SYN+ACKs for %d SYNs.", replies, TCP_SYN_BACKLOG);
+
+        // 队列已满，SYN+ACK的序号是cookie，不协商MSS以外的选项
+        int before = connected;
+        uint32_t cookie[2];
+        for (int i = 0; i < 2; i++) {
+                peer_port++;
+                seg_num = 0;
+                peer_send_opts(tcp_flags_syn, 1000, 0, mss_opt, sizeof(mss_opt), NULL, 0);
+                CHECK(seg_num == 1 && segs[0].flags.syn && segs[0].opts.mss == TCP_MAX_MSS && segs[0].opts.wscale < 0,
+                      "No SYN cookie when the backlog is full.");
+                cookie[i] = segs[0].seq;
+        }
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, cookie[1], NULL, 0);
+        CHECK(seg_num == 1 && segs[0].flags.rst && connected == before, "ACK with a forged cookie accepted.");
+        CHECK(!segs[0].flags.ack && segs[0].seq == cookie[1], "RST to an ACK has seq %u, expected the acknowledgment %u without ACK.",
+              segs[0].seq, cookie[1]);
+        peer_send(tcp_flags_ack, 1001, cookie[1] + 1, data, sizeof(data));
+        CHECK(connected == before + 1 && server->mss == 1300 && ringbuf_len(&server->rx_buf) == sizeof(data),
+              "Connection not established from the cookie with MSS 1300.");
+        peer_send(tcp_flags_ack_rst, 1011, 0, NULL, 0);
+
+        // 队列里的半连接照常完成握手，握手完成后才分配收发缓存
+        uint16_t port = peer_port;
+        peer_port = first;
+        peer_send(tcp_flags_ack, 1001, first_isn + 1, NULL, 0);
+        CHECK(connected == before + 2 && server->mss == 1400 && server->rx_buf.data != NULL,
+              "Queued half-open connection not established.");
+        peer_send(tcp_flags_ack_rst, 1001, 0, NULL, 0);
+
+        // 半连接的SYN+ACK重传次数用尽后被丢弃，过期的cookie不再有效
+        for (int i = 0; i < 200; i++)
+                advance(1000);
+        peer_port = port - 1;
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, cookie[0] + 1, NULL, 0);
+        CHECK(seg_num == 1 && segs[0].flags.rst && connected == before + 2, "Expired cookie accepted.");
+        CHECK(!segs[0].flags.ack && segs[0].seq == cookie[0] + 1, "RST to an expired cookie not in the peer's window.");
+
+        // 不带ACK的报文段，复位确认它的全部序号
+        peer_port = port + 1;
+        seg_num = 0;
+        tcp_flags_t fin = {.fin = 1};
+        peer_send(fin, 1001, 0, data, sizeof(data));
+        CHECK(seg_num == 1 && segs[0].flags.rst && segs[0].flags.ack && segs[0].seq == 0 && segs[0].ack == 1001 + sizeof(data) + 1,
+              "RST to a segment without ACK acknowledges %u, expected %zu.", segs[0].ack, 1001 + sizeof(data) + 1);
+        peer_port = port;
+        replies = 0;
+        for (int i = 0; i < TCP_SYN_BACKLOG; i++) {
+                uint32_t snd = peer_connect(mss_opt, sizeof(mss_opt));
+                replies += server != NULL && server->mss == 1400;
+                peer_send(tcp_flags_ack_rst, 1001, snd, NULL, 0);
+        }
+        CHECK(replies == TCP_SYN_BACKLOG, "Only %d of %d handshakes stateful, half-open connections not expired.", replies,
+              TCP_SYN_BACKLOG);
+        return fail;
+}
+
+/**
+ * @brief 主动打开：SYN提出全部选项，按SYN+ACK的回应协商；被拒绝或SYN超时时通知关闭并归还端口
+ *
+ * @return int 失败数
+ */
+int test_active_open()
+{
+        int fail = 0;
+        uint8_t synack_opt[] = {TCP_OPT_MSS, 4, 1000 >> 8, 1000 & 0xff, TCP_OPT_NOP, TCP_OPT_WSCALE, 3, 2,
+                                TCP_OPT_SACK_PERM, 2, TCP_OPT_NOP, TCP_OPT_NOP};
+        seg_num = connected = closed = 0;
+        server = NULL;
+        tcp_connect_t *client = tcp_connect(ctx, peer_ip, 8080, handler);
+        CHECK(client != NULL && seg_num == 1 && segs[0].flags.syn && !segs[0].flags.ack, "No SYN sent.");
+        if (client == NULL || seg_num != 1)
+                return fail;
+        CHECK(segs[0].src_port >= TCP_PORT_MIN && segs[0].src_port <= TCP_PORT_MAX, "Local port %u out of range.",
+              segs[0].src_port);
+        CHECK(segs[0].opts.mss == TCP_MAX_MSS && segs[0].opts.wscale > 0 && segs[0].opts.sack_ok && segs[0].opts.ts_ok,
+              "SYN does not offer all options.");
+        uint32_t snd = segs[0].seq + 1;
+        peer_port = 8080;
+        stack_port = segs[0].src_port;
+        peer_send(tcp_flags_ack, 5000, snd + 1, NULL, 0);
+        CHECK(connected == 0 && client->state == TCP_SYN_SEND, "Wrong acknowledgment accepted in SYN_SENT.");
+        peer_send_opts(tcp_flags_ack_syn, 5000, snd, synack_opt, sizeof(synack_opt), NULL, 0);
+        CHECK(connected == 1 && server == client && client->state == TCP_ESTABLISHED, "Connection not established.");
+        CHECK(client->mss == 1000 && client->snd_wscale == 2 && client->rcv_wscale > 0 && client->sack_ok && !client->ts_ok,
+              "Options not negotiated from SYN+ACK.");
+        CHECK(seg_num == 2 && segs[1].flags.ack && !segs[1].flags.syn && segs[1].seq == snd && segs[1].ack == 5001,
+              "Handshake not completed with an ACK.");
+        seg_num = 0;
+        tcp_connect_write(client, (const uint8_t *)"hello", 5);
+        CHECK(seg_num == 1 && segs[0].len == 5 && segs[0].seq == snd, "Data not sent on the active connection.");
+        peer_send(tcp_flags_ack, 5001, snd + 5, (const uint8_t *)"world", 5);
+        uint8_t out[8];
+        CHECK(tcp_connect_read(client, out, sizeof(out)) == 5 && memcmp(out, "world", 5) == 0, "Data not received.");
+        peer_send(tcp_flags_ack_rst, 5006, 0, NULL, 0);
+        CHECK(closed == 1, "Reset of an established connection not reported.");
+
+        // 对端拒绝连接
+        closed = 0;
+        seg_num = 0;
+        client = tcp_connect(ctx, peer_ip, 8080, handler);
+        stack_port = segs[0].src_port;
+        peer_send(tcp_flags_ack_rst, 0, segs[0].seq + 1, NULL, 0);
+        CHECK(closed == 1, "Refused connection not reported.");
+
+        // SYN按RTO退避重传，TCP_SYN_RETRIES次后放弃
+        seg_num = 0;
+        client = tcp_connect(ctx, peer_ip, 8080, handler);
+        for (int i = 0; i < 300 && closed == 1; i++)
+                advance(1000);
+        CHECK(seg_num == TCP_SYN_RETRIES + 1 && segs[seg_num - 1].flags.syn && segs[seg_num - 1].seq == segs[0].seq,
+              "SYN sent %d times, expected %d.", seg_num, TCP_SYN_RETRIES + 1);
+        CHECK(closed == 2, "Connection timeout not reported.");
+        peer_port = PEER_PORT;
+        stack_port = SERVER_PORT;
+        return fail;
+}
+
+/**
+ * @brief 临时端口：到同一目的地的连接用尽整个范围，端口互不相同；关闭后归还，可以再次分配
+ *
+ * @return int 失败数
+ */
+int test_ephemeral_ports()
+{
+        int fail = 0;
+        static tcp_connect_t *conns[TCP_PORT_MAX - TCP_PORT_MIN + 1];
+        static uint8_t used[65536];
+        int num = 0, dup = 0;
+        memset(used, 0, sizeof(used));
+        tcp_connect_t *connect;
+        while (num <= TCP_PORT_MAX - TCP_PORT_MIN && (connect = tcp_connect(ctx, peer_ip, 9090, handler)) != NULL) {
+                if (connect->local_port < TCP_PORT_MIN || connect->local_port > TCP_PORT_MAX || used[connect->local_port]++)
+                        dup++;
+                conns[num++] = connect;
+        }
+        CHECK(num == TCP_PORT_MAX - TCP_PORT_MIN + 1 && dup == 0, "Allocated %d ports with %d duplicates, expected %d.",
+              num, dup, TCP_PORT_MAX - TCP_PORT_MIN + 1);
+        CHECK(tcp_connect(ctx, peer_ip, 9090, handler) == NULL, "Port allocated beyond the ephemeral range.");
+        uint16_t port = conns[num / 2]->local_port;
+        tcp_connect_close(conns[num / 2]);
+        connect = tcp_connect(ctx, peer_ip, 9090, handler);
+        CHECK(connect != NULL && connect->local_port == port, "Released port %u not reused.", port);
+        if (connect)
+                conns[num / 2] = connect;
+        for (int i = 0; i < num; i++)
+                tcp_connect_close(conns[i]);
+        connect = tcp_connect(ctx, peer_ip, 9090, handler);
+        CHECK(connect != NULL, "Ports not returned after closing.");
+        if (connect)
+                tcp_connect_close(connect);
+        seg_num = 0;
+        return fail;
+}
+
+/**
+ * @brief TIME_WAIT：本端先关闭后只保留精简记录，重传的FIN得到同样的ACK，RST不能提前结束，2MSL后回收；
+ *        序号在旧连接之后的SYN可以复用同一四元组
+ *
+ * @return int 失败数
+ */
+int test_time_wait()
+{
+        int fail = 0;
+        uint32_t snd = peer_connect(NULL, 0);
+        if (server == NULL)
+                return 1;
+        seg_num = 0;
+        tcp_connect_close(server);
+        CHECK(seg_num == 1 && segs[0].flags.fin && segs[0].seq == snd, "No FIN sent on close.");
+        peer_send(tcp_flags_ack_fin, 1001, snd + 1, NULL, 0);
+        CHECK(seg_num == 2 && segs[1].flags.ack && segs[1].seq == snd + 1 && segs[1].ack == 1002, "Peer FIN not acknowledged.");
+        // 最后的ACK丢失，对端重传FIN
+        advance(1000);
+        peer_send(tcp_flags_ack_fin, 1001, snd + 1, NULL, 0);
+        CHECK(seg_num == 3 && !segs[2].flags.rst && segs[2].seq == snd + 1 && segs[2].ack == 1002,
+              "Retransmitted FIN not acknowledged from TIME_WAIT.");
+        peer_send(tcp_flags_ack_rst, 1002, 0, NULL, 0);
+        peer_send(tcp_flags_ack, 1002, snd + 1, NULL, 0);
+        CHECK(seg_num == 4 && !segs[3].flags.rst && segs[3].ack == 1002, "TIME_WAIT ended by a RST.");
+        // 2MSL从最后一次收到FIN时算起
+        advance(TCP_TIMEWAIT_MS - 1);
+        peer_send(tcp_flags_ack, 1002, snd + 1, NULL, 0);
+        CHECK(seg_num == 5 && !segs[4].flags.rst, "TIME_WAIT record reclaimed before 2MSL.");
+        advance(1);
+        peer_send(tcp_flags_ack, 1002, snd + 1, NULL, 0);
+        CHECK(seg_num == 6 && segs[5].flags.rst, "TIME_WAIT record not reclaimed after 2MSL.");
+
+        snd = peer_connect(NULL, 0);
+        if (server == NULL)
+                return fail + 1;
+        tcp_connect_close(server);
+        peer_send(tcp_flags_ack_fin, 1001, snd + 1, NULL, 0);
+        seg_num = 0;
+        peer_send(tcp_flags_syn, 900, 0, NULL, 0);
+        CHECK(seg_num == 1 && !segs[0].flags.syn && segs[0].ack == 1002, "Old SYN not answered with the last ACK.");
+        server = NULL;
+        peer_send(tcp_flags_syn, 100000, 0, NULL, 0);
+        CHECK(seg_num == 2 && segs[1].flags.syn && segs[1].flags.ack && segs[1].ack == 100001,
+              "New SYN did not reuse the TIME_WAIT 4-tuple.");
+        peer_send(tcp_flags_ack, 100001, segs[1].seq + 1, NULL, 0);
+        CHECK(server != NULL && server->state == TCP_ESTABLISHED, "Reused 4-tuple not established.");
+        peer_send(tcp_flags_ack_rst, 100001, 0, NULL, 0);
+        return fail;
+}
+
+/**
+ * @brief accept队列的回调，记录队列由空变为非空的次数
+ *
+ */
+void listen_ready(tcp_listen_t *listen, net_ctx_t *ctx)
+{
+        ready++;
+}
+
+/**
+ * @brief 监听端口：握手完成的连接进入accept队列，由空变为非空时通知一次；队列满时丢弃握手的ACK，
+ *        取走后对端重传的ACK建立连接；排队期间的数据取走后可读，排队期间被复位的连接不会被取走
+ *
+ * @return int 失败数
+ */
+int test_accept()
+{
+        int fail = 0;
+        tcp_listen_t *listen = tcp_listen(ACCEPT_PORT, 2, handler, listen_ready);
+        if (listen == NULL)
+                return 1;
+        stack_port = ACCEPT_PORT;
+        ready = connected = 0;
+        uint32_t snd[3];
+        for (int i = 0; i < 3; i++)
+                snd[i] = peer_connect(NULL, 0);
+        CHECK(connected == 0 && ready == 1 && listen->queue[ctx->id].len == 2,
+              "Accept queue holds %u connections with %d notifications, expected 2 with 1.", listen->queue[ctx->id].len, ready);
+        // 排队的第二个连接收到数据，第一个连接被复位
+        peer_port -= 1;
+        peer_send(tcp_flags_ack, 1001, snd[1], (const uint8_t *)"queued", 6);
+        peer_port -= 1;
+        peer_send(tcp_flags_ack_rst, 1001, 0, NULL, 0);
+        peer_port += 2;
+        CHECK(connected == 0 && listen->queue[ctx->id].len == 1, "Reset connection not removed from the accept queue.");
+        tcp_connect_t *connect = tcp_accept(ctx, listen);
+        uint8_t out[8];
+        CHECK(connect != NULL && connect->remote_port == peer_port - 1 && tcp_connect_read(connect, out, sizeof(out)) == 6 &&
+              memcmp(out, "queued", 6) == 0, "Data received while queued not readable after accept.");
+        CHECK(tcp_accept(ctx, listen) == NULL, "Accept returned a connection from an empty queue.");
+        // 第三个连接的ACK被丢弃，SYN+ACK重传后对端再次确认
+        advance(TCP_DELACK_MS);
+        seg_num = 0;
+        advance(TCP_RTO_INIT_MS - TCP_DELACK_MS);
+        CHECK(seg_num == 1 && segs[0].flags.syn && segs[0].flags.ack, "SYN+ACK not retransmitted while the queue was full.");
+        peer_send(tcp_flags_ack, 1001, snd[2], NULL, 0);
+        CHECK(ready == 2 && listen->queue[ctx->id].len == 1, "Connection not queued after the queue drained.");
+        tcp_connect_t *last = tcp_accept(ctx, listen);
+        CHECK(last != NULL && last->state == TCP_ESTABLISHED && last->remote_port == peer_port, "Wrong connection accepted.");
+        if (connect)
+                tcp_connect_close(connect);
+        if (last)
+                tcp_connect_close(last);
+        tcp_close(ACCEPT_PORT);
+        stack_port = SERVER_PORT;
+        seg_num = 0;
+        return fail;
+}
+
+/**
+ * @brief 句柄：监听句柄有连接时可读，连接收到数据可读、发送缓存腾出空间可写，对端关闭后读到0，复位后报告HUP
+ *
+ * @return int 失败数
+ */
+int test_sock()
+{
+        int fail = 0;
+        sock_poll_t poll;
+        sock_event_t ev[4];
+        uint8_t data[16384], out[16];
+        memset(data, 's', sizeof(data));
+        sock_poll_init(&poll);
+        sock_t *listen = sock_listen(ctx, ACCEPT_PORT, 4);
+        if (listen == NULL)
+                return 1;
+        sock_watch(&poll, listen, SOCK_EV_IN, listen);
+        CHECK(sock_wait(&poll, ev, 4, 0) == 0 && sock_accept(listen) == NULL, "Idle listen socket reported ready.");
+        stack_port = ACCEPT_PORT;
+        uint32_t snd = peer_connect(NULL, 0);
+        CHECK(sock_wait(&poll, ev, 4, 0) == 1 && ev[0].sock == listen && ev[0].events == SOCK_EV_IN && ev[0].data == listen,
+              "Listen socket not readable after the handshake.");
+        sock_t *conn = sock_accept(listen);
+        if (conn == NULL)
+                return fail + 1;
+        CHECK(sock_accept(listen) == NULL, "Accepted twice.");
+        sock_watch(&poll, conn, SOCK_EV_IN | SOCK_EV_OUT, conn);
+        CHECK(sock_wait(&poll, ev, 4, 0) == 1 && ev[0].sock == conn && ev[0].events == SOCK_EV_OUT,
+              "Accepted socket not only writable.");
+        CHECK(sock_read(conn, out, sizeof(out)) == SOCK_AGAIN, "Read without data did not return SOCK_AGAIN.");
+
+        // 收到数据后可读，水平触发：没有读走时再次等待仍然报告
+        peer_send(tcp_flags_ack, 1001, snd, (const uint8_t *)"ping", 4);
+        CHECK(sock_wait(&poll, ev, 4, 0) == 1 && ev[0].events == (SOCK_EV_IN | SOCK_EV_OUT), "Socket not readable.");
+        CHECK(sock_wait(&poll, ev, 4, 0) == 1 && ev[0].events == (SOCK_EV_IN | SOCK_EV_OUT), "Unread data not reported again.");
+        CHECK(sock_read(conn, out, sizeof(out)) == 4 && memcmp(out, "ping", 4) == 0, "Data not read.");
+
+        // 写满发送缓存后不再可写，对端确认后重新加入就绪链表
+        seg_num = 0;
+        int n, total = 0;
+        while ((n = sock_write(conn, data, sizeof(data))) > 0)
+                total += n;
+        CHECK(n == SOCK_AGAIN && total > 0 && !(sock_events(conn) & SOCK_EV_OUT), "Full send buffer not reported as SOCK_AGAIN.");
+        CHECK(sock_wait(&poll, ev, 4, 0) == 0 && poll.num == 0, "Socket with a full send buffer still ready.");
+        uint32_t acked = snd;
+        for (int i = 0; i < seg_num; i++)
+                if (tcp_seq_lt(acked, segs[i].seq + segs[i].len))
+                        acked = segs[i].seq + segs[i].len;
+        peer_send(tcp_flags_ack, 1005, acked, NULL, 0);
+        CHECK(sock_wait(&poll, ev, 4, 0) == 1 && ev[0].events == SOCK_EV_OUT, "Socket not writable after an acknowledgment.");
+
+        // 对端关闭后可读，数据读完之前复位也不丢数据
+        peer_send(tcp_flags_ack_fin, 1005, acked, (const uint8_t *)"bye", 3);
+        CHECK(sock_wait(&poll, ev, 4, 0) == 1 && (ev[0].events & SOCK_EV_IN), "Socket not readable after the peer's FIN.");
+        CHECK(sock_write(conn, data, 1) == SOCK_ERROR, "Write accepted after the peer closed.");
+        peer_send(tcp_flags_ack_rst, 1009, 0, NULL, 0);
+        CHECK(sock_wait(&poll, ev, 4, 0) == 1 && ev[0].events == (SOCK_EV_IN | SOCK_EV_HUP), "Reset not reported as SOCK_EV_HUP.");
+        CHECK(sock_read(conn, out, sizeof(out)) == 3 && memcmp(out, "bye", 3) == 0 && sock_read(conn, out, sizeof(out)) == 0,
+              "Data received before the reset lost.");
+        sock_close(conn);
+        CHECK(poll.num == 0, "Closed socket left in the ready list.");
+
+        // 主动打开：握手完成前写入返回SOCK_AGAIN，完成后可写
+        seg_num = 0;
+        conn = sock_connect(ctx, peer_ip, 8080);
+        CHECK(conn != NULL && seg_num == 1 && segs[0].flags.syn, "No SYN sent for a connecting socket.");
+        if (conn) {
+                sock_watch(&poll, conn, SOCK_EV_OUT, NULL);
+                CHECK(sock_wait(&poll, ev, 4, 0) == 0 && sock_write(conn, data, 1) == SOCK_AGAIN, "Connecting socket writable.");
+                uint16_t port = peer_port;
+                peer_port = 8080;
+                stack_port = segs[0].src_port;
+                peer_send(tcp_flags_ack_syn, 5000, segs[0].seq + 1, NULL, 0);
+                CHECK(sock_wait(&poll, ev, 4, 0) == 1 && ev[0].events == SOCK_EV_OUT && sock_write(conn, data, 2) == 2,
+                      "Connected socket not writable.");
+                sock_close(conn);
+                peer_send(tcp_flags_ack_rst, 5001, 0, NULL, 0);
+                peer_port = port;
+                stack_port = ACCEPT_PORT;
+        }
+
+        // 对端先关闭后应用关闭：没被确认的数据与FIN仍然超时重传，FIN被确认后才释放连接
+        snd = peer_connect(NULL, 0);
+        conn = sock_accept(listen);
+        if (conn == NULL)
+                return fail + 1;
+        CHECK(sock_write(conn, data, 100) == 100, "Write before the peer's FIN failed.");
+        peer_send(tcp_flags_ack_fin, 1001, snd, (const uint8_t *)"bye", 3);
+        uint32_t rto = conn->connect->rto;
+        sock_close(conn);
+        seg_num = 0;
+        advance(rto);
+        int tail = 0, fin = 0;
+        for (int i = 0; i < seg_num; i++) {
+                tail |= segs[i].seq == snd && segs[i].len == 100;
+                fin |= segs[i].flags.fin && segs[i].seq + segs[i].len == snd + 100;
+        }
+        CHECK(tail && fin, "Unacknowledged tail or FIN not retransmitted after closing in LAST_ACK.");
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1005, snd + 101, NULL, 0);
+        CHECK(seg_num == 0, "Final ACK after closing in LAST_ACK answered.");
+
+        // 关闭监听句柄时复位还在accept队列中的连接
+        peer_connect(NULL, 0);
+        seg_num = 0;
+        sock_close(listen);
+        CHECK(seg_num == 1 && segs[0].flags.rst, "Queued connection not reset when the listen socket closed.");
+        listen = sock_listen(ctx, ACCEPT_PORT, 4);
+        CHECK(listen != NULL, "Port not released by closing the listen socket.");
+        if (listen)
+                sock_close(listen);
+        stack_port = SERVER_PORT;
+        seg_num = 0;
+        return fail;
+}
+
+char coro_log[64];  //协程运行的先后
+int coro_log_len;
+coro_sched_t sched;
+sock_t *coro_listen; //回显服务器的监听句柄
+
+/**
+ * @brief 运行两次，每次记下参数后让出
+ *
+ */
+void coro_step(coro_t *co, void *arg)
+{
+        for (int i = 0; i < 2; i++) {
+                coro_log[coro_log_len++] = *(char *)arg;
+                coro_yield(co);
+        }
+}
+
+/**
+ * @brief 读取一行后原样写回并关闭
+ *
+ */
+void coro_echo(coro_t *co, void *arg)
+{
+        sock_t *sock = arg;
+        uint8_t line[64];
+        int len = 0, n;
+        while (len < sizeof(line) && (n = coro_read(co, sock, line + len, 1)) > 0)
+                if (line[len++] == '\n')
+                        break;
+        coro_write(co, sock, line, len);
+        sock_close(sock);
+}
+
+/**
+ * @brief 接受连接，每个连接交给一个回显协程
+ *
+ */
+void coro_server(coro_t *co, void *arg)
+{
+        sock_t *sock;
+        while ((sock = coro_accept(co, coro_listen)) != NULL)
+                coro_spawn(&sched, coro_echo, sock);
+}
+
+/**
+ * @brief 查找协程写回的数据
+ *
+ */
+int echoed(const char *data)
+{
+        for (int i = 0; i < seg_num; i++)
+                if (segs[i].len == strlen(data) && memcmp(segs[i].data, data, segs[i].len) == 0)
+                        return 1;
+        return 0;
+}
+
+/**
+ * @brief 协程：轮流运行，等待句柄时让出，慢连接不阻塞其他连接，结束的协程的栈被复用
+ *
+ * @return int 失败数
+ */
+int test_coro()
+{
+        int fail = 0;
+        coro_sched_init(&sched);
+        coro_spawn(&sched, coro_step, "a");
+        coro_spawn(&sched, coro_step, "b");
+        while (coro_sched_run(&sched))
+                ;
+        coro_log[coro_log_len] = '\0';
+        CHECK(strcmp(coro_log, "abab") == 0, "Coroutines ran in order %s, expected abab.", coro_log);
+        CHECK(sched.free_num == 2, "Finished coroutines not pooled.");
+
+        coro_listen = sock_listen(ctx, ACCEPT_PORT, 4);
+        if (coro_listen == NULL)
+                return fail + 1;
+        coro_spawn(&sched, coro_server, NULL);
+        CHECK(sched.free_num == 1, "Pooled coroutine not reused.");
+        coro_sched_run(&sched);
+        stack_port = ACCEPT_PORT;
+        // 第一个连接只发半行，第二个连接发完整的一行
+        uint32_t slow = peer_connect(NULL, 0);
+        coro_sched_run(&sched);
+        peer_send(tcp_flags_ack, 1001, slow, (const uint8_t *)"slow", 4);
+        coro_sched_run(&sched);
+        uint32_t fast = peer_connect(NULL, 0);
+        coro_sched_run(&sched);
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, fast, (const uint8_t *)"fast\n", 5);
+        coro_sched_run(&sched);
+        CHECK(echoed("fast\n") && sched.live == 2, "Second connection blocked behind the first.");
+        peer_send(tcp_flags_ack_rst, 1006, 0, NULL, 0);
+        peer_port--;
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1005, slow, (const uint8_t *)"\n", 1);
+        coro_sched_run(&sched);
+        CHECK(echoed("slow\n") && sched.live == 1, "First connection not served after its line completed.");
+        peer_send(tcp_flags_ack_rst, 1006, 0, NULL, 0);
+        peer_port++;
+
+        sock_close(coro_listen);
+        stack_port = SERVER_PORT;
+        seg_num = 0;
+        return fail;
+}
+
+/**
+ * @brief 选项：SYN+ACK回应对端提出的选项，SMSS取双方的较小值，窗口按扩大因子换算，用时间戳测量往返时间
+ *
+ * @return int 失败数
+ */
+int test_options()
+{
+        int fail = 0;
+        uint8_t syn_opt[] = {TCP_OPT_MSS, 4, 1000 >> 8, 1000 & 0xff, TCP_OPT_SACK_PERM, 2, TCP_OPT_TIMESTAMP, 10,
+                             0, 0, 0x30, 0x39, 0, 0, 0, 0, TCP_OPT_NOP, TCP_OPT_WSCALE, 3, 3};
+        uint32_t snd = peer_connect(syn_opt, sizeof(syn_opt));
+        if (server == NULL)
+                return 1;
+        seg_t *syn_ack = &segs[0];
+        CHECK(syn_ack->opts.mss == TCP_MAX_MSS && syn_ack->opts.sack_ok && syn_ack->opts.ts_ok && syn_ack->opts.tsecr == 12345 &&
+              syn_ack->opts.wscale == server->rcv_wscale, "SYN+ACK options do not answer the peer's SYN.");
+        CHECK(server->rcv_wscale > 0 && (TCP_BUF_MAX_SIZE >> server->rcv_wscale) <= UINT16_MAX, "Window scale %u too small.",
+              server->rcv_wscale);
+        CHECK(server->mss == 1000 - TCP_OPT_TS_LEN, "SMSS %u, expected %d.", server->mss, 1000 - TCP_OPT_TS_LEN);
+
+        // 对端的窗口左移3位
+        uint8_t ts_opt[] = {TCP_OPT_NOP, TCP_OPT_NOP, TCP_OPT_TIMESTAMP, 10, 0, 0, 0x30, 0x3a, 0, 0, 0, 0};
+        uint32_t tsval = (uint32_t)ctx->now;
+        memcpy(ts_opt + 8, &(uint32_t){swap32(tsval)}, 4);
+        peer_win = 100;
+        peer_send_opts(tcp_flags_ack, 1001, snd, ts_opt, sizeof(ts_opt), NULL, 0);
+        peer_win = 65535;
+        CHECK(server->remote_win == 800, "Peer window %u not scaled to 800.", server->remote_win);
+
+        // 数据报文段带时间戳，确认回显该时间戳时取样，不依赖单个报文段的计时
+        uint8_t data[2000], out[2000];
+        memset(data, 'x', sizeof(data));
+        seg_num = 0;
+        peer_send_opts(tcp_flags_ack, 1001, snd, ts_opt, sizeof(ts_opt), NULL, 0);
+        tcp_connect_write(server, data, sizeof(data));
+        CHECK(seg_num >= 1 && segs[0].len == server->mss && segs[0].opts.ts_ok && segs[0].opts.tsecr == 12346,
+              "Data segment length %u or timestamp echo %u wrong.", segs[0].len, segs[0].opts.tsecr);
+        // 回显一个早10ms的时间戳，样本应为40而不是按报文段计时的30
+        uint32_t srtt = server->srtt ? (7 * server->srtt + 40) / 8 : 40;
+        advance(30);
+        memcpy(ts_opt + 8, &(uint32_t){swap32(segs[0].opts.tsval - 10)}, 4);
+        peer_send_opts(tcp_flags_ack, 1001, snd + server->mss, ts_opt, sizeof(ts_opt), NULL, 0);
+        CHECK(server->srtt == srtt, "SRTT %u not sampled from the timestamp echo, expected %u.", server->srtt, srtt);
+
+        // 通告的窗口是剩余的接收缓存空间
+        peer_send_opts(tcp_flags_ack, 1001, snd + server->mss, ts_opt, sizeof(ts_opt), data, 1000);
+        advance(TCP_DELACK_MS);
+        uint32_t win = (uint32_t)segs[seg_num - 1].win << server->rcv_wscale;
+        CHECK(win <= TCP_BUF_MAX_SIZE - 1000 && win > TCP_BUF_MAX_SIZE - 1000 - (1u << server->rcv_wscale),
+              "Advertised window %u does not reflect free receive space.", win);
+        tcp_connect_read(server, out, sizeof(out));
+        peer_send(tcp_flags_ack_rst, 2001, 0, NULL, 0);
+        return fail;
+}
+
+/**
+ * @brief 延迟确认：每两个报文段确认一次，单个报文段等定时器到期再确认，有数据要发时捎带确认
+ *
+ * @return int 失败数
+ */
+int test_delack()
+{
+        int fail = 0;
+        uint8_t data[100];
+        memset(data, 'k', sizeof(data));
+        uint32_t snd = peer_connect(NULL, 0);
+        if (server == NULL)
+                return 1;
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, snd, data, sizeof(data));
+        CHECK(seg_num == 0, "First segment acknowledged immediately.");
+        peer_send(tcp_flags_ack, 1101, snd, data, sizeof(data));
+        CHECK(seg_num == 1 && segs[0].ack == 1201, "Second segment not acknowledged immediately.");
+
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1201, snd, data, sizeof(data));
+        advance(TCP_DELACK_MS - 1);
+        CHECK(seg_num == 0, "Delayed ACK sent too early.");
+        advance(1);
+        CHECK(seg_num == 1 && segs[0].ack == 1301 && segs[0].len == 0, "Delayed ACK not sent when the timer expired.");
+
+        // 应用的回复捎带确认，定时器到期后不再单独确认
+        uint8_t out[400];
+        tcp_connect_read(server, out, sizeof(out));
+        echo = 1;
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1301, snd, data, sizeof(data));
+        echo = 0;
+        advance(TCP_DELACK_MS);
+        CHECK(seg_num == 1 && segs[0].ack == 1401 && segs[0].len == sizeof(data), "ACK not piggybacked on the reply.");
+        peer_send(tcp_flags_ack_rst, 1401, 0, NULL, 0);
+        return fail;
+}
+
+/**
+ * @brief Nagle算法与cork：有数据在途时小块写入攒到确认到达再发，关闭Nagle时立即发送，塞住时只发满长度的报文段
+ *
+ * @return int 失败数
+ */
+int test_nagle()
+{
+        int fail = 0;
+        uint8_t data[3000];
+        memset(data, 'n', sizeof(data));
+        uint32_t snd = peer_connect(NULL, 0);
+        if (server == NULL)
+                return 1;
+        uint32_t mss = server->mss;
+
+        // 没有数据在途时第一个小块立即发出，其后的小块合并
+        seg_num = 0;
+        for (int i = 0; i < 10; i++)
+                tcp_connect_write(server, data, 10);
+        CHECK(seg_num == 1 && segs[0].len == 10, "%d segments before the first ACK, expected one of 10 bytes.", seg_num);
+        peer_send(tcp_flags_ack, 1001, snd + 10, NULL, 0);
+        CHECK(seg_num == 2 && segs[1].len == 90, "Small writes not coalesced after the ACK.");
+        snd += 100;
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+
+        // 关闭Nagle后小块立即发出
+        tcp_connect_set_nodelay(server, 1);
+        seg_num = 0;
+        for (int i = 0; i < 3; i++)
+                tcp_connect_write(server, data, 10);
+        CHECK(seg_num == 3, "%d segments with nodelay, expected 3.", seg_num);
+        snd += 30;
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+        tcp_connect_set_nodelay(server, 0);
+
+        // 塞住时即使没有数据在途也只发满长度的报文段，解除后发出剩余部分
+        tcp_connect_set_cork(server, 1);
+        seg_num = 0;
+        tcp_connect_write(server, data, 100);
+        CHECK(seg_num == 0, "Corked write sent a partial segment.");
+        tcp_connect_write(server, data, sizeof(data) - 100);
+        CHECK(seg_num == (int)(sizeof(data) / mss) && segs[0].len == mss, "Corked writes not sent as full segments.");
+        tcp_connect_set_cork(server, 0);
+        CHECK(seg_num == (int)(sizeof(data) / mss) + 1 && segs[seg_num - 1].len == sizeof(data) % mss,
+              "Remaining data not sent on uncork.");
+        snd += sizeof(data);
+        peer_send(tcp_flags_ack_rst, 1001, snd, NULL, 0);
+        return fail;
+}
+
+/**
+ * @brief 分段：一次写入的大块数据按SMSS切成多个报文段，带SACK块时负载相应减小，报文段都不需要ip分片
+ *
+ * @return int 失败数
+ */
+int test_segment()
+{
+        int fail = 0;
+        uint8_t syn_opt[] = {TCP_OPT_MSS, 4, 1460 >> 8, 1460 & 0xff, TCP_OPT_SACK_PERM, 2, TCP_OPT_TIMESTAMP, 10,
+                             0, 0, 0, 1, 0, 0, 0, 0};
+        uint8_t ts_opt[] = {TCP_OPT_NOP, TCP_OPT_NOP, TCP_OPT_TIMESTAMP, 10, 0, 0, 0, 2, 0, 0, 0, 0};
+        uint8_t data[4 * 1460];
+        memset(data, 'm', sizeof(data));
+        oversize = 0;
+        uint32_t snd = peer_connect(syn_opt, sizeof(syn_opt));
+        if (server == NULL)
+                return 1;
+        uint32_t mss = server->mss;
+        tcp_connect_set_nodelay(server, 1); // 尾部的小报文段也立即发出
+
+        // 乱序队列不空时每个数据报文段都带一个SACK块，负载减少12字节
+        peer_send_opts(tcp_flags_ack, 1101, snd, ts_opt, sizeof(ts_opt), data, 100);
+        seg_num = 0;
+        peer_send_opts(tcp_flags_ack, 1001, snd, ts_opt, sizeof(ts_opt), NULL, 0);
+        tcp_connect_write(server, data, sizeof(data));
+        uint32_t total = 0;
+        for (int i = 0; i < seg_num; i++) {
+                CHECK(segs[i].len <= mss - 12 && segs[i].opts.sack_num == 1, "Segment %d has %u bytes and %u SACK blocks.", i,
+                      segs[i].len, segs[i].opts.sack_num);
+                total += segs[i].len;
+        }
+        CHECK(total == sizeof(data) && seg_num == (sizeof(data) + mss - 13) / (mss - 12), "%u bytes in %d segments.", total,
+              seg_num);
+
+        // 空洞补齐后恢复完整的SMSS
+        peer_send_opts(tcp_flags_ack, 1001, snd + sizeof(data), ts_opt, sizeof(ts_opt), data, 100);
+        seg_num = 0;
+        peer_send_opts(tcp_flags_ack, 1201, snd + sizeof(data), ts_opt, sizeof(ts_opt), NULL, 0);
+        tcp_connect_write(server, data, sizeof(data));
+        CHECK(seg_num == (sizeof(data) + mss - 1) / mss && segs[0].len == mss && segs[0].opts.sack_num == 0,
+              "%d segments of %u bytes after the gap was filled.", seg_num, segs[0].len);
+        CHECK(oversize == 0, "%d segments need ip fragmentation.", oversize);
+        peer_send(tcp_flags_ack_rst, 1201, 0, NULL, 0);
+        return fail;
+}
+
+/**
+ * @brief 乱序：后面的报文段先到时回复重复ACK并缓存，空洞补齐后按序交给应用，乱序的FIN在数据补齐后生效
+ *
+ * @return int 失败数
+ */
+int test_reorder()
+{
+        int fail = 0;
+        uint8_t a[100], b[100], c[100], out[400];
+        memset(a, 'a', sizeof(a));
+        memset(b, 'b', sizeof(b));
+        memset(c, 'c', sizeof(c));
+        uint32_t snd = peer_connect(NULL, 0);
+        if (server == NULL)
+                return 1;
+
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1201, snd, c, sizeof(c));
+        CHECK(seg_num == 1 && !segs[0].flags.rst && segs[0].ack == 1001, "Out-of-order segment not answered with a duplicate ACK.");
+        peer_send(tcp_flags_ack, 1101, snd, b, sizeof(b));
+        CHECK(seg_num == 2 && segs[1].ack == 1001, "Second out-of-order segment not answered with a duplicate ACK.");
+        CHECK(server->ooo_num == 1 && server->ooo[0].start == 1101 && server->ooo[0].end == 1301,
+              "Adjacent out-of-order segments not merged.");
+        CHECK(tcp_connect_read(server, out, sizeof(out)) == 0, "Out-of-order data delivered before the gap was filled.");
+        peer_send(tcp_flags_ack, 1001, snd, a, sizeof(a));
+        CHECK(segs[seg_num - 1].ack == 1301, "Filling the gap acknowledged %u, expected 1301.", segs[seg_num - 1].ack);
+        CHECK(tcp_connect_read(server, out, sizeof(out)) == 300 && memcmp(out, a, 100) == 0 && memcmp(out + 100, b, 100) == 0 &&
+              memcmp(out + 200, c, 100) == 0, "Reassembled data out of order.");
+        CHECK(server->ooo_num == 0, "Out-of-order queue not drained.");
+
+        // 开头一部分已收到的报文段只接收新的部分
+        uint8_t overlap[100];
+        memset(overlap, 'c', 50);
+        memset(overlap + 50, 'd', 50);
+        peer_send(tcp_flags_ack, 1251, snd, overlap, sizeof(overlap));
+        advance(TCP_DELACK_MS);
+        CHECK(segs[seg_num - 1].ack == 1351, "Partially duplicate segment acknowledged %u, expected 1351.", segs[seg_num - 1].ack);
+        CHECK(tcp_connect_read(server, out, sizeof(out)) == 50 && memcmp(out, overlap + 50, 50) == 0, "Overlap not trimmed.");
+
+        // FIN先于最后一段数据到达
+        seg_num = 0;
+        peer_send(tcp_flags_ack_fin, 1451, snd, NULL, 0);
+        CHECK(seg_num == 1 && segs[0].ack == 1351 && !segs[0].flags.fin, "Out-of-order FIN processed early.");
+        peer_send(tcp_flags_ack, 1351, snd, a, sizeof(a));
+        CHECK(segs[seg_num - 1].flags.fin && segs[seg_num - 1].ack == 1452, "Queued FIN not processed after the gap was filled.");
+        int closed_before = closed;
+        peer_send(tcp_flags_ack, 1452, snd + 1, NULL, 0);
+        CHECK(closed == closed_before + 1, "Connection not closed after FIN exchange.");
+        return fail;
+}
+
+/**
+ * @brief 生成SACK选项，第一个块包含刚收到的报文段，其余按序号升序
+ *
+ * @param opt 输出缓冲区
+ * @param blocks 乱序区间
+ * @param num 区间数
+ * @param recent 刚收到的报文段的序号
+ * @return size_t 选项长度，没有乱序区间时为0
+ */
+size_t make_sack(uint8_t *opt, const tcp_range_t *blocks, int num, uint32_t recent)
+{
+        if (num == 0)
+                return 0;
+        int first = 0, n = 0;
+        for (int i = 0; i < num; i++)
+                if (tcp_seq_leq(blocks[i].start, recent) && tcp_seq_lt(recent, blocks[i].end))
+                        first = i;
+        opt[0] = TCP_OPT_NOP;
+        opt[1] = TCP_OPT_NOP;
+        opt[2] = TCP_OPT_SACK;
+        for (int i = -1; i < num && n < TCP_SACK_BLOCKS; i++) {
+                if (i == first)
+                        continue;
+                const tcp_range_t *block = &blocks[i < 0 ? first : i];
+                uint32_t edge[2] = {swap32(block->start), swap32(block->end)};
+                memcpy(opt + 4 + 8 * n++, edge, 8);
+        }
+        opt[3] = 2 + 8 * n;
+        return 4 + 8 * n;
+}
+
+/**
+ * @brief SACK：接收方按乱序队列生成SACK块，发送方按记分板只重传空洞
+ *
+ * @return int 失败数
+ */
+int test_sack()
+{
+        int fail = 0;
+        static const uint8_t syn_opt[] = {TCP_OPT_NOP, TCP_OPT_NOP, TCP_OPT_SACK_PERM, 2};
+        uint8_t data[10 * TCP_DEFAULT_MSS], opt[4 + 8 * TCP_SACK_BLOCKS];
+        memset(data, 's', sizeof(data));
+
+        // 接收方：第一个块是最近收到的乱序报文段所在的区间
+        uint32_t snd = peer_connect(syn_opt, sizeof(syn_opt));
+        if (server == NULL)
+                return 1;
+        CHECK(server->sack_ok, "SACK not negotiated.");
+        peer_send(tcp_flags_ack, 1201, snd, data, 100);
+        peer_send(tcp_flags_ack, 1401, snd, data, 100);
+        tcp_opts_t *opts = &segs[seg_num - 1].opts;
+        CHECK(opts->sack_num == 2 && opts->sack[0].start == 1401 && opts->sack[0].end == 1501 && opts->sack[1].start == 1201 &&
+              opts->sack[1].end == 1301, "SACK blocks wrong or misordered.");
+        peer_send(tcp_flags_ack, 1001, snd, data, 200);
+        opts = &segs[seg_num - 1].opts;
+        CHECK(segs[seg_num - 1].ack == 1301 && opts->sack_num == 1 && opts->sack[0].start == 1401,
+              "SACK blocks not trimmed after the first gap was filled.");
+        peer_send(tcp_flags_ack_rst, 1301, 0, NULL, 0);
+
+        // 发送方：10个报文段中第2、4个丢失，只重传这两个
+        snd = peer_connect(syn_opt, sizeof(syn_opt));
+        if (server == NULL)
+                return fail + 1;
+        tcp_connect_set_cc(server, "newreno");
+        uint32_t mss = server->mss;
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+        tcp_connect_write(server, data, sizeof(data));
+        CHECK(seg_num == 10, "%d segments sent, expected an initial window of 10.", seg_num);
+        uint32_t una = snd + mss;
+        tcp_range_t got[2] = {{snd + 2 * mss, snd + 3 * mss}, {snd + 4 * mss, snd + 6 * mss}};
+        seg_num = 0;
+        // 第一个ACK推进unack_seq，其后3个是重复ACK
+        for (int i = 0; i < 4; i++)
+                peer_send_opts(tcp_flags_ack, 1001, una, opt, make_sack(opt, got, 2, snd + 5 * mss), NULL, 0);
+        CHECK(server->in_recovery && server->sacked_num == 2, "Recovery not entered with the scoreboard filled.");
+        CHECK(seg_num == 1 && segs[0].seq == snd + mss && segs[0].len == mss, "First hole not retransmitted.");
+        got[1].end = snd + 9 * mss;
+        seg_num = 0;
+        peer_send_opts(tcp_flags_ack, 1001, una, opt, make_sack(opt, got, 2, snd + 8 * mss), NULL, 0);
+        CHECK(seg_num >= 1 && segs[0].seq == snd + 3 * mss, "Second hole not retransmitted.");
+        for (int i = 0; i < seg_num; i++)
+                CHECK(segs[i].seq != snd + 2 * mss && segs[i].seq != snd + 5 * mss, "SACKed segment at %u retransmitted.", segs[i].seq);
+        peer_send(tcp_flags_ack, 1001, snd + sizeof(data), NULL, 0);
+        CHECK(!server->in_recovery && server->sacked_num == 0, "Recovery not left after a full ACK.");
+        peer_send(tcp_flags_ack_rst, 1001, 0, NULL, 0);
+
+        // 发送方：40个报文段中奇数号的丢失，空洞比记分板能记录的区间多，高处的SACK仍推动重传，不必等超时
+        snd = peer_connect(syn_opt, sizeof(syn_opt));
+        if (server == NULL)
+                return fail + 1;
+        tcp_connect_set_cc(server, "newreno");
+        peer_send(tcp_flags_ack, 1001, snd, NULL, 0);
+        server->cwnd = 40 * mss;
+        seg_num = 0;
+        for (int i = 0; i < 4; i++)
+                tcp_connect_write(server, data, sizeof(data));
+        CHECK(seg_num == 40, "%d segments sent, expected 40.", seg_num);
+        tcp_range_t sacked[20];
+        int sacked_num = 0;
+        seg_num = 0;
+        peer_send(tcp_flags_ack, 1001, snd + mss, NULL, 0);
+        for (int i = 2; i < 40; i++) {
+                if (i % 2 == 0)
+                        sacked[sacked_num++] = (tcp_range_t){snd + i * mss, snd + (i + 1) * mss};
+                else if (i == 39)
+                        sacked[sacked_num - 1].end = snd + 40 * mss;
+                else
+                        continue;
+                peer_send_opts(tcp_flags_ack, 1001, snd + mss, opt, make_sack(opt, sacked, sacked_num, snd + i * mss), NULL, 0);
+        }
+        CHECK(sacked_num > TCP_SACK_MAX, "Only %d holes, the scoreboard does not overflow.", sacked_num);
+        for (int i = 1; i < 39; i += 2) {
+                int found = 0;
+                for (int j = 0; j < seg_num; j++)
+                        found |= segs[j].seq == snd + i * mss && segs[j].len == mss;
+                CHECK(found, "Hole %d not retransmitted before the RTO.", i);
+        }
+
+        // 上次恢复的数据恰好全部确认后，新的丢失重新进入快速恢复
+        peer_send(tcp_flags_ack, 1001, snd + 40 * mss, NULL, 0);
+        CHECK(!server->in_recovery && server->recover == snd + 40 * mss, "Recovery not left at the recovery point.");
+        server->cwnd = 5 * mss;
+        seg_num = 0;
+        tcp_connect_write(server, data, 5 * mss);
+        CHECK(seg_num == 5, "%d new segments sent, expected 5.", seg_num);
+        seg_num = 0;
+        tcp_range_t tail = {snd + 41 * mss, snd + 41 * mss};
+        for (int i = 41; i < 45; i++) {
+                tail.end += mss;
+                peer_send_opts(tcp_flags_ack, 1001, snd + 40 * mss, opt, make_sack(opt, &tail, 1, snd + i * mss), NULL, 0);
+        }
+        CHECK(server->in_recovery && seg_num >= 1 && segs[0].seq == snd + 40 * mss,
+              "Loss right after the recovery point not fast retransmitted.");
+        peer_send(tcp_flags_ack_rst, 1001, 0, NULL, 0);
+        return fail;
+}
+
+/**
+ * @brief 对端收到一个报文段：按字节记录收到的数据，每个报文段回复一个累计确认，乱序时即为重复ACK，
+ *        允许SACK时带上乱序区间
+ *
+ * @param pkt 报文段
+ * @param base 协议栈第一个数据字节的序号
+ * @param rcv_nxt 对端期望的下一个序号
+ * @param fin 出口参数，是否已收到FIN
+ */
+void peer_recv(link_pkt_t *pkt, uint32_t base, uint32_t *rcv_nxt, int *fin)
+{
+        uint32_t off = pkt->seq - base;
+        for (uint32_t i = 0; i < pkt->len && off + i < GOODPUT_BYTES; i++) {
+                peer_data[off + i] = pkt->data[i];
+                peer_got[off + i] = 1;
+        }
+        while (*rcv_nxt - base < GOODPUT_BYTES && peer_got[*rcv_nxt - base])
+                (*rcv_nxt)++;
+        if (pkt->flags.fin && pkt->seq + pkt->len == *rcv_nxt && !*fin) {
+                *fin = 1;
+                (*rcv_nxt)++;
+        }
+        // 维护乱序区间：并入新区间，去掉已连续的部分
+        uint32_t start = pkt->seq, end = pkt->seq + pkt->len;
+        if (tcp_seq_lt(*rcv_nxt, end) && pkt->len) {
+                int i = 0, j;
+                while (i < peer_ooo_num && tcp_seq_lt(peer_ooo[i].end, start))
+                        i++;
+                for (j = i; j < peer_ooo_num && tcp_seq_leq(peer_ooo[j].start, end); j++) {
+                        if (tcp_seq_lt(peer_ooo[j].start, start))
+                                start = peer_ooo[j].start;
+                        if (tcp_seq_lt(end, peer_ooo[j].end))
+                                end = peer_ooo[j].end;
+                }
+                memmove(&peer_ooo[i + 1], &peer_ooo[j], (peer_ooo_num - j) * sizeof(tcp_range_t));
+                peer_ooo[i].start = start;
+                peer_ooo[i].end = end;
+                peer_ooo_num += 1 - (j - i);
+        }
+        while (peer_ooo_num && tcp_seq_leq(peer_ooo[0].end, *rcv_nxt))
+                memmove(&peer_ooo[0], &peer_ooo[1], --peer_ooo_num * sizeof(tcp_range_t));
+        size_t slot = ack_tail++ % LINK_FIFO_SIZE;
+        ack_fifo[slot].arrive_us = pkt->arrive_us + LINK_DELAY_US;
+        ack_fifo[slot].ack = *rcv_nxt;
+        ack_fifo[slot].opt_len = peer_sack ? make_sack(ack_fifo[slot].opt, peer_ooo, peer_ooo_num, pkt->seq) : 0;
+}
+
+/**
+ * @brief 经过有丢包的瓶颈链路传输GOODPUT_BYTES字节，检查数据完整并返回有效吞吐量
+ *
+ * @param cc 拥塞控制算法名
+ * @param loss_permille 随机丢包率，千分比
+ * @param sack 对端是否允许SACK
+ * @param seed 随机丢包的种子，种子相同时丢包序列相同
+ * @param goodput 出口参数，有效吞吐量，字节/毫秒
+ * @return int 失败数
+ */
+int run_goodput(const char *cc, uint32_t loss_permille, int sack, uint32_t seed, uint32_t *goodput)
+{
+        int fail = 0;
+        // 通告以太网MSS与窗口扩大因子2，对端窗口为65535<<2
+        uint8_t syn_opt[] = {TCP_OPT_MSS, 4, 1460 >> 8, 1460 & 0xff, TCP_OPT_NOP, TCP_OPT_WSCALE, 3, 2,
+                             TCP_OPT_NOP, TCP_OPT_NOP, TCP_OPT_SACK_PERM, 2};
+        peer_sack = sack;
+        peer_ooo_num = 0;
+        uint32_t base = peer_connect(syn_opt, sack ? sizeof(syn_opt) : 8), rcv_nxt = base;
+        if (server == NULL || tcp_connect_set_cc(server, cc) != 0)
+                return 1;
+
+        memset(peer_data, 0, sizeof(peer_data));
+        memset(peer_got, 0, sizeof(peer_got));
+        link_on = 1;
+        link_loss_permille = loss_permille;
+        link_rand = seed;
+        link_head = link_tail = ack_head = ack_tail = 0;
+        link_now_us = link_busy_us = ctx->now * 1000;
+        link_drops = 0;
+        uint64_t start = ctx->now;
+        size_t written = 0;
+        int fin = 0, closing = 0;
+        while (!fin && ctx->now - start < GOODPUT_TIMEOUT_MS) {
+                // 应用一直写到发送缓存满为止，写完后关闭连接
+                while (written < GOODPUT_BYTES) {
+                        size_t n = tcp_connect_write(server, app_data + written, GOODPUT_BYTES - written);
+                        if (n == 0)
+                                break;
+                        written += n;
+                }
+                if (written == GOODPUT_BYTES && !closing) {
+                        closing = 1;
+                        tcp_connect_close(server);
+                }
+                uint64_t end_us = (ctx->now + 1) * 1000;
+                for (;;) {
+                        int data_first = link_head != link_tail &&
+                                         (ack_head == ack_tail || link_fifo[link_head % LINK_FIFO_SIZE].arrive_us <= ack_fifo[ack_head % LINK_FIFO_SIZE].arrive_us);
+                        if (data_first && link_fifo[link_head % LINK_FIFO_SIZE].arrive_us < end_us) {
+                                link_pkt_t *pkt = &link_fifo[link_head++ % LINK_FIFO_SIZE];
+                                link_now_us = pkt->arrive_us;
+                                peer_recv(pkt, base, &rcv_nxt, &fin);
+                        } else if (ack_head != ack_tail && ack_fifo[ack_head % LINK_FIFO_SIZE].arrive_us < end_us) {
+                                size_t slot = ack_head++ % LINK_FIFO_SIZE;
+                                link_now_us = ack_fifo[slot].arrive_us;
+                                peer_send_opts(tcp_flags_ack, 1001, ack_fifo[slot].ack, ack_fifo[slot].opt, ack_fifo[slot].opt_len, NULL, 0);
+                        } else {
+                                break;
+                        }
+                }
+                link_now_us = end_us;
+                advance(1);
+        }
+        uint64_t elapsed = ctx->now - start;
+        link_on = 0;
+        CHECK(fin, "%s with %u%% loss did not finish in %d ms.", cc, loss_permille / 10, GOODPUT_TIMEOUT_MS);
+        CHECK(memcmp(peer_data, app_data, GOODPUT_BYTES) == 0, "%s with %u%% loss corrupted the data.", cc, loss_permille / 10);
+        *goodput = elapsed ? GOODPUT_BYTES / elapsed : 0;
+        printf("\e[0;34m%-8s %-7s loss %u%% seed %u: %u bytes/ms, %llu drops.\n\e[0m", cc, sack ? "sack" : "no-sack",
+               loss_permille / 10, seed, *goodput, (unsigned long long)link_drops);
+        // 对端关闭，协议栈回复ACK后释放连接
+        peer_send(tcp_flags_ack_fin, 1001, rcv_nxt, NULL, 0);
+        return fail;
+}
+
+/**
+ * @brief 拥塞控制：NewReno与CUBIC在0%、1%、3%随机丢包下，有无SACK时的有效吞吐量。
+ *        有随机丢包时有无SACK使用同样的几组丢包序列，SACK的总吞吐量不应更低
+ *
+ * @return int 失败数
+ */
+int test_goodput()
+{
+        int fail = 0;
+        const char *ccs[] = {"newreno", "cubic"};
+        uint32_t losses[] = {0, 10, 30};
+        for (size_t i = 0; i < sizeof(app_data); i++)
+                app_data[i] = i * 7 + (i >> 11);
+        oversize = 0;
+        for (size_t i = 0; i < sizeof(ccs) / sizeof(ccs[0]); i++)
+                for (size_t j = 0; j < sizeof(losses) / sizeof(losses[0]); j++) {
+                        uint32_t goodput, total[2] = {0, 0}, seeds = losses[j] ? GOODPUT_SEEDS : 1;
+                        for (int sack = 0; sack < 2; sack++)
+                                for (uint32_t seed = 1; seed <= seeds; seed++) {
+                                        fail += run_goodput(ccs[i], losses[j], sack, seed, &goodput);
+                                        total[sack] += goodput;
+                                }
+                        if (losses[j] == 0)
+                                CHECK(total[1] >= LINK_RATE / 2, "%s goodput %u bytes/ms without random loss, expected at least %d.",
+                                      ccs[i], total[1], LINK_RATE / 2);
+                        else
+                                CHECK(total[1] >= total[0], "%s with %u%% loss: %u bytes/ms with SACK, %u without.", ccs[i],
+                                      losses[j] / 10, total[1] / seeds, total[0] / seeds);
+                }
+        CHECK(oversize == 0, "%d segments need ip fragmentation.", oversize);
+        return fail;
+}
+
+int main(int argc, char* argv[])
+{
+        int fail = 0;
+        uint32_t isn;
+        net_ctx_init(ctx, 0);
+        ctx->now = 0;
+        timer_wheel_init(&ctx->timers, 0);
+        tcp_init();
+        tcp_open(SERVER_PORT, handler);
+
+        printf("\e[0;34mChecking handshake retransmission.\n\e[0m");
+        fail += test_handshake(&isn);
+        if (server) {
+                printf("\e[0;34mChecking RTT estimation and data retransmission.\n\e[0m");
+                fail += test_retransmit(isn);
+                printf("\e[0;34mChecking retransmission limit.\n\e[0m");
+                fail += test_give_up();
+        }
+        printf("\e[0;34mChecking initial sequence numbers.\n\e[0m");
+        fail += test_isn();
+        printf("\e[0;34mChecking SYN cookies.\n\e[0m");
+        fail += test_syn_flood();
+        printf("\e[0;34mChecking active open.\n\e[0m");
+        fail += test_active_open();
+        printf("\e[0;34mChecking ephemeral port allocation.\n\e[0m");
+        fail += test_ephemeral_ports();
+        printf("\e[0;34mChecking TIME_WAIT.\n\e[0m");
+        fail += test_time_wait();
+        printf("\e[0;34mChecking listen backlog and accept.\n\e[0m");
+        fail += test_accept();
+        printf("\e[0;34mChecking readiness-based sockets.\n\e[0m");
+        fail += test_sock();
+        printf("\e[0;34mChecking coroutines.\n\e[0m");
+        fail += test_coro();
+        printf("\e[0;34mChecking option negotiation.\n\e[0m");
+        fail += test_options();
+        printf("\e[0;34mChecking delayed acknowledgment.\n\e[0m");
+        fail += test_delack();
+        printf("\e[0;34mChecking Nagle and cork.\n\e[0m");
+        fail += test_nagle();
+        printf("\e[0;34mChecking segmentation.\n\e[0m");
+        fail += test_segment();
+        printf("\e[0;34mChecking out-of-order reassembly.\n\e[0m");
+        fail += test_reorder();
+        printf("\e[0;34mChecking selective acknowledgment.\n\e[0m");
+        fail += test_sack();
+        printf("\e[0;34mChecking congestion control goodput.\n\e[0m");
+        fail += test_goodput();
+        if (fail == 0)
+                printf("\e[1;32mTCP check passed\n");
+        printf("\e[0m");
+        return fail ? -1 : 0;
+}
@@ -0,0 +1,23 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include "net.h"
+
+// 条件不成立时打印失败信息，并把调用处的局部变量fail加一
+#define CHECK(cond, ...)                               \
+        do {                                           \
+                if (!(cond)) {                         \
+                        printf("\e[0;31m" __VA_ARGS__); \
+                        printf("\n");                  \
+                        fail++;                        \
+                }                                      \
+        } while (0)
+
+// 捕获协议栈发出的一帧，见driver_capture
+typedef void (*driver_capture_t)(netif_t *netif, const uint8_t *frame, size_t len);
+
+extern driver_capture_t driver_capture; //设置后faker驱动把发出的帧交给它，不再写入pcap_out，供不回放pcap文件的测试使用
+extern int driver_flushes;              //driver_send_many被调用的次数，即批量交给驱动的次数
+
+#endif
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "udp.h"
+#include "ip.h"
+#include "sock.h"
+#include "driver.h"
+#include "arp.h"
+#include "test.h"
+
+#define SOCK_PORT 5353
+#define HANDLER_PORT 5354
+#define PEER_PORT 40000
+#define DGRAM_MAX 64
+
+typedef struct dgram //协议栈发出的一个udp数据报
+{
+        uint8_t dst_ip[NET_IP_LEN];
+        uint16_t id; //ip数据包id
+        uint16_t src_port, dst_port;
+        uint16_t len;
+        uint8_t data[BUF_MAX_LEN];
+} dgram_t;
+
+uint8_t local_ip[NET_IP_LEN] = {192, 168, 163, 103};
+uint8_t local_mac[NET_MAC_LEN] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+uint8_t peer_ip[NET_IP_LEN] = {192, 168, 163, 1};
+uint8_t peer_mac[NET_MAC_LEN] = {0x21, 0x32, 0x43, 0x54, 0x65, 0x76};
+extern map_t arp_table;
+net_ctx_t *ctx = &net_main_ctx;
+dgram_t dgrams[DGRAM_MAX];
+int dgram_num;
+int frame_num;  //驱动发出的帧数
+int bad_frames; //长度不足或校验和错误的帧数
+char trace[DGRAM_MAX + 1]; //各帧依次的种类，u为不分片的udp数据报，f为分片
+buf_t rx;
+int handled; //udp_open注册的处理程序被调用的次数
+int ready;   //接收队列由空变为非空的次数
+
+/**
+ * @brief 记录一个发出的以太网帧，不分片的udp数据报校验出错时计入bad_frames
+ *
+ */
+void capture(netif_t *netif, const uint8_t *frame, size_t len)
+{
+        ip_hdr_t *ip_hdr = (ip_hdr_t *)(frame + sizeof(ether_hdr_t));
+        int fragment = swap16(ip_hdr->flags_fragment16) & (IP_MORE_FRAGMENT | 0x1fff);
+        if (frame_num < DGRAM_MAX)
+                trace[frame_num] = fragment ? 'f' : 'u';
+        frame_num++;
+        if (len < sizeof(ether_hdr_t) + ETHERNET_MIN_TRANSPORT_UNIT || checksum16((uint16_t *)ip_hdr, sizeof(ip_hdr_t)) != 0) {
+                bad_frames++;
+                return;
+        }
+        if (ip_hdr->protocol != NET_PROTOCOL_UDP || fragment || dgram_num == DGRAM_MAX)
+                return;
+        udp_hdr_t *hdr = (udp_hdr_t *)(ip_hdr + 1);
+        size_t udp_len = swap16(hdr->total_len16);
+        // 伪头部与数据报拼在一起计算，包括校验和字段在内的结果应为0
+        static uint8_t check[sizeof(udp_peso_hdr_t) + BUF_MAX_LEN];
+        udp_peso_hdr_t *peso = (udp_peso_hdr_t *)check;
+        memcpy(peso->src_ip, ip_hdr->src_ip, NET_IP_LEN);
+        memcpy(peso->dst_ip, ip_hdr->dst_ip, NET_IP_LEN);
+        peso->placeholder = 0;
+        peso->protocol = NET_PROTOCOL_UDP;
+        peso->total_len16 = hdr->total_len16;
+        memcpy(check + sizeof(udp_peso_hdr_t), hdr, udp_len);
+        check[sizeof(udp_peso_hdr_t) + udp_len] = 0;
+        if (swap16(ip_hdr->total_len16) != sizeof(ip_hdr_t) + udp_len ||
+            checksum16((uint16_t *)check, sizeof(udp_peso_hdr_t) + udp_len + udp_len % 2) != 0)
+                bad_frames++;
+        dgram_t *dgram = &dgrams[dgram_num++];
+        memcpy(dgram->dst_ip, ip_hdr->dst_ip, NET_IP_LEN);
+        dgram->id = swap16(ip_hdr->id16);
+        dgram->src_port = swap16(hdr->src_port16);
+        dgram->dst_port = swap16(hdr->dst_port16);
+        dgram->len = udp_len - sizeof(udp_hdr_t);
+        memcpy(dgram->data, hdr + 1, dgram->len);
+}
+
+/**
+ * @brief 以对端身份向协议栈的端口发送一个udp数据报
+ *
+ */
+void peer_send(uint16_t src_port, uint16_t dst_port, const uint8_t *data, size_t len)
+{
+        size_t total = len + sizeof(udp_hdr_t);
+        buf_init(&rx, total);
+        udp_hdr_t *hdr = (udp_hdr_t *)rx.data;
+        hdr->src_port16 = swap16(src_port);
+        hdr->dst_port16 = swap16(dst_port);
+        hdr->total_len16 = swap16(total);
+        hdr->checksum16 = 0;
+        memcpy(rx.data + sizeof(udp_hdr_t), data, len);
+        // 伪头部放在数据报之前计算校验和
+        buf_add_header(&rx, sizeof(udp_peso_hdr_t));
+        udp_peso_hdr_t *peso = (udp_peso_hdr_t *)rx.data;
+        memcpy(peso->src_ip, peer_ip, NET_IP_LEN);
+        memcpy(peso->dst_ip, net_if_ip, NET_IP_LEN);
+        peso->placeholder = 0;
+        peso->protocol = NET_PROTOCOL_UDP;
+        peso->total_len16 = swap16(total);
+        if (total % 2)
+                buf_add_padding(&rx, 1);
+        uint16_t checksum = checksum16((uint16_t *)rx.data, rx.len);
+        if (total % 2)
+                buf_remove_padding(&rx, 1);
+        buf_remove_header(&rx, sizeof(udp_peso_hdr_t));
+        ((udp_hdr_t *)rx.data)->checksum16 = checksum;
+        udp_in(ctx, net_if_default, &rx, peer_ip);
+}
+
+void handler(net_ctx_t *ctx, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+        handled++;
+}
+
+void socket_ready(udp_socket_t *socket, net_ctx_t *ctx)
+{
+        ready++;
+}
+
+/**
+ * @brief 接收队列：数据报按到达顺序批量取出，队列由空变为非空时通知一次，队列满时丢弃并计数
+ *
+ * @return int 失败数
+ */
+int test_queue()
+{
+        int fail = 0;
+        uint8_t bufs[4][16];
+        udp_msg_t msgs[4];
+        udp_socket_t *socket = udp_socket_open(SOCK_PORT, socket_ready);
+        if (socket == NULL)
+                return 1;
+        CHECK(udp_socket_open(SOCK_PORT, NULL) == NULL, "Port opened twice.");
+        for (int i = 0; i < 3; i++) {
+                uint8_t data[8];
+                memset(data, 'a' + i, sizeof(data));
+                peer_send(PEER_PORT + i, SOCK_PORT, data, i == 2 ? 8 : 4);
+        }
+        CHECK(ready == 1 && udp_socket_pending(ctx, socket) == 3, "Queue holds %u datagrams with %d notifications, expected 3 with 1.",
+              udp_socket_pending(ctx, socket), ready);
+        for (int i = 0; i < 4; i++) {
+                msgs[i].data = bufs[i];
+                msgs[i].len = i == 2 ? 6 : sizeof(bufs[i]);
+        }
+        CHECK(udp_socket_recv(ctx, socket, msgs, 2) == 2, "Batch receive did not stop at the batch size.");
+        CHECK(msgs[0].len == 4 && bufs[0][0] == 'a' && msgs[0].port == PEER_PORT && memcmp(msgs[0].ip, peer_ip, NET_IP_LEN) == 0 &&
+              msgs[1].len == 4 && bufs[1][3] == 'b' && msgs[1].port == PEER_PORT + 1 && !msgs[0].trunc,
+              "Datagrams received out of order or with wrong source.");
+        CHECK(udp_socket_recv(ctx, socket, msgs + 2, 2) == 1 && msgs[2].len == 6 && msgs[2].trunc && bufs[2][5] == 'c',
+              "Long datagram not truncated to the buffer.");
+        CHECK(udp_socket_recv(ctx, socket, msgs, 4) == 0, "Empty queue returned datagrams.");
+
+        // 超过一个以太网帧的数据报另行分配缓冲区
+        uint8_t big[3000], out[3000];
+        for (int i = 0; i < sizeof(big); i++)
+                big[i] = i * 7;
+        peer_send(PEER_PORT, SOCK_PORT, big, sizeof(big));
+        msgs[0].data = out;
+        msgs[0].len = sizeof(out);
+        CHECK(udp_socket_recv(ctx, socket, msgs, 1) == 1 && msgs[0].len == sizeof(big) && memcmp(out, big, sizeof(big)) == 0,
+              "Reassembled-size datagram corrupted.");
+
+        for (int i = 0; i < UDP_RX_QUEUE_LEN + 5; i++)
+                peer_send(PEER_PORT, SOCK_PORT, big, 10);
+        CHECK(udp_socket_pending(ctx, socket) == UDP_RX_QUEUE_LEN && socket->drops == 5, "Full queue dropped %llu datagrams, expected 5.",
+              (unsigned long long)socket->drops);
+        CHECK(ready == 3, "Notified %d times, expected 3.", ready);
+        udp_socket_close(socket);
+
+        // 关闭后端口回到处理程序表
+        udp_open(SOCK_PORT, handler);
+        peer_send(PEER_PORT, SOCK_PORT, big, 10);
+        CHECK(handled == 1, "Datagram not delivered to the handler after the socket closed.");
+        udp_close(SOCK_PORT);
+        return fail;
+}
+
+/**
+ * @brief 批量发送：每个数据报从套接字的端口发往各自的目的地，超长的数据报之前停止
+ *
+ * @return int 失败数
+ */
+int test_send()
+{
+        int fail = 0;
+        udp_msg_t msgs[3];
+        uint8_t data[3][8];
+        udp_socket_t *socket = udp_socket_open(SOCK_PORT, NULL);
+        if (socket == NULL)
+                return 1;
+        for (int i = 0; i < 3; i++) {
+                memset(data[i], '0' + i, sizeof(data[i]));
+                msgs[i].data = data[i];
+                msgs[i].len = i + 1;
+                memcpy(msgs[i].ip, peer_ip, NET_IP_LEN);
+                msgs[i].ip[3] += i;
+                msgs[i].port = PEER_PORT + i;
+        }
+        dgram_num = 0;
+        CHECK(udp_socket_send(ctx, socket, msgs, 3) == 3 && dgram_num == 3, "Batch of 3 sent as %d datagrams.", dgram_num);
+        for (int i = 0; i < dgram_num; i++)
+                CHECK(dgrams[i].src_port == SOCK_PORT && dgrams[i].dst_port == PEER_PORT + i && dgrams[i].dst_ip[3] == peer_ip[3] + i &&
+                      dgrams[i].len == i + 1 && dgrams[i].data[0] == '0' + i, "Datagram %d sent wrong.", i);
+        msgs[1].len = UDP_MAX_PAYLOAD + 1;
+        dgram_num = 0;
+        CHECK(udp_socket_send(ctx, socket, msgs, 3) == 1 && dgram_num == 1, "Batch did not stop before an oversized datagram.");
+        udp_socket_close(socket);
+        return fail;
+}
+
+/**
+ * @brief 批量发送：不需分片的数据报在帧池中封装好后一次交给驱动，需要分片的数据报经ip层发出且不打乱顺序，
+ *        超过帧池大小的批次分几次交给驱动
+ *
+ * @return int 失败数
+ */
+int test_sendmany()
+{
+        int fail = 0;
+        static uint8_t data[UDP_TX_BATCH + 8][64];
+        static udp_msg_t msgs[UDP_TX_BATCH + 8];
+        static uint8_t big[3000];
+        for (int i = 0; i < UDP_TX_BATCH + 8; i++) {
+                memset(data[i], 'a' + i % 26, sizeof(data[i]));
+                msgs[i].data = data[i];
+                msgs[i].len = 7 + i % 5 * 10;
+                memcpy(msgs[i].ip, peer_ip, NET_IP_LEN);
+                msgs[i].ip[3] += i == 4;
+                msgs[i].port = PEER_PORT + i;
+        }
+        uint64_t tx_packets = net_if_default->stats.tx_packets;
+        dgram_num = frame_num = bad_frames = driver_flushes = 0;
+        CHECK(udp_sendmany(ctx, SOCK_PORT, msgs, 5) == 5 && driver_flushes == 1 && frame_num == 5,
+              "5 datagrams sent as %d frames in %d flushes, expected 5 in 1.", frame_num, driver_flushes);
+        CHECK(bad_frames == 0, "%d batched frames malformed.", bad_frames);
+        CHECK(net_if_default->stats.tx_packets - tx_packets == 5, "Batched frames not counted.");
+        for (int i = 0; i < dgram_num; i++)
+                CHECK(dgrams[i].src_port == SOCK_PORT && dgrams[i].dst_port == PEER_PORT + i && dgrams[i].dst_ip[3] == peer_ip[3] + (i == 4) &&
+                      dgrams[i].len == msgs[i].len && dgrams[i].data[dgrams[i].len - 1] == 'a' + i &&
+                      (i == 0 || dgrams[i].id == (uint16_t)(dgrams[i - 1].id + 1)),
+                      "Datagram %d sent wrong.", i);
+
+        // 需要分片的数据报夹在中间：此前封装的帧先发出
+        memset(big, 'z', sizeof(big));
+        msgs[1].data = big;
+        msgs[1].len = sizeof(big);
+        dgram_num = frame_num = bad_frames = driver_flushes = 0;
+        memset(trace, 0, sizeof(trace));
+        CHECK(udp_sendmany(ctx, SOCK_PORT, msgs, 3) == 3 && strcmp(trace, "ufffu") == 0 && driver_flushes == 2 && bad_frames == 0,
+              "Fragmented datagram sent out of order: %s.", trace);
+        msgs[1].data = data[1];
+        msgs[1].len = 17;
+
+        dgram_num = frame_num = bad_frames = driver_flushes = 0;
+        CHECK(udp_sendmany(ctx, SOCK_PORT, msgs, UDP_TX_BATCH + 8) == UDP_TX_BATCH + 8 && frame_num == UDP_TX_BATCH + 8 && driver_flushes == 2,
+              "%d datagrams sent in %d flushes, expected 2.", frame_num, driver_flushes);
+
+        // 单个数据报也不经过发送缓冲区
+        dgram_num = driver_flushes = 0;
+        udp_send(ctx, (uint8_t *)"echo", 4, SOCK_PORT, peer_ip, PEER_PORT);
+        CHECK(driver_flushes == 1 && dgram_num == 1 && dgrams[0].len == 4 && memcmp(dgrams[0].data, "echo", 4) == 0, "udp_send not sent from the frame pool.");
+        return fail;
+}
+
+/**
+ * @brief 分段发送：一段数据按段长切成多个数据报，最后一段可以更短，批次超过帧池大小时分几次交给驱动，
+ *        段长超出MTU时各段经ip层分片发送
+ *
+ * @return int 失败数
+ */
+int test_gso()
+{
+        int fail = 0;
+        static uint8_t data[4000];
+        for (int i = 0; i < sizeof(data); i++)
+                data[i] = i * 13;
+        CHECK(udp_send_gso(ctx, SOCK_PORT, peer_ip, PEER_PORT, data, sizeof(data), 0) == -1 &&
+              udp_send_gso(ctx, SOCK_PORT, peer_ip, PEER_PORT, data, sizeof(data), UDP_MAX_PAYLOAD + 1) == -1,
+              "Invalid segment size accepted.");
+
+        dgram_num = frame_num = bad_frames = driver_flushes = 0;
+        CHECK(udp_send_gso(ctx, SOCK_PORT, peer_ip, PEER_PORT, data, 2501, 1000) == 3 && dgram_num == 3 && driver_flushes == 1,
+              "2501 bytes sent as %d datagrams in %d flushes, expected 3 in 1.", dgram_num, driver_flushes);
+        CHECK(bad_frames == 0, "%d segments malformed.", bad_frames);
+        for (int i = 0; i < dgram_num; i++)
+                CHECK(dgrams[i].src_port == SOCK_PORT && dgrams[i].dst_port == PEER_PORT && memcmp(dgrams[i].dst_ip, peer_ip, NET_IP_LEN) == 0 &&
+                      dgrams[i].len == (i == 2 ? 501 : 1000) && memcmp(dgrams[i].data, data + i * 1000, dgrams[i].len) == 0 &&
+                      (i == 0 || dgrams[i].id == (uint16_t)(dgrams[i - 1].id + 1)),
+                      "Segment %d sent wrong.", i);
+
+        dgram_num = frame_num = bad_frames = driver_flushes = 0;
+        CHECK(udp_send_gso(ctx, SOCK_PORT, peer_ip, PEER_PORT, data, (UDP_TX_BATCH + 8) * 10, 10) == UDP_TX_BATCH + 8 &&
+              frame_num == UDP_TX_BATCH + 8 && driver_flushes == 2 && bad_frames == 0,
+              "%d segments sent in %d flushes, expected 2.", frame_num, driver_flushes);
+        CHECK(dgrams[UDP_TX_BATCH + 7].len == 10 && memcmp(dgrams[UDP_TX_BATCH + 7].data, data + (UDP_TX_BATCH + 7) * 10, 10) == 0,
+              "Last small segment sent wrong.");
+
+        dgram_num = frame_num = bad_frames = driver_flushes = 0;
+        memset(trace, 0, sizeof(trace));
+        CHECK(udp_send_gso(ctx, SOCK_PORT, peer_ip, PEER_PORT, data, sizeof(data), 2000) == 2 && strcmp(trace, "ffff") == 0 &&
+              driver_flushes == 0 && bad_frames == 0,
+              "Oversized segments not fragmented by the ip layer: %s.", trace);
+        CHECK(udp_send_gso(ctx, SOCK_PORT, peer_ip, PEER_PORT, data, 0, 1000) == 0, "Empty buffer sent datagrams.");
+        return fail;
+}
+
+/**
+ * @brief 句柄：有数据报时可读，总是可写，读空后返回SOCK_AGAIN
+ *
+ * @return int 失败数
+ */
+int test_sock()
+{
+        int fail = 0;
+        sock_poll_t poll;
+        sock_event_t ev[2];
+        uint8_t buf[16];
+        udp_msg_t msg = {.data = buf, .len = sizeof(buf)};
+        sock_poll_init(&poll);
+        sock_t *sock = sock_udp(ctx, SOCK_PORT);
+        if (sock == NULL)
+                return 1;
+        CHECK(sock_udp(ctx, SOCK_PORT) == NULL, "Port bound twice.");
+        sock_watch(&poll, sock, SOCK_EV_IN, sock);
+        CHECK(sock_wait(&poll, ev, 2, 0) == 0 && sock_recvmmsg(sock, &msg, 1) == SOCK_AGAIN, "Idle socket reported readable.");
+        CHECK(sock_read(sock, buf, sizeof(buf)) == SOCK_ERROR, "Stream read allowed on a datagram socket.");
+        peer_send(PEER_PORT, SOCK_PORT, (const uint8_t *)"query", 5);
+        CHECK(sock_wait(&poll, ev, 2, 0) == 1 && ev[0].sock == sock && ev[0].events == SOCK_EV_IN, "Socket not readable.");
+        CHECK(sock_recvmmsg(sock, &msg, 1) == 1 && msg.len == 5 && memcmp(buf, "query", 5) == 0, "Datagram not received.");
+        CHECK(sock_wait(&poll, ev, 2, 0) == 0, "Drained socket still readable.");
+        CHECK(sock_events(sock) == SOCK_EV_OUT, "Socket not writable.");
+        msg.port = PEER_PORT;
+        memcpy(msg.ip, peer_ip, NET_IP_LEN);
+        dgram_num = 0;
+        CHECK(sock_sendmmsg(sock, &msg, 1) == 1 && dgram_num == 1 && dgrams[0].len == 5, "Reply not sent.");
+        sock_close(sock);
+        CHECK(poll.num == 0, "Closed socket left in the ready list.");
+        return fail;
+}
+
+int main(int argc, char* argv[])
+{
+        int fail = 0;
+        driver_capture = capture;
+        net_ctx_init(ctx, 0);
+        net_if_add(local_ip, local_mac, 24);
+        arp_init();
+        ip_init();
+        udp_init();
+        tcp_init();
+        // 对端地址都已解析，发往它们的数据报走目的地缓存
+        for (int i = 0; i < 5; i++) {
+                uint8_t ip[NET_IP_LEN];
+                memcpy(ip, peer_ip, NET_IP_LEN);
+                ip[3] += i;
+                map_set(&arp_table, ip, peer_mac);
+        }
+
+        printf("\e[0;34mChecking socket receive queues.\n\e[0m");
+        fail += test_queue();
+        printf("\e[0;34mChecking batched send.\n\e[0m");
+        fail += test_send();
+        printf("\e[0;34mChecking batched send over the frame pool.\n\e[0m");
+        fail += test_sendmany();
+        printf("\e[0;34mChecking segmented send.\n\e[0m");
+        fail += test_gso();
+        printf("\e[0;34mChecking datagram socket handles.\n\e[0m");
+        fail += test_sock();
+        if (fail == 0)
+                printf("\e[1;32mUDP check passed\n");
+        printf("\e[0m");
+        return fail ? -1 : 0;
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "worker.h"
+#include "ip.h"
+
+#define FLOW_NUM 4096
+#define SPSC_FRAMES 200000
+
+uint8_t frame[WORKER_FRAME_MAX];
+worker_ring_t ring;
+
+/**
+ * @brief 构造一个以太网+IPv4帧，协议为TCP/UDP时带上端口
+ *
+ * @param protocol 上层协议
+ * @param src_ip 源ip
+ * @param src_port 源端口
+ * @param dst_port 目的端口
+ * @param flags_fragment ip分片字段
+ * @return size_t 帧长度
+ */
+size_t make_frame(uint8_t protocol, uint32_t src_ip, uint16_t src_port, uint16_t dst_port, uint16_t flags_fragment)
+{
+        memset(frame, 0, sizeof(frame));
+        ether_hdr_t *ether_hdr = (ether_hdr_t *)frame;
+        ether_hdr->protocol16 = swap16(NET_PROTOCOL_IP);
+        ip_hdr_t *ip_hdr = (ip_hdr_t *)(frame + sizeof(ether_hdr_t));
+        ip_hdr->version = IP_VERSION_4;
+        ip_hdr->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+        ip_hdr->protocol = protocol;
+        ip_hdr->flags_fragment16 = swap16(flags_fragment);
+        memcpy(ip_hdr->src_ip, &src_ip, NET_IP_LEN);
+        memcpy(ip_hdr->dst_ip, net_if_ip, NET_IP_LEN);
+        uint16_t *ports = (uint16_t *)(ip_hdr + 1);
+        ports[0] = swap16(src_port);
+        ports[1] = swap16(dst_port);
+        return sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 8;
+}
+
+/**
+ * @brief 检查流哈希：同一流稳定、非TCP/UDP与分片交给0号线程、大量流大致均匀分布
+ *
+ * @return int 失败数
+ */
+int test_steer()
+{
+        int fail = 0;
+        int count[NET_WORKER_NUM] = {0};
+        srand(1);
+        for (int i = 0; i < FLOW_NUM; i++) {
+                uint32_t src_ip = rand();
+                uint16_t src_port = rand();
+                size_t len = make_frame(i % 2 ? NET_PROTOCOL_TCP : NET_PROTOCOL_UDP, src_ip, src_port, 80, 0);
+                int worker = worker_steer(frame, len);
+                if (worker < 0 || worker >= NET_WORKER_NUM || worker != worker_steer(frame, len)) {
+                        printf("\e[0;31mFlow %d steered to invalid or unstable worker %d.\n", i, worker);
+                        fail++;
+                }
+                count[worker]++;
+        }
+        for (int i = 0; i < NET_WORKER_NUM; i++) {
+                printf("\e[0;34mWorker %d: %d flows.\n", i, count[i]);
+                if (count[i] < FLOW_NUM / NET_WORKER_NUM * 3 / 4 || count[i] > FLOW_NUM / NET_WORKER_NUM * 5 / 4) {
+                        printf("\e[0;31mWorker %d got an unbalanced share.\n", i);
+                        fail++;
+                }
+        }
+        size_t len = make_frame(NET_PROTOCOL_ICMP, 0x0100a8c0, 0, 0, 0);
+        if (worker_steer(frame, len) != 0) {
+                printf("\e[0;31mICMP not steered to worker 0.\n");
+                fail++;
+        }
+        len = make_frame(NET_PROTOCOL_UDP, 0x0100a8c0, 1234, 53, IP_MORE_FRAGMENT);
+        if (worker_steer(frame, len) != 0) {
+                printf("\e[0;31mFragment not steered to worker 0.\n");
+                fail++;
+        }
+        ((ether_hdr_t *)frame)->protocol16 = swap16(NET_PROTOCOL_ARP);
+        if (worker_steer(frame, len) != 0) {
+                printf("\e[0;31mARP not steered to worker 0.\n");
+                fail++;
+        }
+        return fail;
+}
+
+/**
+ * @brief 检查队列满、先进先出
+ *
+ * @return int 失败数
+ */
+int test_ring()
+{
+        int fail = 0;
+        worker_ring_init(&ring);
+        for (uint32_t i = 0; i < NET_RING_SIZE; i++)
+                if (worker_ring_push(&ring, net_if_default, (uint8_t *)&i, sizeof(i)) != 0) {
+                        printf("\e[0;31mPush %u failed before ring is full.\n", i);
+                        fail++;
+                }
+        uint32_t extra = NET_RING_SIZE;
+        if (worker_ring_push(&ring, net_if_default, (uint8_t *)&extra, sizeof(extra)) == 0) {
+                printf("\e[0;31mPush succeeded on a full ring.\n");
+                fail++;
+        }
+        for (uint32_t i = 0; i < NET_RING_SIZE; i++) {
+                worker_frame_t *frame = worker_ring_peek(&ring);
+                if (frame == NULL || frame->len != sizeof(i) || memcmp(frame->data, &i, sizeof(i)) != 0) {
+                        printf("\e[0;31mFrame %u out of order.\n", i);
+                        fail++;
+                        break;
+                }
+                worker_ring_pop(&ring);
+        }
+        if (worker_ring_peek(&ring) != NULL) {
+                printf("\e[0;31mRing not empty after draining.\n");
+                fail++;
+        }
+        return fail;
+}
+
+/**
+ * @brief 消费者线程，检查收到的序号连续
+ *
+ * @param arg 出口参数，失败数
+ * @return void* 未使用
+ */
+void *consumer(void *arg)
+{
+        int *fail = arg;
+        for (uint32_t expect = 0; expect < SPSC_FRAMES;) {
+                worker_frame_t *frame = worker_ring_peek(&ring);
+                if (frame == NULL)
+                        continue;
+                uint32_t seq;
+                memcpy(&seq, frame->data, sizeof(seq));
+                worker_ring_pop(&ring);
+                if (seq != expect) {
+                        (*fail)++;
+                        return NULL;
+                }
+                expect++;
+        }
+        return NULL;
+}
+
+/**
+ * @brief 一个生产者线程与一个消费者线程并发收发
+ *
+ * @return int 失败数
+ */
+int test_spsc()
+{
+        int fail = 0;
+        pthread_t thread;
+        worker_ring_init(&ring);
+        pthread_create(&thread, NULL, consumer, &fail);
+        for (uint32_t i = 0; i < SPSC_FRAMES;)
+                if (worker_ring_push(&ring, net_if_default, (uint8_t *)&i, sizeof(i)) == 0)
+                        i++;
+        pthread_join(thread, NULL);
+        if (fail)
+                printf("\e[0;31mConcurrent consumer saw frames out of order.\n");
+        return fail;
+}
+
+int main(int argc, char* argv[])
+{
+        int fail = 0;
+        printf("\e[0;34mChecking flow steering.\n");
+        fail += test_steer();
+        printf("\e[0;34mChecking ring order.\n");
+        fail += test_ring();
+        printf("\e[0;34mChecking concurrent producer and consumer.\n");
+        fail += test_spsc();
+        if (fail == 0)
+                printf("\e[1;32mWorker check passed\n");
+        printf("\e[0m");
+        return fail ? -1 : 0;
+}